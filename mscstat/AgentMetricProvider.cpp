@@ -0,0 +1 @@
+#include "AgentMetricProvider.h"
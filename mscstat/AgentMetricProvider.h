@@ -0,0 +1,154 @@
+#pragma once
+#include <thread>
+
+#include "MetricProviderBase.h"
+#include "OverheadMonitor.h"
+
+// Resources used by the application itself. `cpu` is a percentage of every core, as
+// `\Processor(_Total)\% Processor Time`, `resident` is in bytes, and writes are in
+// bytes/sec: `written` by the whole process, and the others by each subsystem.
+class AgentMetricProvider : public MetricProviderBase {
+    struct Metric {
+        std::string name;
+        UINT16 counter;
+        std::chrono::system_clock::time_point timestamp;
+        double cpu = 0; // %
+        double resident = 0; // bytes
+        double written = 0; // bytes/sec
+        double databaseWritten = 0; // bytes/sec
+        double columnarWritten = 0; // bytes/sec
+        double logWritten = 0; // bytes/sec
+    };
+
+    // Totals read on a sample, from which the next one computes its rates.
+    struct Totals {
+        bool isValid = false;
+        std::chrono::steady_clock::time_point time;
+        OverheadMonitor::ProcessUsage usage;
+        uint64_t writtenBytes[Subsystem::SUBSYSTEM_COUNT] = {};
+    };
+
+public:
+    AgentMetricProvider() {
+    }
+
+    virtual rapidjson::Value GetDataJSON(rapidjson::Document& doc, const UINT8 count) const {
+        // Fetch the most recent data, up to `count`
+        rapidjson::Value response(rapidjson::kArrayType);
+
+        auto statement = DataManager::GetInstance().PrepareRead("SELECT * FROM AgentMetricProvider ORDER BY id DESC LIMIT ?");
+        const int idColumn = statement.GetColumnIndex("id");
+        const int counterColumn = statement.GetColumnIndex("counter");
+        const int timestampColumn = statement.GetColumnIndex("timestamp");
+        const int cpuColumn = statement.GetColumnIndex("cpu");
+        const int residentColumn = statement.GetColumnIndex("resident");
+        const int writtenColumn = statement.GetColumnIndex("written");
+        const int databaseWrittenColumn = statement.GetColumnIndex("databaseWritten");
+        const int columnarWrittenColumn = statement.GetColumnIndex("columnarWritten");
+        const int logWrittenColumn = statement.GetColumnIndex("logWritten");
+
+        statement.BindInt64(count).ExecuteSelect([&](const Cursor& row) {
+            rapidjson::Value obj(rapidjson::kObjectType);
+
+            auto id = row.GetInt(idColumn);
+            auto counter = row.GetInt(counterColumn);
+            auto timestamp = row.GetInt(timestampColumn);
+
+            obj.AddMember("id", Utils::ConvertIntToJSONValue(id, doc.GetAllocator()), doc.GetAllocator());
+            obj.AddMember("counter", Utils::ConvertIntToJSONValue(counter, doc.GetAllocator()), doc.GetAllocator());
+            obj.AddMember("timestamp", Utils::ConvertIntToJSONValue(timestamp, doc.GetAllocator()), doc.GetAllocator());
+            obj.AddMember("cpu", Utils::ConvertDoubleToJSONValue(row.GetDouble(cpuColumn), doc.GetAllocator()), doc.GetAllocator());
+            obj.AddMember("resident", Utils::ConvertDoubleToJSONValue(row.GetDouble(residentColumn), doc.GetAllocator()), doc.GetAllocator());
+            obj.AddMember("written", Utils::ConvertDoubleToJSONValue(row.GetDouble(writtenColumn), doc.GetAllocator()), doc.GetAllocator());
+            obj.AddMember("databaseWritten", Utils::ConvertDoubleToJSONValue(row.GetDouble(databaseWrittenColumn), doc.GetAllocator()), doc.GetAllocator());
+            obj.AddMember("columnarWritten", Utils::ConvertDoubleToJSONValue(row.GetDouble(columnarWrittenColumn), doc.GetAllocator()), doc.GetAllocator());
+            obj.AddMember("logWritten", Utils::ConvertDoubleToJSONValue(row.GetDouble(logWrittenColumn), doc.GetAllocator()), doc.GetAllocator());
+
+            response.PushBack(obj, doc.GetAllocator());
+            });
+
+        return response;
+    };
+
+    virtual rapidjson::Value GetAggregateDataJSON(rapidjson::Document& doc, const std::string column) const {
+        rapidjson::Value obj(rapidjson::kObjectType);
+        RollupManager::GetInstance().SelectAggregate("AgentMetricProvider", "Agent", column).AddMembers(obj, doc);
+
+        return obj;
+    };
+
+    virtual std::string GetName() { return "Agent"; }
+
+    virtual std::string GetTableName() const override { return "AgentMetricProvider"; }
+
+    virtual const std::vector<std::string>& GetColumns() const override {
+        static const std::vector<std::string> columns = { "cpu", "resident", "written", "databaseWritten", "columnarWritten", "logWritten" };
+        return columns;
+    }
+
+    // Everything is read from the process itself, not from counters.
+    virtual void RegisterCounters(CounterRegistry& registry) override {
+    }
+
+    virtual void RetrieveMetricValue(const CounterSample& sample) override {
+        latestValue = std::make_shared<Metric>();
+        latestValue->name = "Agent";
+        latestValue->counter = sample.counter;
+        latestValue->timestamp = sample.timestamp;
+
+        Totals totals;
+        totals.time = std::chrono::steady_clock::now();
+        totals.isValid = OverheadMonitor::GetProcessUsage(totals.usage);
+        for (int subsystem = 0; subsystem < Subsystem::SUBSYSTEM_COUNT; subsystem++) {
+            totals.writtenBytes[subsystem] = OverheadMonitor::GetInstance().GetWrittenBytes(static_cast<Subsystem>(subsystem));
+        }
+
+        if (totals.isValid) {
+            latestValue->resident = static_cast<double>(totals.usage.residentBytes);
+        }
+
+        // Rates are only known from the second sample on.
+        const auto seconds = std::chrono::duration<double>(totals.time - previous.time).count();
+        if (totals.isValid && previous.isValid && seconds > 0) {
+            const auto cores = (std::max)(std::thread::hardware_concurrency(), 1u);
+            latestValue->cpu = GetRate(previous.usage.cpuTimeUS, totals.usage.cpuTimeUS, seconds) / 1000000.0 / cores * 100;
+            latestValue->written = GetRate(previous.usage.writtenBytes, totals.usage.writtenBytes, seconds);
+            latestValue->databaseWritten = GetRate(previous.writtenBytes[Subsystem::DATABASE_SUBSYSTEM], totals.writtenBytes[Subsystem::DATABASE_SUBSYSTEM], seconds);
+            latestValue->columnarWritten = GetRate(previous.writtenBytes[Subsystem::COLUMNAR_SUBSYSTEM], totals.writtenBytes[Subsystem::COLUMNAR_SUBSYSTEM], seconds);
+            latestValue->logWritten = GetRate(previous.writtenBytes[Subsystem::LOG_SUBSYSTEM], totals.writtenBytes[Subsystem::LOG_SUBSYSTEM], seconds);
+        }
+        previous = totals;
+
+        if (Publish(sample, { latestValue->cpu, latestValue->resident, latestValue->written, latestValue->databaseWritten, latestValue->columnarWritten, latestValue->logWritten })) {
+            Persist();
+        }
+    }
+
+protected:
+    virtual void Persist() override {
+        const auto p1 = latestValue->timestamp;
+
+        StorageWriter::GetInstance().WriteSample("INSERT INTO AgentMetricProvider VALUES (NULL, ?, ?, ?, ?, ?, ?, ?, ?, ?)", latestValue->name)
+            .BindText(latestValue->name)
+            .BindInt64(latestValue->counter)
+            .BindDouble(latestValue->cpu)
+            .BindDouble(latestValue->resident)
+            .BindDouble(latestValue->written)
+            .BindDouble(latestValue->databaseWritten)
+            .BindDouble(latestValue->columnarWritten)
+            .BindDouble(latestValue->logWritten)
+            .BindInt64(std::chrono::duration_cast<std::chrono::seconds>(p1.time_since_epoch()).count())
+            .Submit();
+    };
+
+private:
+    // Per second increase of a total between two samples.
+    static double GetRate(uint64_t from, uint64_t to, double seconds) {
+        return to > from ? (to - from) / seconds : 0.0;
+    }
+
+private:
+    Totals previous;
+
+    std::shared_ptr<Metric> latestValue = NULL;
+};
@@ -0,0 +1,63 @@
+#include "AggregateStore.h"
+#include "DataManager.h"
+#include "RollupManager.h"
+
+void AggregateStore::Seed(const std::string& table, const std::string& seriesColumn, const std::string& name, const std::vector<std::string>& columns) {
+    const int64_t now = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+    std::map<std::string, RunningAggregate> seeded;
+    for (const auto& column : columns) {
+        seeded[column].allTime = RollupManager::GetInstance().SelectAggregate(table, name, column);
+    }
+
+    // The windows only need the last day of samples.
+    DataManager::GetInstance().GetSampleStore().Scan({ table, seriesColumn, name, columns }, now - 24 * 60 * 60, (std::numeric_limits<int64_t>::max)(), [&](int64_t timestamp, int64_t, const double* values) {
+        for (size_t i = 0; i < columns.size(); i++) {
+            seeded[columns[i]].lastHour.Add(timestamp, values[i]);
+            seeded[columns[i]].lastDay.Add(timestamp, values[i]);
+        }
+        });
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& [column, aggregate] : seeded) {
+        aggregate.isSeeded = true;
+        const auto [it, isNew] = aggregates.try_emplace({ table, name, column }, std::move(aggregate));
+        if (!isNew && !it->second.isSeeded) {
+            it->second.Merge(aggregate);
+            it->second.isSeeded = true;
+        }
+    }
+}
+
+bool AggregateStore::GetJSON(rapidjson::Document& doc, const std::string& table, const std::string& name, const std::string& column, rapidjson::Value& result) const {
+    const int64_t now = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+    AggregateValue allTime;
+    AggregateValue lastHour;
+    AggregateValue lastDay;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto it = aggregates.find({ table, name, column });
+        if (it == aggregates.end()) {
+            return false;
+        }
+
+        allTime = it->second.allTime;
+        lastHour = it->second.lastHour.Get(now);
+        lastDay = it->second.lastDay.Get(now);
+    }
+
+    // All-time values stay at the top level, as served before windows were added.
+    result.SetObject();
+    allTime.AddMembers(result, doc);
+
+    rapidjson::Value lastHour_(rapidjson::kObjectType);
+    lastHour.AddMembers(lastHour_, doc);
+    result.AddMember("lastHour", lastHour_, doc.GetAllocator());
+
+    rapidjson::Value lastDay_(rapidjson::kObjectType);
+    lastDay.AddMembers(lastDay_, doc);
+    result.AddMember("lastDay", lastDay_, doc.GetAllocator());
+
+    return true;
+}
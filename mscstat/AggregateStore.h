@@ -0,0 +1,172 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <rapidjson/document.h>
+
+#include "Utils.h"
+
+// Min, max, sum and count of a set of values.
+struct AggregateValue {
+    double min = 0;
+    double max = 0;
+    double sum = 0;
+    uint64_t count = 0;
+
+    void Add(double value) {
+        Merge({ value, value, value, 1 });
+    }
+
+    void Merge(const AggregateValue& other) {
+        if (other.count == 0) {
+            return;
+        }
+
+        min = count == 0 || other.min < min ? other.min : min;
+        max = count == 0 || other.max > max ? other.max : max;
+        sum += other.sum;
+        count += other.count;
+    }
+
+    // Adds `max`, `min`, `avg`, `total` and `count` to `obj`, as served by the aggregate API.
+    void AddMembers(rapidjson::Value& obj, rapidjson::Document& doc) const {
+        obj.AddMember("max", Utils::ConvertDoubleToJSONValue(max, doc.GetAllocator()), doc.GetAllocator());
+        obj.AddMember("min", Utils::ConvertDoubleToJSONValue(min, doc.GetAllocator()), doc.GetAllocator());
+        obj.AddMember("avg", Utils::ConvertDoubleToJSONValue(count > 0 ? sum / count : 0, doc.GetAllocator()), doc.GetAllocator());
+        obj.AddMember("total", Utils::ConvertDoubleToJSONValue(sum, doc.GetAllocator()), doc.GetAllocator());
+        obj.AddMember("count", Utils::ConvertDoubleToJSONValue(static_cast<double>(count), doc.GetAllocator()), doc.GetAllocator());
+    }
+};
+
+// Aggregate over a sliding window, kept as a ring of fixed-size time buckets. A value
+// is added to the bucket of its timestamp, and buckets that have fallen out of the
+// window are skipped when reading, so the window slides one bucket at a time.
+class WindowedAggregate {
+public:
+    WindowedAggregate(int64_t bucketSeconds, size_t bucketCount) : bucketSeconds(bucketSeconds), buckets(bucketCount) {}
+
+    // `timestamp` is in seconds since epoch.
+    void Add(int64_t timestamp, double value) {
+        const auto epoch = timestamp / bucketSeconds;
+        auto& bucket = buckets[epoch % buckets.size()];
+        if (bucket.epoch != epoch) {
+            // The slot holds a newer bucket, so this value is already out of the window.
+            if (bucket.epoch > epoch) {
+                return;
+            }
+            bucket = Bucket();
+            bucket.epoch = epoch;
+        }
+
+        bucket.value.Add(value);
+    }
+
+    // Adds the buckets of `other`, which has the same bucket size and count.
+    void Merge(const WindowedAggregate& other) {
+        for (const auto& otherBucket : other.buckets) {
+            if (otherBucket.epoch < 0) {
+                continue;
+            }
+
+            auto& bucket = buckets[otherBucket.epoch % buckets.size()];
+            if (bucket.epoch > otherBucket.epoch) {
+                continue;
+            }
+            if (bucket.epoch < otherBucket.epoch) {
+                bucket = otherBucket;
+                continue;
+            }
+            bucket.value.Merge(otherBucket.value);
+        }
+    }
+
+    // Returns the aggregate of the buckets that overlap the window ending at `now`.
+    AggregateValue Get(int64_t now) const {
+        const auto newest = now / bucketSeconds;
+        const auto oldest = newest - static_cast<int64_t>(buckets.size()) + 1;
+
+        AggregateValue result;
+        for (const auto& bucket : buckets) {
+            if (bucket.epoch >= oldest && bucket.epoch <= newest) {
+                result.Merge(bucket.value);
+            }
+        }
+
+        return result;
+    }
+
+private:
+    struct Bucket {
+        int64_t epoch = -1;
+        AggregateValue value;
+    };
+
+    int64_t bucketSeconds;
+    std::vector<Bucket> buckets;
+};
+
+// Running aggregates of a single column of a provider or script: over all time, the
+// last hour and the last day. Each sample updates them in constant time.
+struct RunningAggregate {
+    AggregateValue allTime;
+    // 60 buckets of a minute.
+    WindowedAggregate lastHour = WindowedAggregate(60, 60);
+    // 144 buckets of 10 minutes.
+    WindowedAggregate lastDay = WindowedAggregate(10 * 60, 144);
+    // `true` once loaded from the database by `AggregateStore::Seed`.
+    bool isSeeded = false;
+
+    void Add(int64_t timestamp, double value) {
+        allTime.Add(value);
+        lastHour.Add(timestamp, value);
+        lastDay.Add(timestamp, value);
+    }
+
+    void Merge(const RunningAggregate& other) {
+        allTime.Merge(other.allTime);
+        lastHour.Merge(other.lastHour);
+        lastDay.Merge(other.lastDay);
+    }
+};
+
+// Running aggregates of every provider column and script, kept by MetricsManager so
+// aggregate requests are answered without reading the database. Series are seeded
+// from the database once, and updated with every sample persisted from then on.
+class AggregateStore {
+public:
+    AggregateStore() {}
+
+    AggregateStore(const AggregateStore&) = delete;
+    AggregateStore& operator=(const AggregateStore&) = delete;
+
+    // Loads the aggregates of `columns` of a provider or script from the database.
+    // Samples persisted before this point are read from the rollups, and the last day
+    // from the raw samples. Values recorded before the seed was loaded are kept, and series
+    // that have already been seeded are left as they are.
+    void Seed(const std::string& table, const std::string& seriesColumn, const std::string& name, const std::vector<std::string>& columns);
+
+    // Adds the values of a persisted sample. `columns` names each value. Series that
+    // have not been seeded start empty.
+    void Record(const std::string& table, const std::string& name, const std::vector<std::string>& columns, int64_t timestamp, const double* values, size_t count) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < count && i < columns.size(); i++) {
+            aggregates[{ table, name, columns[i] }].Add(timestamp, values[i]);
+        }
+    }
+
+    // Returns the aggregates of a column as JSON, or `false` if the series is unknown.
+    bool GetJSON(rapidjson::Document& doc, const std::string& table, const std::string& name, const std::string& column, rapidjson::Value& result) const;
+
+private:
+    // Keyed by table, provider or script name, then column.
+    typedef std::tuple<std::string, std::string, std::string> Key;
+
+    mutable std::mutex mutex;
+    std::map<Key, RunningAggregate> aggregates;
+};
@@ -1,15 +1,18 @@
 #include "Application.h"
+#include "Server.h"
 #include "CPUMetricProvider.h"
 #include "StorageMetricProvider.h"
 #include "RAMMetricProvider.h"
 #include "NetworkMetricProvider.h"
 #include "ProcessMetricProvider.h"
+#include "AgentMetricProvider.h"
 
 volatile std::sig_atomic_t Application::g_signal_flag = 0;
-std::shared_ptr<Application> Application::theApp = nullptr;
 
 void Application::Initialize() {
+#ifdef _WIN32
     SetConsoleTitle(std::wstring(name.begin(), name.end()).c_str());
+#endif
     // This is the main application dependency as all other object managers
     // require the configuration object.
     configManager = &ConfigManager::GetInstance();
@@ -27,13 +30,53 @@ void Application::Initialize() {
         return;
     }
 
-    CreateApplicationTable();
+    // Every table and index is created or upgraded here, before anything reads or writes.
+    if (!dataManager->Migrate()) {
+        logManager->LogCritical("Database schema could not be upgraded!");
+        return;
+    }
+
     configManager->LoadConfig(FetchConfigData());
 
+    // Readers are opened before anything queries the database from another thread.
+    DatabaseOptions databaseOptions;
+    databaseOptions.readers = configManager->GetConfig().databaseReaders;
+    databaseOptions.synchronous = configManager->GetConfig().databaseSynchronous;
+    databaseOptions.cacheSize = configManager->GetConfig().databaseCacheSize;
+    databaseOptions.mmapSize = configManager->GetConfig().databaseMmapSize;
+    databaseOptions.walAutoCheckpoint = configManager->GetConfig().walAutoCheckpoint;
+    databaseOptions.storageEngine = configManager->GetConfig().storageEngine;
+    dataManager->Configure(databaseOptions);
+
+    // Samples are written by a single storage writer thread, which must be configured
+    // before any provider or script submits a write.
+    storageWriter = &StorageWriter::GetInstance();
+    storageWriter->Configure(
+        configManager->GetConfig().storageQueueSize,
+        StorageWriter::ParseOverflowPolicy(configManager->GetConfig().storageOverflowPolicy),
+        configManager->GetConfig().storageCommitDelay,
+        configManager->GetConfig().checkpointInterval);
+
+    // Engines that store samples themselves make them durable alongside checkpoints.
+    if (dataManager->GetSampleStore().StoresSamples()) {
+        storageWriter->AddMaintenanceTask(configManager->GetConfig().checkpointInterval, []() {
+            DataManager::GetInstance().GetSampleStore().Flush();
+            });
+    }
+
+    // Raw samples are folded into rollups and expired in the background.
+    storageWriter->AddMaintenanceTask(configManager->GetConfig().rollupInterval, []() {
+        RollupManager::GetInstance().Run();
+        });
+
     metricsManager = &MetricsManager::GetInstance(configManager->GetConfig().metricFetchInterval);
     threadManager = &ThreadManager::GetInstance(configManager->GetConfig().poolSize);
+    threadManager->Resize(configManager->GetConfig().poolSize, configManager->GetConfig().maxPoolSize);
+    ApplyObserverConfig(configManager->GetConfig().observer);
     scriptManager = &ScriptManager::GetInstance(configManager->GetConfig().metricFetchInterval);
-    scriptManager->Initialize();
+    // Budgets are set before the scripts are loaded, so each starts with its own.
+    scriptManager->SetBudgets(configManager->GetConfig());
+    scriptManager->Initialize(metricsManager->GetCounterRegistry(), metricsManager->GetAggregateStore(), (std::max)(configManager->GetConfig().hotTierSize, 0));
 
     aiManager = &IntelligenceManager::GetInstance();
 
@@ -41,6 +84,23 @@ void Application::Initialize() {
     server->SetupWebPaths(Utils::GetAllFilePaths(aiManager->GetWebRoot()));
 }
 
+void Application::ApplyObserverConfig(const ObserverConfig& observer) {
+    ThreadPolicy collectorPolicy;
+    ThreadPolicy storagePolicy;
+    ThreadPolicy backgroundPolicy;
+    if (observer.enabled) {
+        collectorPolicy.cores = observer.collectorCores;
+        storagePolicy.cores = observer.storageCores;
+        backgroundPolicy.isBackground = true;
+    }
+
+    threadManager->SetClassPolicy(TaskClass::SAMPLING_TASK, collectorPolicy);
+    threadManager->SetClassPolicy(TaskClass::SCRIPT_TASK, backgroundPolicy);
+    threadManager->SetClassPolicy(TaskClass::DEFAULT_TASK, backgroundPolicy);
+    threadManager->SetClassPolicy(TaskClass::MAINTENANCE_TASK, backgroundPolicy);
+    threadManager->SetReservedPolicy(ThreadType::STORAGE_WRITER_THREAD, storagePolicy);
+}
+
 void Application::Run() {
     // Implementation of the application logic
     std::signal(SIGINT, SignalHandler); // Handle Ctrl+C (SIGINT)
@@ -55,26 +115,34 @@ void Application::Run() {
     metricsManager->AddMetricProvider(std::make_unique<ProcessMetricProvider>());
     metricsManager->AddMetricProvider(std::make_unique<RAMMetricProvider>());
     metricsManager->AddMetricProvider(std::make_unique<StorageMetricProvider>());
+    // Resources used by the application itself.
+    metricsManager->AddMetricProvider(std::make_unique<AgentMetricProvider>());
 
     // Get the network interfaces available on the device.
     Utils::EnumNetworkInterfaces([&](std::string interfaceName) {
         metricsManager->AddMetricProvider(std::make_unique<NetworkMetricProvider>(interfaceName));
         });
 
+    // The HTTP server runs on this thread.
+    if (configManager->GetConfig().observer.enabled) {
+        ThreadPolicy serverPolicy;
+        serverPolicy.isBackground = true;
+        if (!ThreadPolicy::Apply(ThreadPolicy(), serverPolicy)) {
+            logManager->LogWarning("Could not lower the priority of the HTTP server.");
+        }
+    }
+
     while (!g_signal_flag) {
         try {
+            // Start collecting metrics on timers of the thread pool.
+            // For each metric, we want to collect values using a specific counter value,
+            // therefore giving us insight to when the query was called.
+            metricsManager->StartMetricsCollection();
+            aiManager->Start();
             threadManager->AddTaskToThread([this] {
-                // Start collecting metrics on a dedicated thread.
-                // For each metric, we want to collect values using a specific counter value,
-                // therefore giving us insight to when the query was called.
-                metricsManager->StartMetricsCollection();
-                },
-                ThreadType::METRICS_MANAGER_THREAD
-            );
-            threadManager->AddTaskToThread([this] {
-                aiManager->Start();
+                storageWriter->Run();
                 },
-                ThreadType::INTELLIGENCE_MANAGER_THREAD
+                ThreadType::STORAGE_WRITER_THREAD
             );
 
             logManager->LogInfo("Starting HTTP server.");
@@ -95,8 +163,11 @@ void Application::Stop() {
     logManager->LogInfo("= Stopping application =");
 
     metricsManager->StopMetricsCollection();
+    aiManager->Stop();
     scriptManager->Stop();
     server->Stop();
+    // Commit whatever is still queued before the thread pool goes away.
+    storageWriter->Stop();
     threadManager->Stop();
 
     logManager->LogInfo("= Application stopped! =");
@@ -9,9 +9,12 @@
 #include "DataManager.h"
 #include "MetricsManager.h"
 #include "ScriptManager.h"
-#include "Server.h"
+#include "StorageWriter.h"
 #include "IntelligenceManager.h"
 
+// Only the application itself needs restbed.
+class Server;
+
 class Application
 {
 public:
@@ -41,15 +44,6 @@ private:
         }
     }
 
-    // Creates the root application table that is responsible for storing application
-    // specific information. This includes configuration details, users, keys and any
-    // other information.
-    // 
-    // This table mimicks a key-value store.
-    void CreateApplicationTable() {
-        dataManager->CreateTable(tableName, "id INTEGER PRIMARY KEY, key TEXT UNIQUE NOT NULL, value TEXT");
-    }
-
     std::string FetchConfigData() {
         auto resultSet = dataManager->Select(tableName, "key=\"config\"");
         if (resultSet.empty()) {
@@ -67,10 +61,24 @@ public:
         logManager->LogInfo("Updating application configuration.");
         logManager->LogInfo("Application configuration has been set to: {0}", jsonString);
 
-        return dataManager->Upsert(tableName, "\"key\", \"value\"", "\"config\", \'" + jsonString + "\'");
+        if (!dataManager->Upsert(tableName, "\"key\", \"value\"", "\"config\", \'" + jsonString + "\'")) {
+            return false;
+        }
+
+        // The pool size, prediction interval, policies of random tasks and script budgets
+        // are applied without a restart.
+        threadManager->Resize(newConfig.poolSize, newConfig.maxPoolSize);
+        aiManager->SetInterval(newConfig.predictionInterval);
+        ApplyObserverConfig(newConfig.observer);
+        scriptManager->SetBudgets(newConfig);
+        return true;
     }
 
 private:
+    // Sets the thread policies of the pool for the observer mode, or clears them if it
+    // is disabled.
+    void ApplyObserverConfig(const ObserverConfig& observer);
+
     static volatile std::sig_atomic_t g_signal_flag;
 public:
     std::string version = "1.0";
@@ -83,9 +91,10 @@ public:
     MetricsManager* metricsManager;
     ThreadManager* threadManager;
     ScriptManager* scriptManager;
+    StorageWriter* storageWriter;
     IntelligenceManager* aiManager;
 
     Server* server;
 
-    static std::shared_ptr<Application> theApp;
+    static inline std::shared_ptr<Application> theApp = nullptr;
 };
@@ -0,0 +1 @@
+#include "BoundedQueue.h"
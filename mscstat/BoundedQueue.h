@@ -0,0 +1,112 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+// Bounded lock-free queue for multiple producers and consumers.
+//
+// Each cell carries a sequence number that tells producers and consumers whether it
+// is free to write or ready to read, so a push or pop only contends on a single
+// atomic position counter. Capacity is rounded up to a power of 2.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+
+        mask = size - 1;
+        cells.reset(new Cell[size]);
+        for (size_t i = 0; i < size; i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    // Returns `false` if the queue is full.
+    bool TryPush(T&& item) {
+        Cell* cell;
+        size_t position = enqueuePosition.load(std::memory_order_relaxed);
+
+        for (;;) {
+            cell = &cells[position & mask];
+            const auto sequence = cell->sequence.load(std::memory_order_acquire);
+            const auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+
+            if (difference == 0) {
+                if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+            else if (difference < 0) {
+                return false;
+            }
+            else {
+                position = enqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->item = std::move(item);
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Returns `false` if the queue is empty.
+    bool TryPop(T& item) {
+        Cell* cell;
+        size_t position = dequeuePosition.load(std::memory_order_relaxed);
+
+        for (;;) {
+            cell = &cells[position & mask];
+            const auto sequence = cell->sequence.load(std::memory_order_acquire);
+            const auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position + 1);
+
+            if (difference == 0) {
+                if (dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+            else if (difference < 0) {
+                return false;
+            }
+            else {
+                position = dequeuePosition.load(std::memory_order_relaxed);
+            }
+        }
+
+        item = std::move(cell->item);
+        cell->sequence.store(position + mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Approximate number of items in the queue.
+    size_t Size() const {
+        const auto enqueued = enqueuePosition.load(std::memory_order_relaxed);
+        const auto dequeued = dequeuePosition.load(std::memory_order_relaxed);
+        return enqueued > dequeued ? enqueued - dequeued : 0;
+    }
+
+    size_t Capacity() const {
+        return mask + 1;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T item;
+    };
+
+    // Producers and consumers update different positions, so keep them on
+    // separate cache lines.
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask = 0;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> enqueuePosition = 0;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> dequeuePosition = 0;
+};
@@ -0,0 +1 @@
+#include "BurstBuffer.h"
@@ -0,0 +1,300 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include <rapidjson/document.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+#include "CounterRegistry.h"
+#include "DataManager.h"
+#include "LogManager.h"
+#include "RingBuffer.h"
+#include "StorageWriter.h"
+
+// Holds high-frequency samples taken while burst mode is active.
+//
+// In burst mode providers are sampled every `burstInterval` milliseconds. Raw samples
+// are kept in a fixed-size ring buffer per (provider, column), and only aggregates
+// over each downsample window (min/max/avg/last) are written to the `BurstAggregate`
+// table. Providers persist a single row per window to their own table, so regular
+// queries keep working without a row for every sample.
+class BurstBuffer {
+public:
+    struct Point {
+        uint64_t counter = 0;
+        // Milliseconds since epoch.
+        int64_t timestamp = 0;
+        double value = 0;
+    };
+
+    BurstBuffer() {
+    }
+
+    BurstBuffer(const BurstBuffer&) = delete;
+    BurstBuffer& operator=(const BurstBuffer&) = delete;
+
+    // Starts burst mode for `durationMS` milliseconds, or until `Stop` is called if
+    // `durationMS` is 0. Samples from a previous burst are discarded.
+    void Start(int intervalMS, int downsampleMS, size_t capacity, int durationMS) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (active) {
+            FlushAll();
+        }
+
+        interval = intervalMS > 0 ? intervalMS : 100;
+        downsampleInterval = downsampleMS > 0 ? downsampleMS : 1000;
+        bufferCapacity = capacity > 0 ? capacity : 1;
+        endTime = durationMS > 0
+            ? std::chrono::steady_clock::now() + std::chrono::milliseconds(durationMS)
+            : std::chrono::steady_clock::time_point::max();
+        series.clear();
+
+        active = true;
+        version++;
+
+        LogManager::GetInstance().LogInfo("Burst mode started. Sampling every {0}ms.", interval.load());
+    }
+
+    // Stops burst mode. Windows that are still open are persisted, and the raw
+    // samples remain available until the next burst is started.
+    void Stop() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!active) {
+            return;
+        }
+
+        FlushAll();
+        active = false;
+        version++;
+
+        LogManager::GetInstance().LogInfo("Burst mode stopped.");
+    }
+
+    // Stops burst mode if its duration has elapsed.
+    void Expire() {
+        if (active && std::chrono::steady_clock::now() >= endTime.load()) {
+            Stop();
+        }
+    }
+
+    bool IsActive() const {
+        return active.load();
+    }
+
+    // Sampling interval while burst mode is active.
+    int GetInterval() const {
+        return interval.load();
+    }
+
+    // Incremented whenever burst mode is started or stopped.
+    uint64_t GetVersion() const {
+        return version.load();
+    }
+
+    // Records the numeric values of a provider's sample. `columns` names each value.
+    // Returns `true` if the provider should persist this sample, which is always the
+    // case outside of burst mode. In burst mode only the first sample of each downsample
+    // window is persisted by the provider.
+    bool Record(const std::string& provider, const std::vector<std::string>& columns, const CounterSample& sample, const double* values, size_t count) {
+        if (!active) {
+            return true;
+        }
+
+        const int64_t timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(sample.timestamp.time_since_epoch()).count();
+
+        bool isNewWindow = false;
+        // Windows closed by this sample, as (column, window) pairs.
+        std::vector<std::pair<std::string, Window>> closed;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!active) {
+                return true;
+            }
+
+            const auto window = timestamp / downsampleInterval;
+            auto& providerSeries = series[provider];
+            for (size_t i = 0; i < count && i < columns.size(); i++) {
+                auto& s = providerSeries.try_emplace(columns[i], bufferCapacity).first->second;
+
+                auto& w = s.window;
+
+                if (w.index != window) {
+                    if (w.count > 0) {
+                        closed.emplace_back(columns[i], w);
+                    }
+                    w = Window();
+                    w.index = window;
+                    w.counter = sample.counter;
+                    w.min = values[i];
+                    w.max = values[i];
+                    isNewWindow = true;
+                }
+
+                w.min = values[i] < w.min ? values[i] : w.min;
+                w.max = values[i] > w.max ? values[i] : w.max;
+                w.sum += values[i];
+                w.last = values[i];
+                w.count++;
+
+                s.points.Push({ sample.counter, timestamp, values[i] });
+            }
+        }
+
+        // Insert outside the lock so providers running on other threads are not held up.
+        for (const auto& [column, w] : closed) {
+            PersistWindow(provider, column, w);
+        }
+
+        return isNewWindow;
+    }
+
+    std::string GetInfoAsJSON() const {
+        rapidjson::Document doc;
+        doc.SetObject();
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        doc.AddMember("isActive", active.load(), doc.GetAllocator());
+        doc.AddMember("interval", interval.load(), doc.GetAllocator());
+        doc.AddMember("downsampleInterval", downsampleInterval, doc.GetAllocator());
+        doc.AddMember("capacity", static_cast<uint64_t>(bufferCapacity), doc.GetAllocator());
+
+        int64_t remaining = 0;
+        if (active && endTime.load() != std::chrono::steady_clock::time_point::max()) {
+            remaining = std::chrono::duration_cast<std::chrono::milliseconds>(endTime.load() - std::chrono::steady_clock::now()).count();
+        }
+        doc.AddMember("remaining", remaining > 0 ? remaining : 0, doc.GetAllocator());
+
+        rapidjson::Value jsonArray(rapidjson::kArrayType);
+        for (const auto& [provider, providerSeries] : series) {
+            for (const auto& [column, s] : providerSeries) {
+                rapidjson::Value obj(rapidjson::kObjectType);
+
+                rapidjson::Value name_;
+                name_.SetString(provider.c_str(), doc.GetAllocator());
+                obj.AddMember("name", name_, doc.GetAllocator());
+
+                rapidjson::Value column_;
+                column_.SetString(column.c_str(), doc.GetAllocator());
+                obj.AddMember("column", column_, doc.GetAllocator());
+                obj.AddMember("size", static_cast<uint64_t>(s.points.Size()), doc.GetAllocator());
+
+                jsonArray.PushBack(obj, doc.GetAllocator());
+            }
+        }
+        doc.AddMember("series", jsonArray, doc.GetAllocator());
+
+        // Serialize the Document to a JSON string
+        rapidjson::StringBuffer buffer;
+        rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+        buffer.Flush();
+        doc.Accept(writer);
+
+        return buffer.GetString();
+    }
+
+    // Returns up to `limit` raw samples of a provider's column, most recent first.
+    std::string GetDataJSON(const std::string& provider, const std::string& column, size_t limit) const {
+        rapidjson::Document doc;
+        doc.SetObject();
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        const auto providerSeries = series.find(provider);
+        if (providerSeries == series.end()) {
+            throw std::runtime_error("No burst samples found for the specified provider.");
+        }
+        const auto s = providerSeries->second.find(column);
+        if (s == providerSeries->second.end()) {
+            throw std::runtime_error("No burst samples found for the specified column.");
+        }
+
+        rapidjson::Value jsonArray(rapidjson::kArrayType);
+        const auto size = s->second.points.Size() < limit ? s->second.points.Size() : limit;
+        for (size_t i = 0; i < size; i++) {
+            const auto& point = s->second.points.FromNewest(i);
+            rapidjson::Value obj(rapidjson::kObjectType);
+
+            obj.AddMember("counter", point.counter, doc.GetAllocator());
+            obj.AddMember("timestamp", point.timestamp, doc.GetAllocator());
+            obj.AddMember("value", point.value, doc.GetAllocator());
+
+            jsonArray.PushBack(obj, doc.GetAllocator());
+        }
+        doc.AddMember("data", jsonArray, doc.GetAllocator());
+
+        // Serialize the Document to a JSON string
+        rapidjson::StringBuffer buffer;
+        rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+        buffer.Flush();
+        doc.Accept(writer);
+
+        return buffer.GetString();
+    }
+
+private:
+    // Aggregate of a single downsample window.
+    struct Window {
+        // Window number since epoch, i.e. its start time divided by the downsample interval.
+        int64_t index = -1;
+        uint64_t counter = 0;
+        double min = 0;
+        double max = 0;
+        double sum = 0;
+        double last = 0;
+        uint32_t count = 0;
+    };
+
+    struct Series {
+        explicit Series(size_t capacity) : points(capacity) {}
+
+        RingBuffer<Point> points;
+        Window window;
+    };
+
+    void PersistWindow(const std::string& provider, const std::string& column, const Window& w) const {
+        StorageWriter::GetInstance().WriteSample("INSERT INTO BurstAggregate VALUES (NULL, ?, ?, ?, ?, ?, ?, ?, ?, ?)", provider + "." + column)
+            .BindText(provider)
+            .BindText(column)
+            .BindInt64(w.counter)
+            .BindDouble(w.min)
+            .BindDouble(w.max)
+            .BindDouble(w.sum / w.count)
+            .BindDouble(w.last)
+            .BindInt64(w.count)
+            .BindInt64(w.index * downsampleInterval)
+            .Submit();
+    }
+
+    // Persists every open window. Must be called with `mutex` held.
+    void FlushAll() {
+        for (auto& [provider, providerSeries] : series) {
+            for (auto& [column, s] : providerSeries) {
+                if (s.window.count > 0) {
+                    PersistWindow(provider, column, s.window);
+                    s.window = Window();
+                }
+            }
+        }
+    }
+
+private:
+    mutable std::mutex mutex;
+
+    std::atomic<bool> active = false;
+    std::atomic<uint64_t> version = 0;
+    std::atomic<int> interval = 100;
+    std::atomic<std::chrono::steady_clock::time_point> endTime = std::chrono::steady_clock::time_point::max();
+    int64_t downsampleInterval = 1000;
+    size_t bufferCapacity = 0;
+
+    // Samples keyed by provider name, then column name.
+    std::map<std::string, std::map<std::string, Series>> series;
+};
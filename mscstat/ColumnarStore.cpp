@@ -0,0 +1,583 @@
+#include "ColumnarStore.h"
+#include "LogManager.h"
+#include "OverheadMonitor.h"
+
+namespace {
+    template <typename T>
+    void AppendValue(std::vector<uint8_t>& bytes, T value) {
+        const auto offset = bytes.size();
+        bytes.resize(offset + sizeof(T));
+        std::memcpy(bytes.data() + offset, &value, sizeof(T));
+    }
+
+    template <typename T>
+    T ReadValue(const uint8_t* data) {
+        T value;
+        std::memcpy(&value, data, sizeof(T));
+        return value;
+    }
+
+    int64_t Now() {
+        return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+}
+
+std::string ColumnarStore::EscapeFileName(const std::string& name) {
+    static const char* hex = "0123456789ABCDEF";
+
+    std::string result;
+    for (const unsigned char c : name) {
+        if (std::isalnum(c) || c == '-' || c == '_' || c == '.') {
+            result += static_cast<char>(c);
+        }
+        else {
+            result += '%';
+            result += hex[c >> 4];
+            result += hex[c & 0xF];
+        }
+    }
+    return result;
+}
+
+ColumnarStore::Series& ColumnarStore::GetSeries(const SeriesKey& key) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto& entry = series[{ key.table, key.name }];
+    if (!entry) {
+        entry = std::make_unique<Series>();
+        entry->directory = (std::filesystem::path(directory) / EscapeFileName(key.table) / EscapeFileName(key.name)).string();
+        entry->columnCount = key.columns.size();
+
+        std::lock_guard<std::mutex> seriesLock(entry->mutex);
+        Load(*entry);
+    }
+
+    return *entry;
+}
+
+void ColumnarStore::Load(Series& series) {
+    std::error_code error;
+    if (!std::filesystem::is_directory(series.directory, error)) {
+        return;
+    }
+
+    for (const auto& entry : std::filesystem::directory_iterator(series.directory, error)) {
+        if (entry.path().extension() != ".seg") {
+            continue;
+        }
+
+        int64_t partition = 0;
+        try {
+            partition = std::stoll(entry.path().stem().string());
+        }
+        catch (const std::exception&) {
+            continue;
+        }
+
+        auto& segment = series.segments[partition];
+        segment.path = entry.path().string();
+
+        if (LoadFooter(segment)) {
+            continue;
+        }
+
+        // Only the chunk headers are read. A chunk cut short by a crash ends the segment,
+        // and is cut off so the next chunk is appended after the last good one.
+        std::ifstream file(segment.path, std::ios::binary);
+        std::vector<uint8_t> header(ChunkHeader::SIZE);
+        while (file.read(reinterpret_cast<char*>(header.data()), ChunkHeader::SIZE)) {
+            ChunkHeader chunkHeader;
+            if (!ChunkDecoder::ReadHeader(header.data(), header.size(), chunkHeader)) {
+                break;
+            }
+
+            std::vector<uint8_t> table(ChunkHeader::SIZE + chunkHeader.GetTableSize());
+            std::copy(header.begin(), header.end(), table.begin());
+            if (!file.read(reinterpret_cast<char*>(table.data() + ChunkHeader::SIZE), chunkHeader.GetTableSize())) {
+                break;
+            }
+
+            if (segment.size + chunkHeader.size > entry.file_size(error)) {
+                break;
+            }
+
+            ChunkInfo chunk;
+            chunk.first = chunkHeader.first;
+            chunk.last = chunkHeader.last;
+            chunk.count = chunkHeader.count;
+            chunk.offset = segment.size;
+            chunk.size = chunkHeader.size;
+            // Summaries only need the header and the table, but are read from a buffer
+            // that claims to hold the whole chunk.
+            table.resize(chunkHeader.size);
+            chunk.summaries = ChunkDecoder::ReadSummaries(table.data(), table.size());
+            segment.chunks.push_back(std::move(chunk));
+
+            segment.size += chunkHeader.size;
+            file.seekg(segment.size);
+        }
+        file.close();
+
+        if (segment.size < entry.file_size(error)) {
+            LogManager::GetInstance().LogWarning("Truncating damaged segment {0} to {1} bytes.", segment.path, segment.size);
+            std::filesystem::resize_file(segment.path, segment.size, error);
+        }
+    }
+
+    // Recover the samples of the open chunk written by the last flush. Samples that made
+    // it into a segment before the head was removed are skipped.
+    const auto headPath = (std::filesystem::path(series.directory) / "head.chunk").string();
+    if (std::ifstream head(headPath, std::ios::binary); head) {
+        const std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(head)), std::istreambuf_iterator<char>());
+        int64_t sealed = (std::numeric_limits<int64_t>::min)();
+        for (const auto& [partition, segment] : series.segments) {
+            for (const auto& chunk : segment.chunks) {
+                sealed = (std::max)(sealed, chunk.last);
+            }
+        }
+
+        DecodeChunk(bytes.data(), bytes.size(), series.columnCount, [&](int64_t timestamp, int64_t counter, const double* values) {
+            if (timestamp <= sealed) {
+                return;
+            }
+
+            if (!series.open) {
+                series.open = std::make_unique<ChunkEncoder>(series.columnCount);
+                series.openPartition = FloorToPartition(timestamp);
+            }
+            series.open->Append(timestamp, counter, values);
+            });
+    }
+
+    // Days that ended while the process was not running.
+    SealSegments(series, Now());
+}
+
+bool ColumnarStore::LoadFooter(Segment& segment) {
+    auto mapping = std::make_unique<MappedFile>();
+    if (!mapping->Open(segment.path) || mapping->GetSize() < SegmentTrailer::SIZE) {
+        return false;
+    }
+
+    const uint8_t* data = mapping->GetData();
+    const size_t size = mapping->GetSize();
+
+    SegmentTrailer trailer;
+    trailer.magic = ReadValue<uint32_t>(data + size - SegmentTrailer::SIZE);
+    trailer.columnCount = ReadValue<uint32_t>(data + size - SegmentTrailer::SIZE + 4);
+    trailer.chunkCount = ReadValue<uint64_t>(data + size - SegmentTrailer::SIZE + 8);
+    trailer.indexOffset = ReadValue<uint64_t>(data + size - SegmentTrailer::SIZE + 16);
+
+    if (trailer.magic != SegmentTrailer::MAGIC
+        || trailer.indexOffset % SEGMENT_PAGE_SIZE != 0
+        || trailer.indexOffset > size - SegmentTrailer::SIZE
+        || (size - SegmentTrailer::SIZE - trailer.indexOffset) != trailer.chunkCount * trailer.GetEntrySize()) {
+        return false;
+    }
+
+    std::vector<ChunkInfo> chunks;
+    const uint8_t* entry = data + trailer.indexOffset;
+    for (uint64_t i = 0; i < trailer.chunkCount; i++) {
+        ChunkInfo chunk;
+        chunk.first = ReadValue<int64_t>(entry);
+        chunk.last = ReadValue<int64_t>(entry + 8);
+        chunk.offset = ReadValue<uint64_t>(entry + 16);
+        chunk.size = ReadValue<uint32_t>(entry + 24);
+        chunk.count = ReadValue<uint32_t>(entry + 28);
+        if (chunk.offset + chunk.size > trailer.indexOffset) {
+            return false;
+        }
+
+        const uint8_t* summary = entry + 32;
+        for (uint32_t column = 0; column < trailer.columnCount; column++) {
+            AggregateValue value;
+            value.min = ReadValue<double>(summary);
+            value.max = ReadValue<double>(summary + 8);
+            value.sum = ReadValue<double>(summary + 16);
+            value.count = chunk.count;
+            chunk.summaries.push_back(value);
+            summary += 3 * sizeof(double);
+        }
+
+        chunks.push_back(std::move(chunk));
+        entry += trailer.GetEntrySize();
+    }
+
+    segment.chunks = std::move(chunks);
+    segment.size = trailer.indexOffset;
+    segment.isSealed = true;
+    segment.mapping = std::move(mapping);
+    return true;
+}
+
+void ColumnarStore::SealSegments(Series& series, int64_t now) {
+    for (auto& [partition, segment] : series.segments) {
+        if (segment.isSealed || partition + PARTITION_SECONDS + SEAL_DELAY_SECONDS > now) {
+            continue;
+        }
+
+        if (series.open && series.openPartition == partition) {
+            Seal(series);
+        }
+        SealSegment(segment, series.columnCount);
+    }
+
+    // The open chunk may be the only data of its day.
+    if (series.open && series.openPartition + PARTITION_SECONDS + SEAL_DELAY_SECONDS <= now) {
+        const auto partition = series.openPartition;
+        Seal(series);
+        SealSegment(series.segments[partition], series.columnCount);
+    }
+}
+
+void ColumnarStore::SealSegment(Segment& segment, size_t columnCount) {
+    if (segment.chunks.empty()) {
+        segment.isSealed = true;
+        return;
+    }
+
+    // Pad the chunks to a page boundary, so the footer never shares a page with them.
+    std::vector<uint8_t> footer((SEGMENT_PAGE_SIZE - segment.size % SEGMENT_PAGE_SIZE) % SEGMENT_PAGE_SIZE, 0);
+
+    SegmentTrailer trailer;
+    trailer.columnCount = static_cast<uint32_t>(columnCount);
+    trailer.chunkCount = segment.chunks.size();
+    trailer.indexOffset = segment.size + footer.size();
+
+    for (const auto& chunk : segment.chunks) {
+        AppendValue(footer, chunk.first);
+        AppendValue(footer, chunk.last);
+        AppendValue(footer, chunk.offset);
+        AppendValue(footer, chunk.size);
+        AppendValue(footer, chunk.count);
+        for (size_t column = 0; column < columnCount; column++) {
+            const auto summary = column < chunk.summaries.size() ? chunk.summaries[column] : AggregateValue();
+            AppendValue(footer, summary.min);
+            AppendValue(footer, summary.max);
+            AppendValue(footer, summary.sum);
+        }
+    }
+
+    AppendValue(footer, trailer.magic);
+    AppendValue(footer, trailer.columnCount);
+    AppendValue(footer, trailer.chunkCount);
+    AppendValue(footer, trailer.indexOffset);
+
+    std::ofstream file(segment.path, std::ios::binary | std::ios::app);
+    file.write(reinterpret_cast<const char*>(footer.data()), footer.size());
+    file.close();
+    OverheadMonitor::GetInstance().AddWrittenBytes(Subsystem::COLUMNAR_SUBSYSTEM, footer.size());
+
+    // Left unsealed, to be tried again on the next flush.
+    std::error_code error;
+    if (!file) {
+        LogManager::GetInstance().LogError("Failed to seal segment {0}.", segment.path);
+        std::filesystem::resize_file(segment.path, segment.size, error);
+        return;
+    }
+
+    // Summaries of chunks written before a provider gained columns are padded with zeros
+    // in the footer, so the index is read back the same way.
+    for (auto& chunk : segment.chunks) {
+        chunk.summaries.resize(columnCount);
+    }
+    segment.isSealed = true;
+}
+
+void ColumnarStore::Append(const SeriesKey& key, int64_t timestamp, int64_t counter, const double* values, size_t count) {
+    auto& series = GetSeries(key);
+    std::lock_guard<std::mutex> lock(series.mutex);
+
+    // Chunks never span two days, so whole segments can be expired.
+    const auto partition = FloorToPartition(timestamp);
+    if (const auto it = series.segments.find(partition); it != series.segments.end() && it->second.isSealed) {
+        LogManager::GetInstance().LogWarning("Dropping sample of {0} at {1}, as its day has been sealed.", key.name, timestamp);
+        return;
+    }
+
+    if (series.open && partition != series.openPartition) {
+        Seal(series);
+    }
+
+    if (!series.open) {
+        series.open = std::make_unique<ChunkEncoder>(series.columnCount);
+        series.openPartition = partition;
+    }
+
+    std::vector<double> row(series.columnCount);
+    std::copy(values, values + (std::min)(count, series.columnCount), row.begin());
+    series.open->Append(timestamp, counter, row.data());
+
+    if (series.open->GetCount() >= MAX_CHUNK_SAMPLES) {
+        Seal(series);
+    }
+}
+
+void ColumnarStore::Seal(Series& series) {
+    if (!series.open || series.open->GetCount() == 0) {
+        return;
+    }
+
+    const auto bytes = series.open->Serialize();
+
+    auto& segment = series.segments[series.openPartition];
+    if (segment.path.empty()) {
+        segment.path = (std::filesystem::path(series.directory) / (std::to_string(series.openPartition) + ".seg")).string();
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(series.directory, error);
+
+    std::ofstream file(segment.path, std::ios::binary | std::ios::app);
+    file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    file.close();
+    OverheadMonitor::GetInstance().AddWrittenBytes(Subsystem::COLUMNAR_SUBSYSTEM, bytes.size());
+
+    // A chunk that could not be written is dropped rather than kept in memory forever.
+    if (!file) {
+        LogManager::GetInstance().LogError("Failed to write {0} samples to {1}.", series.open->GetCount(), segment.path);
+        std::filesystem::resize_file(segment.path, segment.size, error);
+    }
+    else {
+        ChunkInfo chunk;
+        chunk.first = series.open->GetFirst();
+        chunk.last = series.open->GetLast();
+        chunk.count = series.open->GetCount();
+        chunk.offset = segment.size;
+        chunk.size = static_cast<uint32_t>(bytes.size());
+        chunk.summaries = ChunkDecoder::ReadSummaries(bytes.data(), bytes.size());
+        segment.chunks.push_back(std::move(chunk));
+        segment.size += bytes.size();
+    }
+
+    series.open.reset();
+    std::filesystem::remove(std::filesystem::path(series.directory) / "head.chunk", error);
+}
+
+void ColumnarStore::Flush() {
+    std::vector<Series*> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& [key, entry] : series) {
+            snapshot.push_back(entry.get());
+        }
+    }
+
+    const auto now = Now();
+    for (auto* entry : snapshot) {
+        std::lock_guard<std::mutex> lock(entry->mutex);
+        SealSegments(*entry, now);
+        if (!entry->open) {
+            continue;
+        }
+
+        // Written aside and renamed, so a crash never leaves a half-written head.
+        const auto bytes = entry->open->Serialize();
+        const auto headPath = std::filesystem::path(entry->directory) / "head.chunk";
+        auto tempPath = headPath;
+        tempPath += ".tmp";
+
+        std::error_code error;
+        std::filesystem::create_directories(entry->directory, error);
+
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+        file.close();
+        OverheadMonitor::GetInstance().AddWrittenBytes(Subsystem::COLUMNAR_SUBSYSTEM, bytes.size());
+
+        if (!file) {
+            LogManager::GetInstance().LogError("Failed to flush samples to {0}.", tempPath.string());
+            continue;
+        }
+        std::filesystem::rename(tempPath, headPath, error);
+    }
+}
+
+void ColumnarStore::VisitChunks(Series& series, int64_t from, int64_t to, const ChunkVisitor& visitor) {
+    std::vector<uint8_t> buffer;
+    for (auto& [partition, segment] : series.segments) {
+        if (partition + PARTITION_SECONDS <= from || partition >= to) {
+            continue;
+        }
+
+        // Sealed segments are decoded straight from the mapped file.
+        if (segment.isSealed) {
+            for (const auto& chunk : segment.chunks) {
+                if (chunk.last < from || chunk.first >= to) {
+                    continue;
+                }
+
+                if (!segment.mapping && !(segment.mapping = std::make_unique<MappedFile>())->Open(segment.path)) {
+                    LogManager::GetInstance().LogError("Failed to map segment {0}.", segment.path);
+                    segment.mapping.reset();
+                    break;
+                }
+
+                if (chunk.offset + chunk.size <= segment.mapping->GetSize()) {
+                    visitor(segment.mapping->GetData() + chunk.offset, chunk.size, chunk);
+                }
+            }
+            continue;
+        }
+
+        std::ifstream file;
+        for (const auto& chunk : segment.chunks) {
+            if (chunk.last < from || chunk.first >= to) {
+                continue;
+            }
+
+            if (!file.is_open()) {
+                file.open(segment.path, std::ios::binary);
+            }
+
+            buffer.resize(chunk.size);
+            file.seekg(chunk.offset);
+            if (!file.read(reinterpret_cast<char*>(buffer.data()), chunk.size)) {
+                LogManager::GetInstance().LogError("Failed to read chunk at {0} of {1}.", chunk.offset, segment.path);
+                file.clear();
+                continue;
+            }
+
+            visitor(buffer.data(), buffer.size(), chunk);
+        }
+    }
+
+    if (series.open && series.open->GetLast() >= from && series.open->GetFirst() < to) {
+        const auto bytes = series.open->Serialize();
+
+        ChunkInfo chunk;
+        chunk.first = series.open->GetFirst();
+        chunk.last = series.open->GetLast();
+        chunk.count = series.open->GetCount();
+        chunk.size = static_cast<uint32_t>(bytes.size());
+        visitor(bytes.data(), bytes.size(), chunk);
+    }
+}
+
+void ColumnarStore::DecodeChunk(const uint8_t* data, size_t size, size_t columnCount, const SampleVisitor& visitor) {
+    ChunkHeader header;
+    if (!ChunkDecoder::ReadHeader(data, size, header)) {
+        return;
+    }
+
+    if (header.columnCount == columnCount) {
+        ChunkDecoder::Decode(data, size, visitor);
+        return;
+    }
+
+    std::vector<double> row(columnCount);
+    ChunkDecoder::Decode(data, size, [&](int64_t timestamp, int64_t counter, const double* values) {
+        std::fill(row.begin(), row.end(), 0.0);
+        std::copy(values, values + (std::min)(columnCount, static_cast<size_t>(header.columnCount)), row.begin());
+        visitor(timestamp, counter, row.data());
+        });
+}
+
+void ColumnarStore::Scan(const SeriesKey& key, int64_t from, int64_t to, const SampleVisitor& visitor) {
+    auto& series = GetSeries(key);
+    std::lock_guard<std::mutex> lock(series.mutex);
+
+    VisitChunks(series, from, to, [&](const uint8_t* data, size_t size, const ChunkInfo&) {
+        DecodeChunk(data, size, series.columnCount, [&](int64_t timestamp, int64_t counter, const double* values) {
+            if (timestamp >= from && timestamp < to) {
+                visitor(timestamp, counter, values);
+            }
+            });
+        });
+}
+
+void ColumnarStore::ScanLatest(const SeriesKey& key, size_t count, const SampleVisitor& visitor) {
+    auto& series = GetSeries(key);
+    std::lock_guard<std::mutex> lock(series.mutex);
+
+    // Gather the newest chunks until they hold `count` samples, starting from the open one.
+    size_t gathered = series.open ? series.open->GetCount() : 0;
+    int64_t from = series.open ? series.open->GetFirst() : (std::numeric_limits<int64_t>::max)();
+    for (auto segment = series.segments.rbegin(); segment != series.segments.rend() && gathered < count; ++segment) {
+        for (auto chunk = segment->second.chunks.rbegin(); chunk != segment->second.chunks.rend() && gathered < count; ++chunk) {
+            gathered += chunk->count;
+            from = (std::min)(from, chunk->first);
+        }
+    }
+
+    std::vector<int64_t> timestamps;
+    std::vector<int64_t> counters;
+    std::vector<double> values;
+    VisitChunks(series, from, (std::numeric_limits<int64_t>::max)(), [&](const uint8_t* data, size_t size, const ChunkInfo&) {
+        DecodeChunk(data, size, series.columnCount, [&](int64_t timestamp, int64_t counter, const double* row) {
+            timestamps.push_back(timestamp);
+            counters.push_back(counter);
+            values.insert(values.end(), row, row + series.columnCount);
+            });
+        });
+
+    const auto n = (std::min)(count, timestamps.size());
+    for (size_t i = 0; i < n; i++) {
+        const auto index = timestamps.size() - 1 - i;
+        visitor(timestamps[index], counters[index], values.data() + index * series.columnCount);
+    }
+}
+
+int64_t ColumnarStore::GetFirstTimestamp(const SeriesKey& key, int64_t from) {
+    auto& series = GetSeries(key);
+    std::lock_guard<std::mutex> lock(series.mutex);
+
+    int64_t first = 0;
+    VisitChunks(series, from, (std::numeric_limits<int64_t>::max)(), [&](const uint8_t* data, size_t size, const ChunkInfo& chunk) {
+        if (first != 0 && first <= chunk.first) {
+            return;
+        }
+
+        DecodeChunk(data, size, series.columnCount, [&](int64_t timestamp, int64_t, const double*) {
+            if (timestamp >= from && (first == 0 || timestamp < first)) {
+                first = timestamp;
+            }
+            });
+        });
+
+    return first;
+}
+
+AggregateValue ColumnarStore::Aggregate(const SeriesKey& key, const std::string& column, int64_t from) {
+    AggregateValue result;
+
+    const auto it = std::find(key.columns.begin(), key.columns.end(), column);
+    if (it == key.columns.end()) {
+        return result;
+    }
+    const auto index = static_cast<size_t>(it - key.columns.begin());
+
+    auto& series = GetSeries(key);
+    std::lock_guard<std::mutex> lock(series.mutex);
+
+    VisitChunks(series, from, (std::numeric_limits<int64_t>::max)(), [&](const uint8_t* data, size_t size, const ChunkInfo& chunk) {
+        // Chunks that are entirely in range are answered from their summaries.
+        if (chunk.first >= from && index < chunk.summaries.size()) {
+            result.Merge(chunk.summaries[index]);
+            return;
+        }
+
+        DecodeChunk(data, size, series.columnCount, [&](int64_t timestamp, int64_t, const double* values) {
+            if (timestamp >= from) {
+                result.Add(values[index]);
+            }
+            });
+        });
+
+    return result;
+}
+
+void ColumnarStore::Expire(const SeriesKey& key, int64_t before, int batchSize) {
+    auto& series = GetSeries(key);
+    std::lock_guard<std::mutex> lock(series.mutex);
+
+    std::error_code error;
+    for (auto it = series.segments.begin(); it != series.segments.end() && it->first + PARTITION_SECONDS <= before;) {
+        it->second.mapping.reset();
+        if (!std::filesystem::remove(it->second.path, error) && error) {
+            LogManager::GetInstance().LogError("Failed to delete segment {0}: {1}", it->second.path, error.message());
+            break;
+        }
+        it = series.segments.erase(it);
+    }
+}
@@ -0,0 +1,172 @@
+#pragma once
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+#include "SampleStore.h"
+#include "SeriesChunk.h"
+
+// Append-only storage engine that keeps every series in compressed chunks, selected with
+// `"storageEngine": "columnar"`. Samples take a few bytes each instead of a SQLite row.
+//
+// Each series has a directory holding one segment file per day. A segment is a sequence
+// of sealed chunks of up to `MAX_CHUNK_SAMPLES` samples, each with a header giving its
+// time range and the min/max/sum of every column. The headers are read into a chunk
+// index when the series is first used, so range scans only read the chunks they need
+// and aggregates over whole chunks do not decode them at all.
+//
+// The chunk being filled is kept in memory and written to `head.chunk` on every `Flush`,
+// so at most one flush interval of samples is lost if the process dies.
+//
+// Once its day is over, a segment is sealed: a footer index of its chunks is appended,
+// starting on a page boundary, and the file is never written again. Sealed segments are
+// memory-mapped and decoded in place, and the footer is all that is read to index them,
+// so a range lookup only touches the pages of the footer and of the chunks it needs.
+//
+// Only numeric columns are stored. Text columns of providers, such as the active process,
+// are not kept.
+class ColumnarStore : public SampleStore {
+public:
+    explicit ColumnarStore(const std::string& directory) : directory(directory) {}
+
+    ColumnarStore(const ColumnarStore&) = delete;
+    ColumnarStore& operator=(const ColumnarStore&) = delete;
+
+    ~ColumnarStore() {
+        Flush();
+    }
+
+    virtual std::string GetName() const override { return "columnar"; }
+
+    virtual bool StoresSamples() const override { return true; }
+
+    virtual void Append(const SeriesKey& key, int64_t timestamp, int64_t counter, const double* values, size_t count) override;
+
+    virtual void Scan(const SeriesKey& key, int64_t from, int64_t to, const SampleVisitor& visitor) override;
+
+    virtual void ScanLatest(const SeriesKey& key, size_t count, const SampleVisitor& visitor) override;
+
+    virtual int64_t GetFirstTimestamp(const SeriesKey& key, int64_t from) override;
+
+    virtual AggregateValue Aggregate(const SeriesKey& key, const std::string& column, int64_t from) override;
+
+    // Whole segments are deleted once all of their day is older than `before`.
+    virtual void Expire(const SeriesKey& key, int64_t before, int batchSize) override;
+
+    virtual void Flush() override;
+
+private:
+    static constexpr int64_t PARTITION_SECONDS = 24 * 60 * 60;
+    // About 3 hours of samples at the default interval.
+    static constexpr uint32_t MAX_CHUNK_SAMPLES = 1024;
+    // Segments are sealed once their day has been over for this long, so samples still
+    // on their way make it in. Samples of a sealed day are dropped.
+    static constexpr int64_t SEAL_DELAY_SECONDS = 60 * 60;
+    // Alignment of footer indexes. This is the page size of every platform we build for.
+    static constexpr uint64_t SEGMENT_PAGE_SIZE = 4096;
+
+    // Last bytes of a sealed segment. The footer index starts at `indexOffset` and holds
+    // an entry per chunk: its first and last timestamps, offset, size and count, then
+    // the min/max/sum of every column.
+    struct SegmentTrailer {
+        static constexpr uint32_t MAGIC = 0x3149464D; // "MFI1"
+        static constexpr size_t SIZE = 24;
+
+        uint32_t magic = MAGIC;
+        uint32_t columnCount = 0;
+        uint64_t chunkCount = 0;
+        uint64_t indexOffset = 0;
+
+        size_t GetEntrySize() const {
+            return 3 * sizeof(int64_t) + 2 * sizeof(uint32_t) + columnCount * 3 * sizeof(double);
+        }
+    };
+
+    // Entry of the chunk index.
+    struct ChunkInfo {
+        int64_t first = 0;
+        int64_t last = 0;
+        uint32_t count = 0;
+        // Position of the chunk in its segment file.
+        uint64_t offset = 0;
+        uint32_t size = 0;
+        std::vector<AggregateValue> summaries;
+    };
+
+    struct Segment {
+        std::string path;
+        // Bytes of chunks in the file.
+        uint64_t size = 0;
+        std::vector<ChunkInfo> chunks;
+        // Sealed segments end with a footer index and are read through `mapping`.
+        bool isSealed = false;
+        std::unique_ptr<MappedFile> mapping;
+    };
+
+    struct Series {
+        std::mutex mutex;
+        std::string directory;
+        size_t columnCount = 0;
+        // Segments keyed by the start of their day.
+        std::map<int64_t, Segment> segments;
+        // Samples not sealed yet, all in the day starting at `openPartition`.
+        std::unique_ptr<ChunkEncoder> open;
+        int64_t openPartition = 0;
+    };
+
+    // Called with each chunk read, and its index entry. The open chunk has no offset.
+    typedef std::function<void(const uint8_t* data, size_t size, const ChunkInfo& chunk)> ChunkVisitor;
+
+    static int64_t FloorToPartition(int64_t timestamp) {
+        return timestamp - (((timestamp % PARTITION_SECONDS) + PARTITION_SECONDS) % PARTITION_SECONDS);
+    }
+
+    // Escapes characters that are not safe in file names, such as those in network
+    // interface names.
+    static std::string EscapeFileName(const std::string& name);
+
+    // Returns the series of `key`, loading its chunk index on first use.
+    Series& GetSeries(const SeriesKey& key);
+
+    // Builds the chunk index from the segment files, and recovers the open chunk.
+    void Load(Series& series);
+
+    // Reads the chunk index of a sealed segment from its footer. Returns `false` if the
+    // segment has no valid footer.
+    static bool LoadFooter(Segment& segment);
+
+    // Appends the open chunk to its segment.
+    void Seal(Series& series);
+
+    // Seals every segment whose day was over `SEAL_DELAY_SECONDS` before `now`.
+    void SealSegments(Series& series, int64_t now);
+
+    // Appends the footer index to a segment, which makes it immutable.
+    static void SealSegment(Segment& segment, size_t columnCount);
+
+    // Visits the chunks that may hold samples between `from` and `to`, oldest first,
+    // with the open chunk last.
+    void VisitChunks(Series& series, int64_t from, int64_t to, const ChunkVisitor& visitor);
+
+    // Decodes a chunk, padding or cutting its values to `columnCount`, so chunks written
+    // before a provider gained or lost columns still line up.
+    static void DecodeChunk(const uint8_t* data, size_t size, size_t columnCount, const SampleVisitor& visitor);
+
+    std::string directory;
+    std::mutex mutex;
+    // Keyed by table, then provider or script name.
+    std::map<std::pair<std::string, std::string>, std::unique_ptr<Series>> series;
+};
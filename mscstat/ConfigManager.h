@@ -1,7 +1,10 @@
 #pragma once
+#include <algorithm>
 #include <iostream>
+#include <map>
 #include <string>
 #include <mutex>
+#include <vector>
 #include <rapidjson/document.h>
 #include <rapidjson/prettywriter.h>
 #include <rapidjson/stringbuffer.h>
@@ -11,9 +14,51 @@
 #endif // !METRICS_FETCHER_PORT
 
 
+// Sampling schedule of a single metric provider or script.
+struct SamplingConfig {
+    // Interval between samples in milliseconds.
+    int interval = 0;
+    // Offset of the first sample from the start of collection in milliseconds.
+    // This allows expensive providers to be spread across the interval.
+    int phase = 0;
+};
+
+// How long the samples of a single metric provider or script are kept, in seconds,
+// at each resolution. 0 keeps them forever.
+struct RetentionConfig {
+    int raw = 7 * 24 * 60 * 60;
+    int minute = 30 * 24 * 60 * 60;
+    int hour = 365 * 24 * 60 * 60;
+    int day = 0;
+};
+
+// Limits of each run of a single script. Runs over either limit are aborted, and the
+// script is skipped for a while. 0 disables a limit.
+struct ScriptBudgetConfig {
+    // CPU time of a run, in milliseconds.
+    int cpuTime = 1000;
+    // Bytes the heap of the script may hold.
+    int64_t memory = 32 * 1024 * 1024;
+};
+
+// Keeps the agent out of the way of what it measures. Sampling tasks and the storage
+// writer run on their own cores, and the HTTP server, scripts and maintenance tasks such
+// as predictions run at low CPU and I/O priority. Changes to the cores of the storage
+// writer and to the server only apply once the application restarts.
+struct ObserverConfig {
+    bool enabled = false;
+    // Cores sampling tasks run on. Empty lets them run on any core.
+    std::vector<int> collectorCores;
+    // Cores the storage writer runs on. Empty lets it run on any core.
+    std::vector<int> storageCores;
+};
+
 struct MyConfig {
-    // Default pool size is 4.
-    short poolSize = 4;
+    // Default pool size is 6. The first thread is reserved for the storage writer.
+    short poolSize = 6;
+    // The pool grows up to this many threads when all of them are busy, and shrinks
+    // back to `poolSize` once they are idle.
+    short maxPoolSize = 12;
     // Environmental variable overrides whatever is set for this value,
     // allowing the operating system to manage the port allocation and provide
     // an available port to the application.
@@ -22,6 +67,94 @@ struct MyConfig {
     short metricFetchInterval = 10 * 1000;
     // Default prediction interval is set to 5 minutes
     int predictionInterval = 5 * 60 * 1000;
+    // Resolution of the metrics scheduler in milliseconds. Intervals and phases
+    // are rounded up to a multiple of this value.
+    int schedulerResolution = 10;
+    // Per-provider and per-script sampling schedules, keyed by provider or script name.
+    // Anything not listed here is sampled every `metricFetchInterval` milliseconds.
+    std::map<std::string, SamplingConfig> sampling;
+    // Sampling interval of metric providers in burst mode, in milliseconds.
+    int burstInterval = 100;
+    // Burst samples are aggregated over windows of this many milliseconds before being persisted.
+    int burstDownsampleInterval = 1000;
+    // Number of raw samples kept in memory per provider column in burst mode.
+    int burstBufferSize = 3000;
+    // Default duration of burst mode in milliseconds. 0 keeps it active until stopped.
+    int burstDuration = 5 * 60 * 1000;
+    // Latest samples kept in memory per provider and script, so `/api/providers` does
+    // not query the database. The dashboard asks for 40. Deeper requests read the database.
+    int hotTierSize = 64;
+    // Maximum number of writes waiting for the storage writer.
+    int storageQueueSize = 4096;
+    // What to do when the storage queue is full: `block`, `drop-oldest` or `coalesce`.
+    std::string storageOverflowPolicy = "block";
+    // Milliseconds the storage writer waits after the first write of a tick, so the
+    // rest of the tick is committed in the same transaction.
+    int storageCommitDelay = 50;
+    // Number of read-only database connections serving API queries.
+    int databaseReaders = 2;
+    // SQLite `synchronous` setting of the writer connection: `OFF`, `NORMAL` or `FULL`.
+    std::string databaseSynchronous = "NORMAL";
+    // SQLite page cache per connection. Negative values are in KiB.
+    int databaseCacheSize = -8000;
+    // Bytes of the database file each connection may memory-map.
+    int64_t databaseMmapSize = 256 * 1024 * 1024;
+    // Pages in the WAL before a commit checkpoints it. 0 leaves checkpoints to the
+    // background checkpoint, which runs every `checkpointInterval` milliseconds.
+    int walAutoCheckpoint = 0;
+    int checkpointInterval = 60 * 1000;
+    // Engine raw samples are stored in. `sqlite` keeps a row per sample in the provider
+    // tables. `columnar` keeps compressed chunks in the `columnar` app data folder,
+    // flushed every `checkpointInterval` milliseconds. Rollups stay in SQLite either way.
+    std::string storageEngine = "sqlite";
+    // Per-provider and per-script retention, keyed by provider or script name. The
+    // `default` entry applies to anything not listed.
+    std::map<std::string, RetentionConfig> retention;
+    // Milliseconds between runs of the rollup and retention job.
+    int rollupInterval = 10 * 1000;
+    // Maximum number of rows deleted from a table in a single write.
+    int retentionBatchSize = 1000;
+    ObserverConfig observer;
+    // Per-script budgets, keyed by script name. The `default` entry applies to anything
+    // not listed.
+    std::map<std::string, ScriptBudgetConfig> scriptBudgets;
+
+    SamplingConfig GetSamplingConfig(const std::string& name) const {
+        SamplingConfig result;
+        if (const auto it = sampling.find(name); it != sampling.end()) {
+            result = it->second;
+        }
+
+        if (result.interval <= 0) {
+            result.interval = metricFetchInterval;
+        }
+        result.interval = (std::max)(result.interval, (std::max)(schedulerResolution, 1));
+        result.phase = (std::max)(result.phase, 0);
+
+        return result;
+    }
+
+    RetentionConfig GetRetentionConfig(const std::string& name) const {
+        if (const auto it = retention.find(name); it != retention.end()) {
+            return it->second;
+        }
+        if (const auto it = retention.find("default"); it != retention.end()) {
+            return it->second;
+        }
+
+        return RetentionConfig();
+    }
+
+    ScriptBudgetConfig GetScriptBudgetConfig(const std::string& name) const {
+        if (const auto it = scriptBudgets.find(name); it != scriptBudgets.end()) {
+            return it->second;
+        }
+        if (const auto it = scriptBudgets.find("default"); it != scriptBudgets.end()) {
+            return it->second;
+        }
+
+        return ScriptBudgetConfig();
+    }
 };
 
 class ConfigManager {
@@ -53,9 +186,89 @@ public:
         doc.SetObject();
 
         doc.AddMember("poolSize", config.poolSize, doc.GetAllocator());
+        doc.AddMember("maxPoolSize", config.maxPoolSize, doc.GetAllocator());
         doc.AddMember("port", config.port, doc.GetAllocator());
         doc.AddMember("metricFetchInterval", config.metricFetchInterval, doc.GetAllocator());
         doc.AddMember("predictionInterval", config.predictionInterval, doc.GetAllocator());
+        doc.AddMember("schedulerResolution", config.schedulerResolution, doc.GetAllocator());
+
+        rapidjson::Value sampling(rapidjson::kObjectType);
+        for (const auto& [name, samplingConfig] : config.sampling) {
+            rapidjson::Value obj(rapidjson::kObjectType);
+            obj.AddMember("interval", samplingConfig.interval, doc.GetAllocator());
+            obj.AddMember("phase", samplingConfig.phase, doc.GetAllocator());
+
+            rapidjson::Value name_;
+            name_.SetString(name.c_str(), doc.GetAllocator());
+            sampling.AddMember(name_, obj, doc.GetAllocator());
+        }
+        doc.AddMember("sampling", sampling, doc.GetAllocator());
+        doc.AddMember("burstInterval", config.burstInterval, doc.GetAllocator());
+        doc.AddMember("burstDownsampleInterval", config.burstDownsampleInterval, doc.GetAllocator());
+        doc.AddMember("burstBufferSize", config.burstBufferSize, doc.GetAllocator());
+        doc.AddMember("burstDuration", config.burstDuration, doc.GetAllocator());
+        doc.AddMember("hotTierSize", config.hotTierSize, doc.GetAllocator());
+        doc.AddMember("storageQueueSize", config.storageQueueSize, doc.GetAllocator());
+
+        rapidjson::Value storageOverflowPolicy_;
+        storageOverflowPolicy_.SetString(config.storageOverflowPolicy.c_str(), doc.GetAllocator());
+        doc.AddMember("storageOverflowPolicy", storageOverflowPolicy_, doc.GetAllocator());
+        doc.AddMember("storageCommitDelay", config.storageCommitDelay, doc.GetAllocator());
+        doc.AddMember("databaseReaders", config.databaseReaders, doc.GetAllocator());
+
+        rapidjson::Value databaseSynchronous_;
+        databaseSynchronous_.SetString(config.databaseSynchronous.c_str(), doc.GetAllocator());
+        doc.AddMember("databaseSynchronous", databaseSynchronous_, doc.GetAllocator());
+        doc.AddMember("databaseCacheSize", config.databaseCacheSize, doc.GetAllocator());
+        doc.AddMember("databaseMmapSize", config.databaseMmapSize, doc.GetAllocator());
+        doc.AddMember("walAutoCheckpoint", config.walAutoCheckpoint, doc.GetAllocator());
+        doc.AddMember("checkpointInterval", config.checkpointInterval, doc.GetAllocator());
+
+        rapidjson::Value storageEngine_;
+        storageEngine_.SetString(config.storageEngine.c_str(), doc.GetAllocator());
+        doc.AddMember("storageEngine", storageEngine_, doc.GetAllocator());
+
+        rapidjson::Value retention(rapidjson::kObjectType);
+        for (const auto& [name, retentionConfig] : config.retention) {
+            rapidjson::Value obj(rapidjson::kObjectType);
+            obj.AddMember("raw", retentionConfig.raw, doc.GetAllocator());
+            obj.AddMember("minute", retentionConfig.minute, doc.GetAllocator());
+            obj.AddMember("hour", retentionConfig.hour, doc.GetAllocator());
+            obj.AddMember("day", retentionConfig.day, doc.GetAllocator());
+
+            rapidjson::Value name_;
+            name_.SetString(name.c_str(), doc.GetAllocator());
+            retention.AddMember(name_, obj, doc.GetAllocator());
+        }
+        doc.AddMember("retention", retention, doc.GetAllocator());
+        doc.AddMember("rollupInterval", config.rollupInterval, doc.GetAllocator());
+        doc.AddMember("retentionBatchSize", config.retentionBatchSize, doc.GetAllocator());
+
+        rapidjson::Value observer(rapidjson::kObjectType);
+        observer.AddMember("enabled", config.observer.enabled, doc.GetAllocator());
+        rapidjson::Value collectorCores(rapidjson::kArrayType);
+        for (const auto core : config.observer.collectorCores) {
+            collectorCores.PushBack(core, doc.GetAllocator());
+        }
+        observer.AddMember("collectorCores", collectorCores, doc.GetAllocator());
+        rapidjson::Value storageCores(rapidjson::kArrayType);
+        for (const auto core : config.observer.storageCores) {
+            storageCores.PushBack(core, doc.GetAllocator());
+        }
+        observer.AddMember("storageCores", storageCores, doc.GetAllocator());
+        doc.AddMember("observer", observer, doc.GetAllocator());
+
+        rapidjson::Value scriptBudgets(rapidjson::kObjectType);
+        for (const auto& [name, budgetConfig] : config.scriptBudgets) {
+            rapidjson::Value obj(rapidjson::kObjectType);
+            obj.AddMember("cpuTime", budgetConfig.cpuTime, doc.GetAllocator());
+            obj.AddMember("memory", budgetConfig.memory, doc.GetAllocator());
+
+            rapidjson::Value name_;
+            name_.SetString(name.c_str(), doc.GetAllocator());
+            scriptBudgets.AddMember(name_, obj, doc.GetAllocator());
+        }
+        doc.AddMember("scriptBudgets", scriptBudgets, doc.GetAllocator());
 
         // Serialize the Document to a JSON string
         rapidjson::StringBuffer buffer;
@@ -84,6 +297,9 @@ public:
         if (document.HasMember("poolSize") && document["poolSize"].IsUint()) {
             config.poolSize = document["poolSize"].GetInt();
         }
+        if (document.HasMember("maxPoolSize") && document["maxPoolSize"].IsUint()) {
+            config.maxPoolSize = document["maxPoolSize"].GetInt();
+        }
         if (document.HasMember("port") && document["port"].IsUint()) {
             config.port = document["port"].GetUint();
         }
@@ -93,6 +309,134 @@ public:
         if (document.HasMember("predictionInterval") && document["predictionInterval"].IsUint()) {
             config.predictionInterval = document["predictionInterval"].GetUint();
         }
+        if (document.HasMember("schedulerResolution") && document["schedulerResolution"].IsUint()) {
+            config.schedulerResolution = document["schedulerResolution"].GetUint();
+        }
+        if (document.HasMember("burstInterval") && document["burstInterval"].IsUint()) {
+            config.burstInterval = document["burstInterval"].GetUint();
+        }
+        if (document.HasMember("burstDownsampleInterval") && document["burstDownsampleInterval"].IsUint()) {
+            config.burstDownsampleInterval = document["burstDownsampleInterval"].GetUint();
+        }
+        if (document.HasMember("burstBufferSize") && document["burstBufferSize"].IsUint()) {
+            config.burstBufferSize = document["burstBufferSize"].GetUint();
+        }
+        if (document.HasMember("burstDuration") && document["burstDuration"].IsUint()) {
+            config.burstDuration = document["burstDuration"].GetUint();
+        }
+        if (document.HasMember("hotTierSize") && document["hotTierSize"].IsUint()) {
+            config.hotTierSize = document["hotTierSize"].GetUint();
+        }
+        if (document.HasMember("storageQueueSize") && document["storageQueueSize"].IsUint()) {
+            config.storageQueueSize = document["storageQueueSize"].GetUint();
+        }
+        if (document.HasMember("storageOverflowPolicy") && document["storageOverflowPolicy"].IsString()) {
+            config.storageOverflowPolicy = document["storageOverflowPolicy"].GetString();
+        }
+        if (document.HasMember("storageCommitDelay") && document["storageCommitDelay"].IsUint()) {
+            config.storageCommitDelay = document["storageCommitDelay"].GetUint();
+        }
+        if (document.HasMember("databaseReaders") && document["databaseReaders"].IsUint()) {
+            config.databaseReaders = document["databaseReaders"].GetUint();
+        }
+        if (document.HasMember("databaseSynchronous") && document["databaseSynchronous"].IsString()) {
+            config.databaseSynchronous = document["databaseSynchronous"].GetString();
+        }
+        if (document.HasMember("databaseCacheSize") && document["databaseCacheSize"].IsInt()) {
+            config.databaseCacheSize = document["databaseCacheSize"].GetInt();
+        }
+        if (document.HasMember("databaseMmapSize") && document["databaseMmapSize"].IsInt64()) {
+            config.databaseMmapSize = document["databaseMmapSize"].GetInt64();
+        }
+        if (document.HasMember("walAutoCheckpoint") && document["walAutoCheckpoint"].IsUint()) {
+            config.walAutoCheckpoint = document["walAutoCheckpoint"].GetUint();
+        }
+        if (document.HasMember("checkpointInterval") && document["checkpointInterval"].IsUint()) {
+            config.checkpointInterval = document["checkpointInterval"].GetUint();
+        }
+        if (document.HasMember("storageEngine") && document["storageEngine"].IsString()) {
+            config.storageEngine = document["storageEngine"].GetString();
+        }
+        if (document.HasMember("sampling") && document["sampling"].IsObject()) {
+            for (const auto& member : document["sampling"].GetObject()) {
+                if (!member.value.IsObject()) {
+                    continue;
+                }
+
+                SamplingConfig samplingConfig;
+                if (member.value.HasMember("interval") && member.value["interval"].IsUint()) {
+                    samplingConfig.interval = member.value["interval"].GetUint();
+                }
+                if (member.value.HasMember("phase") && member.value["phase"].IsUint()) {
+                    samplingConfig.phase = member.value["phase"].GetUint();
+                }
+                config.sampling[member.name.GetString()] = samplingConfig;
+            }
+        }
+        if (document.HasMember("retention") && document["retention"].IsObject()) {
+            for (const auto& member : document["retention"].GetObject()) {
+                if (!member.value.IsObject()) {
+                    continue;
+                }
+
+                RetentionConfig retentionConfig;
+                if (member.value.HasMember("raw") && member.value["raw"].IsUint()) {
+                    retentionConfig.raw = member.value["raw"].GetUint();
+                }
+                if (member.value.HasMember("minute") && member.value["minute"].IsUint()) {
+                    retentionConfig.minute = member.value["minute"].GetUint();
+                }
+                if (member.value.HasMember("hour") && member.value["hour"].IsUint()) {
+                    retentionConfig.hour = member.value["hour"].GetUint();
+                }
+                if (member.value.HasMember("day") && member.value["day"].IsUint()) {
+                    retentionConfig.day = member.value["day"].GetUint();
+                }
+                config.retention[member.name.GetString()] = retentionConfig;
+            }
+        }
+        if (document.HasMember("rollupInterval") && document["rollupInterval"].IsUint()) {
+            config.rollupInterval = document["rollupInterval"].GetUint();
+        }
+        if (document.HasMember("retentionBatchSize") && document["retentionBatchSize"].IsUint()) {
+            config.retentionBatchSize = document["retentionBatchSize"].GetUint();
+        }
+        if (document.HasMember("scriptBudgets") && document["scriptBudgets"].IsObject()) {
+            for (const auto& member : document["scriptBudgets"].GetObject()) {
+                if (!member.value.IsObject()) {
+                    continue;
+                }
+
+                ScriptBudgetConfig budgetConfig;
+                if (member.value.HasMember("cpuTime") && member.value["cpuTime"].IsUint()) {
+                    budgetConfig.cpuTime = member.value["cpuTime"].GetUint();
+                }
+                if (member.value.HasMember("memory") && member.value["memory"].IsUint64()) {
+                    budgetConfig.memory = member.value["memory"].GetUint64();
+                }
+                config.scriptBudgets[member.name.GetString()] = budgetConfig;
+            }
+        }
+        if (document.HasMember("observer") && document["observer"].IsObject()) {
+            const auto& observer = document["observer"];
+            if (observer.HasMember("enabled") && observer["enabled"].IsBool()) {
+                config.observer.enabled = observer["enabled"].GetBool();
+            }
+            if (observer.HasMember("collectorCores") && observer["collectorCores"].IsArray()) {
+                for (const auto& core : observer["collectorCores"].GetArray()) {
+                    if (core.IsUint()) {
+                        config.observer.collectorCores.push_back(core.GetUint());
+                    }
+                }
+            }
+            if (observer.HasMember("storageCores") && observer["storageCores"].IsArray()) {
+                for (const auto& core : observer["storageCores"].GetArray()) {
+                    if (core.IsUint()) {
+                        config.observer.storageCores.push_back(core.GetUint());
+                    }
+                }
+            }
+        }
 
         return config;
     }
@@ -0,0 +1 @@
+#include "CounterRegistry.h"
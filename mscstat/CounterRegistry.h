@@ -0,0 +1,81 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "CounterSource.h"
+
+// Values of every registered counter, read in a single collection pass.
+// All providers and scripts that run within the same tick read from the
+// same sample, so their values were taken at the same instant.
+struct CounterSample {
+    // Tick this sample was collected for.
+    uint64_t counter = 0;
+    std::chrono::system_clock::time_point timestamp;
+    // `false` if the collection failed. Values will all be 0.
+    bool isValid = false;
+    std::vector<double> values;
+
+    double GetValue(CounterHandle handle) const {
+        return handle < values.size() ? values[handle] : 0.0;
+    }
+};
+
+// Registry of every counter used by the application. Counters are added to a
+// single counter source which is collected once per tick by MetricsManager.
+class CounterRegistry {
+public:
+    CounterRegistry() : source(CounterSource::Create()) {}
+
+    CounterRegistry(const CounterRegistry&) = delete;
+    CounterRegistry& operator=(const CounterRegistry&) = delete;
+
+    CounterHandle AddCounter(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto handle = source->AddCounter(path);
+        if (handle >= counterCount) {
+            counterCount = handle + 1;
+        }
+
+        return handle;
+    }
+
+    void RemoveCounter(CounterHandle handle) {
+        std::lock_guard<std::mutex> lock(mutex);
+        source->RemoveCounter(handle);
+    }
+
+    // Collects without creating a sample. This is used to prime rate counters
+    // before the first tick.
+    void Prime() {
+        std::lock_guard<std::mutex> lock(mutex);
+        source->Collect();
+    }
+
+    // Collects every registered counter and returns a snapshot of their values.
+    std::shared_ptr<const CounterSample> Collect(uint64_t counter) {
+        auto sample = std::make_shared<CounterSample>();
+        sample->counter = counter;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        sample->timestamp = std::chrono::system_clock::now();
+        sample->isValid = source->Collect();
+        sample->values.resize(counterCount, 0.0);
+
+        if (sample->isValid) {
+            for (CounterHandle handle = 0; handle < counterCount; handle++) {
+                sample->values[handle] = source->GetValue(handle);
+            }
+        }
+
+        return sample;
+    }
+
+private:
+    std::mutex mutex;
+    std::unique_ptr<CounterSource> source;
+    size_t counterCount = 0;
+};
@@ -0,0 +1,13 @@
+#include "CounterSource.h"
+#include "LinuxCounterSource.h"
+#include "PdhCounterSource.h"
+
+std::unique_ptr<CounterSource> CounterSource::Create() {
+#ifdef _WIN32
+    return std::make_unique<PdhCounterSource>();
+#elif defined(__linux__)
+    return std::make_unique<LinuxCounterSource>();
+#else
+#error "No counter source is available for this platform."
+#endif
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <memory>
+#include <string>
+
+// Identifies a counter that has been added to a `CounterSource`.
+typedef size_t CounterHandle;
+
+// A counter source reads performance counters from the operating system.
+// Counters are identified by their PDH path (e.g. `\Processor(_Total)\% Processor Time`)
+// on every platform, so metric providers do not need to know which backend
+// is reading their values.
+class CounterSource {
+public:
+    virtual ~CounterSource() {}
+
+    // Adds the counter at `path` to this source. The returned handle is used to
+    // read the counter value after each call to `Collect`.
+    virtual CounterHandle AddCounter(const std::string& path) = 0;
+
+    // Removes a counter from this source. Handles are never reused, hence the
+    // handle will read 0 from then on.
+    virtual void RemoveCounter(CounterHandle handle) = 0;
+
+    // Samples every counter added to this source. Rate counters (e.g. `/sec`)
+    // are computed from the difference between two consecutive calls, hence
+    // the first call only primes them.
+    virtual bool Collect() = 0;
+
+    // Returns the value of the counter as of the last call to `Collect`.
+    // Counters that are not supported or have no valid data return 0.
+    virtual double GetValue(CounterHandle handle) const = 0;
+
+    // Creates the counter source for the platform this application was built for.
+    static std::unique_ptr<CounterSource> Create();
+};
@@ -1,16 +1,199 @@
 #include "DataManager.h"
 #include "Application.h"
+#include "ColumnarStore.h"
+#include "OverheadMonitor.h"
+#include "Schema.h"
+#include "SqliteSampleStore.h"
 
-DataManager::DataManager(const std::string& dbFileName) : dbFileName_(dbFileName), db_(nullptr) {
-    int result = sqlite3_open(dbFileName.c_str(), &db_);
+DataManager::DataManager(const std::string& dbFileName) : dbFileName_(dbFileName), sampleStore_(std::make_unique<SqliteSampleStore>()) {
+    writer_ = Open(SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+    if (!writer_) {
+        return;
+    }
+
+    // WAL lets readers query the last committed data while the storage writer commits.
+    // The journal mode is stored in the database file, so read-only connections use it too.
+    writer_->Execute("PRAGMA journal_mode=WAL;");
+    ApplyPragmas(*writer_);
+}
+
+std::unique_ptr<Connection> DataManager::Open(int flags) {
+    sqlite3* db = nullptr;
+    int result = sqlite3_open_v2(dbFileName_.c_str(), &db, flags, nullptr);
+    if (result != SQLITE_OK) {
+        Application::theApp->logManager->LogError("Failed to open database: {0}", sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return nullptr;
+    }
+
+    // Readers and the checkpointer may briefly wait on the writer's locks.
+    sqlite3_busy_timeout(db, 5000);
+
+    return std::make_unique<Connection>(db);
+}
+
+void DataManager::ApplyPragmas(Connection& connection) {
+    connection.Execute("PRAGMA cache_size=" + std::to_string(options_.cacheSize) + ";");
+    connection.Execute("PRAGMA mmap_size=" + std::to_string(options_.mmapSize) + ";");
+}
+
+void DataManager::Configure(const DatabaseOptions& options) {
+    if (!IsOpen()) {
+        return;
+    }
+
+    options_ = options;
+
+    ApplyPragmas(*writer_);
+    writer_->Execute("PRAGMA synchronous=" + options_.synchronous + ";");
+
+    const auto pageSize = Prepare("PRAGMA page_size;").Query();
+    if (!pageSize.empty()) {
+        pageSize_ = pageSize.front().GetInt64("page_size");
+    }
+    writer_->Execute("PRAGMA wal_autocheckpoint=" + std::to_string(options_.walAutoCheckpoint) + ";");
+
+    readers_.clear();
+    for (int i = 0; i < options_.readers; i++) {
+        auto reader = Open(SQLITE_OPEN_READONLY);
+        if (!reader) {
+            break;
+        }
+
+        ApplyPragmas(*reader);
+        readers_.emplace_back(std::move(reader));
+    }
+
+    checkpointer_ = Open(SQLITE_OPEN_READWRITE);
+
+    // Samples already stored by another engine are not moved. Their rollups stay, so
+    // aggregates and long ranges still cover them.
+    if (options_.storageEngine == "columnar") {
+        sampleStore_ = std::make_unique<ColumnarStore>(Utils::GetAppDataPath() + "/columnar");
+    }
+    else if (options_.storageEngine != "sqlite") {
+        Application::theApp->logManager->LogWarning("Unknown storage engine: {0}. Samples are stored in SQLite.", options_.storageEngine);
+    }
+
+    Application::theApp->logManager->LogInfo("Database opened in WAL mode with {0} readers. Samples are stored by the {1} engine.", readers_.size(), sampleStore_->GetName());
+}
+
+bool DataManager::Migrate() {
+    if (!IsOpen()) {
+        return false;
+    }
+
+    // Take the write lock up front, so nothing else can change the schema in between.
+    if (!ExecuteSQLStatement("BEGIN IMMEDIATE;")) {
+        return false;
+    }
+
+    const auto rows = Prepare("PRAGMA user_version;").Query();
+    const int current = rows.empty() ? 0 : rows.front().GetInt("user_version");
+    int version = current;
+
+    for (const auto& migration : Schema::GetMigrations()) {
+        if (migration.version <= version) {
+            continue;
+        }
+
+        Application::theApp->logManager->LogInfo("Applying schema migration {0}: {1}", migration.version, migration.description);
+        for (const auto& statement : migration.statements) {
+            if (!ExecuteSQLStatement(statement)) {
+                Application::theApp->logManager->LogError("Schema migration {0} failed. The database is left at version {1}.", migration.version, current);
+                ExecuteSQLStatement("ROLLBACK;");
+                return false;
+            }
+        }
+        version = migration.version;
+    }
+
+    if (version == current) {
+        ExecuteSQLStatement("ROLLBACK;");
+        return true;
+    }
+
+    // PRAGMA does not take parameters, but the version is one of our own numbers.
+    if (!ExecuteSQLStatement("PRAGMA user_version=" + std::to_string(version) + ";") || !ExecuteSQLStatement("COMMIT;")) {
+        ExecuteSQLStatement("ROLLBACK;");
+        return false;
+    }
+
+    Application::theApp->logManager->LogInfo("Database schema upgraded from version {0} to {1}.", current, version);
+    return true;
+}
+
+PreparedStatement DataManager::PrepareRead(const std::string& sql, bool isCached) {
+    if (readers_.empty()) {
+        if (!IsOpen()) {
+            return PreparedStatement(nullptr, false, std::unique_lock<std::mutex>());
+        }
+
+        return writer_->Prepare(sql, writer_->Lock(), isCached);
+    }
+
+    // Take the first idle reader, starting from a different one on each call. If all
+    // of them are busy, wait for the first one tried.
+    const auto start = nextReader_++;
+    for (size_t i = 0; i < readers_.size(); i++) {
+        auto& reader = *readers_[(start + i) % readers_.size()];
+        if (auto lock = reader.TryLock(); lock.owns_lock()) {
+            return reader.Prepare(sql, std::move(lock), isCached);
+        }
+    }
+
+    auto& reader = *readers_[start % readers_.size()];
+    return reader.Prepare(sql, reader.Lock(), isCached);
+}
+
+bool DataManager::Checkpoint() {
+    if (!checkpointer_) {
+        return false;
+    }
+
+    auto lock = checkpointer_->Lock();
+
+    // Passive checkpoints copy whatever frames no reader still needs, and never wait.
+    int walFrames = 0;
+    int checkpointedFrames = 0;
+    int result = sqlite3_wal_checkpoint_v2(checkpointer_->GetHandle(), nullptr, SQLITE_CHECKPOINT_PASSIVE, &walFrames, &checkpointedFrames);
     if (result != SQLITE_OK) {
-        Application::theApp->logManager->LogError("Failed to open database: {0}", sqlite3_errmsg(db_));
-        db_ = nullptr; // Set to nullptr to indicate failure
+        Application::theApp->logManager->LogError("Checkpoint failed: {0}", sqlite3_errmsg(checkpointer_->GetHandle()));
+        return false;
     }
+
+    Application::theApp->logManager->LogDebug("Checkpointed {0} of {1} WAL frames.", checkpointedFrames, walFrames);
+
+    const auto copiedFrames = checkpointedFrames >= checkpointedFrames_ ? checkpointedFrames - checkpointedFrames_ : checkpointedFrames;
+    checkpointedFrames_ = checkpointedFrames;
+    OverheadMonitor::GetInstance().AddWrittenBytes(Subsystem::DATABASE_SUBSYSTEM, static_cast<uint64_t>(copiedFrames) * pageSize_);
+    return true;
 }
 
-bool DataManager::ExecuteSQLStatement(const std::string& sql) {
+void DataManager::RecordWrittenBytes() {
     if (!IsOpen()) {
+        return;
+    }
+
+    int writtenPages = 0;
+    int highwater = 0;
+    {
+        auto lock = writer_->Lock();
+        // The count is reset, so the next call only sees the pages written after this one.
+        if (sqlite3_db_status(writer_->GetHandle(), SQLITE_DBSTATUS_CACHE_WRITE, &writtenPages, &highwater, 1) != SQLITE_OK) {
+            return;
+        }
+    }
+
+    OverheadMonitor::GetInstance().AddWrittenBytes(Subsystem::DATABASE_SUBSYSTEM, static_cast<uint64_t>(writtenPages) * pageSize_);
+}
+
+bool Connection::Execute(const std::string& sql) {
+    return Execute(sql, Lock());
+}
+
+bool Connection::Execute(const std::string& sql, const std::unique_lock<std::mutex>& lock) {
+    if (!IsLockedBy(lock)) {
         return false;
     }
 
@@ -26,28 +209,192 @@ bool DataManager::ExecuteSQLStatement(const std::string& sql) {
     return true;
 }
 
-
-std::vector<Row> DataManager::ExecuteSelect(const std::string& sql) {
-    std::vector<Row> resultData;
-
-    if (!IsOpen()) {
-        return resultData;
+PreparedStatement Connection::Prepare(const std::string& sql, std::unique_lock<std::mutex> lock, bool isCached) {
+    if (isCached) {
+        if (const auto it = statements_.find(sql); it != statements_.end()) {
+            return PreparedStatement(it->second, true, std::move(lock));
+        }
     }
 
-    sqlite3_stmt* stmt;
-    int result = sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr);
+    sqlite3_stmt* stmt = nullptr;
+    int result = sqlite3_prepare_v3(db_, sql.c_str(), -1, isCached ? SQLITE_PREPARE_PERSISTENT : 0, &stmt, nullptr);
 
     if (result != SQLITE_OK) {
         Application::theApp->logManager->LogError("SQL error: {0}. SQL: {1}", sqlite3_errmsg(db_), sql);
-        return resultData;
+        sqlite3_finalize(stmt);
+        return PreparedStatement(nullptr, false, std::move(lock));
+    }
+
+    isCached = isCached && statements_.size() < MAX_CACHED_STATEMENTS;
+    if (isCached) {
+        statements_.emplace(sql, stmt);
+    }
+
+    return PreparedStatement(stmt, isCached, std::move(lock));
+}
+
+bool PreparedStatement::Execute() {
+    if (stmt_ == nullptr) {
+        return false;
+    }
+
+    int result = sqlite3_step(stmt_);
+    if (result != SQLITE_DONE && result != SQLITE_ROW) {
+        Application::theApp->logManager->LogError("SQL error: {0}. SQL: {1}", sqlite3_errmsg(sqlite3_db_handle(stmt_)), sqlite3_sql(stmt_));
+    }
+    sqlite3_reset(stmt_);
+    index_ = 1;
+
+    return result == SQLITE_DONE || result == SQLITE_ROW;
+}
+
+ResultSet PreparedStatement::Query() {
+    if (stmt_ == nullptr) {
+        return ResultSet();
+    }
+
+    ResultSet resultSet(stmt_);
+    ExecuteSelect([&](const Cursor& cursor) {
+        resultSet.Append(cursor);
+        });
+
+    return resultSet;
+}
+
+bool PreparedStatement::ExecuteSelect(const std::function<void(const Cursor&)>& visitor) {
+    if (stmt_ == nullptr) {
+        return false;
+    }
+
+    const Cursor cursor(stmt_);
+    int result;
+    while ((result = sqlite3_step(stmt_)) == SQLITE_ROW) {
+        visitor(cursor);
+    }
+
+    const bool isSuccessful = result == SQLITE_DONE;
+    if (!isSuccessful) {
+        Application::theApp->logManager->LogError("SQL error: {0}. SQL: {1}", sqlite3_errmsg(sqlite3_db_handle(stmt_)), sqlite3_sql(stmt_));
+    }
+    sqlite3_reset(stmt_);
+    index_ = 1;
+
+    return isSuccessful;
+}
+
+ResultSet::ResultSet(sqlite3_stmt* stmt) {
+    const int count = sqlite3_column_count(stmt);
+    columns_.resize(count);
+
+    for (int i = 0; i < count; i++) {
+        columns_[i].name = sqlite3_column_name(stmt, i);
+
+        // Follows the SQLite rules for column affinity.
+        const char* declared = sqlite3_column_decltype(stmt, i);
+        if (declared == nullptr) {
+            continue;
+        }
+
+        std::string type(declared);
+        std::transform(type.begin(), type.end(), type.begin(), [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+        if (type.find("INT") != std::string::npos) {
+            columns_[i].type = ColumnType::Integer;
+        }
+        else if (type.find("CHAR") != std::string::npos || type.find("CLOB") != std::string::npos || type.find("TEXT") != std::string::npos) {
+            columns_[i].type = ColumnType::Text;
+        }
+        else if (type.find("REAL") != std::string::npos || type.find("FLOA") != std::string::npos || type.find("DOUB") != std::string::npos) {
+            columns_[i].type = ColumnType::Real;
+        }
     }
+}
+
+void ResultSet::Append(const Cursor& cursor) {
+    for (size_t i = 0; i < columns_.size(); i++) {
+        auto& column = columns_[i];
+        const int index = static_cast<int>(i);
+        const int valueType = cursor.GetType(index);
 
-    // Execute the SELECT statement
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        auto columnValue2 = sqlite3_column_text(stmt, 2);
+        if (column.type == ColumnType::Unknown && valueType != SQLITE_NULL) {
+            column.type = valueType == SQLITE_INTEGER ? ColumnType::Integer : valueType == SQLITE_FLOAT ? ColumnType::Real : ColumnType::Text;
+            // Earlier rows of this column were all NULL.
+            column.integers.resize(column.type == ColumnType::Integer ? rowCount_ : 0);
+            column.reals.resize(column.type == ColumnType::Real ? rowCount_ : 0);
+            column.texts.resize(column.type == ColumnType::Text ? rowCount_ : 0);
+        }
 
-        resultData.emplace_back(stmt);
+        column.isNull.push_back(valueType == SQLITE_NULL);
+        switch (column.type) {
+        case ColumnType::Integer:
+            column.integers.push_back(cursor.GetInt64(index));
+            break;
+
+        case ColumnType::Real:
+            column.reals.push_back(cursor.GetDouble(index));
+            break;
+
+        case ColumnType::Text:
+            column.texts.push_back(valueType == SQLITE_NULL ? std::string() : cursor.GetString(index));
+            break;
+
+        default:
+            break;
+        }
     }
 
-    return resultData;
-}
\ No newline at end of file
+    rowCount_++;
+}
+
+int64_t ResultSet::GetInt64(size_t row, int column) const {
+    const auto* values = GetColumn(row, column);
+    if (values == nullptr) {
+        return 0;
+    }
+
+    switch (values->type) {
+    case ColumnType::Integer:
+        return values->integers[row];
+    case ColumnType::Real:
+        return static_cast<int64_t>(values->reals[row]);
+    case ColumnType::Text:
+        return std::strtoll(values->texts[row].c_str(), nullptr, 10);
+    default:
+        return 0;
+    }
+}
+
+double ResultSet::GetDouble(size_t row, int column) const {
+    const auto* values = GetColumn(row, column);
+    if (values == nullptr) {
+        return 0;
+    }
+
+    switch (values->type) {
+    case ColumnType::Integer:
+        return static_cast<double>(values->integers[row]);
+    case ColumnType::Real:
+        return values->reals[row];
+    case ColumnType::Text:
+        return std::strtod(values->texts[row].c_str(), nullptr);
+    default:
+        return 0;
+    }
+}
+
+std::string ResultSet::GetString(size_t row, int column) const {
+    const auto* values = GetColumn(row, column);
+    if (values == nullptr) {
+        return std::string();
+    }
+
+    switch (values->type) {
+    case ColumnType::Integer:
+        return std::to_string(values->integers[row]);
+    case ColumnType::Real:
+        return std::to_string(values->reals[row]);
+    case ColumnType::Text:
+        return values->texts[row];
+    default:
+        return std::string();
+    }
+}
@@ -1,71 +1,444 @@
 #pragma once
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iterator>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <sqlite3.h>
-#include <variant>
+#include <unordered_map>
 #include <vector>
 
+#include "SampleStore.h"
 #include "Utils.h"
 
+class ResultSet;
+class Cursor;
+
+// A row of a `ResultSet`, read by column name or by the index returned by
+// `ResultSet::GetColumnIndex`. Reading by index skips the name lookup, which matters
+// in loops over many rows. Missing columns and NULL values read as 0 or an empty string.
 class Row {
+public:
+    Row(const ResultSet* resultSet, size_t index) : resultSet_(resultSet), index_(index) {}
+
+    int GetInt(int column) const {
+        return static_cast<int>(GetInt64(column));
+    }
+
+    int64_t GetInt64(int column) const;
+
+    double GetDouble(int column) const;
+
+    std::string GetString(int column) const;
+
+    int GetInt(const std::string& columnName) const;
+
+    int64_t GetInt64(const std::string& columnName) const;
+
+    double GetDouble(const std::string& columnName) const;
+
+    std::string GetString(const std::string& columnName) const;
+
+private:
+    friend class ResultSet;
+
+    const ResultSet* resultSet_;
+    size_t index_;
+};
+
+// Rows returned by `PreparedStatement::Query`. Column names are kept once, and the values
+// of each column in a vector of its type, so rows cost no allocation beyond their text.
+class ResultSet {
+public:
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Row;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Row*;
+        using reference = const Row&;
+
+        Iterator(const ResultSet* resultSet, size_t index) : row_(resultSet, index) {}
+
+        const Row& operator*() const {
+            return row_;
+        }
+
+        const Row* operator->() const {
+            return &row_;
+        }
+
+        Iterator& operator++() {
+            row_.index_++;
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator previous = *this;
+            row_.index_++;
+            return previous;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return row_.index_ == other.row_.index_;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return row_.index_ != other.row_.index_;
+        }
+
+    private:
+        Row row_;
+    };
+
+    ResultSet() = default;
+
+    // Takes the column names and types of a prepared statement.
+    explicit ResultSet(sqlite3_stmt* stmt);
+
+    // Adds the current row of a statement.
+    void Append(const Cursor& cursor);
+
+    // Returns the index of `columnName`, or -1 if there is no such column.
+    int GetColumnIndex(const std::string& columnName) const {
+        for (size_t i = 0; i < columns_.size(); i++) {
+            if (columns_[i].name == columnName) {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    size_t GetColumnCount() const {
+        return columns_.size();
+    }
+
+    size_t size() const {
+        return rowCount_;
+    }
+
+    bool empty() const {
+        return rowCount_ == 0;
+    }
+
+    Row front() const {
+        return Row(this, 0);
+    }
+
+    Row operator[](size_t index) const {
+        return Row(this, index);
+    }
+
+    Iterator begin() const {
+        return Iterator(this, 0);
+    }
+
+    Iterator end() const {
+        return Iterator(this, rowCount_);
+    }
+
+    int64_t GetInt64(size_t row, int column) const;
+
+    double GetDouble(size_t row, int column) const;
+
+    std::string GetString(size_t row, int column) const;
+
+private:
+    enum class ColumnType { Unknown, Integer, Real, Text };
+
+    // Only the vector of `type` holds values. Columns without a declared type, such as
+    // expressions, take the type of their first value that is not NULL.
+    struct Column {
+        std::string name;
+        ColumnType type = ColumnType::Unknown;
+        std::vector<int64_t> integers;
+        std::vector<double> reals;
+        std::vector<std::string> texts;
+        std::vector<bool> isNull;
+    };
+
+    const Column* GetColumn(size_t row, int column) const {
+        if (column < 0 || static_cast<size_t>(column) >= columns_.size() || row >= rowCount_ || columns_[column].isNull[row]) {
+            return nullptr;
+        }
+        return &columns_[column];
+    }
+
+    std::vector<Column> columns_;
+    size_t rowCount_ = 0;
+};
+
+inline int64_t Row::GetInt64(int column) const {
+    return resultSet_->GetInt64(index_, column);
+}
+
+inline double Row::GetDouble(int column) const {
+    return resultSet_->GetDouble(index_, column);
+}
+
+inline std::string Row::GetString(int column) const {
+    return resultSet_->GetString(index_, column);
+}
+
+inline int Row::GetInt(const std::string& columnName) const {
+    return GetInt(resultSet_->GetColumnIndex(columnName));
+}
+
+inline int64_t Row::GetInt64(const std::string& columnName) const {
+    return GetInt64(resultSet_->GetColumnIndex(columnName));
+}
+
+inline double Row::GetDouble(const std::string& columnName) const {
+    return GetDouble(resultSet_->GetColumnIndex(columnName));
+}
+
+inline std::string Row::GetString(const std::string& columnName) const {
+    return GetString(resultSet_->GetColumnIndex(columnName));
+}
+
+// The current row of a statement run with `PreparedStatement::ExecuteSelect`. Values are
+// read straight from SQLite by column index, and are only valid until the visitor returns.
+class Cursor {
+public:
+    explicit Cursor(sqlite3_stmt* stmt) : stmt_(stmt) {}
+
+    int GetColumnCount() const {
+        return sqlite3_column_count(stmt_);
+    }
+
+    bool IsNull(int column) const {
+        return column < 0 || sqlite3_column_type(stmt_, column) == SQLITE_NULL;
+    }
+
+    int GetType(int column) const {
+        return column < 0 ? SQLITE_NULL : sqlite3_column_type(stmt_, column);
+    }
+
+    int GetInt(int column) const {
+        return column < 0 ? 0 : sqlite3_column_int(stmt_, column);
+    }
+
+    int64_t GetInt64(int column) const {
+        return column < 0 ? 0 : sqlite3_column_int64(stmt_, column);
+    }
+
+    double GetDouble(int column) const {
+        return column < 0 ? 0 : sqlite3_column_double(stmt_, column);
+    }
+
+    std::string GetString(int column) const {
+        const char* text = column < 0 ? nullptr : reinterpret_cast<const char*>(sqlite3_column_text(stmt_, column));
+        return text ? std::string(text, sqlite3_column_bytes(stmt_, column)) : std::string();
+    }
+
+    std::vector<uint8_t> GetBlob(int column) const {
+        const auto* data = column < 0 ? nullptr : static_cast<const uint8_t*>(sqlite3_column_blob(stmt_, column));
+        return data ? std::vector<uint8_t>(data, data + sqlite3_column_bytes(stmt_, column)) : std::vector<uint8_t>();
+    }
+
 private:
-    std::map <std::string, std::variant<int, double, std::string, std::vector<unsigned char>>> data_;
+    sqlite3_stmt* stmt_;
+};
 
+// A prepared statement handed out by `DataManager::Prepare`. Parameters are bound
+// in order with the typed `Bind` functions, then the statement is run with `Execute`,
+// `Query` or `ExecuteSelect`. Cached statements are reset when this object is destroyed
+// so they can be reused.
+//
+// The DataManager statement lock is held for as long as this object lives, hence it
+// should not be kept longer than it takes to read its rows.
+class PreparedStatement {
 public:
-    Row(sqlite3_stmt* stmt) {
-        int numColumns = sqlite3_column_count(stmt);
-        for (int i = 0; i < numColumns; i++) {
-            const char* columnName = sqlite3_column_name(stmt, i);
-            int columnType = sqlite3_column_type(stmt, i);
-
-            switch (columnType) {
-            case SQLITE_INTEGER:
-                data_[columnName] = sqlite3_column_int(stmt, i);
-                break;
-
-            case SQLITE_FLOAT:
-                data_[columnName] = sqlite3_column_double(stmt, i);
-                break;
-
-            default:
-                const char* columnValue = reinterpret_cast<const char*>(sqlite3_column_text(stmt, i));
-                if (columnValue) {
-                    data_[columnName] = std::string(columnValue);
-                }
-                break;
+    PreparedStatement(sqlite3_stmt* stmt, bool isCached, std::unique_lock<std::mutex> lock)
+        : stmt_(stmt), isCached_(isCached), lock_(std::move(lock)) {}
+
+    PreparedStatement(PreparedStatement&& other) noexcept
+        : stmt_(other.stmt_), isCached_(other.isCached_), index_(other.index_), lock_(std::move(other.lock_)) {
+        other.stmt_ = nullptr;
+    }
+
+    PreparedStatement(const PreparedStatement&) = delete;
+    PreparedStatement& operator=(const PreparedStatement&) = delete;
+
+    ~PreparedStatement() {
+        if (stmt_ == nullptr) {
+            return;
+        }
+
+        if (isCached_) {
+            sqlite3_reset(stmt_);
+            sqlite3_clear_bindings(stmt_);
+        }
+        else {
+            sqlite3_finalize(stmt_);
+        }
+    }
+
+    // `false` if the statement failed to prepare. Binding and running an invalid
+    // statement does nothing.
+    bool IsValid() const {
+        return stmt_ != nullptr;
+    }
+
+    PreparedStatement& BindNull() {
+        if (stmt_) {
+            sqlite3_bind_null(stmt_, index_);
+        }
+        index_++;
+        return *this;
+    }
+
+    PreparedStatement& BindInt64(int64_t value) {
+        if (stmt_) {
+            sqlite3_bind_int64(stmt_, index_, value);
+        }
+        index_++;
+        return *this;
+    }
+
+    PreparedStatement& BindDouble(double value) {
+        if (stmt_) {
+            sqlite3_bind_double(stmt_, index_, value);
+        }
+        index_++;
+        return *this;
+    }
+
+    PreparedStatement& BindText(const std::string& value) {
+        if (stmt_) {
+            sqlite3_bind_text(stmt_, index_, value.c_str(), static_cast<int>(value.size()), SQLITE_TRANSIENT);
+        }
+        index_++;
+        return *this;
+    }
+
+    PreparedStatement& BindBlob(const std::vector<uint8_t>& value) {
+        if (stmt_) {
+            sqlite3_bind_blob(stmt_, index_, value.data(), static_cast<int>(value.size()), SQLITE_TRANSIENT);
+        }
+        index_++;
+        return *this;
+    }
+
+    // Runs a statement that does not return rows.
+    bool Execute();
+
+    // Returns the index of `columnName` in the rows of this statement, or -1 if there is
+    // no such column. This can be called before the statement is run, so loops over rows
+    // can read values by index.
+    int GetColumnIndex(const std::string& columnName) const {
+        if (stmt_ == nullptr) {
+            return -1;
+        }
+
+        const int count = sqlite3_column_count(stmt_);
+        for (int i = 0; i < count; i++) {
+            if (columnName == sqlite3_column_name(stmt_, i)) {
+                return i;
             }
         }
+        return -1;
     }
 
-    // Retrieve the value by column name
-    template <typename T>
-    T GetValue(const std::string& columnName) const {
-        auto it = data_.find(columnName);
-        if (it != data_.end()) {
-            return std::get<T>(it->second);
+    // Runs a statement and returns every row.
+    ResultSet Query();
+
+    // Runs a statement and calls `visitor` with each row as it is stepped, without
+    // keeping any of them.
+    bool ExecuteSelect(const std::function<void(const Cursor&)>& visitor);
+
+private:
+    sqlite3_stmt* stmt_;
+    bool isCached_;
+    // Index of the next parameter to bind. SQLite parameters start at 1.
+    int index_ = 1;
+    std::unique_lock<std::mutex> lock_;
+};
+
+// A SQLite connection and its cache of prepared statements. A connection is only
+// used by one thread at a time: statements hold its lock for as long as they live.
+class Connection {
+public:
+    explicit Connection(sqlite3* db) : db_(db) {}
+
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    ~Connection() {
+        for (auto& [sql, stmt] : statements_) {
+            sqlite3_finalize(stmt);
+        }
+
+        if (db_) {
+            sqlite3_close(db_);
         }
-        return T{};
     }
 
-    // Get an integer value from the row
-    int GetInt(const std::string& columnName) const {
-        return GetValue<int>(columnName);
+    sqlite3* GetHandle() const {
+        return db_;
     }
 
-    // Get a double value from the row
-    double GetDouble(const std::string& columnName) const {
-        return GetValue<double>(columnName);
+    std::unique_lock<std::mutex> Lock() {
+        return std::unique_lock<std::mutex>(mutex_);
     }
 
-    // Get a string value from the row
-    std::string GetString(const std::string& columnName) const {
-        return GetValue<std::string>(columnName);
+    // Returns an unlocked lock if the connection is in use.
+    std::unique_lock<std::mutex> TryLock() {
+        return std::unique_lock<std::mutex>(mutex_, std::try_to_lock);
     }
+
+    // Returns the prepared statement for `sql`, which takes over `lock`. If `isCached` is
+    // `true`, the statement is prepared once and kept for the next call with the same SQL text.
+    PreparedStatement Prepare(const std::string& sql, std::unique_lock<std::mutex> lock, bool isCached = true);
+
+    // `true` if `lock` holds this connection.
+    bool IsLockedBy(const std::unique_lock<std::mutex>& lock) const {
+        return lock.owns_lock() && lock.mutex() == &mutex_;
+    }
+
+    // Runs `sql` without preparing a statement. Returns `false` on error.
+    bool Execute(const std::string& sql);
+
+    // Same as `Execute`, while the caller holds `lock` from `Lock`.
+    bool Execute(const std::string& sql, const std::unique_lock<std::mutex>& lock);
+
+private:
+    // Statements are only cached up to this number, so SQL built from user input
+    // cannot grow the cache without bound.
+    static constexpr size_t MAX_CACHED_STATEMENTS = 128;
+
+    sqlite3* db_;
+    std::mutex mutex_;
+    std::unordered_map<std::string, sqlite3_stmt*> statements_;
+};
+
+// Connection settings, applied once the configuration has been loaded.
+struct DatabaseOptions {
+    // Number of read-only connections used by API queries.
+    int readers = 2;
+    // PRAGMA synchronous for the writer connection. NORMAL is durable in WAL mode
+    // except for the last commits before a power loss.
+    std::string synchronous = "NORMAL";
+    // PRAGMA cache_size for every connection. Negative values are in KiB.
+    int cacheSize = -8000;
+    // PRAGMA mmap_size for every connection, in bytes.
+    int64_t mmapSize = 256 * 1024 * 1024;
+    // PRAGMA wal_autocheckpoint in pages. 0 leaves checkpoints to `DataManager::Checkpoint`,
+    // so they never run as part of a commit.
+    int walAutoCheckpoint = 0;
+    // Engine raw samples are stored in: `sqlite` or `columnar`.
+    std::string storageEngine = "sqlite";
 };
 
 class DataManager {
 public:
     static DataManager& GetInstance() {
-        static DataManager instance(Utils::GetAppDataPath() + "\\storage.db");
+        static DataManager instance(Utils::GetAppDataPath() + "/storage.db");
         return instance;
     }
 
@@ -73,7 +446,31 @@ public:
     DataManager& operator=(const DataManager&) = delete;
 
     bool IsOpen() const {
-        return db_ != nullptr;
+        return writer_ != nullptr;
+    }
+
+    // Applies `options` to the writer connection and opens the read-only connections.
+    // This should be called once, before the API server starts.
+    void Configure(const DatabaseOptions& options);
+
+    // Brings the schema up to date by applying every migration newer than the database's
+    // `user_version`, all in a single transaction. Databases created before versioning
+    // start at 0 and are upgraded in place. Returns `false` if any migration failed, in
+    // which case nothing is changed.
+    bool Migrate();
+
+    // Runs a passive WAL checkpoint on a dedicated connection. Neither the writer nor
+    // readers are blocked by it, so it can run at any time off the sampling path.
+    bool Checkpoint();
+
+    // Counts the pages the writer connection wrote since the last call as writes of the
+    // database subsystem. Called by the storage writer after each commit.
+    void RecordWrittenBytes();
+
+    // Returns the engine raw samples are stored in. This is the SQLite tables until
+    // `Configure` selects another one.
+    SampleStore& GetSampleStore() {
+        return *sampleStore_;
     }
 
     bool CreateTable(const std::string& tableName, const std::string& columns) {
@@ -112,7 +509,56 @@ public:
         return ExecuteSQLStatement(upsertSQL);
     }
 
-    std::vector<Row> SelectAggregate(const std::string& tableName, const std::string& column, const std::string& condition = "") {
+    // Holds the writer connection until the lock is released, so a transaction and the
+    // writes in it are not interleaved with writes from other threads, which wait instead.
+    // The lock is passed to the overloads below while it is held.
+    std::unique_lock<std::mutex> LockWriter() {
+        return IsOpen() ? writer_->Lock() : std::unique_lock<std::mutex>();
+    }
+
+    bool BeginTransaction(const std::unique_lock<std::mutex>& writerLock) {
+        return ExecuteSQLStatement("BEGIN TRANSACTION;", writerLock);
+    }
+
+    bool CommitTransaction(const std::unique_lock<std::mutex>& writerLock) {
+        return ExecuteSQLStatement("COMMIT;", writerLock);
+    }
+
+    // Rolls back the open transaction. Does nothing if there is none, as SQLite rolls
+    // back by itself after some errors.
+    bool RollbackTransaction(const std::unique_lock<std::mutex>& writerLock) {
+        if (IsOpen() && writer_->IsLockedBy(writerLock) && sqlite3_get_autocommit(writer_->GetHandle())) {
+            return true;
+        }
+        return ExecuteSQLStatement("ROLLBACK;", writerLock);
+    }
+
+    // Returns the prepared statement for `sql` on the writer connection. Statements are
+    // prepared once and cached, so repeated calls with the same SQL text skip parsing
+    // altogether. Values should be bound as parameters (`?`) rather than formatted into `sql`.
+    PreparedStatement Prepare(const std::string& sql) {
+        if (!IsOpen()) {
+            return PreparedStatement(nullptr, false, std::unique_lock<std::mutex>());
+        }
+
+        return writer_->Prepare(sql, writer_->Lock());
+    }
+
+    // Same as `Prepare`, while the caller holds `writerLock` from `LockWriter`. The
+    // statement must not outlive the lock.
+    PreparedStatement Prepare(const std::string& sql, const std::unique_lock<std::mutex>& writerLock) {
+        if (!IsOpen() || !writer_->IsLockedBy(writerLock)) {
+            return PreparedStatement(nullptr, false, std::unique_lock<std::mutex>());
+        }
+
+        return writer_->Prepare(sql, std::unique_lock<std::mutex>());
+    }
+
+    // Same as `Prepare`, but on one of the read-only connections, so queries do not wait
+    // for writes in progress. Readers see the last committed transaction.
+    PreparedStatement PrepareRead(const std::string& sql, bool isCached = true);
+
+    ResultSet SelectAggregate(const std::string& tableName, const std::string& column, const std::string& condition = "") {
         std::string selectSQL = "\
             SELECT \
             MAX(CAST(" + column + " AS REAL)) AS max, \
@@ -123,29 +569,42 @@ public:
         if (!condition.empty()) {
             selectSQL += " WHERE " + condition;
         }
-        return ExecuteSelect(selectSQL);
+        // The set of aggregated columns is small, so these statements are worth caching.
+        return PrepareRead(selectSQL).Query();
     }
 
-    std::vector<Row> Select(const std::string& tableName, const std::string& condition = "") {
+    ResultSet Select(const std::string& tableName, const std::string& condition = "") {
         std::string selectSQL = "SELECT * FROM " + tableName;
         if (!condition.empty()) {
             selectSQL += " WHERE " + condition;
         }
-        return ExecuteSelect(selectSQL);
+        // Conditions are formatted into the SQL text, so these are not cached.
+        return PrepareRead(selectSQL, false).Query();
     }
 private:
     DataManager(const std::string& dbFileName);
 
     ~DataManager() {
-        if (db_) {
-            // Close the database when the DataManager is destroyed
-            sqlite3_close(db_);
-        }
+        // Close the database when the DataManager is destroyed
+        sampleStore_.reset();
+        readers_.clear();
+        checkpointer_.reset();
+        writer_.reset();
     }
 
-    bool ExecuteSQLStatement(const std::string& sql);
+    bool ExecuteSQLStatement(const std::string& sql) {
+        return IsOpen() && writer_->Execute(sql);
+    }
 
-    std::vector<Row> ExecuteSelect(const std::string& sql);
+    bool ExecuteSQLStatement(const std::string& sql, const std::unique_lock<std::mutex>& writerLock) {
+        return IsOpen() && writer_->Execute(sql, writerLock);
+    }
+
+    // Opens a connection to the database file with `flags`. Returns `nullptr` on failure.
+    std::unique_ptr<Connection> Open(int flags);
+
+    // Applies the pragmas shared by every connection.
+    void ApplyPragmas(Connection& connection);
 
     std::string JoinValues(const std::vector<std::string>& values, const std::string& separator = ", ") {
         std::string result;
@@ -160,5 +619,19 @@ private:
 
 private:
     std::string dbFileName_;
-    sqlite3* db_;
+    DatabaseOptions options_;
+
+    // Every write goes through this connection.
+    std::unique_ptr<Connection> writer_;
+    // Read-only connections for queries. They are picked round-robin, skipping busy ones.
+    std::vector<std::unique_ptr<Connection>> readers_;
+    std::atomic<size_t> nextReader_ = 0;
+    // Only used by `Checkpoint`, so a checkpoint never waits for a reader or the writer.
+    std::unique_ptr<Connection> checkpointer_;
+    // WAL frames the last checkpoint reported as copied to the database. They are counted
+    // from the start of the WAL, which restarts once it has been fully checkpointed.
+    int checkpointedFrames_ = 0;
+    // Page size of the database file, in bytes.
+    int64_t pageSize_ = 4096;
+    std::unique_ptr<SampleStore> sampleStore_;
 };
@@ -2,25 +2,45 @@
 #include "Application.h"
 
 void IntelligenceManager::Start() {
-    active = true;
+    if (active.exchange(true)) {
+        return;
+    }
 
     LogManager::GetInstance().LogInfo("Starting intelligence manager.");
-    auto errorCount = 0;
+    errorCount = 0;
 
-    while (active) {
-        try {
-            UINT interval = Application::theApp->configManager->GetConfig().predictionInterval;
-            Predict();
-            std::this_thread::sleep_for(std::chrono::milliseconds(interval));
-            errorCount = 0;
-        }
-        catch (std::exception e) {
-            LogManager::GetInstance().LogError("Intelligence manager loop failed: {0}", e.what());
-            if (errorCount > 3) {
-                active = false;
-                break;
-            }
-            errorCount++;
+    const auto interval = std::chrono::milliseconds(Application::theApp->configManager->GetConfig().predictionInterval);
+    TaskOptions options;
+    options.taskClass = TaskClass::MAINTENANCE_TASK;
+    timer = Application::theApp->threadManager->AddPeriodicTimer([this] {
+        Run();
+        }, interval, ThreadManager::Clock::now(), options);
+}
+
+void IntelligenceManager::Stop() {
+    active = false;
+    Application::theApp->threadManager->CancelTimer(timer.load());
+}
+
+void IntelligenceManager::SetInterval(int intervalMS) {
+    Application::theApp->threadManager->SetTimerInterval(timer.load(), std::chrono::milliseconds(intervalMS));
+}
+
+void IntelligenceManager::Run() {
+    if (!active) {
+        return;
+    }
+
+    try {
+        Predict();
+        errorCount = 0;
+    }
+    catch (std::exception e) {
+        LogManager::GetInstance().LogError("Intelligence manager loop failed: {0}", e.what());
+        if (errorCount > 3) {
+            Stop();
+            return;
         }
+        errorCount++;
     }
-} 
\ No newline at end of file
+}
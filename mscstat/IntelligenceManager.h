@@ -1,4 +1,6 @@
 #pragma once
+#include <atomic>
+#include <cstdint>
 #include <string>
 
 #include "Utils.h"
@@ -23,9 +25,9 @@ class IntelligenceManager {
 public:
     static IntelligenceManager& GetInstance() {
         static IntelligenceManager instance(
-            Utils::GetAppDataPath() + "\\www",
-            Utils::GetAppDataPath() + "\\model",
-            Utils::GetAppDataPath() + "\\prediction.txt");
+            Utils::GetAppDataPath() + "/www",
+            Utils::GetAppDataPath() + "/model",
+            Utils::GetAppDataPath() + "/prediction.txt");
         return instance;
     }
 
@@ -38,18 +40,25 @@ public:
 
     // This will start the prediction service and will run in at intervals to
     // compute and predict the device health using the module loaded.
-    // This is a blocking call and should be done in a different thread.
+    // Predictions run on a periodic timer of the thread pool, so this returns right away.
     void Start();
 
-    void Stop() {
-        active = false;
-    }
+    void Stop();
+
+    // Changes the time between predictions, in milliseconds.
+    void SetInterval(int intervalMS);
 
 private:
+    // Runs a prediction. The service stops after a few failures in a row.
+    void Run();
+
     std::string webRoot;
     std::string modelFullPath;
     std::string predictionFullPath;
     std::atomic<bool> active = false;
+    // Only accessed from `Run`, which never runs twice at once.
+    int errorCount = 0;
+    std::atomic<uint64_t> timer = 0;
 
 private:
     IntelligenceManager(const std::string webPath, const std::string modelPath, const std::string output) {
@@ -79,7 +88,7 @@ private:
     }
 
     void CreateWebRoot() {
-        std::string sourcePath = Utils::GetExecutableDir() + "\\www.zip";
+        std::string sourcePath = Utils::GetExecutableDir() + "/www.zip";
 
         LogManager::GetInstance().LogInfo("About to create web root");
         LogManager::GetInstance().LogInfo("\tFrom: {0}", sourcePath);
@@ -87,7 +96,7 @@ private:
 
         // Check if the operation was successful
         if (!Utils::ExtractZip(sourcePath, webRoot)) {
-            LogManager::GetInstance().LogError("Web root creation failed: {0}", GetLastError());
+            LogManager::GetInstance().LogError("Web root creation failed.");
             throw std::runtime_error("Failed to create web root.");
         }
         LogManager::GetInstance().LogInfo("Web root created successfully!");
@@ -95,7 +104,7 @@ private:
 
     void CreateModelRoot() {
         // Load the model
-        std::string sourcePath = Utils::GetExecutableDir() + "\\model.zip";
+        std::string sourcePath = Utils::GetExecutableDir() + "/model.zip";
 
         LogManager::GetInstance().LogInfo("About to create model root");
         LogManager::GetInstance().LogInfo("\tFrom: {0}", sourcePath);
@@ -103,7 +112,7 @@ private:
 
         // Check if the operation was successful
         if (!Utils::ExtractZip(sourcePath, modelFullPath)) {
-            LogManager::GetInstance().LogError("Model root creation failed: {0}", GetLastError());
+            LogManager::GetInstance().LogError("Model root creation failed.");
             throw std::runtime_error("Failed to create model root.");
         }
         LogManager::GetInstance().LogInfo("Model root created successfully!");
@@ -115,18 +124,18 @@ private:
             throw std::runtime_error("Python is required to run this program.");
         }
 
-        Utils::CheckAndInstallPythonDependencies(Utils::GetExecutableDir() + "\\requirements.txt");
+        Utils::CheckAndInstallPythonDependencies(Utils::GetExecutableDir() + "/requirements.txt");
         LogManager::GetInstance().LogInfo("Python dependencies setup successfully!");
     }
 
     void Predict() {
         const std::string params = "\"" + this->modelFullPath + "\" \""
-            + Utils::GetAppDataPath() + "\\storage.db" + "\""
+            + Utils::GetAppDataPath() + "/storage.db" + "\""
             + " \"" + this->predictionFullPath + "\"";
         // Code to run prediction is saved in python.
         // Here, we run the file.
         const auto response = Utils::ExecutePythonFile(
-            Utils::GetExecutableDir() + "\\predict.py",
+            Utils::GetExecutableDir() + "/predict.py",
             params
         );
 
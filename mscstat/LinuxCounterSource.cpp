@@ -0,0 +1,435 @@
+#include "LinuxCounterSource.h"
+#ifdef __linux__
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "LogManager.h"
+
+namespace {
+    const char* SkipSpaces(const char* p, const char* end) {
+        while (p < end && (*p == ' ' || *p == '\t')) {
+            p++;
+        }
+        return p;
+    }
+
+    const char* SkipToken(const char* p, const char* end) {
+        while (p < end && *p != ' ' && *p != '\t' && *p != '\n') {
+            p++;
+        }
+        return p;
+    }
+
+    const char* NextLine(const char* p, const char* end) {
+        while (p < end && *p != '\n') {
+            p++;
+        }
+        return p < end ? p + 1 : end;
+    }
+
+    // Parses the next unsigned integer, skipping any leading whitespace.
+    unsigned long long ParseNumber(const char*& p, const char* end) {
+        unsigned long long value = 0;
+
+        p = SkipSpaces(p, end);
+        while (p < end && *p >= '0' && *p <= '9') {
+            value = value * 10 + (*p - '0');
+            p++;
+        }
+
+        return value;
+    }
+
+    bool StartsWith(const char* p, const char* end, const char* prefix, size_t prefixLength) {
+        return static_cast<size_t>(end - p) >= prefixLength && std::memcmp(p, prefix, prefixLength) == 0;
+    }
+
+    bool EndsWithDigit(const char* name, size_t length) {
+        return length > 0 && name[length - 1] >= '0' && name[length - 1] <= '9';
+    }
+}
+
+CounterHandle LinuxCounterSource::AddCounter(const std::string& path) {
+    Counter counter;
+
+    // Split `\Object(instance)\Counter` into its parts.
+    const auto objectStart = path.find_first_not_of('\\');
+    const auto counterStart = path.find_last_of('\\');
+    std::string object;
+    std::string name;
+
+    if (objectStart != std::string::npos && counterStart != std::string::npos && counterStart > objectStart) {
+        object = path.substr(objectStart, counterStart - objectStart);
+        name = path.substr(counterStart + 1);
+
+        const auto instanceStart = object.find('(');
+        const auto instanceEnd = object.rfind(')');
+        if (instanceStart != std::string::npos && instanceEnd != std::string::npos && instanceEnd > instanceStart) {
+            counter.instance = object.substr(instanceStart + 1, instanceEnd - instanceStart - 1);
+            object = object.substr(0, instanceStart);
+        }
+    }
+
+    if (object == "Processor" && name == "% Processor Time") {
+        counter.kind = Kind::ProcessorTime;
+        files |= PROC_STAT;
+    }
+    else if (object == "System" && name == "Processes") {
+        counter.kind = Kind::Processes;
+        files |= PROC_LOADAVG;
+    }
+    else if (object == "Memory" && name == "Available Bytes") {
+        counter.kind = Kind::AvailableBytes;
+        files |= PROC_MEMINFO;
+    }
+    else if (object == "Memory" && name == "Committed Bytes") {
+        counter.kind = Kind::CommittedBytes;
+        files |= PROC_MEMINFO;
+    }
+    else if (object == "Memory" && name == "Page Faults/sec") {
+        counter.kind = Kind::PageFaults;
+        counter.isRate = true;
+        files |= PROC_VMSTAT;
+    }
+    else if (object == "PhysicalDisk" && name == "Disk Read Bytes/sec") {
+        counter.kind = Kind::DiskReadBytes;
+        counter.isRate = true;
+        files |= PROC_DISKSTATS;
+    }
+    else if (object == "PhysicalDisk" && name == "Disk Write Bytes/sec") {
+        counter.kind = Kind::DiskWriteBytes;
+        counter.isRate = true;
+        files |= PROC_DISKSTATS;
+    }
+    else if (object == "PhysicalDisk" && name == "Disk Bytes/sec") {
+        counter.kind = Kind::DiskBytes;
+        counter.isRate = true;
+        files |= PROC_DISKSTATS;
+    }
+    else if (object == "Network Interface") {
+        counter.isRate = true;
+        if (name == "Bytes Sent/sec") {
+            counter.kind = Kind::NetworkBytesSent;
+        }
+        else if (name == "Bytes Received/sec") {
+            counter.kind = Kind::NetworkBytesReceived;
+        }
+        else if (name == "Bytes Total/sec") {
+            counter.kind = Kind::NetworkBytesTotal;
+        }
+        else if (name == "Packets Sent/sec") {
+            counter.kind = Kind::NetworkPacketsSent;
+        }
+        else if (name == "Packets Received/sec") {
+            counter.kind = Kind::NetworkPacketsReceived;
+        }
+        else if (name == "Network Error/sec") {
+            counter.kind = Kind::NetworkErrors;
+        }
+        else {
+            counter.isRate = false;
+        }
+
+        if (counter.kind != Kind::Unsupported) {
+            files |= PROC_NET_DEV;
+        }
+    }
+
+    if (counter.kind == Kind::Unsupported) {
+        LogManager::GetInstance().LogInfo("Counter is not supported on this platform and will read 0: {0}", path);
+    }
+
+    counters.push_back(counter);
+    return counters.size() - 1;
+}
+
+bool LinuxCounterSource::Collect() {
+    const auto now = std::chrono::steady_clock::now();
+    bool success = true;
+
+    if (files & PROC_STAT) {
+        if (ReadProcFile(statPath)) {
+            ParseStat();
+        }
+        else {
+            success = false;
+        }
+    }
+    if (files & PROC_LOADAVG) {
+        if (ReadProcFile(loadAvgPath)) {
+            ParseLoadAvg();
+        }
+        else {
+            success = false;
+        }
+    }
+    if (files & PROC_MEMINFO) {
+        if (ReadProcFile(memInfoPath)) {
+            ParseMemInfo();
+        }
+        else {
+            success = false;
+        }
+    }
+    if (files & PROC_VMSTAT) {
+        if (ReadProcFile(vmStatPath)) {
+            ParseVmStat();
+        }
+        else {
+            success = false;
+        }
+    }
+    if (files & PROC_DISKSTATS) {
+        if (ReadProcFile(diskStatsPath)) {
+            ParseDiskStats();
+        }
+        else {
+            success = false;
+        }
+    }
+    if (files & PROC_NET_DEV) {
+        if (ReadProcFile(netDevPath)) {
+            ParseNetDev();
+        }
+        else {
+            success = false;
+        }
+    }
+
+    const double elapsed = std::chrono::duration<double>(now - lastCollect).count();
+    for (auto& counter : counters) {
+        if (counter.isRate) {
+            const double delta = counter.raw - counter.previousRaw;
+            counter.value = (counter.hasPreviousRaw && elapsed > 0 && delta > 0) ? delta / elapsed : 0;
+            counter.previousRaw = counter.raw;
+            counter.hasPreviousRaw = true;
+        }
+        else if (counter.kind != Kind::ProcessorTime) {
+            counter.value = counter.raw;
+        }
+    }
+
+    lastCollect = now;
+
+    return success;
+}
+
+bool LinuxCounterSource::ReadProcFile(const std::string& path) {
+    length = 0;
+
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    // Files in /proc report a size of 0, so read until EOF.
+    ssize_t bytesRead;
+    while (length < sizeof(buffer) && (bytesRead = read(fd, buffer + length, sizeof(buffer) - length)) > 0) {
+        length += static_cast<size_t>(bytesRead);
+    }
+
+    close(fd);
+    return length > 0;
+}
+
+void LinuxCounterSource::SetRaw(Kind kind, double raw) {
+    for (auto& counter : counters) {
+        if (counter.kind == kind) {
+            counter.raw = raw;
+        }
+    }
+}
+
+void LinuxCounterSource::ParseStat() {
+    const char* p = buffer;
+    const char* end = buffer + length;
+
+    // The aggregate line is always first:
+    // cpu user nice system idle iowait irq softirq steal ...
+    if (!StartsWith(p, end, "cpu ", 4)) {
+        return;
+    }
+    p += 4;
+
+    unsigned long long fields[8] = {};
+    for (auto& field : fields) {
+        field = ParseNumber(p, end);
+    }
+
+    unsigned long long total = 0;
+    for (const auto field : fields) {
+        total += field;
+    }
+    const unsigned long long idle = fields[3] + fields[4];
+
+    const auto totalDelta = total - previousCpuTotal;
+    const auto idleDelta = idle - previousCpuIdle;
+    const double usage = (previousCpuTotal != 0 && totalDelta > 0)
+        ? 100.0 * static_cast<double>(totalDelta - idleDelta) / static_cast<double>(totalDelta)
+        : 0.0;
+
+    previousCpuTotal = total;
+    previousCpuIdle = idle;
+
+    for (auto& counter : counters) {
+        if (counter.kind == Kind::ProcessorTime) {
+            counter.value = usage;
+        }
+    }
+}
+
+void LinuxCounterSource::ParseLoadAvg() {
+    // 0.00 0.01 0.05 1/123 4567
+    const char* p = buffer;
+    const char* end = buffer + length;
+
+    for (int i = 0; i < 3; i++) {
+        p = SkipToken(SkipSpaces(p, end), end);
+    }
+    ParseNumber(p, end);
+    if (p < end && *p == '/') {
+        p++;
+        SetRaw(Kind::Processes, static_cast<double>(ParseNumber(p, end)));
+    }
+}
+
+void LinuxCounterSource::ParseMemInfo() {
+    const char* p = buffer;
+    const char* end = buffer + length;
+
+    // Values are reported in kB.
+    while (p < end) {
+        if (StartsWith(p, end, "MemAvailable:", 13)) {
+            p += 13;
+            SetRaw(Kind::AvailableBytes, static_cast<double>(ParseNumber(p, end)) * 1024);
+        }
+        else if (StartsWith(p, end, "Committed_AS:", 13)) {
+            p += 13;
+            SetRaw(Kind::CommittedBytes, static_cast<double>(ParseNumber(p, end)) * 1024);
+        }
+        p = NextLine(p, end);
+    }
+}
+
+void LinuxCounterSource::ParseVmStat() {
+    const char* p = buffer;
+    const char* end = buffer + length;
+
+    while (p < end) {
+        if (StartsWith(p, end, "pgfault ", 8)) {
+            p += 8;
+            SetRaw(Kind::PageFaults, static_cast<double>(ParseNumber(p, end)));
+            return;
+        }
+        p = NextLine(p, end);
+    }
+}
+
+void LinuxCounterSource::ParseDiskStats() {
+    const char* p = buffer;
+    const char* end = buffer + length;
+
+    // Partitions are listed right after the disk they belong to and share its
+    // name as a prefix (sda, sda1 or nvme0n1, nvme0n1p1), hence they are skipped
+    // to avoid counting the same transfer twice.
+    const char* disk = nullptr;
+    size_t diskLength = 0;
+    unsigned long long sectorsRead = 0;
+    unsigned long long sectorsWritten = 0;
+
+    while (p < end) {
+        // major minor name reads merged sectorsRead msReading writes merged sectorsWritten ...
+        ParseNumber(p, end);
+        ParseNumber(p, end);
+        const char* name = SkipSpaces(p, end);
+        p = SkipToken(name, end);
+        const size_t nameLength = p - name;
+
+        const bool isVirtual = StartsWith(name, p, "loop", 4) || StartsWith(name, p, "ram", 3)
+            || StartsWith(name, p, "dm-", 3) || StartsWith(name, p, "zram", 4);
+        const bool isPartition = disk != nullptr && nameLength > diskLength
+            && std::memcmp(name, disk, diskLength) == 0 && EndsWithDigit(name, nameLength);
+
+        if (nameLength > 0 && !isVirtual && !isPartition) {
+            disk = name;
+            diskLength = nameLength;
+
+            unsigned long long fields[7] = {};
+            for (auto& field : fields) {
+                field = ParseNumber(p, end);
+            }
+            sectorsRead += fields[2];
+            sectorsWritten += fields[6];
+        }
+
+        p = NextLine(p, end);
+    }
+
+    // Sectors are always 512 bytes in /proc/diskstats, regardless of the device.
+    SetRaw(Kind::DiskReadBytes, static_cast<double>(sectorsRead) * 512);
+    SetRaw(Kind::DiskWriteBytes, static_cast<double>(sectorsWritten) * 512);
+    SetRaw(Kind::DiskBytes, static_cast<double>(sectorsRead + sectorsWritten) * 512);
+}
+
+void LinuxCounterSource::ParseNetDev() {
+    const char* p = buffer;
+    const char* end = buffer + length;
+
+    // The first two lines are column headers.
+    p = NextLine(NextLine(p, end), end);
+
+    while (p < end) {
+        // iface: rxBytes rxPackets rxErrs rxDrop rxFifo rxFrame rxCompressed rxMulticast
+        //        txBytes txPackets txErrs ...
+        const char* name = SkipSpaces(p, end);
+        const char* colon = name;
+        while (colon < end && *colon != ':' && *colon != '\n') {
+            colon++;
+        }
+        if (colon >= end || *colon != ':') {
+            p = NextLine(colon, end);
+            continue;
+        }
+
+        const size_t nameLength = colon - name;
+        p = colon + 1;
+
+        unsigned long long fields[11] = {};
+        for (auto& field : fields) {
+            field = ParseNumber(p, end);
+        }
+
+        for (auto& counter : counters) {
+            if (counter.instance.size() != nameLength || std::memcmp(counter.instance.data(), name, nameLength) != 0) {
+                continue;
+            }
+
+            switch (counter.kind) {
+            case Kind::NetworkBytesReceived:
+                counter.raw = static_cast<double>(fields[0]);
+                break;
+            case Kind::NetworkBytesSent:
+                counter.raw = static_cast<double>(fields[8]);
+                break;
+            case Kind::NetworkBytesTotal:
+                counter.raw = static_cast<double>(fields[0] + fields[8]);
+                break;
+            case Kind::NetworkPacketsReceived:
+                counter.raw = static_cast<double>(fields[1]);
+                break;
+            case Kind::NetworkPacketsSent:
+                counter.raw = static_cast<double>(fields[9]);
+                break;
+            case Kind::NetworkErrors:
+                counter.raw = static_cast<double>(fields[2] + fields[10]);
+                break;
+            default:
+                break;
+            }
+        }
+
+        p = NextLine(p, end);
+    }
+}
+#endif // __linux__
@@ -0,0 +1,130 @@
+#pragma once
+#ifdef __linux__
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "CounterSource.h"
+
+// Reads counters from the `/proc` filesystem. PDH counter paths are mapped to
+// their closest `/proc` equivalent when they are added, so the parsers that run
+// on every `Collect` only scan a fixed buffer and never allocate.
+//
+// Supported counters:
+//  - \Processor(_Total)\% Processor Time       (/proc/stat)
+//  - \System\Processes                         (/proc/loadavg)
+//  - \Memory\Available Bytes                   (/proc/meminfo)
+//  - \Memory\Committed Bytes                   (/proc/meminfo)
+//  - \Memory\Page Faults/sec                   (/proc/vmstat)
+//  - \PhysicalDisk(_Total)\Disk Read Bytes/sec  (/proc/diskstats)
+//  - \PhysicalDisk(_Total)\Disk Write Bytes/sec (/proc/diskstats)
+//  - \PhysicalDisk(_Total)\Disk Bytes/sec       (/proc/diskstats)
+//  - \Network Interface(<name>)\Bytes Sent/sec, Bytes Received/sec, Bytes Total/sec,
+//    Packets Sent/sec, Packets Received/sec, Network Error/sec (/proc/net/dev)
+//
+// Every other counter is accepted but always reads 0.
+class LinuxCounterSource : public CounterSource {
+public:
+    // Reads the files under `procRoot`, which tests point at a copy of /proc.
+    explicit LinuxCounterSource(const std::string& procRoot = "/proc")
+        : statPath(procRoot + "/stat"),
+          loadAvgPath(procRoot + "/loadavg"),
+          memInfoPath(procRoot + "/meminfo"),
+          vmStatPath(procRoot + "/vmstat"),
+          diskStatsPath(procRoot + "/diskstats"),
+          netDevPath(procRoot + "/net/dev") {}
+
+    virtual CounterHandle AddCounter(const std::string& path) override;
+
+    virtual void RemoveCounter(CounterHandle handle) override {
+        if (handle < counters.size()) {
+            counters[handle] = Counter();
+        }
+    }
+
+    virtual bool Collect() override;
+
+    virtual double GetValue(CounterHandle handle) const override {
+        if (handle >= counters.size()) {
+            return 0.0;
+        }
+
+        return counters[handle].value;
+    }
+
+private:
+    enum class Kind {
+        Unsupported,
+        ProcessorTime,
+        Processes,
+        AvailableBytes,
+        CommittedBytes,
+        PageFaults,
+        DiskReadBytes,
+        DiskWriteBytes,
+        DiskBytes,
+        NetworkBytesSent,
+        NetworkBytesReceived,
+        NetworkBytesTotal,
+        NetworkPacketsSent,
+        NetworkPacketsReceived,
+        NetworkErrors,
+    };
+
+    // Files that need to be read on each collection, as a bit mask.
+    enum ProcFile {
+        PROC_STAT = 1 << 0,
+        PROC_LOADAVG = 1 << 1,
+        PROC_MEMINFO = 1 << 2,
+        PROC_VMSTAT = 1 << 3,
+        PROC_DISKSTATS = 1 << 4,
+        PROC_NET_DEV = 1 << 5,
+    };
+
+    struct Counter {
+        Kind kind = Kind::Unsupported;
+        // Network interface name for `Network Interface` counters.
+        std::string instance;
+        // `true` if the value is computed as a per-second rate of `raw`.
+        bool isRate = false;
+        double raw = 0;
+        double previousRaw = 0;
+        // `false` until `previousRaw` has been read. Counters added after the first
+        // `Collect` are primed by the next one, so they read 0 until then.
+        bool hasPreviousRaw = false;
+        double value = 0;
+    };
+
+    bool ReadProcFile(const std::string& path);
+
+    void ParseStat();
+    void ParseLoadAvg();
+    void ParseMemInfo();
+    void ParseVmStat();
+    void ParseDiskStats();
+    void ParseNetDev();
+
+    void SetRaw(Kind kind, double raw);
+
+private:
+    // Paths are built once, so `Collect` does not allocate.
+    const std::string statPath;
+    const std::string loadAvgPath;
+    const std::string memInfoPath;
+    const std::string vmStatPath;
+    const std::string diskStatsPath;
+    const std::string netDevPath;
+
+    std::vector<Counter> counters;
+    unsigned int files = 0;
+    std::chrono::steady_clock::time_point lastCollect;
+
+    unsigned long long previousCpuTotal = 0;
+    unsigned long long previousCpuIdle = 0;
+
+    // Contents of the file currently being parsed. 64kb comfortably fits every
+    // file read here, even on machines with many disks or interfaces.
+    char buffer[64 * 1024];
+    size_t length = 0;
+};
+#endif // __linux__
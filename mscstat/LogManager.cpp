@@ -7,8 +7,8 @@ LogManager::LogManager() {
     constexpr size_t maxFiles = 5;
     const auto& app = Application::theApp;
 
-    auto consoleSink = std::make_shared<spdlog::sinks::wincolor_stdout_sink_mt>();
-    auto fileSink = std::make_shared<spdlog::sinks::rotating_file_sink_mt>(Utils::GetAppDataPath() + "\\logs.txt", maxFileSize, maxFiles);
+    auto consoleSink = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
+    auto fileSink = std::make_shared<spdlog::sinks::rotating_file_sink_mt>(Utils::GetAppDataPath() + "/logs.txt", maxFileSize, maxFiles);
 
     logger = std::make_shared<spdlog::logger>(
         app->name,
@@ -17,7 +17,7 @@ LogManager::LogManager() {
 
     if (!logger) {
         spdlog::critical("Could not create file logger. Cannot continue application");
-        throw std::exception("Failed to initialize logger!");
+        throw std::runtime_error("Failed to initialize logger!");
     }
 
     spdlog::set_default_logger(logger);
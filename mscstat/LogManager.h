@@ -3,6 +3,9 @@
 #include <memory>
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/rotating_file_sink.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+
+#include "OverheadMonitor.h"
 
 class LogManager {
 public:
@@ -12,53 +15,66 @@ public:
     }
 
     void LogDebug(const std::string& message) {
+        CountWrittenBytes(spdlog::level::debug, message);
         logger->debug(message);
     }
 
     void LogInfo(const std::string& message) {
+        CountWrittenBytes(spdlog::level::info, message);
         logger->info(message);
     }
 
     void LogWarning(const std::string& message) {
+        CountWrittenBytes(spdlog::level::warn, message);
         logger->warn(message);
     }
 
     void LogError(const std::string& message) {
+        CountWrittenBytes(spdlog::level::err, message);
         logger->error(message);
     }
 
     void LogCritical(const std::string& message) {
+        CountWrittenBytes(spdlog::level::critical, message);
         logger->critical(message);
     }
 
     template <typename... Args>
     void LogDebug(const std::string& format, const Args&... args) {
-        logger->debug(fmt::format(format, args...));
+        LogDebug(fmt::format(format, args...));
     }
 
     template <typename... Args>
     void LogInfo(const std::string& format, const Args&... args) {
-        logger->info(fmt::format(format, args...));
+        LogInfo(fmt::format(format, args...));
     }
 
     template <typename... Args>
     void LogWarning(const std::string& format, const Args&... args) {
-        logger->warn(fmt::format(format, args...));
+        LogWarning(fmt::format(format, args...));
     }
 
     template <typename... Args>
     void LogError(const std::string& format, const Args&... args) {
-        logger->error(fmt::format(format, args...));
+        LogError(fmt::format(format, args...));
     }
 
     template <typename... Args>
     void LogCritical(const std::string& format, const Args&... args) {
-        logger->critical(fmt::format(format, args...));
+        LogCritical(fmt::format(format, args...));
     }
 
 private:
     LogManager();
 
+    // Counts the message and its line break. Messages below the level of the logger
+    // are not written.
+    void CountWrittenBytes(spdlog::level::level_enum level, const std::string& message) {
+        if (logger->should_log(level)) {
+            OverheadMonitor::GetInstance().AddWrittenBytes(Subsystem::LOG_SUBSYSTEM, message.size() + 1);
+        }
+    }
+
     ~LogManager() {
         logger->flush();
     }
@@ -0,0 +1,88 @@
+#include "MappedFile.h"
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+bool MappedFile::Open(const std::string& path) {
+    Close();
+
+    // Deletes are shared, so expired segments can be removed while a view is open.
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (mapping == nullptr) {
+        return false;
+    }
+
+    // The view keeps the mapping alive once its handle is closed.
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (view == nullptr) {
+        return false;
+    }
+
+    data = static_cast<const uint8_t*>(view);
+    size = static_cast<size_t>(fileSize.QuadPart);
+    return true;
+}
+
+void MappedFile::Close() {
+    if (data != nullptr) {
+        UnmapViewOfFile(data);
+    }
+
+    data = nullptr;
+    size = 0;
+}
+#else
+bool MappedFile::Open(const std::string& path) {
+    Close();
+
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    // The mapping stays valid once the descriptor is closed.
+    void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED) {
+        return false;
+    }
+
+    data = static_cast<const uint8_t*>(view);
+    size = static_cast<size_t>(info.st_size);
+    return true;
+}
+
+void MappedFile::Close() {
+    if (data != nullptr) {
+        munmap(const_cast<uint8_t*>(data), size);
+    }
+
+    data = nullptr;
+    size = 0;
+}
+#endif // _WIN32
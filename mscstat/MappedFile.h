@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read-only memory map of a whole file. Pages are only read from disk when they are
+// first touched, so scanning part of a large file only reads that part.
+class MappedFile {
+public:
+    MappedFile() {}
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        Close();
+    }
+
+    // Maps `path`. Returns `false` if the file could not be opened or is empty.
+    bool Open(const std::string& path);
+
+    void Close();
+
+    bool IsOpen() const {
+        return data != nullptr;
+    }
+
+    const uint8_t* GetData() const {
+        return data;
+    }
+
+    size_t GetSize() const {
+        return size;
+    }
+
+private:
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+};
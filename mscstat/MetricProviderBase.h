@@ -1,13 +1,20 @@
 #pragma once
 #include <chrono>
-#include <pdh.h>
+#include <initializer_list>
+#include <memory>
 #include <sstream>
-#include <pdhmsg.h>
+#include <vector>
 #include <rapidjson/document.h>
 #include <rapidjson/stringbuffer.h>
 #include <rapidjson/writer.h>
 
+#include "AggregateStore.h"
+#include "BurstBuffer.h"
+#include "CounterRegistry.h"
 #include "DataManager.h"
+#include "RollupManager.h"
+#include "SampleRing.h"
+#include "StorageWriter.h"
 #include "Utils.h"
 
 class MetricProviderBase {
@@ -15,52 +22,142 @@ public:
     virtual rapidjson::Value GetDataJSON(rapidjson::Document& doc, const UINT8 count) const = 0;
     virtual rapidjson::Value GetAggregateDataJSON(rapidjson::Document& doc, const std::string column) const = 0;
     virtual std::string GetName() = 0;
+    // Name of the table samples of this provider are stored in.
+    virtual std::string GetTableName() const = 0;
     // Returns `true` if this metric supports multiple values in its table.
     // `false` otherwise.
     virtual bool IsMulti() { return false; };
 
-    virtual ~MetricProviderBase() {
-        PdhCloseQuery(queryHandle);
-    }
+    virtual ~MetricProviderBase() {}
+
+    // Adds the counters used by this provider to the shared registry. This is
+    // called once, when the provider is added to MetricsManager.
+    virtual void RegisterCounters(CounterRegistry& registry) = 0;
 
     // Retrieves a metric from the device. This will be implemented by subclasses
-    // to retrieve and persist metric data. It accepts a counter that will be
-    // used in combination with the timestamp to identify patterns across metrics.
-    // if 2 metric values have the same counter value, it indicates that they were
-    // read within the same loop. This should be used with the timestamp for finer
-    // grouping beteween various metric values.
+    // to read and persist metric data from the sample collected for this tick.
+    // The sample counter will be used in combination with the timestamp to identify
+    // patterns across metrics. if 2 metric values have the same counter value, it
+    // indicates that they were read within the same loop. This should be used with
+    // the timestamp for finer grouping beteween various metric values.
     // 
-    // @param counter is a counter that indicates what point of the loop
-    // this metric was fetched.
-    virtual void RetrieveMetricValue(UINT16 counter) = 0;
+    // @param sample holds the values of every registered counter, collected once
+    // for this tick.
+    virtual void RetrieveMetricValue(const CounterSample& sample) = 0;
+
+    // Names of the numeric columns of this provider, in the order their values
+    // are passed to `Publish`.
+    virtual const std::vector<std::string>& GetColumns() const = 0;
+
+    // Called by MetricsManager when the provider is added.
+    void SetBurstBuffer(BurstBuffer* buffer) {
+        burstBuffer = buffer;
+    }
+
+    // Called by MetricsManager when the provider is added.
+    void SetAggregateStore(AggregateStore* store) {
+        aggregateStore = store;
+    }
+
+    // Called by MetricsManager when the provider is added, before it is sampled.
+    void SetHotTier(size_t capacity) {
+        hotTier = std::make_unique<SampleRing>(capacity, GetColumns().size());
+    }
+
+    // Latest persisted samples, or nullptr if they are not kept.
+    const SampleRing* GetHotTier() const {
+        return hotTier.get();
+    }
+
+    // Identifies the raw samples of this provider in the sample store.
+    SeriesKey GetSeriesKey() {
+        return { GetTableName(), "name", GetName(), GetColumns() };
+    }
+
+    // Same as `GetDataJSON`, but read from the sample store. This is used instead when
+    // the storage engine stores samples itself, and only has the numeric columns.
+    rapidjson::Value GetSampleDataJSON(rapidjson::Document& doc, const UINT8 count) {
+        rapidjson::Value response(rapidjson::kArrayType);
+
+        const auto key = GetSeriesKey();
+        DataManager::GetInstance().GetSampleStore().ScanLatest(key, count, [&](int64_t timestamp, int64_t counter, const double* values) {
+            response.PushBack(GetSampleJSON(doc, timestamp, counter, values), doc.GetAllocator());
+            });
+
+        return response;
+    }
+
+    // Same as `GetSampleDataJSON`, but read from the latest samples kept in memory.
+    // Returns `false` if fewer than `count` samples are held, and the database should
+    // be read instead.
+    bool GetHotDataJSON(rapidjson::Document& doc, const UINT8 count, rapidjson::Value& response) const {
+        if (!hotTier) {
+            return false;
+        }
+
+        rapidjson::Value samples(rapidjson::kArrayType);
+        const auto isHot = hotTier->ReadLatest(count, [&](int64_t timestamp, int64_t counter, const double* values) {
+            samples.PushBack(GetSampleJSON(doc, timestamp, counter, values), doc.GetAllocator());
+            });
+        if (isHot) {
+            response = samples;
+        }
+
+        return isHot;
+    }
 
 protected:
     // Saves the metric value using the data storage defined by subclasses.
     virtual void Persist() {};
 
-    bool CollectData() {
-        PDH_STATUS status;
+    // Publishes the numeric values of the latest sample, in the order of `GetColumns`.
+    // Returns `true` if the provider should persist the sample as a row. It does not if
+    // burst mode has already persisted a sample for the current window, or if the
+    // storage engine has stored the sample itself.
+    bool Publish(const CounterSample& sample, std::initializer_list<double> values) {
+        const auto isPersisted = burstBuffer == nullptr || burstBuffer->Record(GetName(), GetColumns(), sample, values.begin(), values.size());
+        if (!isPersisted) {
+            return false;
+        }
 
-        status = PdhCollectQueryData(queryHandle);
-        if (status != ERROR_SUCCESS) {
+        const auto timestamp = std::chrono::duration_cast<std::chrono::seconds>(sample.timestamp.time_since_epoch()).count();
+
+        // Running aggregates follow the persisted samples, so they agree with the database.
+        if (aggregateStore != nullptr) {
+            aggregateStore->Record(GetTableName(), GetName(), GetColumns(), timestamp, values.begin(), values.size());
+        }
+        if (hotTier) {
+            hotTier->Push(timestamp, static_cast<int64_t>(sample.counter), values.begin(), values.size());
+        }
+
+        auto& store = DataManager::GetInstance().GetSampleStore();
+        if (store.StoresSamples()) {
+            store.Append(GetSeriesKey(), timestamp, static_cast<int64_t>(sample.counter), values.begin(), values.size());
             return false;
         }
 
         return true;
-    };
+    }
 
-    double GetCounterValue(PDH_HCOUNTER counter) {
-        PDH_FMT_COUNTERVALUE value;
+private:
+    // A sample of the numeric columns, as returned by the API.
+    rapidjson::Value GetSampleJSON(rapidjson::Document& doc, int64_t timestamp, int64_t counter, const double* values) const {
+        const auto& columns = GetColumns();
 
-        PdhGetFormattedCounterValue(counter, PDH_FMT_DOUBLE, nullptr, &value);
-        if (value.CStatus == PDH_CSTATUS_VALID_DATA) {
-            return value.doubleValue;
-        }
-        else {
-            return 0.0;
+        rapidjson::Value obj(rapidjson::kObjectType);
+        obj.AddMember("counter", Utils::ConvertIntToJSONValue(static_cast<int>(counter), doc.GetAllocator()), doc.GetAllocator());
+        obj.AddMember("timestamp", Utils::ConvertIntToJSONValue(static_cast<int>(timestamp), doc.GetAllocator()), doc.GetAllocator());
+        for (size_t i = 0; i < columns.size(); i++) {
+            rapidjson::Value column;
+            column.SetString(columns[i].c_str(), doc.GetAllocator());
+            obj.AddMember(column, Utils::ConvertDoubleToJSONValue(values[i], doc.GetAllocator()), doc.GetAllocator());
         }
+
+        return obj;
     }
 
-protected:
-    PDH_HQUERY queryHandle = nullptr;
+    BurstBuffer* burstBuffer = nullptr;
+    AggregateStore* aggregateStore = nullptr;
+    // Latest persisted samples, written only by the sampling job of this provider.
+    std::unique_ptr<SampleRing> hotTier;
 };
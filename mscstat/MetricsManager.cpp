@@ -1,34 +1,353 @@
 #include "MetricsManager.h"
 #include "Application.h"
 
-// Start collecting metrics at a specified interval
+// Start collecting metrics. Each provider and script has its own interval and phase.
 void MetricsManager::StartMetricsCollection() {
     // Set the flag to indicate that metrics collection is active
-    isCollectingMetrics_ = true;
+    if (isCollectingMetrics_.exchange(true)) {
+        return;
+    }
     counter = 0;
+    counterRegistry.Prime();
+
+    collectionConfig = Application::theApp->configManager->GetConfig();
+    const auto resolution = std::chrono::milliseconds((std::max)(collectionConfig.schedulerResolution, 1));
+
+    collectionStart = TimerWheel::Clock::now();
+    wheel = std::make_unique<TimerWheel>(resolution, collectionStart);
+
+    // Aggregates are loaded before the first sample, so no sample is counted twice.
+    for (const auto& provider : metricProviders_) {
+        aggregateStore.Seed(provider->GetTableName(), "name", provider->GetName(), provider->GetColumns());
+    }
+
+    samplingJobs.clear();
+    seedingScripts.clear();
+    for (const auto& provider : metricProviders_) {
+        SamplingJob job;
+        job.provider = provider.get();
+        AddSamplingJob(*wheel, job, collectionConfig.GetSamplingConfig(provider->GetName()));
+    }
+    scriptsVersion = Application::theApp->scriptManager->GetScriptsVersion() - 1;
+    burstVersion = burstBuffer.GetVersion() - 1;
+    previousTick = TaskGroup();
 
-    // Start a loop to collect metrics at the specified interval.
+    Tick(++collectionGeneration);
+}
+
+void MetricsManager::Tick(UINT64 generation) {
+    if (!isCollectingMetrics_.load() || generation != collectionGeneration.load()) {
+        return;
+    }
+
+    // Each tick of the scheduler collects counters once for every job that is due.
     // In order to get conformity and track each metric fetch cycle, we will pass the counter
     // value to metrics providers. This way, each metric recorded will have insight to when the
     // data was fetched relative to other metric providers.
-    while (isCollectingMetrics_.load()) {
-        for (const auto& provider : metricProviders_) {
-            Application::theApp->threadManager->AddTaskToThread([&] {
-                provider->RetrieveMetricValue(counter.load());
-                });
+    expiredJobs.clear();
+    wheel->Advance(TimerWheel::Clock::now(), expiredJobs);
+    if (!expiredJobs.empty()) {
+        RunSamplingJobs(*wheel, expiredJobs);
+    }
+
+    SyncScriptJobs(*wheel, collectionConfig);
+    burstBuffer.Expire();
+    SyncBurstJobs(*wheel);
+
+    // The next tick is scheduled once this one is over, so ticks never overlap.
+    TaskOptions options;
+    options.taskClass = TaskClass::SAMPLING_TASK;
+    tickTimer = Application::theApp->threadManager->AddTimer([this, generation] {
+        Tick(generation);
+        }, wheel->NextExpiry(), options);
+}
+
+void MetricsManager::StopMetricsCollection() {
+    ++collectionGeneration;
+    isCollectingMetrics_.store(false);
+    Application::theApp->threadManager->CancelTimer(tickTimer.load());
+}
+
+void MetricsManager::AddMetricProvider(std::unique_ptr<MetricProviderBase> provider) {
+    provider->RegisterCounters(counterRegistry);
+    provider->SetBurstBuffer(&burstBuffer);
+    provider->SetAggregateStore(&aggregateStore);
+    provider->SetHotTier((std::max)(Application::theApp->configManager->GetConfig().hotTierSize, 0));
+
+    auto& rollupManager = RollupManager::GetInstance();
+    rollupManager.AddSource(provider->GetTableName(), "name", provider->GetColumns());
+    rollupManager.AddSeries(provider->GetTableName(), provider->GetName());
+
+    metricProviders_.emplace_back(std::move(provider));
+}
+
+void MetricsManager::AddSamplingJob(TimerWheel& wheel, SamplingJob job, const SamplingConfig& samplingConfig) {
+    job.baseInterval = std::chrono::milliseconds(samplingConfig.interval);
+    job.interval = job.baseInterval;
+    job.phase = std::chrono::milliseconds(samplingConfig.phase);
+
+    const auto id = nextJobId++;
+    auto& added = samplingJobs.emplace(id, std::move(job)).first->second;
+    ScheduleSamplingJob(wheel, id, added);
+}
+
+void MetricsManager::ScheduleSamplingJob(TimerWheel& wheel, TimerWheel::TimerId id, SamplingJob& job) {
+    // Jobs stay aligned to the start of collection, so a job added later still
+    // runs in phase with the jobs that were there from the start.
+    const auto now = TimerWheel::Clock::now();
+    job.due = collectionStart + job.phase;
+    if (job.due < now) {
+        job.due += ((now - job.due) / job.interval + 1) * job.interval;
+    }
+
+    wheel.Schedule(id, job.due);
+}
+
+void MetricsManager::SyncBurstJobs(TimerWheel& wheel) {
+    const auto version = burstBuffer.GetVersion();
+    if (version == burstVersion) {
+        return;
+    }
+    burstVersion = version;
+
+    const auto isBurst = burstBuffer.IsActive();
+    const auto burstInterval = std::chrono::duration_cast<TimerWheel::Clock::duration>(std::chrono::milliseconds(burstBuffer.GetInterval()));
+
+    // Scripts keep their own interval. Only providers are sampled faster in burst mode.
+    for (auto& [id, job] : samplingJobs) {
+        if (job.provider == nullptr) {
+            continue;
+        }
+
+        job.interval = isBurst && burstInterval < job.baseInterval ? burstInterval : job.baseInterval;
+        ScheduleSamplingJob(wheel, id, job);
+    }
+}
+
+void MetricsManager::StartBurst(int durationMS) {
+    const auto config = Application::theApp->configManager->GetConfig();
+    burstBuffer.Start(
+        config.burstInterval,
+        config.burstDownsampleInterval,
+        config.burstBufferSize,
+        durationMS < 0 ? config.burstDuration : durationMS);
+}
+
+void MetricsManager::SyncScriptJobs(TimerWheel& wheel, const MyConfig& config) {
+    // Scripts get their job once their aggregates are seeded, so no sample is recorded
+    // before the seed is in.
+    for (auto it = seedingScripts.begin(); it != seedingScripts.end();) {
+        if (!it->second.IsDone()) {
+            ++it;
+            continue;
+        }
+
+        SamplingJob job;
+        job.scriptName = it->first;
+        AddSamplingJob(wheel, job, config.GetSamplingConfig(it->first));
+        it = seedingScripts.erase(it);
+    }
+
+    const auto version = Application::theApp->scriptManager->GetScriptsVersion();
+    if (version == scriptsVersion) {
+        return;
+    }
+    scriptsVersion = version;
+
+    auto names = Application::theApp->scriptManager->GetScriptNames();
+
+    // Forget deleted scripts that are still being seeded, and skip the others.
+    for (auto it = seedingScripts.begin(); it != seedingScripts.end();) {
+        const auto name = std::find(names.begin(), names.end(), it->first);
+        if (name == names.end()) {
+            it = seedingScripts.erase(it);
+        }
+        else {
+            names.erase(name);
+            ++it;
+        }
+    }
+
+    // Remove jobs of deleted scripts, and skip scripts that are already scheduled.
+    for (auto it = samplingJobs.begin(); it != samplingJobs.end();) {
+        if (it->second.provider != nullptr) {
+            ++it;
+            continue;
+        }
+
+        const auto name = std::find(names.begin(), names.end(), it->second.scriptName);
+        if (name == names.end()) {
+            wheel.Cancel(it->first);
+            it = samplingJobs.erase(it);
+        }
+        else {
+            names.erase(name);
+            ++it;
+        }
+    }
+
+    // Seeding reads the rollups and a day of raw samples, so it runs on the pool rather
+    // than hold up the samples due in this tick.
+    TaskOptions options;
+    options.taskClass = TaskClass::MAINTENANCE_TASK;
+    for (const auto& name : names) {
+        seedingScripts[name] = Application::theApp->threadManager->AddTask([this, name] {
+            aggregateStore.Seed("ScriptData", "key", name, { "value" });
+            }, options);
+    }
+}
+
+void MetricsManager::RunSamplingJobs(TimerWheel& wheel, const std::vector<TimerWheel::TimerId>& expired) {
+    CheckPreviousTick();
+
+    // All counters are collected in a single pass, so every provider and script
+    // running in this tick reads values that were taken at the same instant.
+
+    const auto sample = counterRegistry.Collect(counter.load());
+    const auto now = TimerWheel::Clock::now();
+
+    TaskGroup tick;
+    std::vector<std::string> scriptNames;
+    std::vector<SamplingJob*> scriptJobs;
+    for (const auto id : expired) {
+        const auto it = samplingJobs.find(id);
+        if (it == samplingJobs.end()) {
+            continue;
+        }
+        auto& job = it->second;
+
+        const auto lateness = std::chrono::duration_cast<std::chrono::microseconds>(now - job.due).count();
+        lastLatenessUS = lateness;
+        if (lateness > maxLatenessUS.load()) {
+            maxLatenessUS = lateness;
+        }
+
+        // Ticks of the same job never overlap. While its previous sample is queued or
+        // running, the job is skipped.
+        if (!job.inFlight.IsDone()) {
+            overlappingSamples++;
+            LogManager::GetInstance().LogWarning(
+                "Skipped a sample of {0}, as the previous one is not done.",
+                job.provider != nullptr ? job.provider->GetName() : job.scriptName);
         }
-        Application::theApp->scriptManager->Process(counter);
+        else if (job.provider != nullptr) {
+            // A sample that has not started by the next tick is stale, and is dropped.
+            TaskOptions options;
+            options.taskClass = TaskClass::SAMPLING_TASK;
+            options.deadline = job.due + job.interval;
 
-        counter++;
+            job.inFlight = Application::theApp->threadManager->AddTask([provider = job.provider, sample] {
+                provider->RetrieveMetricValue(*sample);
+                }, options);
+            tick.Add(job.inFlight);
+        }
+        else {
+            scriptNames.push_back(job.scriptName);
+            scriptJobs.push_back(&job);
+        }
 
-        // Minimum interval is 1 second
-        const auto interval = intervalMS_ < 4000 ? 4000 : intervalMS_;
-        LogManager::GetInstance().LogInfo(
-            "Metrics Fetched: {0}. Next fetch in {1} seconds. ",
-            counter.load(),
-            interval / 1000);
-        std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+        // The next due time is computed from the previous due time rather than from
+        // `now`, so the time spent in this tick does not accumulate as drift. If we fell
+        // behind by more than an interval, the missed samples are skipped.
+        job.due += job.interval;
+        if (job.due <= now) {
+            const auto missed = (now - job.due) / job.interval + 1;
+            job.due += missed * job.interval;
+            missedSamples += missed;
+
+            LogManager::GetInstance().LogWarning(
+                "Metrics scheduler fell behind by {0} samples of {1}.",
+                missed,
+                job.provider != nullptr ? job.provider->GetName() : job.scriptName);
+        }
+        wheel.Schedule(id, job.due);
     }
+
+    if (!scriptNames.empty()) {
+        const auto handles = Application::theApp->scriptManager->Process(scriptNames, counter.load(), sample);
+        for (auto* job : scriptJobs) {
+            const auto handle = handles.find(job->scriptName);
+            if (handle != handles.end()) {
+                job->inFlight = handle->second;
+                tick.Add(handle->second);
+            }
+        }
+    }
+
+    counter++;
+
+    LogManager::GetInstance().LogDebug(
+        "Metrics Fetched: {0}. Jobs run: {1}. Lateness: {2}us.",
+        counter.load(),
+        expired.size(),
+        lastLatenessUS.load());
+
+    previousTick = std::move(tick);
+    previousTickStart = now;
+}
+
+void MetricsManager::CheckPreviousTick() {
+    if (previousTick.empty()) {
+        return;
+    }
+
+    const auto pending = previousTick.GetPendingCount();
+    if (pending == 0) {
+        tickLatency.Record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(previousTick.GetFinishTime() - previousTickStart).count()));
+    }
+    else {
+        overrunTicks++;
+        LogManager::GetInstance().LogWarning(
+            "Metrics tick {0} overran: {1} of {2} tasks are not done.",
+            counter.load() - 1,
+            pending,
+            previousTick.size());
+    }
+
+    previousTick = TaskGroup();
+}
+
+std::string MetricsManager::GetInfoAsJSON() const {
+    const auto metricsActive = IsActive();
+    const auto providers = GetActiveProviders();
+
+    // Create a RapidJSON Document
+    rapidjson::Document doc;
+    doc.SetObject();
+
+    rapidjson::Value isActive_;
+    isActive_.SetBool(metricsActive);
+    doc.AddMember("isActive", isActive_, doc.GetAllocator());
+
+    rapidjson::Value jsonArray(rapidjson::kArrayType);
+    for (const auto& provider : providers) {
+        rapidjson::Value name_;
+        name_.SetString(provider.c_str(), doc.GetAllocator());
+
+        jsonArray.PushBack(name_, doc.GetAllocator());
+    }
+
+    doc.AddMember("providers", jsonArray, doc.GetAllocator());
+
+    // Lateness is how long after its due time a sample was actually taken.
+    rapidjson::Value scheduler(rapidjson::kObjectType);
+    scheduler.AddMember("lastLatenessMS", lastLatenessUS.load() / 1000.0, doc.GetAllocator());
+    scheduler.AddMember("maxLatenessMS", maxLatenessUS.load() / 1000.0, doc.GetAllocator());
+    scheduler.AddMember("missedSamples", missedSamples.load(), doc.GetAllocator());
+    scheduler.AddMember("overrunTicks", overrunTicks.load(), doc.GetAllocator());
+    scheduler.AddMember("overlappingSamples", overlappingSamples.load(), doc.GetAllocator());
+    scheduler.AddMember("tickLatency", tickLatency.GetJSON(doc), doc.GetAllocator());
+    doc.AddMember("scheduler", scheduler, doc.GetAllocator());
+    doc.AddMember("storage", StorageWriter::GetInstance().GetInfoJSON(doc), doc.GetAllocator());
+    doc.AddMember("tasks", Application::theApp->threadManager->GetInfoJSON(doc), doc.GetAllocator());
+
+    // Serialize the Document to a JSON string
+    rapidjson::StringBuffer buffer;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+    buffer.Flush();
+    doc.Accept(writer);
+
+    return buffer.GetString();
 }
 
 std::string MetricsManager::GetProviderDataJSON(const UINT8 count) const {
@@ -43,6 +362,7 @@ std::string MetricsManager::GetProviderDataJSON(const UINT8 count) const {
     doc.AddMember("nextUpdateTime", nextUpdateTime, doc.GetAllocator());
 
     // Here we will fetch the number of data specified in `count`.
+    const auto storesSamples = DataManager::GetInstance().GetSampleStore().StoresSamples();
     rapidjson::Value jsonArray(rapidjson::kArrayType);
     for (const auto& provider : metricProviders_) {
         rapidjson::Value obj(rapidjson::kObjectType);
@@ -50,7 +370,12 @@ std::string MetricsManager::GetProviderDataJSON(const UINT8 count) const {
         rapidjson::Value name;
         name.SetString(provider->GetName().c_str(), doc.GetAllocator());
         obj.AddMember("name", name, doc.GetAllocator());
-        obj.AddMember("data", provider->GetDataJSON(doc, count), doc.GetAllocator());
+        // The latest samples are kept in memory. Only deeper requests read the database.
+        rapidjson::Value data;
+        if (!provider->GetHotDataJSON(doc, count, data)) {
+            data = storesSamples ? provider->GetSampleDataJSON(doc, count) : provider->GetDataJSON(doc, count);
+        }
+        obj.AddMember("data", data, doc.GetAllocator());
 
         rapidjson::Value isCustom;
         isCustom.SetBool(false);
@@ -92,7 +417,15 @@ std::string MetricsManager::GetProviderAggregateDataJSON(const std::string colum
     else {
         for (auto& p : metricProviders_) {
             if (p->GetName() == name) {
-                doc.AddMember("data", p->GetAggregateDataJSON(doc, column), doc.GetAllocator());
+                // Answered from the running aggregates, unless the provider has not been seeded yet.
+                const auto& columns = p->GetColumns();
+                rapidjson::Value data(rapidjson::kObjectType);
+                if (std::find(columns.begin(), columns.end(), column) != columns.end() && aggregateStore.GetJSON(doc, p->GetTableName(), name, column, data)) {
+                    doc.AddMember("data", data, doc.GetAllocator());
+                }
+                else {
+                    doc.AddMember("data", p->GetAggregateDataJSON(doc, column), doc.GetAllocator());
+                }
 
                 // Serialize the Document to a JSON string
                 rapidjson::StringBuffer buffer;
@@ -107,3 +440,33 @@ std::string MetricsManager::GetProviderAggregateDataJSON(const std::string colum
     }
     throw std::runtime_error("Provider with specified name not found");
 }
+
+std::string MetricsManager::GetProviderRangeDataJSON(const std::string column, const bool isCustom, const std::string name, int64_t from, int64_t to) const {
+    // Create a RapidJSON Document
+    rapidjson::Document doc;
+    doc.SetObject();
+
+    if (isCustom) {
+        if (column != "value") {
+            throw std::runtime_error("Unknown column: " + column);
+        }
+        doc.AddMember("data", RollupManager::GetInstance().GetRangeJSON(doc, "ScriptData", name, column, from, to), doc.GetAllocator());
+    }
+    else {
+        const auto provider = std::find_if(metricProviders_.begin(), metricProviders_.end(), [&name](const auto& p) {
+            return p->GetName() == name;
+            });
+        if (provider == metricProviders_.end()) {
+            throw std::runtime_error("Provider with specified name not found");
+        }
+        doc.AddMember("data", RollupManager::GetInstance().GetRangeJSON(doc, (*provider)->GetTableName(), name, column, from, to), doc.GetAllocator());
+    }
+
+    // Serialize the Document to a JSON string
+    rapidjson::StringBuffer buffer;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+    buffer.Flush();
+    doc.Accept(writer);
+
+    return buffer.GetString();
+}
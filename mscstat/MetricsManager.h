@@ -1,6 +1,7 @@
 #pragma once
 #include <algorithm>
 #include <iostream>
+#include <map>
 #include <vector>
 #include <memory>
 #include <chrono>
@@ -10,8 +11,15 @@
 #include <rapidjson/stringbuffer.h>
 #include <rapidjson/writer.h>
 
+#include "AggregateStore.h"
+#include "BurstBuffer.h"
+#include "ConfigManager.h"
 #include "LogManager.h"
 #include "MetricProviderBase.h"
+#include "RollupManager.h"
+#include "TaskGroup.h"
+#include "TaskTelemetry.h"
+#include "TimerWheel.h"
 
 class MetricsManager {
 public:
@@ -21,54 +29,63 @@ public:
         return instance;
     }
 
-    // Start collecting metrics at a specified interval
+    // Start collecting metrics. Each provider and script is sampled on its own
+    // interval and phase, as configured in `MyConfig::sampling`. The scheduler runs on
+    // timers of the thread pool, so this returns right away.
     void StartMetricsCollection();
 
     // Stop collecting metrics
-    void StopMetricsCollection() {
-        isCollectingMetrics_.store(false);
-    }
+    void StopMetricsCollection();
 
     // Add metric providers to the manager
-    void AddMetricProvider(std::unique_ptr<MetricProviderBase> provider) {
-        metricProviders_.emplace_back(std::move(provider));
-    }
+    void AddMetricProvider(std::unique_ptr<MetricProviderBase> provider);
 
-    std::string GetInfoAsJSON() const {
-        const auto metricsActive = IsActive();
-        const auto providers = GetActiveProviders();
+    // Registry of every counter read by providers and scripts. It is collected
+    // once per tick, before any provider or script runs.
+    CounterRegistry& GetCounterRegistry() {
+        return counterRegistry;
+    }
 
-        // Create a RapidJSON Document
-        rapidjson::Document doc;
-        doc.SetObject();
+    // Samples every provider at `MyConfig::burstInterval` for `durationMS` milliseconds.
+    // If `durationMS` is negative, `MyConfig::burstDuration` is used.
+    void StartBurst(int durationMS);
 
-        rapidjson::Value isActive_;
-        isActive_.SetBool(metricsActive);
-        doc.AddMember("isActive", isActive_, doc.GetAllocator());
+    void StopBurst() {
+        burstBuffer.Stop();
+    }
 
-        rapidjson::Value jsonArray(rapidjson::kArrayType);
-        for (const auto& provider : providers) {
-            rapidjson::Value name_;
-            name_.SetString(provider.c_str(), doc.GetAllocator());
+    // Running aggregates of every provider column and script.
+    AggregateStore& GetAggregateStore() {
+        return aggregateStore;
+    }
 
-            jsonArray.PushBack(name_, doc.GetAllocator());
+    // Returns the provider named `name`, or nullptr. Providers are all added before
+    // metrics are collected, so this is safe from any thread once they run.
+    MetricProviderBase* FindProvider(const std::string& name) const {
+        for (const auto& provider : metricProviders_) {
+            if (provider->GetName() == name) {
+                return provider.get();
+            }
         }
 
-        doc.AddMember("providers", jsonArray, doc.GetAllocator());
-
-        // Serialize the Document to a JSON string
-        rapidjson::StringBuffer buffer;
-        rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
-        buffer.Flush();
-        doc.Accept(writer);
+        return nullptr;
+    }
 
-        return buffer.GetString();
+    // Raw samples taken in burst mode.
+    const BurstBuffer& GetBurstBuffer() const {
+        return burstBuffer;
     }
 
+    std::string GetInfoAsJSON() const;
+
     std::string GetProviderDataJSON(const UINT8 count) const;
 
     std::string GetProviderAggregateDataJSON(const std::string column, const bool isCustom, const std::string name = "") const;
 
+    // Returns the values of `column` between `from` and `to`, in seconds since epoch.
+    // Long ranges are answered from the rollup tables.
+    std::string GetProviderRangeDataJSON(const std::string column, const bool isCustom, const std::string name, int64_t from, int64_t to) const;
+
     std::string GetAvailableCountersJSON() {
         // Create a RapidJSON Document
         rapidjson::Document doc;
@@ -105,15 +122,91 @@ private:
         return providerNames;
     }
 
+    // A provider or script sampled by the scheduler. Exactly one of `provider`
+    // and `scriptName` is set.
+    struct SamplingJob {
+        MetricProviderBase* provider = nullptr;
+        std::string scriptName;
+        // Configured interval. `interval` may be shorter while burst mode is active.
+        TimerWheel::Clock::duration baseInterval;
+        TimerWheel::Clock::duration interval;
+        TimerWheel::Clock::duration phase;
+        TimerWheel::Clock::time_point due;
+        // Task of the latest sample. A job is not sampled again until it is done.
+        TaskHandle inFlight;
+    };
+
+    void AddSamplingJob(TimerWheel& wheel, SamplingJob job, const SamplingConfig& samplingConfig);
+
+    // Schedules the first run of `job` after now, aligned to the start of collection.
+    void ScheduleSamplingJob(TimerWheel& wheel, TimerWheel::TimerId id, SamplingJob& job);
+
+    // Switches provider jobs between their configured interval and the burst interval.
+    void SyncBurstJobs(TimerWheel& wheel);
+
+    // Adds and removes script jobs to match the scripts in ScriptManager.
+    void SyncScriptJobs(TimerWheel& wheel, const MyConfig& config);
+
+    // Runs the jobs that are due, then schedules the next tick on a timer of the
+    // thread pool. A tick of an earlier collection (before a stop or restart)
+    // returns without doing anything.
+    void Tick(UINT64 generation);
+
+    // Collects counters once and runs every job in `expired` against the sample.
+    void RunSamplingJobs(TimerWheel& wheel, const std::vector<TimerWheel::TimerId>& expired);
+
+    // Records the completion latency of the previous tick, or counts it as an overrun
+    // if some of its tasks are not done.
+    void CheckPreviousTick();
+
 private:
     MetricsManager(int intervalMS) : intervalMS_(intervalMS) {
         // Here we will get the list of available counters on the computer
+#ifdef _WIN32
         availableCounters = std::make_shared<std::vector<std::string>>(Utils::ExecuteShellCommand("typeperf -qx"));
+#else
+        availableCounters = std::make_shared<std::vector<std::string>>();
+#endif
     } // Private constructor to prevent external instantiation
     std::vector<std::unique_ptr<MetricProviderBase>> metricProviders_;
+    CounterRegistry counterRegistry;
+    BurstBuffer burstBuffer;
+    AggregateStore aggregateStore;
     std::atomic<bool> isCollectingMetrics_ = false; // Flag to control metrics collection
     std::atomic<UINT64> counter = 0;
     int intervalMS_;
 
+    // Scheduler state. This is only accessed from `Tick`, which never runs twice at once,
+    // and before the first tick.
+    MyConfig collectionConfig;
+    std::unique_ptr<TimerWheel> wheel;
+    std::vector<TimerWheel::TimerId> expiredJobs;
+    std::map<TimerWheel::TimerId, SamplingJob> samplingJobs;
+    // Scripts whose aggregates are being seeded, and the task seeding them. Their job is
+    // added once it is done.
+    std::map<std::string, TaskHandle> seedingScripts;
+    TimerWheel::TimerId nextJobId = 0;
+    TimerWheel::Clock::time_point collectionStart;
+    UINT64 scriptsVersion = 0;
+    UINT64 burstVersion = 0;
+    // Timer of the next tick in the thread pool.
+    std::atomic<UINT64> tickTimer = 0;
+    // Bumped by every start and stop, so a tick that was already running when the
+    // timer was cancelled does not start a second chain.
+    std::atomic<UINT64> collectionGeneration = 0;
+    // Tasks of the previous tick that ran jobs.
+    TaskGroup previousTick;
+    TimerWheel::Clock::time_point previousTickStart;
+
+    std::atomic<INT64> lastLatenessUS = 0;
+    std::atomic<INT64> maxLatenessUS = 0;
+    std::atomic<UINT64> missedSamples = 0;
+    // Time from the start of a tick until every task it started is done.
+    LatencyHistogram tickLatency;
+    // Ticks whose tasks were not all done when the next tick was due.
+    std::atomic<UINT64> overrunTicks = 0;
+    // Samples skipped as the previous sample of the same job was not done.
+    std::atomic<UINT64> overlappingSamples = 0;
+
     std::shared_ptr<std::vector<std::string>> availableCounters;
 };
\ No newline at end of file
@@ -10,6 +10,7 @@ class NetworkMetricProvider : public MetricProviderBase {
     struct Metric {
         std::string name;
         UINT16 counter = 0;
+        std::chrono::system_clock::time_point timestamp;
         double bytesSentPerSecond = 0;      // bytes/sec
         double bytesReceivedPerSecond = 0;  // bytes/sec
         double bytesTotalPerSecond = 0;     // bytes/sec
@@ -24,75 +25,45 @@ class NetworkMetricProvider : public MetricProviderBase {
 public:
     NetworkMetricProvider(std::string interfaceName) {
         this->name = interfaceName;
-        // Create a table for this metric provider if it does not exist
-        DataManager::GetInstance().CreateTable("NetworkMetricProvider", " \
-            id INTEGER PRIMARY KEY, \
-            name TEXT DEFAULT \"" + interfaceName + "\", \
-            counter INTEGER NOT NULL, \
-            bytesSentPerSecond REAL DEFAULT 0, \
-            bytesReceivedPerSecond REAL DEFAULT 0, \
-            bytesTotalPerSecond REAL DEFAULT 0, \
-            currentBandwidth REAL DEFAULT 0, \
-            packetsReceivedPerSecond REAL DEFAULT 0, \
-            packetsSentPerSecond REAL DEFAULT 0, \
-            connectionsActive REAL DEFAULT 0, \
-            connectionsEstablished REAL DEFAULT 0, \
-            networkErrorsPerSecond REAL DEFAULT 0, \
-            timestamp INTEGER NOT NULL");
-
-        PDH_STATUS status = PdhOpenQuery(nullptr, 0, &queryHandle);
-        if (status != ERROR_SUCCESS) {
-            throw std::runtime_error("Failed to open PDH query.");
-        }
-
-        // Create a wstring using wstring_convert
-        std::wstring wideString = Utils::StringToWstring(name);
-
-        std::wstring bytesSentName = L"\\Network Interface(" + wideString + L")\\Bytes Sent/sec";
-        std::wstring bytesRecivedName = L"\\Network Interface(" + wideString + L")\\Bytes Received/sec";
-        std::wstring bytesTotalName = L"\\Network Interface(" + wideString + L")\\Bytes Total/sec";
-        std::wstring currentBandwidthName = L"\\Network Interface(" + wideString + L")\\Current Bandwidth";
-        std::wstring packetsRecivedName = L"\\Network Interface(" + wideString + L")\\Packets Received/sec";
-        std::wstring packetsSentName = L"\\Network Interface(" + wideString + L")\\Packets Sent/sec";
-        std::wstring connectionsActiveName = L"\\Network Interface(" + wideString + L")\\Connections Active";
-        std::wstring connectionsEstablishedName = L"\\Network Interface(" + wideString + L")\\Connections Established";
-        std::wstring networkErrorName = L"\\Network Interface(" + wideString + L")\\Network Error/sec";
-
-        PdhAddEnglishCounter(queryHandle, bytesSentName.c_str(), 0, &bytesSentCounter);
-        PdhAddEnglishCounter(queryHandle, bytesRecivedName.c_str(), 0, &bytesReceivedCounter);
-        PdhAddEnglishCounter(queryHandle, bytesTotalName.c_str(), 0, &bytesTotalCounter);
-        PdhAddEnglishCounter(queryHandle, currentBandwidthName.c_str(), 0, &currentBandwidthCounter);
-        PdhAddEnglishCounter(queryHandle, packetsRecivedName.c_str(), 0, &packetsReceivedCounter);
-        PdhAddEnglishCounter(queryHandle, packetsSentName.c_str(), 0, &packetsSentCounter);
-        PdhAddEnglishCounter(queryHandle, connectionsActiveName.c_str(), 0, &connectionsActiveCounter);
-        PdhAddEnglishCounter(queryHandle, connectionsEstablishedName.c_str(), 0, &connectionsEstablishedCounter);
-        PdhAddEnglishCounter(queryHandle, networkErrorName.c_str(), 0, &networkErrorsCounter);
-
-        PdhCollectQueryData(queryHandle);
     }
 
     virtual rapidjson::Value GetDataJSON(rapidjson::Document& doc, const UINT8 count) const {
         // Fetch the most recent data, up to `count`
         rapidjson::Value response(rapidjson::kArrayType);
 
-        const auto rows = DataManager::GetInstance().Select("NetworkMetricProvider",
-            "name = \"" + name + "\"  ORDER BY id DESC LIMIT " + std::to_string(count));
-        for (auto& row : rows) {
+        auto statement = DataManager::GetInstance().PrepareRead("SELECT * FROM NetworkMetricProvider WHERE name = ? ORDER BY id DESC LIMIT ?");
+        const int idColumn = statement.GetColumnIndex("id");
+        const int counterColumn = statement.GetColumnIndex("counter");
+        const int timestampColumn = statement.GetColumnIndex("timestamp");
+        const int bytesSentPerSecondColumn = statement.GetColumnIndex("bytesSentPerSecond");
+        const int bytesReceivedPerSecondColumn = statement.GetColumnIndex("bytesReceivedPerSecond");
+        const int bytesTotalPerSecondColumn = statement.GetColumnIndex("bytesTotalPerSecond");
+        const int currentBandwidthColumn = statement.GetColumnIndex("currentBandwidth");
+        const int packetsReceivedPerSecondColumn = statement.GetColumnIndex("packetsReceivedPerSecond");
+        const int packetsSentPerSecondColumn = statement.GetColumnIndex("packetsSentPerSecond");
+        const int connectionsActiveColumn = statement.GetColumnIndex("connectionsActive");
+        const int connectionsEstablishedColumn = statement.GetColumnIndex("connectionsEstablished");
+        const int networkErrorsPerSecondColumn = statement.GetColumnIndex("networkErrorsPerSecond");
+
+        statement
+            .BindText(name)
+            .BindInt64(count)
+            .ExecuteSelect([&](const Cursor& row) {
             rapidjson::Value obj(rapidjson::kObjectType);
 
-            auto id = row.GetInt("id");
-            auto counter = row.GetInt("counter");
-            auto timestamp = row.GetInt("timestamp");
+            auto id = row.GetInt(idColumn);
+            auto counter = row.GetInt(counterColumn);
+            auto timestamp = row.GetInt(timestampColumn);
 
-            auto bytesSentPerSecond = row.GetDouble("bytesSentPerSecond");
-            auto bytesReceivedPerSecond = row.GetDouble("bytesReceivedPerSecond");
-            auto bytesTotalPerSecond = row.GetDouble("bytesTotalPerSecond");
-            auto currentBandwidth = row.GetDouble("currentBandwidth");
-            auto packetsReceivedPerSecond = row.GetDouble("packetsReceivedPerSecond");
-            auto packetsSentPerSecond = row.GetDouble("packetsSentPerSecond");
-            auto connectionsActive = row.GetDouble("connectionsActive");
-            auto connectionsEstablished = row.GetDouble("connectionsEstablished");
-            auto networkErrorsPerSecond = row.GetDouble("networkErrorsPerSecond");
+            auto bytesSentPerSecond = row.GetDouble(bytesSentPerSecondColumn);
+            auto bytesReceivedPerSecond = row.GetDouble(bytesReceivedPerSecondColumn);
+            auto bytesTotalPerSecond = row.GetDouble(bytesTotalPerSecondColumn);
+            auto currentBandwidth = row.GetDouble(currentBandwidthColumn);
+            auto packetsReceivedPerSecond = row.GetDouble(packetsReceivedPerSecondColumn);
+            auto packetsSentPerSecond = row.GetDouble(packetsSentPerSecondColumn);
+            auto connectionsActive = row.GetDouble(connectionsActiveColumn);
+            auto connectionsEstablished = row.GetDouble(connectionsEstablishedColumn);
+            auto networkErrorsPerSecond = row.GetDouble(networkErrorsPerSecondColumn);
 
 
             obj.AddMember("id", Utils::ConvertIntToJSONValue(id, doc.GetAllocator()), doc.GetAllocator());
@@ -109,89 +80,115 @@ public:
             obj.AddMember("networkErrorsPerSecond", Utils::ConvertDoubleToJSONValue(networkErrorsPerSecond, doc.GetAllocator()), doc.GetAllocator());
 
             response.PushBack(obj, doc.GetAllocator());
-        }
+            });
 
         return response;
     };
 
     virtual rapidjson::Value GetAggregateDataJSON(rapidjson::Document& doc, const std::string column) const {
-        const auto& rows = DataManager::GetInstance().SelectAggregate("NetworkMetricProvider", column, "name = \"" + name + "\"");
         rapidjson::Value obj(rapidjson::kObjectType);
-
-        const auto& row = rows[0];
-        auto max = row.GetDouble("max");
-        auto min = row.GetDouble("min");
-        auto avg = row.GetDouble("avg");
-        auto total = row.GetDouble("total");
-        auto count = row.GetInt("count");
-
-        obj.AddMember("max", Utils::ConvertDoubleToJSONValue(max, doc.GetAllocator()), doc.GetAllocator());
-        obj.AddMember("min", Utils::ConvertDoubleToJSONValue(min, doc.GetAllocator()), doc.GetAllocator());
-        obj.AddMember("avg", Utils::ConvertDoubleToJSONValue(avg, doc.GetAllocator()), doc.GetAllocator());
-        obj.AddMember("total", Utils::ConvertDoubleToJSONValue(total, doc.GetAllocator()), doc.GetAllocator());
-        obj.AddMember("count", Utils::ConvertDoubleToJSONValue(count, doc.GetAllocator()), doc.GetAllocator());
+        RollupManager::GetInstance().SelectAggregate("NetworkMetricProvider", name, column).AddMembers(obj, doc);
 
         return obj;
     };
 
     virtual std::string GetName() { return  name; }
+
+    virtual std::string GetTableName() const override { return "NetworkMetricProvider"; }
+
+    virtual const std::vector<std::string>& GetColumns() const override {
+        static const std::vector<std::string> columns = { "bytesSentPerSecond", "bytesReceivedPerSecond", "bytesTotalPerSecond", "currentBandwidth", "packetsReceivedPerSecond", "packetsSentPerSecond", "connectionsActive", "connectionsEstablished", "networkErrorsPerSecond" };
+        return columns;
+    }
+
     virtual bool IsMulti() { return  true; }
 
-    virtual void RetrieveMetricValue(UINT16 counter) override {
+    virtual void RegisterCounters(CounterRegistry& registry) override {
+        std::string bytesSentName = "\\Network Interface(" + name + ")\\Bytes Sent/sec";
+        std::string bytesRecivedName = "\\Network Interface(" + name + ")\\Bytes Received/sec";
+        std::string bytesTotalName = "\\Network Interface(" + name + ")\\Bytes Total/sec";
+        std::string currentBandwidthName = "\\Network Interface(" + name + ")\\Current Bandwidth";
+        std::string packetsRecivedName = "\\Network Interface(" + name + ")\\Packets Received/sec";
+        std::string packetsSentName = "\\Network Interface(" + name + ")\\Packets Sent/sec";
+        std::string connectionsActiveName = "\\Network Interface(" + name + ")\\Connections Active";
+        std::string connectionsEstablishedName = "\\Network Interface(" + name + ")\\Connections Established";
+        std::string networkErrorName = "\\Network Interface(" + name + ")\\Network Error/sec";
+
+        bytesSentCounter = registry.AddCounter(bytesSentName);
+        bytesReceivedCounter = registry.AddCounter(bytesRecivedName);
+        bytesTotalCounter = registry.AddCounter(bytesTotalName);
+        currentBandwidthCounter = registry.AddCounter(currentBandwidthName);
+        packetsReceivedCounter = registry.AddCounter(packetsRecivedName);
+        packetsSentCounter = registry.AddCounter(packetsSentName);
+        connectionsActiveCounter = registry.AddCounter(connectionsActiveName);
+        connectionsEstablishedCounter = registry.AddCounter(connectionsEstablishedName);
+        networkErrorsCounter = registry.AddCounter(networkErrorName);
+    }
+
+    virtual void RetrieveMetricValue(const CounterSample& sample) override {
         // Save the data to the database
         latestValue = std::make_shared<Metric>();
         latestValue->name = name;
-        latestValue->counter = counter;
-
-        if (CollectData()) {
-            latestValue->bytesSentPerSecond = GetCounterValue(bytesSentCounter);
-            latestValue->bytesReceivedPerSecond = GetCounterValue(bytesReceivedCounter);
-            latestValue->bytesTotalPerSecond = GetCounterValue(bytesTotalCounter);
-            latestValue->currentBandwidth = GetCounterValue(currentBandwidthCounter);
-            latestValue->packetsReceivedPerSecond = GetCounterValue(packetsReceivedCounter);
-            latestValue->packetsSentPerSecond = GetCounterValue(packetsSentCounter);
-            latestValue->connectionsActive = GetCounterValue(connectionsActiveCounter);
-            latestValue->connectionsEstablished = GetCounterValue(connectionsEstablishedCounter);
-            latestValue->networkErrorsPerSecond = GetCounterValue(networkErrorsCounter);
+        latestValue->counter = sample.counter;
+        latestValue->timestamp = sample.timestamp;
+
+        if (sample.isValid) {
+            latestValue->bytesSentPerSecond = sample.GetValue(bytesSentCounter);
+            latestValue->bytesReceivedPerSecond = sample.GetValue(bytesReceivedCounter);
+            latestValue->bytesTotalPerSecond = sample.GetValue(bytesTotalCounter);
+            latestValue->currentBandwidth = sample.GetValue(currentBandwidthCounter);
+            latestValue->packetsReceivedPerSecond = sample.GetValue(packetsReceivedCounter);
+            latestValue->packetsSentPerSecond = sample.GetValue(packetsSentCounter);
+            latestValue->connectionsActive = sample.GetValue(connectionsActiveCounter);
+            latestValue->connectionsEstablished = sample.GetValue(connectionsEstablishedCounter);
+            latestValue->networkErrorsPerSecond = sample.GetValue(networkErrorsCounter);
         }
 
-        Persist();
+        if (Publish(sample, {
+            latestValue->bytesSentPerSecond,
+            latestValue->bytesReceivedPerSecond,
+            latestValue->bytesTotalPerSecond,
+            latestValue->currentBandwidth,
+            latestValue->packetsReceivedPerSecond,
+            latestValue->packetsSentPerSecond,
+            latestValue->connectionsActive,
+            latestValue->connectionsEstablished,
+            latestValue->networkErrorsPerSecond
+        })) {
+            Persist();
+        }
     }
 
 protected:
     virtual void Persist() override {
-        const auto p1 = std::chrono::system_clock::now();
-
-        // Create a stringstream object
-        std::ostringstream stream{};
-        stream << "NULL, "
-            << "\"" << latestValue->name << "\", "
-            << latestValue->counter << ", "
-            << latestValue->bytesSentPerSecond << ", "
-            << latestValue->bytesReceivedPerSecond << ", "
-            << latestValue->bytesTotalPerSecond << ", "
-            << latestValue->currentBandwidth << ", "
-            << latestValue->packetsReceivedPerSecond << ", "
-            << latestValue->packetsSentPerSecond << ", "
-            << latestValue->connectionsActive << ", "
-            << latestValue->connectionsEstablished << ", "
-            << latestValue->networkErrorsPerSecond << ", "
-            << std::chrono::duration_cast<std::chrono::seconds>(p1.time_since_epoch()).count();
-        std::string sqlString = stream.str();
-
-        DataManager::GetInstance().Insert("NetworkMetricProvider", sqlString);
+        const auto p1 = latestValue->timestamp;
+
+        StorageWriter::GetInstance().WriteSample("INSERT INTO NetworkMetricProvider VALUES (NULL, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)", latestValue->name)
+            .BindText(latestValue->name)
+            .BindInt64(latestValue->counter)
+            .BindDouble(latestValue->bytesSentPerSecond)
+            .BindDouble(latestValue->bytesReceivedPerSecond)
+            .BindDouble(latestValue->bytesTotalPerSecond)
+            .BindDouble(latestValue->currentBandwidth)
+            .BindDouble(latestValue->packetsReceivedPerSecond)
+            .BindDouble(latestValue->packetsSentPerSecond)
+            .BindDouble(latestValue->connectionsActive)
+            .BindDouble(latestValue->connectionsEstablished)
+            .BindDouble(latestValue->networkErrorsPerSecond)
+            .BindInt64(std::chrono::duration_cast<std::chrono::seconds>(p1.time_since_epoch()).count())
+            .Submit();
     };
 
 private:
-    PDH_HCOUNTER bytesSentCounter;
-    PDH_HCOUNTER bytesReceivedCounter;
-    PDH_HCOUNTER bytesTotalCounter;
-    PDH_HCOUNTER currentBandwidthCounter;
-    PDH_HCOUNTER packetsReceivedCounter;
-    PDH_HCOUNTER packetsSentCounter;
-    PDH_HCOUNTER connectionsActiveCounter;
-    PDH_HCOUNTER connectionsEstablishedCounter;
-    PDH_HCOUNTER networkErrorsCounter;
+    CounterHandle bytesSentCounter;
+    CounterHandle bytesReceivedCounter;
+    CounterHandle bytesTotalCounter;
+    CounterHandle currentBandwidthCounter;
+    CounterHandle packetsReceivedCounter;
+    CounterHandle packetsSentCounter;
+    CounterHandle connectionsActiveCounter;
+    CounterHandle connectionsEstablishedCounter;
+    CounterHandle networkErrorsCounter;
 
     std::shared_ptr<Metric> latestValue = NULL;
     std::string name;
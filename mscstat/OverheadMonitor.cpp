@@ -0,0 +1,97 @@
+#include "OverheadMonitor.h"
+#ifdef _WIN32
+#include <Windows.h>
+#include <Psapi.h>
+#else
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+bool OverheadMonitor::GetProcessUsage(ProcessUsage& usage) {
+    const auto process = GetCurrentProcess();
+
+    FILETIME creationTime;
+    FILETIME exitTime;
+    FILETIME kernelTime;
+    FILETIME userTime;
+    if (!GetProcessTimes(process, &creationTime, &exitTime, &kernelTime, &userTime)) {
+        return false;
+    }
+
+    // File times are in units of 100 nanoseconds.
+    ULARGE_INTEGER kernel;
+    kernel.LowPart = kernelTime.dwLowDateTime;
+    kernel.HighPart = kernelTime.dwHighDateTime;
+    ULARGE_INTEGER user;
+    user.LowPart = userTime.dwLowDateTime;
+    user.HighPart = userTime.dwHighDateTime;
+    usage.cpuTimeUS = (kernel.QuadPart + user.QuadPart) / 10;
+
+    PROCESS_MEMORY_COUNTERS memory;
+    if (!GetProcessMemoryInfo(process, &memory, sizeof(memory))) {
+        return false;
+    }
+    usage.residentBytes = memory.WorkingSetSize;
+
+    IO_COUNTERS io;
+    if (!GetProcessIoCounters(process, &io)) {
+        return false;
+    }
+    usage.writtenBytes = io.WriteTransferCount;
+
+    return true;
+}
+#else
+bool OverheadMonitor::GetProcessUsage(ProcessUsage& usage) {
+    // utime and stime are the 14th and 15th fields. The command name, in parentheses,
+    // may hold spaces, so fields are counted from the last parenthesis.
+    std::ifstream stat("/proc/self/stat");
+    std::string line;
+    if (!std::getline(stat, line)) {
+        return false;
+    }
+
+    const auto end = line.rfind(')');
+    if (end == std::string::npos) {
+        return false;
+    }
+
+    unsigned long long userTicks = 0;
+    unsigned long long systemTicks = 0;
+    if (std::sscanf(line.c_str() + end + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &userTicks, &systemTicks) != 2) {
+        return false;
+    }
+
+    const auto ticksPerSecond = sysconf(_SC_CLK_TCK);
+    if (ticksPerSecond <= 0) {
+        return false;
+    }
+    usage.cpuTimeUS = (userTicks + systemTicks) * 1000000 / ticksPerSecond;
+
+    // The second field of statm is the resident set in pages.
+    std::ifstream statm("/proc/self/statm");
+    unsigned long long sizePages = 0;
+    unsigned long long residentPages = 0;
+    if (!(statm >> sizePages >> residentPages)) {
+        return false;
+    }
+    usage.residentBytes = residentPages * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+
+    // `wchar` counts bytes passed to write calls, as the Windows counter does, whether
+    // or not they reached the disk.
+    std::ifstream io("/proc/self/io");
+    std::string name;
+    unsigned long long value = 0;
+    while (io >> name >> value) {
+        if (name == "wchar:") {
+            usage.writtenBytes = value;
+            return true;
+        }
+    }
+
+    return false;
+}
+#endif
@@ -0,0 +1,60 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// Parts of the application whose writes to disk are counted separately.
+enum Subsystem {
+    // Pages written by the SQLite writer to the WAL, and by checkpoints to the database.
+    DATABASE_SUBSYSTEM = 0,
+    // Chunks and indexes written by the columnar storage engine.
+    COLUMNAR_SUBSYSTEM = 1,
+    // Log messages. The prefix of each line is not counted.
+    LOG_SUBSYSTEM = 2,
+    SUBSYSTEM_COUNT = 3,
+};
+
+// Resources used by the application itself, so the overhead of the agent on the machine
+// it measures can be trended like any other metric. Each subsystem counts the bytes it
+// writes as it writes them, which takes no lock.
+class OverheadMonitor {
+public:
+    // Totals of the process since it started.
+    struct ProcessUsage {
+        // User and kernel time of every thread, in microseconds.
+        uint64_t cpuTimeUS = 0;
+        // Resident set, or working set on Windows, in bytes.
+        uint64_t residentBytes = 0;
+        // Bytes written to files and devices, by any part of the process.
+        uint64_t writtenBytes = 0;
+    };
+
+    static OverheadMonitor& GetInstance() {
+        static OverheadMonitor instance;
+        return instance;
+    }
+
+    void AddWrittenBytes(Subsystem subsystem, uint64_t bytes) {
+        writtenBytes[subsystem].fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    // Bytes written by `subsystem` since the process started.
+    uint64_t GetWrittenBytes(Subsystem subsystem) const {
+        return writtenBytes[subsystem].load(std::memory_order_relaxed);
+    }
+
+    // Reads the usage of the process from the operating system. Returns `false` if it
+    // could not be read.
+    static bool GetProcessUsage(ProcessUsage& usage);
+
+private:
+    OverheadMonitor() {
+        for (auto& bytes : writtenBytes) {
+            bytes.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    OverheadMonitor(const OverheadMonitor&) = delete;
+    OverheadMonitor& operator=(const OverheadMonitor&) = delete;
+
+    std::atomic<uint64_t> writtenBytes[SUBSYSTEM_COUNT];
+};
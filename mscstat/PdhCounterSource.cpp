@@ -0,0 +1 @@
+#include "PdhCounterSource.h"
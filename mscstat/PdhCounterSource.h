@@ -0,0 +1,68 @@
+#pragma once
+#ifdef _WIN32
+#include <stdexcept>
+#include <vector>
+#include <pdh.h>
+#include <pdhmsg.h>
+
+#include "CounterSource.h"
+#include "Utils.h"
+
+// Reads counters through a single PDH query.
+class PdhCounterSource : public CounterSource {
+public:
+    PdhCounterSource() {
+        PDH_STATUS status = PdhOpenQuery(nullptr, 0, &queryHandle);
+        if (status != ERROR_SUCCESS) {
+            throw std::runtime_error("Failed to open PDH query.");
+        }
+    }
+
+    virtual ~PdhCounterSource() {
+        PdhCloseQuery(queryHandle);
+    }
+
+    virtual CounterHandle AddCounter(const std::string& path) override {
+        PDH_HCOUNTER counter = nullptr;
+        const auto widePath = Utils::StringToWstring(path);
+
+        if (PdhAddEnglishCounter(queryHandle, widePath.c_str(), 0, &counter) != ERROR_SUCCESS) {
+            LogManager::GetInstance().LogWarning("Failed to add PDH counter: {0}", path);
+            counter = nullptr;
+        }
+
+        counters.push_back(counter);
+        return counters.size() - 1;
+    }
+
+    virtual void RemoveCounter(CounterHandle handle) override {
+        if (handle < counters.size() && counters[handle] != nullptr) {
+            PdhRemoveCounter(counters[handle]);
+            counters[handle] = nullptr;
+        }
+    }
+
+    virtual bool Collect() override {
+        return PdhCollectQueryData(queryHandle) == ERROR_SUCCESS;
+    }
+
+    virtual double GetValue(CounterHandle handle) const override {
+        if (handle >= counters.size() || counters[handle] == nullptr) {
+            return 0.0;
+        }
+
+        PDH_FMT_COUNTERVALUE value;
+        PdhGetFormattedCounterValue(counters[handle], PDH_FMT_DOUBLE, nullptr, &value);
+        if (value.CStatus == PDH_CSTATUS_VALID_DATA) {
+            return value.doubleValue;
+        }
+        else {
+            return 0.0;
+        }
+    }
+
+private:
+    PDH_HQUERY queryHandle = nullptr;
+    std::vector<PDH_HCOUNTER> counters;
+};
+#endif // _WIN32
@@ -5,6 +5,7 @@ class ProcessMetricProvider: public MetricProviderBase {
     struct Metric {
         std::string name;
         UINT16 counter;
+        std::chrono::system_clock::time_point timestamp;
         double read = 0;
         double write = 0;
         double processCount = 0;
@@ -14,48 +15,34 @@ class ProcessMetricProvider: public MetricProviderBase {
 
     public:
         ProcessMetricProvider() {
-            // Create a table for this metric provider if it does not exist
-            DataManager::GetInstance().CreateTable("ProcessMetricProvider", " \
-            id INTEGER PRIMARY KEY, \
-            name TEXT DEFAULT \"Process\", \
-            counter INTEGER NOT NULL, \
-            processCount REAL DEFAULT 0, \
-            activeProcess TEXT DEFAULT \"\", \
-            activeWindow TEXT DEFAULT \"\", \
-            bytesReadPerSecond REAL DEFAULT 0, \
-            bytesWrittenPerSecond REAL DEFAULT 0, \
-            timestamp INTEGER NOT NULL");
-
-            PDH_STATUS status = PdhOpenQuery(nullptr, 0, &queryHandle);
-            if (status != ERROR_SUCCESS) {
-                throw std::runtime_error("Failed to open PDH query.");
-            }
-
-            PdhAddEnglishCounter(queryHandle, L"\\System\\Processes", 0, &processCounter);
-            PdhAddEnglishCounter(queryHandle, L"\\Process(_Total)\\IO Read Bytes/sec", 0, &readRateCounter);
-            PdhAddEnglishCounter(queryHandle, L"\\Process(_Total)\\IO Write Bytes/sec", 0, &writeRateCounter);
-
-
-            PdhCollectQueryData(queryHandle);
         }
 
         virtual rapidjson::Value GetDataJSON(rapidjson::Document& doc, const UINT8 count) const {
             // Fetch the most recent data, up to `count`
             rapidjson::Value response(rapidjson::kArrayType);
 
-            const auto rows = DataManager::GetInstance().Select("ProcessMetricProvider", "1=1 ORDER BY id DESC LIMIT " + std::to_string(count));
-            for (auto& row : rows) {
+            auto statement = DataManager::GetInstance().PrepareRead("SELECT * FROM ProcessMetricProvider ORDER BY id DESC LIMIT ?");
+            const int idColumn = statement.GetColumnIndex("id");
+            const int counterColumn = statement.GetColumnIndex("counter");
+            const int timestampColumn = statement.GetColumnIndex("timestamp");
+            const int processCountColumn = statement.GetColumnIndex("processCount");
+            const int activeProcessColumn = statement.GetColumnIndex("activeProcess");
+            const int activeWindowColumn = statement.GetColumnIndex("activeWindow");
+            const int bytesReadPerSecondColumn = statement.GetColumnIndex("bytesReadPerSecond");
+            const int bytesWrittenPerSecondColumn = statement.GetColumnIndex("bytesWrittenPerSecond");
+
+            statement.BindInt64(count).ExecuteSelect([&](const Cursor& row) {
                 rapidjson::Value obj(rapidjson::kObjectType);
 
-                auto id = row.GetInt("id");
-                auto counter = row.GetInt("counter");
-                auto timestamp = row.GetInt("timestamp");
+                auto id = row.GetInt(idColumn);
+                auto counter = row.GetInt(counterColumn);
+                auto timestamp = row.GetInt(timestampColumn);
 
-                auto processCount = row.GetDouble("processCount");
-                auto activeProcess = row.GetString("activeProcess");
-                auto activeWindow = row.GetString("activeWindow");
-                auto bytesReadPerSecond = row.GetDouble("bytesReadPerSecond");
-                auto bytesWrittenPerSecond = row.GetDouble("bytesWrittenPerSecond");
+                auto processCount = row.GetDouble(processCountColumn);
+                auto activeProcess = row.GetString(activeProcessColumn);
+                auto activeWindow = row.GetString(activeWindowColumn);
+                auto bytesReadPerSecond = row.GetDouble(bytesReadPerSecondColumn);
+                auto bytesWrittenPerSecond = row.GetDouble(bytesWrittenPerSecondColumn);
 
                 obj.AddMember("id", Utils::ConvertIntToJSONValue(id, doc.GetAllocator()), doc.GetAllocator());
                 obj.AddMember("counter", Utils::ConvertIntToJSONValue(counter, doc.GetAllocator()), doc.GetAllocator());
@@ -73,74 +60,73 @@ class ProcessMetricProvider: public MetricProviderBase {
                 obj.AddMember("activeWindow",activeWindow_, doc.GetAllocator());
 
                 response.PushBack(obj, doc.GetAllocator());
-            }
+                });
 
             return response;
         };
 
         virtual rapidjson::Value GetAggregateDataJSON(rapidjson::Document& doc, const std::string column) const {
-            const auto& rows = DataManager::GetInstance().SelectAggregate("ProcessMetricProvider", column);
             rapidjson::Value obj(rapidjson::kObjectType);
-
-            const auto& row = rows[0];
-            auto max = row.GetDouble("max");
-            auto min = row.GetDouble("min");
-            auto avg = row.GetDouble("avg");
-            auto total = row.GetDouble("total");
-            auto count = row.GetInt("count");
-
-            obj.AddMember("max", Utils::ConvertDoubleToJSONValue(max, doc.GetAllocator()), doc.GetAllocator());
-            obj.AddMember("min", Utils::ConvertDoubleToJSONValue(min, doc.GetAllocator()), doc.GetAllocator());
-            obj.AddMember("avg", Utils::ConvertDoubleToJSONValue(avg, doc.GetAllocator()), doc.GetAllocator());
-            obj.AddMember("total", Utils::ConvertDoubleToJSONValue(total, doc.GetAllocator()), doc.GetAllocator());
-            obj.AddMember("count", Utils::ConvertDoubleToJSONValue(count, doc.GetAllocator()), doc.GetAllocator());
+            RollupManager::GetInstance().SelectAggregate("ProcessMetricProvider", "Process", column).AddMembers(obj, doc);
 
             return obj;
         };
 
         virtual std::string GetName() { return  "Process"; }
 
-        virtual void RetrieveMetricValue(UINT16 counter) override {
+        virtual std::string GetTableName() const override { return "ProcessMetricProvider"; }
+
+        virtual const std::vector<std::string>& GetColumns() const override {
+            static const std::vector<std::string> columns = { "processCount", "bytesReadPerSecond", "bytesWrittenPerSecond" };
+            return columns;
+        }
+
+        virtual void RegisterCounters(CounterRegistry& registry) override {
+            processCounter = registry.AddCounter("\\System\\Processes");
+            readRateCounter = registry.AddCounter("\\Process(_Total)\\IO Read Bytes/sec");
+            writeRateCounter = registry.AddCounter("\\Process(_Total)\\IO Write Bytes/sec");
+        }
+
+        virtual void RetrieveMetricValue(const CounterSample& sample) override {
             // Save the data to the database
             latestValue = std::make_shared<Metric>();
             latestValue->name = "Process";
-            latestValue->counter = counter;
+            latestValue->counter = sample.counter;
+            latestValue->timestamp = sample.timestamp;
 
-            if (CollectData()) {
-                latestValue->processCount = GetCounterValue(processCounter);
+            if (sample.isValid) {
+                latestValue->processCount = sample.GetValue(processCounter);
                 latestValue->activeProcess= Utils::GetActiveProcessTitle();
                 latestValue->activeWindow = Utils::GetActiveWindowTitle();
-                latestValue->read = GetCounterValue(readRateCounter);
-                latestValue->write = GetCounterValue(writeRateCounter);
+                latestValue->read = sample.GetValue(readRateCounter);
+                latestValue->write = sample.GetValue(writeRateCounter);
             }
 
-            Persist();
+            if (Publish(sample, { latestValue->processCount, latestValue->read, latestValue->write })) {
+                Persist();
+            }
         }
 
     protected:
         virtual void Persist() override {
-            const auto p1 = std::chrono::system_clock::now();
-
-            // Create a stringstream object
-            std::ostringstream stream{};
-            stream << "NULL, "
-                << "\"" << latestValue->name << "\", "
-                << latestValue->counter << ", "
-                << latestValue->processCount << ", "
-                << "\"" << latestValue->activeProcess<< "\"" << ", "
-                << "\"" << latestValue->activeWindow << "\"" << ", "
-                << latestValue->read << ", "
-                << latestValue->write << ", "
-                << std::chrono::duration_cast<std::chrono::seconds>(p1.time_since_epoch()).count();
-            std::string sqlString = stream.str();
-
-            DataManager::GetInstance().Insert("ProcessMetricProvider", sqlString);
+            const auto p1 = latestValue->timestamp;
+
+            StorageWriter::GetInstance().WriteSample("INSERT INTO ProcessMetricProvider VALUES (NULL, ?, ?, ?, ?, ?, ?, ?, ?)", latestValue->name)
+                .BindText(latestValue->name)
+                .BindInt64(latestValue->counter)
+                .BindDouble(latestValue->processCount)
+                .BindText(latestValue->activeProcess)
+                .BindText(latestValue->activeWindow)
+                .BindDouble(latestValue->read)
+                .BindDouble(latestValue->write)
+                .BindInt64(std::chrono::duration_cast<std::chrono::seconds>(p1.time_since_epoch()).count())
+                .Submit();
         };
 
     private:
-        PDH_HCOUNTER processCounter;
-        PDH_HCOUNTER readRateCounter;
-        PDH_HCOUNTER writeRateCounter;
+        CounterHandle processCounter;
+        CounterHandle readRateCounter;
+        CounterHandle writeRateCounter;
 
         std::shared_ptr<Metric> latestValue = NULL;
 };
@@ -6,6 +6,7 @@ class RAMMetricProvider : public MetricProviderBase {
     struct Metric {
         std::string name;
         UINT16 counter;
+        std::chrono::system_clock::time_point timestamp;
         double available = 0; // bytes
         double committed = 0; // bytes
         double pageFaults = 0; // fault/sec
@@ -13,43 +14,30 @@ class RAMMetricProvider : public MetricProviderBase {
 
 public:
     RAMMetricProvider() {
-        // Create a table for this metric provider if it does not exist
-        DataManager::GetInstance().CreateTable("RAMMetricProvider", " \
-            id INTEGER PRIMARY KEY, \
-            name TEXT DEFAULT \"Memory\", \
-            counter INTEGER NOT NULL, \
-            available REAL DEFAULT 0, \
-            committed REAL DEFAULT 0, \
-            pageFaults REAL DEFAULT 0, \
-            timestamp INTEGER NOT NULL");
-
-        PDH_STATUS status = PdhOpenQuery(nullptr, 0, &queryHandle);
-        if (status != ERROR_SUCCESS) {
-            throw std::runtime_error("Failed to open PDH query.");
-        }
-
-        PdhAddEnglishCounter(queryHandle, L"\\Memory\\Available Bytes", 0, &availableCounter);
-        PdhAddEnglishCounter(queryHandle, L"\\Memory\\Committed Bytes", 0, &committedCounter);
-        PdhAddEnglishCounter(queryHandle, L"\\Memory\\Page Faults/sec", 0, &pageFaultsCounter);
-
-        PdhCollectQueryData(queryHandle);
     }
 
     virtual rapidjson::Value GetDataJSON(rapidjson::Document& doc, const UINT8 count) const {
         // Fetch the most recent data, up to `count`
         rapidjson::Value response(rapidjson::kArrayType);
 
-        const auto rows = DataManager::GetInstance().Select("RAMMetricProvider", "1=1 ORDER BY id DESC LIMIT " + std::to_string(count));
-        for (auto& row : rows) {
+        auto statement = DataManager::GetInstance().PrepareRead("SELECT * FROM RAMMetricProvider ORDER BY id DESC LIMIT ?");
+        const int idColumn = statement.GetColumnIndex("id");
+        const int counterColumn = statement.GetColumnIndex("counter");
+        const int timestampColumn = statement.GetColumnIndex("timestamp");
+        const int availableColumn = statement.GetColumnIndex("available");
+        const int committedColumn = statement.GetColumnIndex("committed");
+        const int pageFaultsColumn = statement.GetColumnIndex("pageFaults");
+
+        statement.BindInt64(count).ExecuteSelect([&](const Cursor& row) {
             rapidjson::Value obj(rapidjson::kObjectType);
 
-            auto id = row.GetInt("id");
-            auto counter = row.GetInt("counter");
-            auto timestamp = row.GetInt("timestamp");
+            auto id = row.GetInt(idColumn);
+            auto counter = row.GetInt(counterColumn);
+            auto timestamp = row.GetInt(timestampColumn);
 
-            auto available = row.GetDouble("available");
-            auto committed = row.GetDouble("committed");
-            auto pageFaults = row.GetDouble("pageFaults");
+            auto available = row.GetDouble(availableColumn);
+            auto committed = row.GetDouble(committedColumn);
+            auto pageFaults = row.GetDouble(pageFaultsColumn);
 
             obj.AddMember("id", Utils::ConvertIntToJSONValue(id, doc.GetAllocator()), doc.GetAllocator());
             obj.AddMember("counter", Utils::ConvertIntToJSONValue(counter, doc.GetAllocator()), doc.GetAllocator());
@@ -59,83 +47,82 @@ public:
             obj.AddMember("pageFaults", Utils::ConvertDoubleToJSONValue(pageFaults, doc.GetAllocator()), doc.GetAllocator());
 
             response.PushBack(obj, doc.GetAllocator());
-        }
+            });
 
         return response;
     };
 
     virtual rapidjson::Value GetAggregateDataJSON(rapidjson::Document& doc, const std::string column) const {
-        const auto& rows = DataManager::GetInstance().SelectAggregate("RAMMetricProvider", column);
         rapidjson::Value obj(rapidjson::kObjectType);
-
-        const auto& row = rows[0];
-        auto max = row.GetDouble("max");
-        auto min = row.GetDouble("min");
-        auto avg = row.GetDouble("avg");
-        auto total = row.GetDouble("total");
-        auto count = row.GetInt("count");
-
-        obj.AddMember("max", Utils::ConvertDoubleToJSONValue(max, doc.GetAllocator()), doc.GetAllocator());
-        obj.AddMember("min", Utils::ConvertDoubleToJSONValue(min, doc.GetAllocator()), doc.GetAllocator());
-        obj.AddMember("avg", Utils::ConvertDoubleToJSONValue(avg, doc.GetAllocator()), doc.GetAllocator());
-        obj.AddMember("total", Utils::ConvertDoubleToJSONValue(total, doc.GetAllocator()), doc.GetAllocator());
-        obj.AddMember("count", Utils::ConvertDoubleToJSONValue(count, doc.GetAllocator()), doc.GetAllocator());
+        RollupManager::GetInstance().SelectAggregate("RAMMetricProvider", "Memory", column).AddMembers(obj, doc);
 
         return obj;
     };
 
     virtual std::string GetName() { return  "Memory"; }
 
-    virtual void RetrieveMetricValue(UINT16 counter) override {
+    virtual std::string GetTableName() const override { return "RAMMetricProvider"; }
+
+    virtual const std::vector<std::string>& GetColumns() const override {
+        static const std::vector<std::string> columns = { "available", "committed", "pageFaults" };
+        return columns;
+    }
+
+    virtual void RegisterCounters(CounterRegistry& registry) override {
+        availableCounter = registry.AddCounter("\\Memory\\Available Bytes");
+        committedCounter = registry.AddCounter("\\Memory\\Committed Bytes");
+        pageFaultsCounter = registry.AddCounter("\\Memory\\Page Faults/sec");
+    }
+
+    virtual void RetrieveMetricValue(const CounterSample& sample) override {
         // Save the data to the database
         latestValue = std::make_shared<Metric>();
         latestValue->name = "Memory";
-        latestValue->counter = counter;
+        latestValue->counter = sample.counter;
+        latestValue->timestamp = sample.timestamp;
 
-        if (CollectData()) {
-            latestValue->available = GetAvailableRate();
-            latestValue->committed = GetCommittedRate();
-            latestValue->pageFaults = GetPageFaultsRate();
+        if (sample.isValid) {
+            latestValue->available = GetAvailableRate(sample);
+            latestValue->committed = GetCommittedRate(sample);
+            latestValue->pageFaults = GetPageFaultsRate(sample);
         }
 
-        Persist();
+        if (Publish(sample, { latestValue->available, latestValue->committed, latestValue->pageFaults })) {
+            Persist();
+        }
     }
 
 protected:
     virtual void Persist() override {
-        const auto p1 = std::chrono::system_clock::now();
-
-        // Create a stringstream object
-        std::ostringstream stream{};
-        stream << "NULL, "
-            << "\"" << latestValue->name << "\", "
-            << latestValue->counter << ", "
-            << latestValue->available << ", "
-            << latestValue->committed << ", "
-            << latestValue->pageFaults << ", "
-            << std::chrono::duration_cast<std::chrono::seconds>(p1.time_since_epoch()).count();
-        std::string sqlString = stream.str();
-
-        DataManager::GetInstance().Insert("RAMMetricProvider", sqlString);
+        const auto p1 = latestValue->timestamp;
+
+        StorageWriter::GetInstance().WriteSample("INSERT INTO RAMMetricProvider VALUES (NULL, ?, ?, ?, ?, ?, ?)", latestValue->name)
+            .BindText(latestValue->name)
+            .BindInt64(latestValue->counter)
+            .BindDouble(latestValue->available)
+            .BindDouble(latestValue->committed)
+            .BindDouble(latestValue->pageFaults)
+            .BindInt64(std::chrono::duration_cast<std::chrono::seconds>(p1.time_since_epoch()).count())
+            .Submit();
     };
 
 private:
-    double GetAvailableRate() {
-        return GetCounterValue(availableCounter);
+    double GetAvailableRate(const CounterSample& sample) {
+        return sample.GetValue(availableCounter);
     }
 
-    double GetCommittedRate() {
-        return GetCounterValue(committedCounter);
+    double GetCommittedRate(const CounterSample& sample) {
+        return sample.GetValue(committedCounter);
     }
 
-    double GetPageFaultsRate() {
-        return GetCounterValue(pageFaultsCounter);
+    double GetPageFaultsRate(const CounterSample& sample) {
+        return sample.GetValue(pageFaultsCounter);
     }
 
 private:
-    PDH_HCOUNTER availableCounter;
-    PDH_HCOUNTER committedCounter;
-    PDH_HCOUNTER pageFaultsCounter;
+    CounterHandle availableCounter;
+    CounterHandle committedCounter;
+    CounterHandle pageFaultsCounter;
 
     std::shared_ptr<Metric> latestValue = NULL;
 };
@@ -0,0 +1 @@
+#include "RingBuffer.h"
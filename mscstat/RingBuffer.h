@@ -0,0 +1,47 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+// Fixed-size circular buffer. Once full, pushing an item overwrites the oldest one.
+// This is not thread safe; callers are expected to provide their own locking.
+template <typename T>
+class RingBuffer {
+public:
+    explicit RingBuffer(size_t capacity = 0) : items(capacity) {}
+
+    void Push(const T& item) {
+        if (items.empty()) {
+            return;
+        }
+
+        items[head] = item;
+        head = (head + 1) % items.size();
+        if (size < items.size()) {
+            size++;
+        }
+    }
+
+    // Returns the item `index` places before the most recent one.
+    const T& FromNewest(size_t index) const {
+        return items[(head + items.size() - 1 - index) % items.size()];
+    }
+
+    size_t Size() const {
+        return size;
+    }
+
+    size_t Capacity() const {
+        return items.size();
+    }
+
+    void Clear() {
+        head = 0;
+        size = 0;
+    }
+
+private:
+    std::vector<T> items;
+    // Index the next item will be written to.
+    size_t head = 0;
+    size_t size = 0;
+};
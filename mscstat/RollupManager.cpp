@@ -0,0 +1,320 @@
+#include "RollupManager.h"
+#include "Application.h"
+
+void RollupManager::Run() {
+    try {
+        const auto config = ConfigManager::GetInstance().GetConfig();
+        const int64_t now = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+        std::map<std::string, Source> snapshot;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            snapshot = sources;
+        }
+
+        // Scripts come and go, so their series are picked up on every run. Scripts that
+        // have been deleted keep being rolled up and expired until their data is gone.
+        if (auto it = snapshot.find("ScriptData"); it != snapshot.end() && Application::theApp->scriptManager) {
+            for (const auto& name : Application::theApp->scriptManager->GetSeriesNames()) {
+                it->second.series.insert(name);
+                AddSeries("ScriptData", name);
+            }
+        }
+
+        for (const auto& [table, source] : snapshot) {
+            for (const auto& name : source.series) {
+                RollupRaw(table, source, name, now);
+                for (size_t i = 1; i < LEVEL_COUNT; i++) {
+                    RollupLevel(table, name, i);
+                }
+
+                ApplyRetention(table, source, name, config.GetRetentionConfig(name), config.retentionBatchSize, now);
+            }
+        }
+
+        // Burst aggregates are kept as long as raw samples. Their timestamps are in milliseconds.
+        const auto retention = config.GetRetentionConfig("default");
+        if (retention.raw > 0) {
+            StorageWriter::GetInstance().Write("DELETE FROM BurstAggregate WHERE id IN (SELECT id FROM BurstAggregate WHERE timestamp < ? LIMIT ?)", "retention.BurstAggregate")
+                .BindInt64((now - retention.raw) * 1000)
+                .BindInt64(config.retentionBatchSize)
+                .Submit();
+        }
+    }
+    catch (const std::exception& e) {
+        LogManager::GetInstance().LogError("Rollup failed: {0}", e.what());
+    }
+}
+
+RollupManager::Source RollupManager::FindSource(const std::string& table, const std::string& column) const {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    const auto it = sources.find(table);
+    if (it == sources.end()) {
+        throw std::runtime_error("No samples are stored for the specified provider.");
+    }
+
+    // Column names are formatted into the SQL text, so only known columns are accepted.
+    const auto& columns = it->second.columns;
+    if (std::find(columns.begin(), columns.end(), column) == columns.end()) {
+        throw std::runtime_error("Unknown column: " + column);
+    }
+
+    return it->second;
+}
+
+int64_t RollupManager::GetWatermark(const std::string& table, const std::string& name, int64_t resolution) const {
+    const auto rows = DataManager::GetInstance().PrepareRead("SELECT watermark FROM RollupState WHERE source = ? AND series = ? AND resolution = ?")
+        .BindText(table)
+        .BindText(name)
+        .BindInt64(resolution)
+        .Query();
+
+    return rows.empty() ? 0 : rows.front().GetInt64("watermark");
+}
+
+void RollupManager::SetWatermark(const std::string& table, const std::string& name, int64_t resolution, int64_t watermark) const {
+    StorageWriter::GetInstance().Write("INSERT OR REPLACE INTO RollupState VALUES (?, ?, ?, ?)", "rollup." + table + "." + name + "." + std::to_string(resolution))
+        .BindText(table)
+        .BindText(name)
+        .BindInt64(resolution)
+        .BindInt64(watermark)
+        .Submit();
+}
+
+void RollupManager::RollupRaw(const std::string& table, const Source& source, const std::string& name, int64_t now) const {
+    const auto& level = LEVELS[0];
+    const auto watermark = GetWatermark(table, name, level.resolution);
+    const auto end = FloorToBucket(now - COMMIT_GRACE_SECONDS, level.resolution);
+
+    auto& store = DataManager::GetInstance().GetSampleStore();
+    const auto key = GetSeriesKey(table, source, name);
+
+    // Skip over gaps in the data instead of walking them a chunk at a time.
+    const auto firstTimestamp = store.GetFirstTimestamp(key, watermark);
+    const auto start = firstTimestamp == 0 ? end : (std::max)(watermark, FloorToBucket(firstTimestamp, level.resolution));
+    if (start >= end) {
+        // Nothing to fold yet. Move the watermark on anyway, so coarser resolutions
+        // can fold the last buckets of series that are no longer sampled.
+        if (end > watermark) {
+            SetWatermark(table, name, level.resolution, end);
+        }
+        return;
+    }
+
+    const auto chunkEnd = (std::min)(end, start + MAX_BUCKETS_PER_RUN * level.resolution);
+
+    // Buckets keyed by column, then bucket start.
+    std::map<std::pair<std::string, int64_t>, Bucket> buckets;
+    store.Scan(key, start, chunkEnd, [&](int64_t timestamp, int64_t, const double* values) {
+        const auto bucket = FloorToBucket(timestamp, level.resolution);
+        for (size_t i = 0; i < source.columns.size(); i++) {
+            buckets[{ source.columns[i], bucket }].Merge(values[i], values[i], values[i], 1, values[i]);
+        }
+        });
+
+    PersistBuckets(table, name, level, buckets);
+    SetWatermark(table, name, level.resolution, chunkEnd);
+}
+
+void RollupManager::RollupLevel(const std::string& table, const std::string& name, size_t index) const {
+    const auto& level = LEVELS[index];
+    const auto& finer = LEVELS[index - 1];
+
+    // Only fold buckets the finer resolution is done with.
+    const auto watermark = GetWatermark(table, name, level.resolution);
+    const auto end = FloorToBucket(GetWatermark(table, name, finer.resolution), level.resolution);
+
+    const auto first = DataManager::GetInstance().PrepareRead(std::string("SELECT MIN(bucket) AS first FROM ") + finer.table + " WHERE source = ? AND series = ? AND bucket >= ?")
+        .BindText(table)
+        .BindText(name)
+        .BindInt64(watermark)
+        .Query();
+    const int64_t firstBucket = first.empty() ? 0 : first.front().GetInt64("first");
+    const auto start = firstBucket == 0 ? end : (std::max)(watermark, FloorToBucket(firstBucket, level.resolution));
+    if (start >= end) {
+        if (end > watermark) {
+            SetWatermark(table, name, level.resolution, end);
+        }
+        return;
+    }
+
+    const auto chunkEnd = (std::min)(end, start + MAX_BUCKETS_PER_RUN * level.resolution);
+
+    const auto rows = DataManager::GetInstance().PrepareRead(std::string("SELECT * FROM ") + finer.table + " WHERE source = ? AND series = ? AND bucket >= ? AND bucket < ? ORDER BY bucket")
+        .BindText(table)
+        .BindText(name)
+        .BindInt64(start)
+        .BindInt64(chunkEnd)
+        .Query();
+
+    std::map<std::pair<std::string, int64_t>, Bucket> buckets;
+    for (const auto& row : rows) {
+        const auto bucket = FloorToBucket(row.GetInt64("bucket"), level.resolution);
+        buckets[{ row.GetString("metric"), bucket }].Merge(
+            row.GetDouble("min"),
+            row.GetDouble("max"),
+            row.GetDouble("sum"),
+            row.GetInt("count"),
+            row.GetDouble("last"));
+    }
+
+    PersistBuckets(table, name, level, buckets);
+    SetWatermark(table, name, level.resolution, chunkEnd);
+}
+
+void RollupManager::PersistBuckets(const std::string& table, const std::string& name, const Level& level, const std::map<std::pair<std::string, int64_t>, Bucket>& buckets) const {
+    // Buckets are replaced rather than added to, so folding the same range twice is harmless.
+    const auto sql = std::string("INSERT OR REPLACE INTO ") + level.table + " VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)";
+    for (const auto& [key, bucket] : buckets) {
+        StorageWriter::GetInstance().Write(sql, "rollup." + table + "." + name + "." + key.first + "." + std::to_string(key.second))
+            .BindText(table)
+            .BindText(name)
+            .BindText(key.first)
+            .BindInt64(key.second)
+            .BindDouble(bucket.min)
+            .BindDouble(bucket.max)
+            .BindDouble(bucket.sum)
+            .BindInt64(bucket.count)
+            .BindDouble(bucket.last)
+            .Submit();
+    }
+}
+
+void RollupManager::ApplyRetention(const std::string& table, const Source& source, const std::string& name, const RetentionConfig& retention, int batchSize, int64_t now) const {
+    if (batchSize <= 0) {
+        return;
+    }
+
+    // Each delete is a single small write, so a large backlog is worked off a batch
+    // per run instead of holding up the storage writer.
+    if (retention.raw > 0) {
+        const auto cutoff = (std::min)(now - retention.raw, GetWatermark(table, name, LEVELS[0].resolution));
+        DataManager::GetInstance().GetSampleStore().Expire(GetSeriesKey(table, source, name), cutoff, batchSize);
+    }
+
+    const int ttls[LEVEL_COUNT] = { retention.minute, retention.hour, retention.day };
+    for (size_t i = 0; i < LEVEL_COUNT; i++) {
+        if (ttls[i] <= 0) {
+            continue;
+        }
+
+        auto cutoff = now - ttls[i];
+        if (i + 1 < LEVEL_COUNT) {
+            cutoff = (std::min)(cutoff, GetWatermark(table, name, LEVELS[i + 1].resolution));
+        }
+
+        const std::string levelTable = LEVELS[i].table;
+        StorageWriter::GetInstance().Write("DELETE FROM " + levelTable + " WHERE rowid IN (SELECT rowid FROM " + levelTable + " WHERE source = ? AND series = ? AND bucket < ? LIMIT ?)", "retention." + levelTable + "." + table + "." + name)
+            .BindText(table)
+            .BindText(name)
+            .BindInt64(cutoff)
+            .BindInt64(batchSize)
+            .Submit();
+    }
+}
+
+AggregateValue RollupManager::SelectAggregate(const std::string& table, const std::string& name, const std::string& column) const {
+    const auto source = FindSource(table, column);
+
+    // The rollups are read in a single statement, so every resolution is read from the
+    // same snapshot. Each covers the range between its own watermark and that of the next
+    // coarser one, and the sample store covers the rest from the minute watermark on.
+    const auto sql = "\
+        WITH w AS (SELECT \
+            COALESCE((SELECT watermark FROM RollupState WHERE source = ?1 AND series = ?2 AND resolution = 60), 0) AS m, \
+            COALESCE((SELECT watermark FROM RollupState WHERE source = ?1 AND series = ?2 AND resolution = 3600), 0) AS h, \
+            COALESCE((SELECT watermark FROM RollupState WHERE source = ?1 AND series = ?2 AND resolution = 86400), 0) AS d) \
+        SELECT \
+            MAX(max) AS max, \
+            MIN(min) AS min, \
+            TOTAL(sum) AS total, \
+            CAST(TOTAL(count) AS INTEGER) AS count, \
+            (SELECT m FROM w) AS watermark FROM ( \
+            SELECT max, min, sum, count FROM RollupDay, w WHERE source = ?1 AND series = ?2 AND metric = ?3 AND bucket < w.d \
+            UNION ALL \
+            SELECT max, min, sum, count FROM RollupHour, w WHERE source = ?1 AND series = ?2 AND metric = ?3 AND bucket >= w.d AND bucket < w.h \
+            UNION ALL \
+            SELECT max, min, sum, count FROM RollupMinute, w WHERE source = ?1 AND series = ?2 AND metric = ?3 AND bucket >= w.h AND bucket < w.m)";
+
+    const auto rows = DataManager::GetInstance().PrepareRead(sql)
+        .BindText(table)
+        .BindText(name)
+        .BindText(column)
+        .Query();
+
+    AggregateValue result;
+    int64_t watermark = 0;
+    if (!rows.empty()) {
+        const auto& row = rows.front();
+        result.max = row.GetDouble("max");
+        result.min = row.GetDouble("min");
+        result.sum = row.GetDouble("total");
+        result.count = row.GetInt("count");
+        watermark = row.GetInt64("watermark");
+    }
+
+    // If a rollup runs in between, raw samples from the old watermark on are still there,
+    // as retention never deletes samples that recent.
+    result.Merge(DataManager::GetInstance().GetSampleStore().Aggregate(GetSeriesKey(table, source, name), column, watermark));
+    return result;
+}
+
+rapidjson::Value RollupManager::GetRangeJSON(rapidjson::Document& doc, const std::string& table, const std::string& name, const std::string& column, int64_t from, int64_t to) const {
+    const auto source = FindSource(table, column);
+    if (to <= from) {
+        throw std::runtime_error("The end of the range must be after its start.");
+    }
+
+    const int64_t now = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    const auto retention = ConfigManager::GetInstance().GetConfig().GetRetentionConfig(name);
+
+    // Pick the finest resolution the range is short enough for. Raw rows are only
+    // used while they have not been deleted yet.
+    size_t level = 0;
+    while (level < LEVEL_COUNT && (to - from > MAX_RANGE_SECONDS[level] || (level == 0 && retention.raw > 0 && from < now - retention.raw))) {
+        level++;
+    }
+
+    rapidjson::Value obj(rapidjson::kObjectType);
+    rapidjson::Value response(rapidjson::kArrayType);
+
+    if (level == 0) {
+        const auto index = static_cast<size_t>(std::find(source.columns.begin(), source.columns.end(), column) - source.columns.begin());
+        DataManager::GetInstance().GetSampleStore().Scan(GetSeriesKey(table, source, name), from, to, [&](int64_t timestamp, int64_t, const double* values) {
+            rapidjson::Value point(rapidjson::kObjectType);
+            point.AddMember("timestamp", Utils::ConvertIntToJSONValue(static_cast<int>(timestamp), doc.GetAllocator()), doc.GetAllocator());
+            point.AddMember("value", Utils::ConvertDoubleToJSONValue(values[index], doc.GetAllocator()), doc.GetAllocator());
+            response.PushBack(point, doc.GetAllocator());
+            });
+
+        obj.AddMember("resolution", 0, doc.GetAllocator());
+    }
+    else {
+        const auto& rollup = LEVELS[level - 1];
+        const auto rows = DataManager::GetInstance().PrepareRead(std::string("SELECT * FROM ") + rollup.table + " WHERE source = ? AND series = ? AND metric = ? AND bucket >= ? AND bucket < ? ORDER BY bucket")
+            .BindText(table)
+            .BindText(name)
+            .BindText(column)
+            .BindInt64(FloorToBucket(from, rollup.resolution))
+            .BindInt64(to)
+            .Query();
+        for (const auto& row : rows) {
+            const auto count = row.GetInt("count");
+
+            rapidjson::Value point(rapidjson::kObjectType);
+            point.AddMember("timestamp", Utils::ConvertIntToJSONValue(row.GetInt64("bucket"), doc.GetAllocator()), doc.GetAllocator());
+            point.AddMember("min", Utils::ConvertDoubleToJSONValue(row.GetDouble("min"), doc.GetAllocator()), doc.GetAllocator());
+            point.AddMember("max", Utils::ConvertDoubleToJSONValue(row.GetDouble("max"), doc.GetAllocator()), doc.GetAllocator());
+            point.AddMember("avg", Utils::ConvertDoubleToJSONValue(count > 0 ? row.GetDouble("sum") / count : 0, doc.GetAllocator()), doc.GetAllocator());
+            point.AddMember("last", Utils::ConvertDoubleToJSONValue(row.GetDouble("last"), doc.GetAllocator()), doc.GetAllocator());
+            point.AddMember("count", Utils::ConvertIntToJSONValue(count, doc.GetAllocator()), doc.GetAllocator());
+            response.PushBack(point, doc.GetAllocator());
+        }
+
+        obj.AddMember("resolution", rollup.resolution, doc.GetAllocator());
+    }
+
+    obj.AddMember("data", response, doc.GetAllocator());
+    return obj;
+}
@@ -0,0 +1,144 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <rapidjson/document.h>
+
+#include "AggregateStore.h"
+#include "ConfigManager.h"
+#include "DataManager.h"
+#include "LogManager.h"
+#include "SampleStore.h"
+#include "StorageWriter.h"
+
+// Folds raw samples from the sample store into the `RollupMinute`, `RollupHour` and
+// `RollupDay` tables (min/max/sum/count/last per bucket), and deletes samples and rows
+// past their retention.
+//
+// Each resolution keeps a watermark in `RollupState`: everything before it has been
+// folded into that resolution. Rows are only deleted once they are behind the next
+// resolution's watermark, so aggregates over all time can always be answered from
+// the rollups plus the raw rows that have not been folded yet.
+class RollupManager {
+public:
+    static RollupManager& GetInstance() {
+        static RollupManager instance;
+        return instance;
+    }
+
+    RollupManager(const RollupManager&) = delete;
+    RollupManager& operator=(const RollupManager&) = delete;
+
+    // Registers a table of samples. `seriesColumn` holds the provider or script name
+    // of each row, and `columns` are the numeric columns to roll up.
+    void AddSource(const std::string& table, const std::string& seriesColumn, const std::vector<std::string>& columns) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto& source = sources[table];
+        source.seriesColumn = seriesColumn;
+        source.columns = columns;
+    }
+
+    // Registers a provider or script whose samples are stored in `table`.
+    void AddSeries(const std::string& table, const std::string& name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        sources[table].series.insert(name);
+    }
+
+    // Rolls up and applies retention to every series, a bounded amount of work at a
+    // time. This is run periodically as a storage writer maintenance task.
+    void Run();
+
+    // Returns the aggregate of `column` over all time. Rolled up buckets are read instead
+    // of raw samples wherever they exist.
+    AggregateValue SelectAggregate(const std::string& table, const std::string& name, const std::string& column) const;
+
+    // Returns the values of `column` between `from` and `to`, in seconds since epoch.
+    // Short ranges are read from the raw rows, and longer ones from the coarsest
+    // rollup that still gives a useful number of points.
+    rapidjson::Value GetRangeJSON(rapidjson::Document& doc, const std::string& table, const std::string& name, const std::string& column, int64_t from, int64_t to) const;
+
+private:
+    RollupManager() {}
+
+    struct Source {
+        std::string seriesColumn;
+        std::vector<std::string> columns;
+        std::set<std::string> series;
+    };
+
+    struct Level {
+        // Bucket size in seconds.
+        int64_t resolution;
+        const char* table;
+    };
+
+    // Aggregate of a single bucket.
+    struct Bucket {
+        double min = 0;
+        double max = 0;
+        double sum = 0;
+        int64_t count = 0;
+        double last = 0;
+
+        void Merge(double bucketMin, double bucketMax, double bucketSum, int64_t bucketCount, double bucketLast) {
+            min = count == 0 || bucketMin < min ? bucketMin : min;
+            max = count == 0 || bucketMax > max ? bucketMax : max;
+            sum += bucketSum;
+            count += bucketCount;
+            last = bucketLast;
+        }
+    };
+
+    static constexpr Level LEVELS[] = {
+        { 60, "RollupMinute" },
+        { 60 * 60, "RollupHour" },
+        { 24 * 60 * 60, "RollupDay" },
+    };
+    static constexpr size_t LEVEL_COUNT = sizeof(LEVELS) / sizeof(LEVELS[0]);
+
+    // Raw rows are only folded once they are this old, so samples still queued in
+    // the storage writer are not missed.
+    static constexpr int64_t COMMIT_GRACE_SECONDS = 60;
+    // Maximum number of buckets folded per series and resolution in a single run.
+    // This bounds the work done when catching up on a large existing database.
+    static constexpr int64_t MAX_BUCKETS_PER_RUN = 120;
+    // Longest range answered from raw rows, and from each rollup but the last.
+    static constexpr int64_t MAX_RANGE_SECONDS[] = { 6 * 60 * 60, 7 * 24 * 60 * 60, 180 * 24 * 60 * 60 };
+
+    static int64_t FloorToBucket(int64_t timestamp, int64_t resolution) {
+        return timestamp - (((timestamp % resolution) + resolution) % resolution);
+    }
+
+    // Returns the source stored in `table`, if it has `column`.
+    Source FindSource(const std::string& table, const std::string& column) const;
+
+    static SeriesKey GetSeriesKey(const std::string& table, const Source& source, const std::string& name) {
+        return { table, source.seriesColumn, name, source.columns };
+    }
+
+    int64_t GetWatermark(const std::string& table, const std::string& name, int64_t resolution) const;
+
+    void SetWatermark(const std::string& table, const std::string& name, int64_t resolution, int64_t watermark) const;
+
+    // Folds raw rows into minute buckets.
+    void RollupRaw(const std::string& table, const Source& source, const std::string& name, int64_t now) const;
+
+    // Folds buckets of `LEVELS[index - 1]` into buckets of `LEVELS[index]`.
+    void RollupLevel(const std::string& table, const std::string& name, size_t index) const;
+
+    void PersistBuckets(const std::string& table, const std::string& name, const Level& level, const std::map<std::pair<std::string, int64_t>, Bucket>& buckets) const;
+
+    // Deletes a batch of rows past their retention at each resolution.
+    void ApplyRetention(const std::string& table, const Source& source, const std::string& name, const RetentionConfig& retention, int batchSize, int64_t now) const;
+
+private:
+    mutable std::mutex mutex;
+    // Sources keyed by table name.
+    std::map<std::string, Source> sources;
+};
@@ -0,0 +1,109 @@
+#include "SampleRing.h"
+
+void SampleRing::Push(int64_t timestamp, int64_t counter, const double* sampleValues, size_t count) {
+    if (capacity == 0) {
+        return;
+    }
+
+    const auto n = written.load(std::memory_order_relaxed);
+    const auto slot = n % capacity;
+
+    // The release fence keeps the writes below from being seen before the odd sequence.
+    sequences[slot].store(2 * n + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    timestamps[slot].store(timestamp, std::memory_order_relaxed);
+    counters[slot].store(counter, std::memory_order_relaxed);
+    for (size_t i = 0; i < columnCount; i++) {
+        values[slot * columnCount + i].store(i < count ? sampleValues[i] : 0, std::memory_order_relaxed);
+    }
+
+    sequences[slot].store(2 * n + 2, std::memory_order_release);
+    written.store(n + 1, std::memory_order_release);
+}
+
+bool SampleRing::ReadLatest(size_t count, const SampleVisitor& visitor) const {
+    if (count == 0) {
+        return true;
+    }
+    if (count > capacity) {
+        return false;
+    }
+
+    // Samples are copied out first, so the visitor only sees a consistent set.
+    std::vector<int64_t> sampleTimestamps(count);
+    std::vector<int64_t> sampleCounters(count);
+    std::vector<double> sampleValues(count * columnCount);
+
+    for (int attempt = 0; attempt < MAX_READ_ATTEMPTS; attempt++) {
+        const auto total = written.load(std::memory_order_acquire);
+        if (total < count) {
+            return false;
+        }
+
+        bool isConsistent = true;
+        for (size_t i = 0; i < count && isConsistent; i++) {
+            const auto n = total - 1 - i;
+            const auto slot = n % capacity;
+
+            const auto before = sequences[slot].load(std::memory_order_acquire);
+            if (before != 2 * n + 2) {
+                isConsistent = false;
+                break;
+            }
+
+            sampleTimestamps[i] = timestamps[slot].load(std::memory_order_relaxed);
+            sampleCounters[i] = counters[slot].load(std::memory_order_relaxed);
+            for (size_t column = 0; column < columnCount; column++) {
+                sampleValues[i * columnCount + column] = values[slot * columnCount + column].load(std::memory_order_relaxed);
+            }
+
+            // The acquire fence keeps the reads above from moving past the second check.
+            std::atomic_thread_fence(std::memory_order_acquire);
+            isConsistent = sequences[slot].load(std::memory_order_relaxed) == before;
+        }
+
+        if (isConsistent) {
+            for (size_t i = 0; i < count; i++) {
+                visitor(sampleTimestamps[i], sampleCounters[i], sampleValues.data() + i * columnCount);
+            }
+            return true;
+        }
+    }
+
+    return false;
+}
+
+size_t SampleRing::ReadColumn(size_t column, size_t count, double* destination) const {
+    if (column >= columnCount) {
+        return 0;
+    }
+
+    for (int attempt = 0; attempt < MAX_READ_ATTEMPTS; attempt++) {
+        const auto total = written.load(std::memory_order_acquire);
+        const auto available = static_cast<size_t>((std::min)(static_cast<uint64_t>((std::min)(count, capacity)), total));
+
+        bool isConsistent = true;
+        for (size_t i = 0; i < available && isConsistent; i++) {
+            const auto n = total - available + i;
+            const auto slot = n % capacity;
+
+            const auto before = sequences[slot].load(std::memory_order_acquire);
+            if (before != 2 * n + 2) {
+                isConsistent = false;
+                break;
+            }
+
+            destination[i] = values[slot * columnCount + column].load(std::memory_order_relaxed);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            isConsistent = sequences[slot].load(std::memory_order_relaxed) == before;
+        }
+
+        if (isConsistent) {
+            return available;
+        }
+    }
+
+    return 0;
+}
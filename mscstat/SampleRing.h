@@ -0,0 +1,67 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "SeriesChunk.h"
+
+// The latest samples of a single provider or script, kept in memory so the API can serve
+// them without a query. Samples are pushed by one thread, the sampling job of their series,
+// and read by any number of API threads without locks.
+//
+// Each slot has a sequence number that is odd while the slot is being written and
+// identifies the sample it holds once written. Readers check it before and after copying
+// a slot, and start over if the writer got to the slot in between.
+class SampleRing {
+public:
+    SampleRing(size_t capacity, size_t columnCount)
+        : capacity(capacity),
+          columnCount(columnCount),
+          sequences(new std::atomic<uint64_t>[capacity]),
+          timestamps(new std::atomic<int64_t>[capacity]),
+          counters(new std::atomic<int64_t>[capacity]),
+          values(new std::atomic<double>[capacity * columnCount]) {
+        for (size_t i = 0; i < capacity; i++) {
+            sequences[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    SampleRing(const SampleRing&) = delete;
+    SampleRing& operator=(const SampleRing&) = delete;
+
+    size_t Capacity() const {
+        return capacity;
+    }
+
+    // Adds a sample, overwriting the oldest one once the ring is full. Values past
+    // the column count are ignored, and missing ones are stored as 0.
+    // This must only be called from one thread at a time.
+    void Push(int64_t timestamp, int64_t counter, const double* sampleValues, size_t count);
+
+    // Visits the latest `count` samples, newest first. Returns `false` without visiting
+    // any if fewer than `count` samples have been pushed, or if the ring could not be
+    // read consistently, in which case the caller should read from the database.
+    bool ReadLatest(size_t count, const SampleVisitor& visitor) const;
+
+    // Copies the values of `column` of the latest `count` samples, or of as many as have
+    // been pushed, into `destination`, oldest first. Returns the number copied, which is
+    // 0 if the ring could not be read consistently.
+    size_t ReadColumn(size_t column, size_t count, double* destination) const;
+
+private:
+    // Reads are retried this many times while the writer overwrites the samples being read.
+    static constexpr int MAX_READ_ATTEMPTS = 4;
+
+    const size_t capacity;
+    const size_t columnCount;
+    std::unique_ptr<std::atomic<uint64_t>[]> sequences;
+    std::unique_ptr<std::atomic<int64_t>[]> timestamps;
+    std::unique_ptr<std::atomic<int64_t>[]> counters;
+    // `columnCount` values per slot.
+    std::unique_ptr<std::atomic<double>[]> values;
+    // Number of samples pushed so far.
+    std::atomic<uint64_t> written = 0;
+};
@@ -0,0 +1 @@
+#include "SampleStore.h"
@@ -0,0 +1,55 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "AggregateStore.h"
+#include "SeriesChunk.h"
+
+// Identifies the raw samples of a single provider or script. In SQLite they are the rows
+// of `table` whose `seriesColumn` is `name`. `columns` are the numeric columns of each
+// sample, in the order their values are stored.
+struct SeriesKey {
+    std::string table;
+    std::string seriesColumn;
+    std::string name;
+    std::vector<std::string> columns;
+};
+
+// Storage engine for raw samples, selected with `storageEngine` in the configuration.
+// Rollups, retention, aggregates and range queries read raw samples only through this
+// interface. Everything else, rollups included, stays in SQLite.
+class SampleStore {
+public:
+    virtual ~SampleStore() {}
+
+    // Name of the engine, as set in `storageEngine`.
+    virtual std::string GetName() const = 0;
+
+    // `true` if samples are stored with `Append`. The SQLite engine leaves them to the
+    // providers and scripts, which insert rows with their own columns.
+    virtual bool StoresSamples() const = 0;
+
+    // Stores a sample of `key`, with one value per column. `timestamp` is in seconds.
+    virtual void Append(const SeriesKey& key, int64_t timestamp, int64_t counter, const double* values, size_t count) = 0;
+
+    // Visits the samples with `from <= timestamp < to`, oldest first.
+    virtual void Scan(const SeriesKey& key, int64_t from, int64_t to, const SampleVisitor& visitor) = 0;
+
+    // Visits the latest `count` samples, newest first.
+    virtual void ScanLatest(const SeriesKey& key, size_t count, const SampleVisitor& visitor) = 0;
+
+    // Returns the timestamp of the first sample at or after `from`, or 0 if there is none.
+    virtual int64_t GetFirstTimestamp(const SeriesKey& key, int64_t from) = 0;
+
+    // Returns the aggregate of `column` over the samples at or after `from`.
+    virtual AggregateValue Aggregate(const SeriesKey& key, const std::string& column, int64_t from) = 0;
+
+    // Deletes samples older than `before`. Engines may delete less at a time, down to
+    // `batchSize` samples, as this is called again on every retention run.
+    virtual void Expire(const SeriesKey& key, int64_t before, int batchSize) = 0;
+
+    // Makes every sample appended so far durable.
+    virtual void Flush() {}
+};
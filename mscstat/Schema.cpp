@@ -0,0 +1 @@
+#include "Schema.h"
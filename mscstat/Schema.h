@@ -0,0 +1,206 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// A step of the database schema. Migrations are applied in order, each exactly once,
+// and the database's `user_version` records the last one applied. Released migrations
+// should never be edited; changes go in a new migration instead.
+struct Migration {
+    int version;
+    std::string description;
+    std::vector<std::string> statements;
+};
+
+class Schema {
+public:
+    // Returns every migration, ordered by version.
+    static const std::vector<Migration>& GetMigrations() {
+        static const std::vector<Migration> migrations = {
+            {
+                1,
+                "Create tables",
+                {
+                    // The root application table stores application specific information.
+                    // This includes configuration details, users, keys and any other
+                    // information. This table mimicks a key-value store.
+                    "CREATE TABLE IF NOT EXISTS Metrics_Fetcher ( \
+                        id INTEGER PRIMARY KEY, \
+                        key TEXT UNIQUE NOT NULL, \
+                        value TEXT);",
+                    "CREATE TABLE IF NOT EXISTS CPUMetricProvider ( \
+                        id INTEGER PRIMARY KEY, \
+                        name TEXT DEFAULT \"CPUMetricProvider\", \
+                        counter INTEGER NOT NULL, \
+                        usage REAL DEFAULT 0, \
+                        instructionsRetired REAL DEFAULT 0, \
+                        cycles REAL DEFAULT 0, \
+                        floatingPointOperations REAL DEFAULT 0, \
+                        temperature REAL DEFAULT 0, \
+                        timestamp INTEGER NOT NULL);",
+                    "CREATE TABLE IF NOT EXISTS RAMMetricProvider ( \
+                        id INTEGER PRIMARY KEY, \
+                        name TEXT DEFAULT \"Memory\", \
+                        counter INTEGER NOT NULL, \
+                        available REAL DEFAULT 0, \
+                        committed REAL DEFAULT 0, \
+                        pageFaults REAL DEFAULT 0, \
+                        timestamp INTEGER NOT NULL);",
+                    "CREATE TABLE IF NOT EXISTS StorageMetricProvider ( \
+                        id INTEGER PRIMARY KEY, \
+                        name TEXT DEFAULT \"Storage\", \
+                        counter INTEGER NOT NULL, \
+                        read REAL DEFAULT 0, \
+                        write REAL DEFAULT 0, \
+                        transferRate REAL DEFAULT 0, \
+                        timestamp INTEGER NOT NULL);",
+                    // Rows of every network interface share this table, keyed by `name`.
+                    "CREATE TABLE IF NOT EXISTS NetworkMetricProvider ( \
+                        id INTEGER PRIMARY KEY, \
+                        name TEXT DEFAULT \"\", \
+                        counter INTEGER NOT NULL, \
+                        bytesSentPerSecond REAL DEFAULT 0, \
+                        bytesReceivedPerSecond REAL DEFAULT 0, \
+                        bytesTotalPerSecond REAL DEFAULT 0, \
+                        currentBandwidth REAL DEFAULT 0, \
+                        packetsReceivedPerSecond REAL DEFAULT 0, \
+                        packetsSentPerSecond REAL DEFAULT 0, \
+                        connectionsActive REAL DEFAULT 0, \
+                        connectionsEstablished REAL DEFAULT 0, \
+                        networkErrorsPerSecond REAL DEFAULT 0, \
+                        timestamp INTEGER NOT NULL);",
+                    "CREATE TABLE IF NOT EXISTS ProcessMetricProvider ( \
+                        id INTEGER PRIMARY KEY, \
+                        name TEXT DEFAULT \"Process\", \
+                        counter INTEGER NOT NULL, \
+                        processCount REAL DEFAULT 0, \
+                        activeProcess TEXT DEFAULT \"\", \
+                        activeWindow TEXT DEFAULT \"\", \
+                        bytesReadPerSecond REAL DEFAULT 0, \
+                        bytesWrittenPerSecond REAL DEFAULT 0, \
+                        timestamp INTEGER NOT NULL);",
+                    "CREATE TABLE IF NOT EXISTS ScriptManager ( \
+                        id INTEGER PRIMARY KEY, \
+                        name TEXT UNIQUE NOT NULL, \
+                        scriptText TEXT NOT NULL, \
+                        metricName TEXT DEFAULT NULL, \
+                        timestamp INTEGER NOT NULL);",
+                    "CREATE TABLE IF NOT EXISTS ScriptData ( \
+                        id INTEGER PRIMARY KEY, \
+                        counter INTEGER NOT NULL, \
+                        key TEXT NOT NULL, \
+                        value REAL NOT NULL, \
+                        timestamp INTEGER NOT NULL);",
+                    // Timestamps are in milliseconds, as burst windows may be shorter than a second.
+                    "CREATE TABLE IF NOT EXISTS BurstAggregate ( \
+                        id INTEGER PRIMARY KEY, \
+                        provider TEXT NOT NULL, \
+                        metric TEXT NOT NULL, \
+                        counter INTEGER NOT NULL, \
+                        min REAL DEFAULT 0, \
+                        max REAL DEFAULT 0, \
+                        avg REAL DEFAULT 0, \
+                        last REAL DEFAULT 0, \
+                        count INTEGER DEFAULT 0, \
+                        timestamp INTEGER NOT NULL);",
+                },
+            },
+            {
+                2,
+                "Add time-series indexes",
+                {
+                    // Latest rows of a series: `WHERE name = ? ORDER BY id DESC LIMIT ?`.
+                    "CREATE INDEX IF NOT EXISTS NetworkMetricProvider_name_id ON NetworkMetricProvider (name, id);",
+                    "CREATE INDEX IF NOT EXISTS ScriptData_key_id ON ScriptData (key, id);",
+                    "CREATE INDEX IF NOT EXISTS BurstAggregate_provider_metric_id ON BurstAggregate (provider, metric, id);",
+                    // Time range queries.
+                    "CREATE INDEX IF NOT EXISTS CPUMetricProvider_timestamp ON CPUMetricProvider (timestamp);",
+                    "CREATE INDEX IF NOT EXISTS RAMMetricProvider_timestamp ON RAMMetricProvider (timestamp);",
+                    "CREATE INDEX IF NOT EXISTS StorageMetricProvider_timestamp ON StorageMetricProvider (timestamp);",
+                    "CREATE INDEX IF NOT EXISTS NetworkMetricProvider_timestamp ON NetworkMetricProvider (timestamp);",
+                    "CREATE INDEX IF NOT EXISTS ProcessMetricProvider_timestamp ON ProcessMetricProvider (timestamp);",
+                    "CREATE INDEX IF NOT EXISTS ScriptData_timestamp ON ScriptData (timestamp);",
+                    "CREATE INDEX IF NOT EXISTS BurstAggregate_timestamp ON BurstAggregate (timestamp);",
+                },
+            },
+            {
+                3,
+                "Add rollup tables",
+                {
+                    // Samples folded into buckets of a minute, an hour and a day. `source` is
+                    // the table the samples come from, `series` the provider or script name,
+                    // and `bucket` the start of the bucket in seconds since epoch.
+                    "CREATE TABLE IF NOT EXISTS RollupMinute ( \
+                        source TEXT NOT NULL, \
+                        series TEXT NOT NULL, \
+                        metric TEXT NOT NULL, \
+                        bucket INTEGER NOT NULL, \
+                        min REAL DEFAULT 0, \
+                        max REAL DEFAULT 0, \
+                        sum REAL DEFAULT 0, \
+                        count INTEGER DEFAULT 0, \
+                        last REAL DEFAULT 0, \
+                        PRIMARY KEY (source, series, metric, bucket));",
+                    "CREATE TABLE IF NOT EXISTS RollupHour ( \
+                        source TEXT NOT NULL, \
+                        series TEXT NOT NULL, \
+                        metric TEXT NOT NULL, \
+                        bucket INTEGER NOT NULL, \
+                        min REAL DEFAULT 0, \
+                        max REAL DEFAULT 0, \
+                        sum REAL DEFAULT 0, \
+                        count INTEGER DEFAULT 0, \
+                        last REAL DEFAULT 0, \
+                        PRIMARY KEY (source, series, metric, bucket));",
+                    "CREATE TABLE IF NOT EXISTS RollupDay ( \
+                        source TEXT NOT NULL, \
+                        series TEXT NOT NULL, \
+                        metric TEXT NOT NULL, \
+                        bucket INTEGER NOT NULL, \
+                        min REAL DEFAULT 0, \
+                        max REAL DEFAULT 0, \
+                        sum REAL DEFAULT 0, \
+                        count INTEGER DEFAULT 0, \
+                        last REAL DEFAULT 0, \
+                        PRIMARY KEY (source, series, metric, bucket));",
+                    // Everything before `watermark` has been folded into buckets of `resolution` seconds.
+                    "CREATE TABLE IF NOT EXISTS RollupState ( \
+                        source TEXT NOT NULL, \
+                        series TEXT NOT NULL, \
+                        resolution INTEGER NOT NULL, \
+                        watermark INTEGER NOT NULL, \
+                        PRIMARY KEY (source, series, resolution));",
+                },
+            },
+            {
+                4,
+                "Add agent overhead table",
+                {
+                    "CREATE TABLE IF NOT EXISTS AgentMetricProvider ( \
+                        id INTEGER PRIMARY KEY, \
+                        name TEXT DEFAULT \"Agent\", \
+                        counter INTEGER NOT NULL, \
+                        cpu REAL DEFAULT 0, \
+                        resident REAL DEFAULT 0, \
+                        written REAL DEFAULT 0, \
+                        databaseWritten REAL DEFAULT 0, \
+                        columnarWritten REAL DEFAULT 0, \
+                        logWritten REAL DEFAULT 0, \
+                        timestamp INTEGER NOT NULL);",
+                    "CREATE INDEX IF NOT EXISTS AgentMetricProvider_timestamp ON AgentMetricProvider (timestamp);",
+                },
+            },
+            {
+                5,
+                "Add script bytecode",
+                {
+                    // Compiled `scriptText`, valid while `bytecodeHash` matches the hash of
+                    // the text and of the Duktape version.
+                    "ALTER TABLE ScriptManager ADD COLUMN bytecode BLOB DEFAULT NULL;",
+                    "ALTER TABLE ScriptManager ADD COLUMN bytecodeHash INTEGER DEFAULT 0;",
+                },
+            },
+        };
+
+        return migrations;
+    }
+};
@@ -1 +1,276 @@
 #include "Script.h"
+#include "Application.h"
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <time.h>
+#endif
+
+#include <cstddef>
+#include <cstdlib>
+
+namespace {
+    // Blocks start with their size, padded so the memory after it stays aligned.
+    constexpr size_t BLOCK_HEADER_SIZE = alignof(std::max_align_t);
+
+    uint8_t* GetBlock(void* ptr) {
+        return ptr ? static_cast<uint8_t*>(ptr) - BLOCK_HEADER_SIZE : nullptr;
+    }
+
+    size_t GetBlockSize(const uint8_t* block) {
+        size_t size = 0;
+        if (block) {
+            std::memcpy(&size, block, sizeof(size));
+        }
+        return size;
+    }
+}
+
+// `DUK_USE_EXEC_TIMEOUT_CHECK(udata)` of the Duktape built by `ports/duktape`. `udata` is
+// the script, as passed to `duk_create_heap`, or null for heaps of other code.
+extern "C" duk_bool_t ScriptExecTimeoutCheck(void* udata) {
+    return udata != nullptr && static_cast<Script*>(udata)->IsOverBudget();
+}
+
+bool Script::Compile() {
+    std::lock_guard<std::mutex> lock(ctxMutex);
+    bytecode.clear();
+
+    auto* compileCtx = duk_create_heap(Allocate, Reallocate, Free, this, nullptr);
+    if (!compileCtx) {
+        return false;
+    }
+
+    // Compiling is not a run, so it is not counted in the usage of runs or throttled.
+    exceeded = BudgetExceeded::NONE;
+    allocationCount = 0;
+    runStartCpuUS = GetThreadCpuTimeUS();
+    isRunning = true;
+
+    const auto isCompiled = duk_pcompile_lstring(compileCtx, 0, scriptText.c_str(), scriptText.size()) == 0;
+    if (isCompiled) {
+        duk_dump_function(compileCtx);
+
+        duk_size_t size = 0;
+        const auto* data = static_cast<const uint8_t*>(duk_get_buffer_data(compileCtx, -1, &size));
+        bytecode.assign(data, data + size);
+    }
+    else if (exceeded != BudgetExceeded::NONE) {
+        LogManager::GetInstance().LogWarning("Script {0} went over its budget while compiling.", name);
+    }
+
+    isRunning = false;
+    exceeded = BudgetExceeded::NONE;
+    duk_destroy_heap(compileCtx);
+    return isCompiled;
+}
+
+void* Script::Allocate(void* udata, duk_size_t size) {
+    return Reallocate(udata, nullptr, size);
+}
+
+void* Script::Reallocate(void* udata, void* ptr, duk_size_t size) {
+    auto* script = static_cast<Script*>(udata);
+    auto* block = GetBlock(ptr);
+    const auto oldSize = GetBlockSize(block);
+
+    if (size == 0) {
+        Free(udata, ptr);
+        return nullptr;
+    }
+
+    if (!script->Reserve(size > oldSize ? size - oldSize : 0)) {
+        return nullptr;
+    }
+
+    auto* newBlock = static_cast<uint8_t*>(std::realloc(block, size + BLOCK_HEADER_SIZE));
+    if (!newBlock) {
+        return nullptr;
+    }
+    std::memcpy(newBlock, &size, sizeof(size));
+
+    script->memoryUsed.fetch_add(size, std::memory_order_relaxed);
+    const auto used = script->memoryUsed.fetch_sub(oldSize, std::memory_order_relaxed) - oldSize;
+    if (used > script->peakMemoryUsed.load(std::memory_order_relaxed)) {
+        script->peakMemoryUsed.store(used, std::memory_order_relaxed);
+    }
+
+    return newBlock + BLOCK_HEADER_SIZE;
+}
+
+void Script::Free(void* udata, void* ptr) {
+    auto* block = GetBlock(ptr);
+    if (!block) {
+        return;
+    }
+
+    static_cast<Script*>(udata)->memoryUsed.fetch_sub(GetBlockSize(block), std::memory_order_relaxed);
+    std::free(block);
+}
+
+bool Script::Reserve(size_t bytes) {
+    // Once a budget is exceeded, the rest of the run fails, so the error reaches `execute`.
+    if (exceeded != BudgetExceeded::NONE) {
+        return false;
+    }
+
+    const auto memoryLimit = memoryBudget.load();
+    if (memoryLimit > 0 && memoryUsed.load(std::memory_order_relaxed) + bytes > static_cast<uint64_t>(memoryLimit)) {
+        exceeded = BudgetExceeded::MEMORY;
+        return false;
+    }
+
+    const auto cpuLimitUS = cpuBudgetUS.load();
+    if (isRunning && cpuLimitUS > 0 && ++allocationCount % CPU_CHECK_INTERVAL == 0
+        && GetThreadCpuTimeUS() - runStartCpuUS > static_cast<uint64_t>(cpuLimitUS)) {
+        exceeded = BudgetExceeded::CPU_TIME;
+        return false;
+    }
+
+    return true;
+}
+
+bool Script::IsOverBudget() {
+    if (exceeded != BudgetExceeded::NONE) {
+        return true;
+    }
+
+    // Interrupts are already spaced out, so the CPU time is read on each of them.
+    const auto cpuLimitUS = cpuBudgetUS.load();
+    if (isRunning && cpuLimitUS > 0 && GetThreadCpuTimeUS() - runStartCpuUS > static_cast<uint64_t>(cpuLimitUS)) {
+        exceeded = BudgetExceeded::CPU_TIME;
+        return true;
+    }
+
+    return false;
+}
+
+void Script::BeginRun() {
+    exceeded = BudgetExceeded::NONE;
+    allocationCount = 0;
+    runStartCpuUS = GetThreadCpuTimeUS();
+    isRunning = true;
+}
+
+Script::BudgetExceeded Script::EndRun() {
+    isRunning = false;
+
+    const auto cpuUS = GetThreadCpuTimeUS() - runStartCpuUS;
+    lastCpuUS.store(cpuUS);
+    if (cpuUS > maxCpuUS.load()) {
+        maxCpuUS.store(cpuUS);
+    }
+
+    // Runs that ended before the CPU time check caught them still count against the script.
+    const auto cpuLimitUS = cpuBudgetUS.load();
+    const auto isCpuOverrun = exceeded == BudgetExceeded::CPU_TIME || (cpuLimitUS > 0 && cpuUS > static_cast<uint64_t>(cpuLimitUS));
+
+    if (exceeded == BudgetExceeded::MEMORY) {
+        memoryOverruns++;
+    }
+    else if (isCpuOverrun) {
+        cpuOverruns++;
+    }
+
+    if (exceeded == BudgetExceeded::NONE && !isCpuOverrun) {
+        consecutiveOverruns = 0;
+    }
+    else {
+        consecutiveOverruns = (std::min)(consecutiveOverruns + 1, 7);
+        skippedRunsLeft.store((std::min)(1 << (consecutiveOverruns - 1), MAX_THROTTLED_RUNS));
+        LogManager::GetInstance().LogWarning("Script {0} is over its budget, and skips its next {1} runs.", name, skippedRunsLeft.load());
+    }
+
+    const auto result = exceeded;
+    exceeded = BudgetExceeded::NONE;
+    return result;
+}
+
+uint64_t Script::GetThreadCpuTimeUS() {
+#ifdef _WIN32
+    FILETIME creationTime;
+    FILETIME exitTime;
+    FILETIME kernelTime;
+    FILETIME userTime;
+    if (!GetThreadTimes(GetCurrentThread(), &creationTime, &exitTime, &kernelTime, &userTime)) {
+        return 0;
+    }
+
+    // File times are in units of 100 nanoseconds.
+    ULARGE_INTEGER kernel;
+    kernel.LowPart = kernelTime.dwLowDateTime;
+    kernel.HighPart = kernelTime.dwHighDateTime;
+    ULARGE_INTEGER user;
+    user.LowPart = userTime.dwLowDateTime;
+    user.HighPart = userTime.dwHighDateTime;
+    return (kernel.QuadPart + user.QuadPart) / 10;
+#else
+    timespec time;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) != 0) {
+        return 0;
+    }
+    return static_cast<uint64_t>(time.tv_sec) * 1000000 + time.tv_nsec / 1000;
+#endif
+}
+
+bool Script::ReadMetric(const char* provider, const char* column, double* values, size_t& count) {
+    auto* metricProvider = Application::theApp->metricsManager->FindProvider(provider);
+    if (metricProvider == nullptr || metricProvider->GetHotTier() == nullptr) {
+        return false;
+    }
+
+    const auto& columns = metricProvider->GetColumns();
+    const auto it = std::find(columns.begin(), columns.end(), column);
+    if (it == columns.end()) {
+        return false;
+    }
+
+    return ReadHotTier(*metricProvider->GetHotTier(), it - columns.begin(), values, count);
+}
+
+bool Script::ReadSeries(const char* seriesName, double* values, size_t& count) {
+    // Series of this script do not need to be looked up. Otherwise, the script that owns
+    // the series is kept alive while it is read.
+    std::shared_ptr<Script> owner;
+    auto* ring = GetSeriesHotTier(seriesName);
+    if (ring == nullptr) {
+        owner = Application::theApp->scriptManager->FindSeriesOwner(seriesName);
+        ring = owner ? owner->GetSeriesHotTier(seriesName) : nullptr;
+    }
+    if (ring == nullptr) {
+        return false;
+    }
+
+    // Script series have no column, unlike those of providers.
+    return ReadHotTier(*ring, 0, values, count);
+}
+
+bool Script::ReadHotTier(const SampleRing& ring, size_t column, double* values, size_t& count) {
+    count = (std::min)(count, ring.Capacity());
+    if (values != nullptr) {
+        count = ring.ReadColumn(column, count, values);
+    }
+    return true;
+}
+
+void Script::PushFloat64Array(duk_context* ctx, size_t count) {
+    duk_push_buffer_object(ctx, -1, 0, count * sizeof(double), DUK_BUFOBJ_FLOAT64ARRAY);
+    duk_remove(ctx, -2);
+}
+
+rapidjson::Value Script::GetBudgetJSON(rapidjson::Document& doc) const {
+    rapidjson::Value obj(rapidjson::kObjectType);
+
+    obj.AddMember("cpuTimeMS", cpuBudgetUS.load() / 1000.0, doc.GetAllocator());
+    obj.AddMember("memory", memoryBudget.load(), doc.GetAllocator());
+    obj.AddMember("lastCpuTimeMS", lastCpuUS.load() / 1000.0, doc.GetAllocator());
+    obj.AddMember("maxCpuTimeMS", maxCpuUS.load() / 1000.0, doc.GetAllocator());
+    obj.AddMember("memoryUsed", memoryUsed.load(), doc.GetAllocator());
+    obj.AddMember("peakMemoryUsed", peakMemoryUsed.load(), doc.GetAllocator());
+    obj.AddMember("cpuOverruns", cpuOverruns.load(), doc.GetAllocator());
+    obj.AddMember("memoryOverruns", memoryOverruns.load(), doc.GetAllocator());
+    obj.AddMember("throttledRuns", throttledRuns.load(), doc.GetAllocator());
+    obj.AddMember("skippedRunsLeft", skippedRunsLeft.load(), doc.GetAllocator());
+
+    return obj;
+}
@@ -1,68 +1,57 @@
 #pragma once
+#include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <cstring>
 #include <duktape.h>
+#include <map>
+#include <memory>
+#include <rapidjson/document.h>
 #include <stdexcept>
 #include <sstream>
-#include <pdh.h>
-#include <pdhmsg.h>
+#include <string>
+#include <utility>
+#include <vector>
 
+#include "CounterRegistry.h"
 #include "DataManager.h"
 #include "LogManager.h"
-
+#include "SampleRing.h"
+#include "ScriptBatch.h"
+#include "StorageWriter.h"
+
+#ifndef SCRIPT_INSTANCE_NAME
+#define SCRIPT_INSTANCE_NAME DUK_HIDDEN_SYMBOL("instance")
+#endif // !SCRIPT_INSTANCE_NAME
+
+// A user script and its Duktape heap. The heap is created, and the script evaluated, the
+// first time the script runs. It is kept until the script is destroyed, so each tick only
+// calls `execute`. Updated scripts are new instances, with a heap of their own. Scripts
+// compiled to bytecode when they were saved are loaded from it, so their text is only
+// compiled again once Duktape changes version.
+//
+// Each run has a budget of CPU time, and the heap one of memory. The heap allocates
+// through the script, which fails allocations once a budget is exceeded, and Duktape,
+// built by the overlay port in `ports/duktape`, interrupts the run now and then to check
+// its CPU time, so a run over budget is aborted with an error even if it never allocates.
+// After each run over budget, the script is skipped for twice as many ticks as after the
+// previous one, up to `MAX_THROTTLED_RUNS`.
 class Script {
-private:
-    std::string getLastErrorAsString()
-    {
-        //Get the error message ID, if any.
-        DWORD errorMessageID = ::GetLastError();
-        if (errorMessageID == 0) {
-            return std::string(); //No error message has been recorded
-        }
-
-        LPSTR messageBuffer = nullptr;
-
-        //Ask Win32 to give us the string version of that message ID.
-        //The parameters we pass in, tell Win32 to create the buffer that holds the message for us (because we don't yet know how long the message string will be).
-        size_t size = FormatMessageA(FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
-            NULL, errorMessageID, MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT), (LPSTR)&messageBuffer, 0, NULL);
-
-        //Copy the error message into a std::string.
-        std::string message(messageBuffer, size);
-
-        //Free the Win32's string's buffer.
-        LocalFree(messageBuffer);
-
-        return message;
-    }
 public:
-    Script(std::string scriptName, std::string text, std::string scriptMetricName) : scriptText(text) {
+    Script(std::string scriptName, std::string text, std::string scriptMetricName, CounterRegistry& registry, size_t hotTierSize, std::vector<uint8_t> scriptBytecode = {})
+        : scriptText(text), bytecode(std::move(scriptBytecode)), counterRegistry(registry), hotTier(hotTierSize, 1) {
         name = scriptName;
         metricName = scriptMetricName;
 
-        DataManager::GetInstance().CreateTable("ScriptData", " \
-            id INTEGER PRIMARY KEY, \
-            counter INTEGER NOT NULL, \
-            key TEXT NOT NULL, \
-            value REAL NOT NULL, \
-            timestamp INTEGER NOT NULL"
-        );
-
-        PDH_STATUS status = PdhOpenQuery(nullptr, 0, &queryHandle);
-        if (status != ERROR_SUCCESS) {
-            throw std::runtime_error("Failed to open PDH query.");
-        }
-
         SetupCounter();
     }
 
     ~Script() {
-        // Destroy the Duktape context
-        //if (ctx) {
-        //    duk_destroy_heap(ctx);
-        //}
+        if (ctx) {
+            duk_destroy_heap(ctx);
+        }
 
-        PdhCloseQuery(queryHandle);
+        counterRegistry.RemoveCounter(counter);
     }
 
     duk_context* GetContext() {
@@ -92,6 +81,60 @@ public:
         duk_pop(ctx);
     }
 
+    // Runs the script compiled to `bytecode`.
+    void ExecuteBytecode() {
+        if (!ctx) {
+            throw std::runtime_error("Duktape context is not initialized.");
+        }
+
+        auto* buffer = duk_push_fixed_buffer(ctx, bytecode.size());
+        std::memcpy(buffer, bytecode.data(), bytecode.size());
+
+        // Loading throws on bytecode it cannot read, so it runs as a safe call.
+        const auto load = [](duk_context* ctx_, void*) -> duk_ret_t {
+            duk_load_function(ctx_);
+            return 1;
+        };
+        if (duk_safe_call(ctx, load, nullptr, 1, 1) != 0 || duk_pcall(ctx, 0) != 0) {
+            duk_get_prop_string(ctx, -1, "stack");
+            auto err = duk_safe_to_string(ctx, -1);
+            throw std::runtime_error(err ? err : "JavaScript execution error");
+        }
+
+        // Ignore the return value
+        duk_pop(ctx);
+    }
+
+    // Hash of `text` and of the Duktape version, stored with the bytecode of `text`.
+    // Bytecode is only loaded while both match, as its format changes between versions.
+    static int64_t GetBytecodeHash(const std::string& text) {
+        // 64-bit FNV-1a.
+        uint64_t hash = 14695981039346656037ull;
+        const auto add = [&hash](uint8_t byte) {
+            hash = (hash ^ byte) * 1099511628211ull;
+        };
+
+        const uint32_t version = DUK_VERSION;
+        for (int i = 0; i < 4; i++) {
+            add(static_cast<uint8_t>(version >> (i * 8)));
+        }
+        for (const auto c : text) {
+            add(static_cast<uint8_t>(c));
+        }
+
+        return static_cast<int64_t>(hash);
+    }
+
+    // Compiles the script text to bytecode, in a heap of its own that allocates through
+    // the script, so compiling is held to the budgets of a run. Returns `false`, with the
+    // bytecode empty, if it does not compile or goes over budget.
+    bool Compile();
+
+    // Bytecode of the script text, or empty if it is compiled when the script loads.
+    const std::vector<uint8_t>& GetBytecode() const {
+        return bytecode;
+    }
+
     // Function to call a JavaScript function by name
     void CallJavaScriptFunction(const std::string& functionName) {
         if (!ctx) {
@@ -118,62 +161,146 @@ public:
     }
 
     void ClearDuktapeStack() {
-        // Get the current stack size
-        duk_idx_t stackSize = duk_get_top(ctx);
-
-        // Pop all items from the stack
-        duk_pop_n(ctx, stackSize);
-        duk_destroy_heap(ctx);
+        duk_set_top(ctx, 0);
     }
 
-    void CreateContext() {
-        ctx = duk_create_heap_default();
+    // Runs the `execute` function of the script, loading the script first if it was not
+    // yet. Called with `ctxMutex` held.
+    void Execute() {
+        BeginRun();
 
+        std::string error;
+        try {
+            if (!ctx) {
+                Load();
+            }
+            CallJavaScriptFunction("execute");
+        }
+        catch (const std::exception& e) {
+            error = e.what();
+        }
 
-        if (!ctx) {
-            throw std::runtime_error("Failed to create Duktape context.");
+        // The heap is kept, but not what the run left on its stack.
+        if (ctx) {
+            ClearDuktapeStack();
+        }
+
+        const auto reason = EndRun();
+        if (reason == BudgetExceeded::MEMORY) {
+            // Whatever the script holds on to is released, and it loads again on its next run.
+            if (ctx) {
+                duk_destroy_heap(ctx);
+                ctx = nullptr;
+            }
+            throw std::runtime_error("Script exceeded its memory budget of " + std::to_string(memoryBudget.load()) + " bytes.");
+        }
+        if (reason == BudgetExceeded::CPU_TIME) {
+            throw std::runtime_error("Script exceeded its CPU time budget of " + std::to_string(cpuBudgetUS.load() / 1000) + " ms.");
+        }
+        if (!error.empty()) {
+            throw std::runtime_error(error);
+        }
+    }
+
+    // Sets the budgets of the next runs. 0 disables a budget.
+    void SetBudget(int64_t cpuTimeMS, int64_t memoryBytes) {
+        cpuBudgetUS.store((std::max)(cpuTimeMS, static_cast<int64_t>(0)) * 1000);
+        memoryBudget.store((std::max)(memoryBytes, static_cast<int64_t>(0)));
+    }
+
+    // Returns `true` if the run of this tick should be skipped, as the script is throttled.
+    bool ShouldSkipRun() {
+        auto runs = skippedRunsLeft.load();
+        while (runs > 0) {
+            if (skippedRunsLeft.compare_exchange_weak(runs, runs - 1)) {
+                throttledRuns++;
+                return true;
+            }
         }
+        return false;
     }
 
+    // Returns `true` once the current run is over budget. Called by Duktape while the
+    // script runs, every few hundred thousand instructions.
+    bool IsOverBudget();
+
+    // Budgets, the usage of the last run and of the heap, and runs over budget or skipped.
+    rapidjson::Value GetBudgetJSON(rapidjson::Document& doc) const;
+
     void SetupCounter() {
-        const auto counterName = Utils::StringToWstring(metricName);
-        PdhAddEnglishCounter(queryHandle, counterName.c_str(), 0, &counter);
+        counter = counterRegistry.AddCounter(metricName);
+    }
 
-        PdhCollectQueryData(queryHandle);
+    // Latest values persisted by this script.
+    const SampleRing& GetHotTier() const {
+        return hotTier;
     }
 
+    // Adds a value of the series of this script to the values of this run. They are
+    // stored with the batch of the tick, once the run is over.
     void Persist(double value) {
-        const auto p1 = std::chrono::system_clock::now();
-
-        // Create a stringstream object
-        std::ostringstream stream{};
-        stream << "NULL, "
-            << metricCounter << ", "
-            << "\"" << name << "\"" << ", "
-            << value << ", "
-            << std::chrono::duration_cast<std::chrono::seconds>(p1.time_since_epoch()).count();
-        std::string sqlString = stream.str();
-        std::cout << metricCounter;
-        DataManager::GetInstance().Insert("ScriptData", sqlString);
-    };
+        const auto timestamp = GetTimestamp();
+        hotTier.Push(timestamp, metricCounter, &value, 1);
+        pendingSamples.push_back({ name, timestamp, metricCounter, value });
+    }
 
-    double GetCounterValue() {
-        PDH_FMT_COUNTERVALUE value;
-        PDH_STATUS status;
+    // Same for the series `<script>.<key>`, which is added by `persistMany` along with a
+    // hot tier of its own.
+    void Persist(const char* key, int64_t timestamp, double value) {
+        auto seriesName = name + "." + key;
+
+        SampleRing* ring = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(seriesMutex);
+            auto& seriesRing = series[seriesName];
+            if (!seriesRing) {
+                seriesRing = std::make_unique<SampleRing>(hotTier.Capacity(), 1);
+            }
+            ring = seriesRing.get();
+        }
+        // Rings are only pushed to by this script, and never removed, so this needs no lock.
+        ring->Push(timestamp, metricCounter, &value, 1);
 
-        status = PdhCollectQueryData(queryHandle);
-        if (status != ERROR_SUCCESS) {
-            LogManager::GetInstance().LogWarning("Failed to read counter value: {0}", getLastErrorAsString());
-            return 0.0;
+        pendingSamples.push_back({ std::move(seriesName), timestamp, metricCounter, value });
+    }
+
+    // Moves the values persisted since the last call into `batch`.
+    void TakePendingSamples(ScriptBatch& batch) {
+        batch.Add(pendingSamples);
+    }
+
+    // Series added with `persistMany` since the script was created.
+    std::vector<std::string> GetSeriesNames() const {
+        std::lock_guard<std::mutex> lock(seriesMutex);
+        std::vector<std::string> names;
+        for (const auto& [seriesName, ring] : series) {
+            names.push_back(seriesName);
         }
 
-        PdhGetFormattedCounterValue(counter, PDH_FMT_DOUBLE, nullptr, &value);
-        if (value.CStatus == PDH_CSTATUS_VALID_DATA) {
-            return value.doubleValue;
+        return names;
+    }
+
+    // Returns the hot tier of `seriesName`, the series of this script or one it added with
+    // `persistMany`, or nullptr. It lives as long as the script.
+    const SampleRing* GetSeriesHotTier(const std::string& seriesName) const {
+        if (seriesName == name) {
+            return &hotTier;
         }
-        else {
+
+        std::lock_guard<std::mutex> lock(seriesMutex);
+        const auto it = series.find(seriesName);
+        return it != series.end() ? it->second.get() : nullptr;
+    }
+
+    // Returns the value of this script's counter from the sample collected for
+    // the current tick.
+    double GetCounterValue() {
+        if (!currentSample || !currentSample->isValid) {
+            LogManager::GetInstance().LogWarning("Failed to read counter value: {0}", metricName);
             return 0.0;
         }
+
+        return currentSample->GetValue(counter);
     }
 
     std::array<std::string, 3> GetInfo() const {
@@ -195,16 +322,222 @@ public:
     }
 
 private:
-    PDH_HCOUNTER counter = nullptr;
-    PDH_HQUERY queryHandle = nullptr;
+    // Creates the heap, adds the host functions and evaluates the script text. A script
+    // that fails to load is not evaluated again, and every run throws its error.
+    void Load() {
+        if (!loadError.empty()) {
+            throw std::runtime_error(loadError);
+        }
+
+        // Allocations go through the script, which counts them against its budgets.
+        ctx = duk_create_heap(Allocate, Reallocate, Free, this, nullptr);
+        if (!ctx) {
+            throw std::runtime_error("Failed to create Duktape context.");
+        }
+
+        duk_push_pointer(ctx, this);
+        duk_put_global_string(ctx, SCRIPT_INSTANCE_NAME);
+
+        duk_push_c_function(ctx, [](duk_context* ctx_) -> duk_ret_t {
+            const double value = duk_require_number(ctx_, 0);
+            GetInstance(ctx_)->Persist(value);
+            return 0;
+            }, /*num_args=*/1);
+        duk_put_global_string(ctx, "persist");
+
+        // Duktape errors unwind with `longjmp`, so no C++ object may be alive in here
+        // while Duktape is called.
+        duk_push_c_function(ctx, [](duk_context* ctx_) -> duk_ret_t {
+            duk_require_object(ctx_, 0);
+            auto* script = GetInstance(ctx_);
+            const auto timestamp = GetTimestamp();
+
+            duk_enum(ctx_, 0, DUK_ENUM_OWN_PROPERTIES_ONLY);
+            while (duk_next(ctx_, -1, /*get_value=*/1)) {
+                const char* key = duk_get_string(ctx_, -2);
+                if (key == nullptr || key[0] == '\0') {
+                    return duk_type_error(ctx_, "persistMany keys must not be empty.");
+                }
+
+                script->Persist(key, timestamp, duk_require_number(ctx_, -1));
+                duk_pop_2(ctx_);
+            }
+            return 0;
+            }, /*num_args=*/1);
+        duk_put_global_string(ctx, "persistMany");
+
+        duk_push_c_function(ctx, [](duk_context* ctx_) -> duk_ret_t {
+            duk_push_number(ctx_, GetInstance(ctx_)->GetCounterValue());
+            return 1;
+            }, /*num_args=*/0);
+        duk_put_global_string(ctx, "getCounterValue");
+
+        duk_push_c_function(ctx, [](duk_context* ctx_) -> duk_ret_t {
+            const char* provider = duk_require_string(ctx_, 0);
+            const char* column = duk_require_string(ctx_, 1);
+            size_t count = (std::max)(duk_require_int(ctx_, 2), 0);
+
+            // Every call gets its own buffer, so arrays held by the script never change.
+            auto* script = GetInstance(ctx_);
+            if (!script->ReadMetric(provider, column, nullptr, count)) {
+                return duk_range_error(ctx_, "Unknown metric: %s.%s", provider, column);
+            }
+            auto* values = static_cast<double*>(duk_push_fixed_buffer(ctx_, count * sizeof(double)));
+            if (!script->ReadMetric(provider, column, values, count)) {
+                return duk_range_error(ctx_, "Unknown metric: %s.%s", provider, column);
+            }
+            PushFloat64Array(ctx_, count);
+            return 1;
+            }, /*num_args=*/3);
+        duk_put_global_string(ctx, "getMetric");
+
+        duk_push_c_function(ctx, [](duk_context* ctx_) -> duk_ret_t {
+            const char* seriesName = duk_require_string(ctx_, 0);
+            size_t count = (std::max)(duk_require_int(ctx_, 1), 0);
+
+            // Every call gets its own buffer, so arrays held by the script never change.
+            auto* script = GetInstance(ctx_);
+            if (!script->ReadSeries(seriesName, nullptr, count)) {
+                return duk_range_error(ctx_, "Unknown series: %s", seriesName);
+            }
+            auto* values = static_cast<double*>(duk_push_fixed_buffer(ctx_, count * sizeof(double)));
+            if (!script->ReadSeries(seriesName, values, count)) {
+                return duk_range_error(ctx_, "Unknown series: %s", seriesName);
+            }
+            PushFloat64Array(ctx_, count);
+            return 1;
+            }, /*num_args=*/2);
+        duk_put_global_string(ctx, "getSeries");
+
+        try {
+            if (!bytecode.empty()) {
+                ExecuteBytecode();
+            }
+            else {
+                ExecuteJavaScript();
+            }
+
+            // All scripts must define a single function called `execute`.
+            if (!duk_get_global_string(ctx, "execute") || !duk_is_function(ctx, -1)) {
+                throw std::runtime_error("Script does not define an `execute` function.");
+            }
+            duk_pop(ctx);
+        }
+        catch (const std::exception& e) {
+            // Runs over budget load again on their next run.
+            if (exceeded == BudgetExceeded::NONE) {
+                loadError = e.what();
+            }
+            duk_destroy_heap(ctx);
+            ctx = nullptr;
+            throw;
+        }
+    }
+
+    // Reads the latest `count` values of a provider column, or of a script series, from
+    // their hot tier into `values`, oldest first. Script series are named as in
+    // `ScriptData`: the script, or `<script>.<key>` for those added by `persistMany`.
+    // `count` is set to the number read, which is less if fewer are held. If `values` is
+    // null, nothing is read, and `count` is only capped to the size of the hot tier, so
+    // the caller can size the buffer first. Returns `false` if the provider, column or
+    // series is unknown.
+    //
+    // They do not call into the heap, as a Duktape error would skip the destructors.
+    bool ReadMetric(const char* provider, const char* column, double* values, size_t& count);
+    bool ReadSeries(const char* seriesName, double* values, size_t& count);
+    bool ReadHotTier(const SampleRing& ring, size_t column, double* values, size_t& count);
+
+    // Replaces the buffer on top of the stack with a Float64Array over its first `count`
+    // values.
+    static void PushFloat64Array(duk_context* ctx, size_t count);
+
+    // Seconds since the epoch, as stored with persisted values.
+    static int64_t GetTimestamp() {
+        return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    // Returns the script whose heap `ctx` is, from a host function.
+    static Script* GetInstance(duk_context* ctx) {
+        duk_get_global_string(ctx, SCRIPT_INSTANCE_NAME);
+        auto* instance = static_cast<Script*>(duk_require_pointer(ctx, -1));
+        duk_pop(ctx);
+        return instance;
+    }
+
+    enum class BudgetExceeded {
+        NONE,
+        CPU_TIME,
+        MEMORY,
+    };
+
+    // Allocation functions of the heap, with the script as `udata`. Each block starts with
+    // its size, so the memory held by the heap is known.
+    static void* Allocate(void* udata, duk_size_t size);
+    static void* Reallocate(void* udata, void* ptr, duk_size_t size);
+    static void Free(void* udata, void* ptr);
+
+    // Returns `false` if the heap may not grow by `bytes`, or if the current run is over
+    // its CPU time budget, which is checked every `CPU_CHECK_INTERVAL` allocations.
+    bool Reserve(size_t bytes);
+
+    // Starts and ends the accounting of a run. `EndRun` returns the budget the run
+    // exceeded, and throttles the script if it did.
+    void BeginRun();
+    BudgetExceeded EndRun();
+
+    // CPU time of the calling thread, in microseconds.
+    static uint64_t GetThreadCpuTimeUS();
+
+    // Most ticks skipped after a run over budget.
+    static constexpr int MAX_THROTTLED_RUNS = 64;
+    // Reading the CPU time of the thread is a system call, so it is not done on every
+    // allocation.
+    static constexpr uint32_t CPU_CHECK_INTERVAL = 64;
+
+    CounterRegistry& counterRegistry;
+    CounterHandle counter = 0;
+    // Only written by `Persist`, which runs under `ctxMutex`.
+    SampleRing hotTier;
+    // Values persisted by the current run, also under `ctxMutex`.
+    std::vector<PersistedSample> pendingSamples;
+    // Hot tiers of the series added by `persistMany`, keyed by series name.
+    mutable std::mutex seriesMutex;
+    std::map<std::string, std::unique_ptr<SampleRing>> series;
 
     duk_context* ctx = nullptr;
+    // Set if the script text could not be evaluated.
+    std::string loadError;
 
     std::string name;
     std::string scriptText;
+    // `scriptText` compiled by `Compile`, or empty to compile it when the script loads.
+    // Only written before the script is added to the list of scripts.
+    std::vector<uint8_t> bytecode;
     std::string metricName;
 
+    std::atomic<int64_t> cpuBudgetUS = 0;
+    std::atomic<int64_t> memoryBudget = 0;
+    // Bytes held by the heap, and the most it ever held.
+    std::atomic<uint64_t> memoryUsed = 0;
+    std::atomic<uint64_t> peakMemoryUsed = 0;
+    std::atomic<uint64_t> lastCpuUS = 0;
+    std::atomic<uint64_t> maxCpuUS = 0;
+    // Runs over their CPU time budget, whether they were aborted or ended first.
+    std::atomic<uint64_t> cpuOverruns = 0;
+    std::atomic<uint64_t> memoryOverruns = 0;
+    std::atomic<uint64_t> throttledRuns = 0;
+    std::atomic<int> skippedRunsLeft = 0;
+
+    // State of the current run, only used under `ctxMutex`.
+    bool isRunning = false;
+    uint64_t runStartCpuUS = 0;
+    uint32_t allocationCount = 0;
+    BudgetExceeded exceeded = BudgetExceeded::NONE;
+    int consecutiveOverruns = 0;
+
 public:
     std::mutex ctxMutex;
     UINT metricCounter = 0;
+    // Counter values collected for the tick this script is executing in.
+    std::shared_ptr<const CounterSample> currentSample;
 };
@@ -0,0 +1,61 @@
+#include "ScriptBatch.h"
+#include "DataManager.h"
+#include "LogManager.h"
+#include "StorageWriter.h"
+
+ScriptBatch::~ScriptBatch() {
+    try {
+        Flush();
+    }
+    catch (const std::exception& e) {
+        LogManager::GetInstance().LogError("Failed to store the values persisted by scripts: {0}", e.what());
+    }
+}
+
+void ScriptBatch::Flush() {
+    std::vector<PersistedSample> batch;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        batch.swap(samples);
+    }
+    if (batch.empty()) {
+        return;
+    }
+
+    static const std::vector<std::string> columns = { "value" };
+    if (aggregateStore != nullptr) {
+        for (const auto& sample : batch) {
+            aggregateStore->Record("ScriptData", sample.key, columns, sample.timestamp, &sample.value, 1);
+        }
+    }
+
+    // Engines other than SQLite store the samples instead of `ScriptData` rows.
+    auto& store = DataManager::GetInstance().GetSampleStore();
+    if (store.StoresSamples()) {
+        for (const auto& sample : batch) {
+            store.Append({ "ScriptData", "key", sample.key, columns }, sample.timestamp, sample.counter, &sample.value, 1);
+        }
+        return;
+    }
+
+    for (size_t first = 0; first < batch.size(); first += MAX_ROWS_PER_INSERT) {
+        const auto last = (std::min)(first + MAX_ROWS_PER_INSERT, batch.size());
+
+        std::string sql = "INSERT INTO ScriptData VALUES (NULL, ?, ?, ?, ?)";
+        for (size_t i = first + 1; i < last; i++) {
+            sql += ", (NULL, ?, ?, ?, ?)";
+        }
+
+        // A batch holds the values of many scripts, so it is not a raw sample the overflow
+        // policy could drop or coalesce by series.
+        auto request = StorageWriter::GetInstance().Write(sql, "ScriptData");
+        for (size_t i = first; i < last; i++) {
+            request
+                .BindInt64(batch[i].counter)
+                .BindText(batch[i].key)
+                .BindDouble(batch[i].value)
+                .BindInt64(batch[i].timestamp);
+        }
+        request.Submit();
+    }
+}
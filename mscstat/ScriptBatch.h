@@ -0,0 +1,53 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "AggregateStore.h"
+
+// A value persisted by a script, waiting for the write of its tick. `key` is the name of
+// its series in `ScriptData`.
+struct PersistedSample {
+    std::string key;
+    int64_t timestamp = 0;
+    int64_t counter = 0;
+    double value = 0.0;
+};
+
+// Values persisted by the scripts of a tick. Each script adds what it persisted once its
+// run is over, and the batch is written when the last script of the tick lets go of it,
+// in one write instead of one per call to `persist`.
+class ScriptBatch {
+public:
+    explicit ScriptBatch(AggregateStore* aggregateStore) : aggregateStore(aggregateStore) {}
+
+    ScriptBatch(const ScriptBatch&) = delete;
+    ScriptBatch& operator=(const ScriptBatch&) = delete;
+
+    ~ScriptBatch();
+
+    // Moves `pending` into the batch.
+    void Add(std::vector<PersistedSample>& pending) {
+        if (pending.empty()) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        samples.insert(samples.end(), std::make_move_iterator(pending.begin()), std::make_move_iterator(pending.end()));
+        pending.clear();
+    }
+
+    // Records the values in the aggregates and stores them.
+    void Flush();
+
+private:
+    // Each row binds 4 parameters, and older SQLite builds allow 999 per statement.
+    static constexpr size_t MAX_ROWS_PER_INSERT = 200;
+
+    AggregateStore* aggregateStore = nullptr;
+    std::mutex mutex;
+    std::vector<PersistedSample> samples;
+};
@@ -1,30 +1,45 @@
 #include "ScriptManager.h"
 #include "Application.h"
 
-void ScriptManager::Process(std::atomic<UINT64>& counter) {
-    // Because we create the JavaScript context each time this process is called,
-    // we endup creating a non-threadsafe condition if this function is called
-    // multiple times. To fix this, we will need to wait and ensure that this function
-    // only returns after all scripts have been triggered.
+std::map<std::string, TaskHandle> ScriptManager::Process(const std::vector<std::string>& names, UINT64 counter, const std::shared_ptr<const CounterSample>& sample) {
+    std::map<std::string, TaskHandle> handles;
+    // Written once the last script of the tick is done with it.
+    auto batch = std::make_shared<ScriptBatch>(aggregateStore);
+
     std::lock_guard<std::mutex> lock(scriptMutex);
     for (std::shared_ptr<Script>& script : scripts) {
-        Application::theApp->threadManager->AddTaskToThread([&] {
+        if (std::find(names.begin(), names.end(), script->GetInfo()[0]) == names.end()) {
+            continue;
+        }
+        // Scripts that went over budget sit out a few ticks.
+        if (script->ShouldSkipRun()) {
+            continue;
+        }
+
+        // Scripts rank below samples.
+        TaskOptions options;
+        options.taskClass = TaskClass::SCRIPT_TASK;
+
+        // The script is captured by value, as the list of scripts may change before the task runs.
+        handles[script->GetInfo()[0]] = Application::theApp->threadManager->AddTask([this, script, counter, sample, batch]() mutable {
             std::lock_guard<std::mutex> scriptLock(script->ctxMutex);
             try {
                 if (!should_stop.load()) {
-                    SetupJavascriptContext(script);
                     script->metricCounter = counter;
-                    // All scripts must define a single function called `execute`.
-                    script->CallJavaScriptFunction("execute");
-                    script->ClearDuktapeStack();
+                    script->currentSample = sample;
+                    // The heap of the script is kept between ticks, so this only calls `execute`.
+                    script->Execute();
                 }
             }
             catch (std::exception e) {
                 // Ignore error and move to next script
                 LogManager::GetInstance().LogError("Failed to call `execute` function in script: {0}", e.what());
             }
-            });
+            // Values persisted before an error are kept.
+            script->TakePendingSamples(*batch);
+            }, options);
     }
 
-    LogManager::GetInstance().LogInfo("Scripts Run counter: {0}. Script count: {1}", counter + 1, scripts.size());
+    LogManager::GetInstance().LogDebug("Scripts Run counter: {0}. Script count: {1}", counter + 1, names.size());
+    return handles;
 }
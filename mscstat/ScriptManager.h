@@ -3,6 +3,7 @@
 #include <atomic>
 #include <chrono>
 #include <duktape.h>
+#include <map>
 #include <stdexcept>
 #include <sstream>
 #include <vector>
@@ -10,12 +11,12 @@
 #include <rapidjson/stringbuffer.h>
 #include <rapidjson/writer.h>
 
+#include "ConfigManager.h"
 #include "DataManager.h"
+#include "RollupManager.h"
 #include "Script.h"
-
-#ifndef SCRIPT_INSTANCE_NAME
-#define SCRIPT_INSTANCE_NAME DUK_HIDDEN_SYMBOL("instance")
-#endif // !SCRIPT_INSTANCE_NAME
+#include "StorageWriter.h"
+#include "TaskGroup.h"
 
 
 /**
@@ -29,27 +30,109 @@ public:
         return instance;
     }
 
-    void Initialize() {
-        // We should retrieve the list of scripts from the DB and create the functions
-        auto scriptRows = DataManager::GetInstance().Select("ScriptManager");
+    // Loads saved scripts. The counter read by each script is added to `registry`
+    // so it is collected together with the metric providers' counters, and the values
+    // scripts persist are added to the running aggregates in `store`. Each script keeps
+    // its latest `hotTierSize` values in memory.
+    void Initialize(CounterRegistry& registry, AggregateStore& store, size_t hotTierSize) {
+        counterRegistry = &registry;
+        aggregateStore = &store;
+        this->hotTierSize = hotTierSize;
+        RollupManager::GetInstance().AddSource("ScriptData", "key", { "value" });
+
+        // Scripts are read with a cursor, as the result set does not hold bytecode.
+        struct ScriptRow {
+            std::string name;
+            std::string scriptText;
+            std::string metricName;
+            std::vector<uint8_t> bytecode;
+            int64_t bytecodeHash = 0;
+        };
+        std::vector<ScriptRow> scriptRows;
+
+        auto statement = DataManager::GetInstance().PrepareRead("SELECT name, scriptText, metricName, bytecode, bytecodeHash FROM ScriptManager", false);
+        statement.ExecuteSelect([&](const Cursor& row) {
+            scriptRows.push_back({ row.GetString(0), row.GetString(1), row.GetString(2), row.GetBlob(3), row.GetInt64(4) });
+            });
 
         std::lock_guard<std::mutex> lock(scriptMutex);
         for (auto& row : scriptRows) {
-            auto scriptName = row.GetString("name");
-            auto scriptText = row.GetString("scriptText");
-            auto metricName = row.GetString("metricName");
+            // Scripts saved before bytecode was stored, or by another version of Duktape,
+            // are compiled again.
+            const auto isCompiled = row.bytecodeHash == Script::GetBytecodeHash(row.scriptText);
 
             try {
-                std::shared_ptr<Script> sc = std::make_shared<Script>(scriptName, scriptText, metricName);
-
-                //SetupJavascriptContext(sc);
-                scripts.push_back(std::move(sc));
+                auto script = isCompiled
+                    ? CreateScript(row.name, row.scriptText, row.metricName, std::move(row.bytecode))
+                    : CompileScript(row.name, row.scriptText, row.metricName);
+                if (!isCompiled) {
+                    // The hash is stored either way, so scripts that do not compile are not
+                    // compiled again on every start.
+                    StorageWriter::GetInstance().Write("UPDATE ScriptManager SET bytecode = ?, bytecodeHash = ? WHERE name = ?", "ScriptManager." + row.name)
+                        .BindBlob(script->GetBytecode())
+                        .BindInt64(Script::GetBytecodeHash(row.scriptText))
+                        .BindText(row.name)
+                        .Submit();
+                }
+                scripts.push_back(script);
             }
             catch (std::exception e) {
                 // Ignore error and move to next script
-                LogManager::GetInstance().LogError("Failed to execute script: {0}", row.GetString("name"));
+                LogManager::GetInstance().LogError("Failed to execute script: {0}", row.name);
             }
         }
+        scriptsVersion++;
+    }
+
+    // Incremented whenever a script is added, updated or deleted, so the scheduler
+    // knows when it has to reload the list of scripts.
+    UINT64 GetScriptsVersion() const {
+        return scriptsVersion.load();
+    }
+
+    std::vector<std::string> GetScriptNames() {
+        std::lock_guard<std::mutex> lock(scriptMutex);
+        std::vector<std::string> names;
+        for (const auto& script : scripts) {
+            names.push_back(script->GetInfo()[0]);
+        }
+
+        return names;
+    }
+
+    // Returns the script named `name`, or nullptr.
+    std::shared_ptr<Script> FindScript(const std::string& name) const {
+        std::lock_guard<std::mutex> lock(scriptMutex);
+        auto it = std::find_if(scripts.begin(), scripts.end(), [&name](const std::shared_ptr<Script>& script) { return script->GetInfo()[0] == name; });
+        return it != scripts.end() ? *it : nullptr;
+    }
+
+    // Returns the script that owns the series `seriesName`, which is either the script
+    // itself or one it added with `persistMany`, or nullptr.
+    std::shared_ptr<Script> FindSeriesOwner(const std::string& seriesName) {
+        std::lock_guard<std::mutex> lock(scriptMutex);
+        for (const auto& script : scripts) {
+            if (script->GetSeriesHotTier(seriesName) != nullptr) {
+                return script;
+            }
+        }
+
+        return nullptr;
+    }
+
+    // Names of every series in `ScriptData`: the scripts, and the series they added with
+    // `persistMany`.
+    std::vector<std::string> GetSeriesNames() {
+        std::lock_guard<std::mutex> lock(scriptMutex);
+        std::vector<std::string> names;
+        for (const auto& script : scripts) {
+            names.push_back(script->GetInfo()[0]);
+
+            const auto series = script->GetSeriesNames();
+            names.insert(names.end(), series.begin(), series.end());
+        }
+
+        return names;
     }
 
     std::string GetAllScriptsAsJSON() const {
@@ -58,7 +141,7 @@ public:
         rapidjson::Value jsonArray(rapidjson::kArrayType);
         doc.SetObject();
 
-        for (const auto& script : scripts) {
+        for (const auto& script : GetScripts()) {
             const auto [name, scriptText, metricName] = script->GetInfo();
             rapidjson::Value obj(rapidjson::kObjectType);
 
@@ -73,6 +156,7 @@ public:
             rapidjson::Value metric_;
             metric_.SetString(metricName.c_str(), doc.GetAllocator());
             obj.AddMember("metricName", metric_, doc.GetAllocator());
+            obj.AddMember("budget", script->GetBudgetJSON(doc), doc.GetAllocator());
 
             jsonArray.PushBack(obj, doc.GetAllocator());
         }
@@ -89,10 +173,10 @@ public:
     }
 
     void updateDataJSONArray(rapidjson::Document& doc, rapidjson::Value& response, const UINT8& count) const {
-        // Fetch the most recent data, up to `count`
-        for (auto& script : scripts) {
-            const auto& rows = DataManager::GetInstance().Select("ScriptData", "key=\"" + script->GetInfo()[0] + "\" ORDER BY id DESC LIMIT " + std::to_string(count));
+        auto& store = DataManager::GetInstance().GetSampleStore();
 
+        // Fetch the most recent data, up to `count`
+        for (auto& script : GetScripts()) {
             rapidjson::Value obj(rapidjson::kObjectType);
 
             rapidjson::Value name;
@@ -105,20 +189,46 @@ public:
 
             rapidjson::Value dataArr(rapidjson::kArrayType);
 
-            for (auto& row : rows) {
+            const auto addSample = [&](int64_t timestamp, int64_t counter, const double* values) {
                 rapidjson::Value data(rapidjson::kObjectType);
+                data.AddMember("counter", Utils::ConvertIntToJSONValue(static_cast<int>(counter), doc.GetAllocator()), doc.GetAllocator());
+                data.AddMember("timestamp", Utils::ConvertIntToJSONValue(static_cast<int>(timestamp), doc.GetAllocator()), doc.GetAllocator());
+                data.AddMember("value", Utils::ConvertDoubleToJSONValue(values[0], doc.GetAllocator()), doc.GetAllocator());
+                dataArr.PushBack(data, doc.GetAllocator());
+            };
 
-                auto id = row.GetInt("id");
-                auto counter = row.GetInt("counter");
-                auto timestamp = row.GetInt("timestamp");
-                auto value = row.GetDouble("value");
-
-                data.AddMember("id", Utils::ConvertIntToJSONValue(id, doc.GetAllocator()), doc.GetAllocator());
-                data.AddMember("counter", Utils::ConvertIntToJSONValue(counter, doc.GetAllocator()), doc.GetAllocator());
-                data.AddMember("timestamp", Utils::ConvertIntToJSONValue(timestamp, doc.GetAllocator()), doc.GetAllocator());
-                data.AddMember("value", Utils::ConvertDoubleToJSONValue(value, doc.GetAllocator()), doc.GetAllocator());
+            // The latest values are kept in memory. Only deeper requests read the database.
+            const auto isHot = script->GetHotTier().ReadLatest(count, addSample);
 
-                dataArr.PushBack(data, doc.GetAllocator());
+            // Engines that store samples themselves have no row ids.
+            if (!isHot && store.StoresSamples()) {
+                store.ScanLatest({ "ScriptData", "key", script->GetInfo()[0], { "value" } }, count, addSample);
+            }
+            else if (!isHot) {
+                auto statement = DataManager::GetInstance().PrepareRead("SELECT * FROM ScriptData WHERE key = ? ORDER BY id DESC LIMIT ?");
+                const int idColumn = statement.GetColumnIndex("id");
+                const int counterColumn = statement.GetColumnIndex("counter");
+                const int timestampColumn = statement.GetColumnIndex("timestamp");
+                const int valueColumn = statement.GetColumnIndex("value");
+
+                statement
+                    .BindText(script->GetInfo()[0])
+                    .BindInt64(count)
+                    .ExecuteSelect([&](const Cursor& row) {
+                    rapidjson::Value data(rapidjson::kObjectType);
+
+                    auto id = row.GetInt(idColumn);
+                    auto counter = row.GetInt(counterColumn);
+                    auto timestamp = row.GetInt(timestampColumn);
+                    auto value = row.GetDouble(valueColumn);
+
+                    data.AddMember("id", Utils::ConvertIntToJSONValue(id, doc.GetAllocator()), doc.GetAllocator());
+                    data.AddMember("counter", Utils::ConvertIntToJSONValue(counter, doc.GetAllocator()), doc.GetAllocator());
+                    data.AddMember("timestamp", Utils::ConvertIntToJSONValue(timestamp, doc.GetAllocator()), doc.GetAllocator());
+                    data.AddMember("value", Utils::ConvertDoubleToJSONValue(value, doc.GetAllocator()), doc.GetAllocator());
+
+                    dataArr.PushBack(data, doc.GetAllocator());
+                    });
             }
 
             obj.AddMember("data", dataArr, doc.GetAllocator());
@@ -129,21 +239,12 @@ public:
 
     rapidjson::Value GetAggregateDataJSON(rapidjson::Document& doc, const std::string& name) const {
         rapidjson::Value obj(rapidjson::kObjectType);
+        if (aggregateStore != nullptr && aggregateStore->GetJSON(doc, "ScriptData", name, "value", obj)) {
+            return obj;
+        }
 
-        const auto& rows = DataManager::GetInstance().SelectAggregate("ScriptData", "value", "key=\"" + name + "\"");
-
-        const auto& row = rows[0];
-        auto max = row.GetDouble("max");
-        auto min = row.GetDouble("min");
-        auto avg = row.GetDouble("avg");
-        auto total = row.GetDouble("total");
-        auto count = row.GetInt("count");
-
-        obj.AddMember("max", Utils::ConvertDoubleToJSONValue(max, doc.GetAllocator()), doc.GetAllocator());
-        obj.AddMember("min", Utils::ConvertDoubleToJSONValue(min, doc.GetAllocator()), doc.GetAllocator());
-        obj.AddMember("avg", Utils::ConvertDoubleToJSONValue(avg, doc.GetAllocator()), doc.GetAllocator());
-        obj.AddMember("total", Utils::ConvertDoubleToJSONValue(total, doc.GetAllocator()), doc.GetAllocator());
-        obj.AddMember("count", Utils::ConvertDoubleToJSONValue(count, doc.GetAllocator()), doc.GetAllocator());
+        // Not seeded yet, so read it from the database.
+        RollupManager::GetInstance().SelectAggregate("ScriptData", name, "value").AddMembers(obj, doc);
 
         return obj;
     };
@@ -178,25 +279,28 @@ public:
             metricName = document["metricName"].GetString();
         }
 
-        if (auto it = std::find_if(scripts.begin(), scripts.end(), [name](const std::shared_ptr<Script>& sc) {return sc->GetInfo()[0] == name; }); it != scripts.end()) {
+        if (FindScript(name) != nullptr) {
             // Script with same name already exists
             throw std::runtime_error("Script names must be unique. Provided name already in use.");
         }
 
-        // Create a stringstream object
-        std::ostringstream stream{};
-        stream << "NULL, "
-            << "\"" << name << "\", "
-            << "\"" << scriptText << "\", "
-            << "\"" << metricName << "\", "
-            << std::chrono::duration_cast<std::chrono::seconds>(p1.time_since_epoch()).count();
-        std::string sqlString = stream.str();
-
-        if (DataManager::GetInstance().Insert("ScriptManager", sqlString)) {
+        // The script is compiled first, so its bytecode is saved in the same row.
+        auto sc = CompileScript(name, scriptText, metricName);
+        const auto isSaved = DataManager::GetInstance().Prepare("INSERT INTO ScriptManager (name, scriptText, metricName, timestamp, bytecode, bytecodeHash) VALUES (?, ?, ?, ?, ?, ?)")
+            .BindText(name)
+            .BindText(scriptText)
+            .BindText(metricName)
+            .BindInt64(std::chrono::duration_cast<std::chrono::seconds>(p1.time_since_epoch()).count())
+            .BindBlob(sc->GetBytecode())
+            .BindInt64(Script::GetBytecodeHash(scriptText))
+            .Execute();
+
+        if (isSaved) {
             LogManager::GetInstance().LogInfo("Saved script to the database: {0}", name);
             // Add new script to in-memory list of scripts
-            std::shared_ptr<Script> sc = std::make_shared<Script>(name, scriptText, metricName);
+            std::lock_guard<std::mutex> lock(scriptMutex);
             scripts.emplace_back(sc);
+            scriptsVersion++;
 
             return true;
         }
@@ -233,19 +337,29 @@ public:
             metricName = document["metricName"].GetString();
         }
 
-        auto it = std::find_if(scripts.begin(), scripts.end(), [name](const std::shared_ptr<Script>& sc) {return sc->GetInfo()[0] == name; });
-        if (it == scripts.end()) {
-            // Script with same name already exists
+        if (FindScript(name) == nullptr) {
             throw std::runtime_error("Script not found. The provided script name could not be found");
         }
-        if (DataManager::GetInstance().Update("ScriptManager", "\"scriptText\" = \"" + scriptText + "\", \"metricName\" = \"" + metricName + "\"", "\"name\" = \"" + name + "\"")) {
+        // The script is compiled first, so its bytecode is saved in the same row.
+        auto sc = CompileScript(name, scriptText, metricName);
+        const auto isSaved = DataManager::GetInstance().Prepare("UPDATE ScriptManager SET scriptText = ?, metricName = ?, bytecode = ?, bytecodeHash = ? WHERE name = ?")
+            .BindText(scriptText)
+            .BindText(metricName)
+            .BindBlob(sc->GetBytecode())
+            .BindInt64(Script::GetBytecodeHash(scriptText))
+            .BindText(name)
+            .Execute();
+
+        if (isSaved) {
             LogManager::GetInstance().LogInfo("Saved script to the database: {0}", name);
-            // Add new script to in-memory list of scripts
-            std::shared_ptr<Script> sc = std::make_shared<Script>(name, scriptText, metricName);
 
+            // The script is looked up again, as the list may have changed while it compiled.
+            std::lock_guard<std::mutex> lock(scriptMutex);
+            auto it = std::find_if(scripts.begin(), scripts.end(), [&name](const std::shared_ptr<Script>& script) { return script->GetInfo()[0] == name; });
             if (it != scripts.end()) {
                 // Element with the specified name found, replace it
                 *it = sc;
+                scriptsVersion++;
             }
             else {
                 LogManager::GetInstance().LogWarning("Failed to update scripts list. A server restart will be required.");
@@ -269,15 +383,32 @@ public:
             auto nameComparator = [&name](const std::shared_ptr<Script>& script) {
                 return script->GetInfo()[0] == name;
             };
+            std::lock_guard<std::mutex> lock(scriptMutex);
             auto newEnd = std::remove_if(scripts.begin(), scripts.end(), nameComparator);
             scripts.erase(newEnd, scripts.end());
+            scriptsVersion++;
             return true;
         }
 
         return false;
     }
 
-    void Process(std::atomic<UINT64>& counter);
+    // Runs the scripts in `names` against `sample`. Scripts that no longer exist are skipped.
+    // Returns the handle of the task of each script, keyed by name.
+    std::map<std::string, TaskHandle> Process(const std::vector<std::string>& names, UINT64 counter, const std::shared_ptr<const CounterSample>& sample);
+
+    // Sets the budgets of every script from `config`, starting with their next run.
+    void SetBudgets(const MyConfig& config) {
+        {
+            std::lock_guard<std::mutex> lock(budgetMutex);
+            budgetConfig.scriptBudgets = config.scriptBudgets;
+        }
+
+        std::lock_guard<std::mutex> lock(scriptMutex);
+        for (const auto& script : scripts) {
+            SetBudget(*script);
+        }
+    }
 
     void Stop() {
         should_stop.store(true);
@@ -286,57 +417,49 @@ public:
 private:
     ScriptManager(int intervalMS) : intervalMS_(intervalMS) {
         should_stop.store(false);
-        DataManager::GetInstance().CreateTable("ScriptManager", " \
-            id INTEGER PRIMARY KEY, \
-            name TEXT UNIQUE NOT NULL, \
-            scriptText TEXT NOT NULL, \
-            metricName TEXT DEFAULT NULL, \
-            timestamp INTEGER NOT NULL"
-        );
     }
 
-    void SetupJavascriptContext(std::shared_ptr<Script>& sc) {
-        sc->CreateContext();
-        auto* ctx = sc->GetContext();
-
-        duk_push_global_object(ctx);
-        duk_push_pointer(ctx, sc.get()); // Pass a pointer to the C++ instance
-        duk_put_global_string(ctx, SCRIPT_INSTANCE_NAME); // Set a property to store the C++ instance
-
-        duk_push_c_function(ctx, [](duk_context* ctx_) -> int {
-            duk_push_global_object(ctx_);
-            duk_get_global_string(ctx_, SCRIPT_INSTANCE_NAME);
-            Script* myInstance = static_cast<Script*>(duk_require_pointer(ctx_, -1)); // Get the C++ instance
-
-            double arg1 = duk_require_number(ctx_, 0); // Get the argument from JavaScript
-
-            // Call the C++ class method on the instance
-            myInstance->Persist(arg1);
-
-            return 0;
-            }, /*num_args=*/1);
-        duk_put_global_string(ctx, "persist");
-
-        duk_push_c_function(ctx, [](duk_context* ctx_) -> int {
-            duk_push_global_object(ctx_);
-            duk_get_global_string(ctx_, SCRIPT_INSTANCE_NAME);
-            Script* myInstance = static_cast<Script*>(duk_require_pointer(ctx_, -1)); // Get the C++ instance
-
-            // Call the C++ class method on the instance
-            auto counterValue = myInstance->GetCounterValue();
+    // Creates a script and compiles its text, within the budgets of the script. Scripts
+    // that do not compile have no bytecode, and report their error when they run.
+    std::shared_ptr<Script> CompileScript(const std::string& name, const std::string& scriptText, const std::string& metricName) {
+        auto script = CreateScript(name, scriptText, metricName, {});
+        if (!script->Compile()) {
+            LogManager::GetInstance().LogWarning("Script does not compile, and will report its error when it runs: {0}", name);
+        }
+        return script;
+    }
 
-            duk_push_number(ctx_, counterValue);
-            return 1;
-            }, /*num_args=*/0);
-        duk_put_global_string(ctx, "getCounterValue");
+    // The heap of the script is only created when it first runs, on a pool thread.
+    std::shared_ptr<Script> CreateScript(const std::string& name, const std::string& scriptText, const std::string& metricName, std::vector<uint8_t> bytecode) {
+        auto script = std::make_shared<Script>(name, scriptText, metricName, *counterRegistry, hotTierSize, std::move(bytecode));
+        SetBudget(*script);
+        return script;
+    }
 
-        sc->ExecuteJavaScript();
+    void SetBudget(Script& script) {
+        std::lock_guard<std::mutex> lock(budgetMutex);
+        const auto budget = budgetConfig.GetScriptBudgetConfig(script.GetInfo()[0]);
+        script.SetBudget(budget.cpuTime, budget.memory);
     }
 
 private:
-    std::mutex scriptMutex;
+    // Copies the list of scripts, so it can be walked without holding `scriptMutex`
+    // while reading the database or building JSON.
+    std::vector<std::shared_ptr<Script>> GetScripts() const {
+        std::lock_guard<std::mutex> lock(scriptMutex);
+        return scripts;
+    }
+
+    mutable std::mutex scriptMutex;
 
     std::vector<std::shared_ptr<Script>> scripts;
+    CounterRegistry* counterRegistry = nullptr;
+    AggregateStore* aggregateStore = nullptr;
+    size_t hotTierSize = 0;
+    std::atomic<UINT64> scriptsVersion = 0;
+    // Only `scriptBudgets` is used.
+    std::mutex budgetMutex;
+    MyConfig budgetConfig;
     std::atomic<bool> should_stop;
     int intervalMS_;
 };
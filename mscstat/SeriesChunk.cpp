@@ -0,0 +1,292 @@
+#include "SeriesChunk.h"
+
+namespace {
+    template <typename T>
+    void AppendValue(std::vector<uint8_t>& bytes, T value) {
+        const auto offset = bytes.size();
+        bytes.resize(offset + sizeof(T));
+        std::memcpy(bytes.data() + offset, &value, sizeof(T));
+    }
+
+    template <typename T>
+    T ReadValue(const uint8_t* data) {
+        T value;
+        std::memcpy(&value, data, sizeof(T));
+        return value;
+    }
+
+    int CountLeadingZeros(uint64_t value) {
+        int n = 0;
+        for (uint64_t bit = uint64_t(1) << 63; bit != 0 && (value & bit) == 0; bit >>= 1) {
+            n++;
+        }
+        return n;
+    }
+
+    int CountTrailingZeros(uint64_t value) {
+        int n = 0;
+        for (uint64_t bit = 1; bit != 0 && (value & bit) == 0; bit <<= 1) {
+            n++;
+        }
+        return n;
+    }
+
+    // Maps signed values to unsigned ones so small magnitudes of either sign stay small.
+    uint64_t ZigZag(int64_t value) {
+        return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    }
+
+    int64_t UnZigZag(uint64_t value) {
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+}
+
+void ChunkEncoder::DeltaStream::Append(int64_t value, bool isFirst) {
+    if (isFirst) {
+        writer.Write(static_cast<uint64_t>(value), 64);
+        previous = value;
+        previousDelta = 0;
+        return;
+    }
+
+    const int64_t delta = value - previous;
+    const uint64_t dod = ZigZag(delta - previousDelta);
+    previous = value;
+    previousDelta = delta;
+
+    // Samples on a fixed interval have a delta-of-delta of 0, which takes a single bit.
+    if (dod == 0) {
+        writer.WriteBit(false);
+    }
+    else if (dod < (uint64_t(1) << 7)) {
+        writer.Write(0b10, 2);
+        writer.Write(dod, 7);
+    }
+    else if (dod < (uint64_t(1) << 9)) {
+        writer.Write(0b110, 3);
+        writer.Write(dod, 9);
+    }
+    else if (dod < (uint64_t(1) << 12)) {
+        writer.Write(0b1110, 4);
+        writer.Write(dod, 12);
+    }
+    else {
+        writer.Write(0b1111, 4);
+        writer.Write(dod, 64);
+    }
+}
+
+void ChunkEncoder::XorStream::Append(double value, bool isFirst) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    if (isFirst) {
+        writer.Write(bits, 64);
+        previous = bits;
+        return;
+    }
+
+    const uint64_t xored = bits ^ previous;
+    previous = bits;
+
+    // An unchanged value takes a single bit.
+    if (xored == 0) {
+        writer.WriteBit(false);
+        return;
+    }
+    writer.WriteBit(true);
+
+    // The leading zero count is stored in 5 bits.
+    const int leading = (std::min)(CountLeadingZeros(xored), 31);
+    const int trailing = CountTrailingZeros(xored);
+
+    // Reuse the previous window if the meaningful bits fit in it, which saves the
+    // 11 bits describing a new one.
+    if (previousLeading >= 0 && leading >= previousLeading && trailing >= previousTrailing) {
+        writer.WriteBit(false);
+        writer.Write(xored >> previousTrailing, 64 - previousLeading - previousTrailing);
+        return;
+    }
+
+    const int meaningful = 64 - leading - trailing;
+    writer.WriteBit(true);
+    writer.Write(leading, 5);
+    // 1 to 64 meaningful bits, stored as 0 to 63.
+    writer.Write(meaningful - 1, 6);
+    writer.Write(xored >> trailing, meaningful);
+
+    previousLeading = leading;
+    previousTrailing = trailing;
+}
+
+std::vector<uint8_t> ChunkEncoder::Serialize() const {
+    std::vector<const std::vector<uint8_t>*> streams = { &timestamps.writer.GetBytes(), &counters.writer.GetBytes() };
+    for (const auto& column : columns) {
+        streams.push_back(&column.writer.GetBytes());
+    }
+
+    ChunkHeader header;
+    header.count = count;
+    header.columnCount = static_cast<uint32_t>(columns.size());
+    header.first = first;
+    header.last = last;
+
+    size_t size = ChunkHeader::SIZE + header.GetTableSize();
+    for (const auto* stream : streams) {
+        size += stream->size();
+    }
+    header.size = static_cast<uint32_t>(size);
+
+    std::vector<uint8_t> bytes;
+    bytes.reserve(size);
+    AppendValue(bytes, header.magic);
+    AppendValue(bytes, header.size);
+    AppendValue(bytes, header.count);
+    AppendValue(bytes, header.columnCount);
+    AppendValue(bytes, header.first);
+    AppendValue(bytes, header.last);
+
+    for (const auto* stream : streams) {
+        AppendValue(bytes, static_cast<uint32_t>(stream->size()));
+    }
+    for (const auto& summary : summaries) {
+        AppendValue(bytes, summary.min);
+        AppendValue(bytes, summary.max);
+        AppendValue(bytes, summary.sum);
+    }
+    for (const auto* stream : streams) {
+        bytes.insert(bytes.end(), stream->begin(), stream->end());
+    }
+
+    return bytes;
+}
+
+bool ChunkDecoder::ReadHeader(const uint8_t* data, size_t size, ChunkHeader& header) {
+    if (size < ChunkHeader::SIZE) {
+        return false;
+    }
+
+    header.magic = ReadValue<uint32_t>(data);
+    header.size = ReadValue<uint32_t>(data + 4);
+    header.count = ReadValue<uint32_t>(data + 8);
+    header.columnCount = ReadValue<uint32_t>(data + 12);
+    header.first = ReadValue<int64_t>(data + 16);
+    header.last = ReadValue<int64_t>(data + 24);
+
+    return header.magic == ChunkHeader::MAGIC && header.size >= ChunkHeader::SIZE + header.GetTableSize();
+}
+
+std::vector<AggregateValue> ChunkDecoder::ReadSummaries(const uint8_t* data, size_t size) {
+    std::vector<AggregateValue> summaries;
+
+    ChunkHeader header;
+    if (!ReadHeader(data, size, header) || size < header.size) {
+        return summaries;
+    }
+
+    const uint8_t* summary = data + ChunkHeader::SIZE + (header.columnCount + 2) * sizeof(uint32_t);
+    for (uint32_t i = 0; i < header.columnCount; i++) {
+        AggregateValue value;
+        value.min = ReadValue<double>(summary);
+        value.max = ReadValue<double>(summary + 8);
+        value.sum = ReadValue<double>(summary + 16);
+        value.count = header.count;
+        summaries.push_back(value);
+        summary += 3 * sizeof(double);
+    }
+
+    return summaries;
+}
+
+bool ChunkDecoder::Decode(const uint8_t* data, size_t size, const SampleVisitor& visitor) {
+    ChunkHeader header;
+    if (!ReadHeader(data, size, header) || size < header.size) {
+        return false;
+    }
+
+    // Locate every stream from the table of sizes.
+    const uint8_t* sizes = data + ChunkHeader::SIZE;
+    const uint8_t* stream = data + ChunkHeader::SIZE + header.GetTableSize();
+    const uint8_t* end = data + header.size;
+
+    std::vector<std::pair<const uint8_t*, size_t>> streams;
+    for (uint32_t i = 0; i < header.columnCount + 2; i++) {
+        const auto streamSize = ReadValue<uint32_t>(sizes + i * sizeof(uint32_t));
+        if (streamSize > static_cast<size_t>(end - stream)) {
+            return false;
+        }
+
+        streams.emplace_back(stream, streamSize);
+        stream += streamSize;
+    }
+
+    DeltaStream timestamps(streams[0].first, streams[0].second);
+    DeltaStream counters(streams[1].first, streams[1].second);
+    std::vector<XorStream> columns;
+    columns.reserve(header.columnCount);
+    for (uint32_t i = 0; i < header.columnCount; i++) {
+        columns.emplace_back(streams[i + 2].first, streams[i + 2].second);
+    }
+
+    std::vector<double> values(header.columnCount);
+    for (uint32_t n = 0; n < header.count; n++) {
+        const auto timestamp = timestamps.Next(n == 0);
+        const auto counter = counters.Next(n == 0);
+        for (uint32_t i = 0; i < header.columnCount; i++) {
+            values[i] = columns[i].Next(n == 0);
+        }
+
+        visitor(timestamp, counter, values.data());
+    }
+
+    return true;
+}
+
+int64_t ChunkDecoder::DeltaStream::Next(bool isFirst) {
+    if (isFirst) {
+        previous = static_cast<int64_t>(reader.Read(64));
+        previousDelta = 0;
+        return previous;
+    }
+
+    uint64_t dod = 0;
+    if (!reader.ReadBit()) {
+        dod = 0;
+    }
+    else if (!reader.ReadBit()) {
+        dod = reader.Read(7);
+    }
+    else if (!reader.ReadBit()) {
+        dod = reader.Read(9);
+    }
+    else if (!reader.ReadBit()) {
+        dod = reader.Read(12);
+    }
+    else {
+        dod = reader.Read(64);
+    }
+
+    previousDelta += UnZigZag(dod);
+    previous += previousDelta;
+    return previous;
+}
+
+double ChunkDecoder::XorStream::Next(bool isFirst) {
+    if (isFirst) {
+        previous = reader.Read(64);
+    }
+    else if (reader.ReadBit()) {
+        if (reader.ReadBit()) {
+            previousLeading = static_cast<int>(reader.Read(5));
+            const int meaningful = static_cast<int>(reader.Read(6)) + 1;
+            previousTrailing = 64 - previousLeading - meaningful;
+        }
+
+        const int meaningful = 64 - previousLeading - previousTrailing;
+        previous ^= reader.Read(meaningful) << previousTrailing;
+    }
+
+    double value;
+    std::memcpy(&value, &previous, sizeof(value));
+    return value;
+}
@@ -0,0 +1,201 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+#include "AggregateStore.h"
+
+// Called for each sample read from a sample store, with its timestamp in seconds since
+// epoch, its counter and one value per column of the series.
+typedef std::function<void(int64_t timestamp, int64_t counter, const double* values)> SampleVisitor;
+
+// Appends values of any width up to 64 bits to a byte buffer, most significant bit first.
+class BitWriter {
+public:
+    void Write(uint64_t value, int bits) {
+        while (bits > 0) {
+            if (used == 0) {
+                bytes.push_back(0);
+                used = 8;
+            }
+
+            const int n = bits < used ? bits : used;
+            const uint64_t part = (value >> (bits - n)) & ((uint64_t(1) << n) - 1);
+            bytes.back() |= static_cast<uint8_t>(part << (used - n));
+            used -= n;
+            bits -= n;
+        }
+    }
+
+    void WriteBit(bool bit) {
+        Write(bit ? 1 : 0, 1);
+    }
+
+    const std::vector<uint8_t>& GetBytes() const {
+        return bytes;
+    }
+
+private:
+    std::vector<uint8_t> bytes;
+    // Bits still free in the last byte.
+    int used = 0;
+};
+
+// Reads values written by `BitWriter`. Reading past the end returns zero bits.
+class BitReader {
+public:
+    BitReader(const uint8_t* data, size_t size) : data(data), size(size) {}
+
+    uint64_t Read(int bits) {
+        uint64_t value = 0;
+        while (bits > 0) {
+            const size_t byte = position / 8;
+            const int offset = static_cast<int>(position % 8);
+            const int n = bits < 8 - offset ? bits : 8 - offset;
+            const uint8_t current = byte < size ? data[byte] : 0;
+
+            value = (value << n) | ((current >> (8 - offset - n)) & ((1 << n) - 1));
+            position += n;
+            bits -= n;
+        }
+
+        return value;
+    }
+
+    bool ReadBit() {
+        return Read(1) != 0;
+    }
+
+private:
+    const uint8_t* data;
+    size_t size;
+    size_t position = 0;
+};
+
+// Fixed part of a serialized chunk. It is followed by the byte size of every stream
+// (timestamps, counters, then one per column), the min/max/sum of every column, and
+// the streams themselves. Numbers are stored in the byte order of the host, which is
+// little-endian on every platform we build for.
+struct ChunkHeader {
+    static constexpr uint32_t MAGIC = 0x3143464D; // "MFC1"
+    static constexpr size_t SIZE = 32;
+
+    uint32_t magic = MAGIC;
+    // Bytes of the whole chunk, header included.
+    uint32_t size = 0;
+    uint32_t count = 0;
+    uint32_t columnCount = 0;
+    int64_t first = 0;
+    int64_t last = 0;
+
+    // Bytes between the fixed header and the first stream.
+    size_t GetTableSize() const {
+        return (columnCount + 2) * sizeof(uint32_t) + columnCount * 3 * sizeof(double);
+    }
+};
+
+// Compresses the samples of a series into a chunk, as described in Facebook's Gorilla
+// paper: timestamps and counters as delta-of-deltas, and values XORed with the previous
+// value of their column. Regular samples of a slowly changing metric take a few bits each.
+class ChunkEncoder {
+public:
+    explicit ChunkEncoder(size_t columnCount) : columns(columnCount), summaries(columnCount) {}
+
+    void Append(int64_t timestamp, int64_t counter, const double* values) {
+        if (count == 0) {
+            first = timestamp;
+        }
+        last = timestamp;
+
+        timestamps.Append(timestamp, count == 0);
+        counters.Append(counter, count == 0);
+        for (size_t i = 0; i < columns.size(); i++) {
+            columns[i].Append(values[i], count == 0);
+            summaries[i].Add(values[i]);
+        }
+
+        count++;
+    }
+
+    uint32_t GetCount() const {
+        return count;
+    }
+
+    int64_t GetFirst() const {
+        return first;
+    }
+
+    int64_t GetLast() const {
+        return last;
+    }
+
+    // Returns the chunk serialized as described by `ChunkHeader`.
+    std::vector<uint8_t> Serialize() const;
+
+private:
+    // Delta-of-delta coding. The first value is stored whole, then the change of the
+    // difference between consecutive values, in the smallest of a few fixed widths.
+    struct DeltaStream {
+        BitWriter writer;
+        int64_t previous = 0;
+        int64_t previousDelta = 0;
+
+        void Append(int64_t value, bool isFirst);
+    };
+
+    // XOR coding. Each value is XORed with the previous one, and only the bits between
+    // the leading and trailing zeros of the result are stored.
+    struct XorStream {
+        BitWriter writer;
+        uint64_t previous = 0;
+        int previousLeading = -1;
+        int previousTrailing = 0;
+
+        void Append(double value, bool isFirst);
+    };
+
+    uint32_t count = 0;
+    int64_t first = 0;
+    int64_t last = 0;
+    DeltaStream timestamps;
+    DeltaStream counters;
+    std::vector<XorStream> columns;
+    std::vector<AggregateValue> summaries;
+};
+
+// Reads chunks written by `ChunkEncoder`.
+class ChunkDecoder {
+public:
+    // Reads the fixed header from `data`. Returns `false` if it is not a chunk header.
+    static bool ReadHeader(const uint8_t* data, size_t size, ChunkHeader& header);
+
+    // Returns the min/max/sum/count of every column of a whole chunk, without decoding it.
+    static std::vector<AggregateValue> ReadSummaries(const uint8_t* data, size_t size);
+
+    // Visits every sample of a chunk, oldest first. Returns `false` if the chunk is damaged.
+    static bool Decode(const uint8_t* data, size_t size, const SampleVisitor& visitor);
+
+private:
+    struct DeltaStream {
+        BitReader reader;
+        int64_t previous = 0;
+        int64_t previousDelta = 0;
+
+        DeltaStream(const uint8_t* data, size_t size) : reader(data, size) {}
+
+        int64_t Next(bool isFirst);
+    };
+
+    struct XorStream {
+        BitReader reader;
+        uint64_t previous = 0;
+        int previousLeading = 0;
+        int previousTrailing = 0;
+
+        XorStream(const uint8_t* data, size_t size) : reader(data, size) {}
+
+        double Next(bool isFirst);
+    };
+};
@@ -5,7 +5,7 @@ void Server::getIndexHandler(const std::shared_ptr< Session >& session)
 {
     const auto request = session->get_request();
     const std::string requestPath = request->get_path();
-    std::string file_path = Utils::GetAppDataPath() + "\\www" + requestPath;
+    std::string file_path = Utils::GetAppDataPath() + "/www" + requestPath;
     std::string file_content = read_file(file_path);
 
     // Check if the file exists
@@ -30,7 +30,7 @@ void Server::getIndexHandler(const std::shared_ptr< Session >& session)
         fallback = read_file(file_path + ".html");
     }
     else {
-        fallback = read_file(Utils::GetAppDataPath() + "\\www\\404.html");
+        fallback = read_file(Utils::GetAppDataPath() + "/www/404.html");
     }
 
     session->close(OK, fallback, { {"Content-Type", "text/html"}, {"Content-Length", std::to_string(fallback.length())} });
@@ -243,6 +243,36 @@ void Server::GetProviderAggregateData(const std::shared_ptr< Session >& session)
     }
 }
 
+void Server::GetProviderRangeData(const std::shared_ptr< Session >& session)
+{
+    try {
+        const auto& req = session->get_request();
+        const auto& column = req->get_query_parameter("column");
+        if (column.empty()) {
+            throw std::runtime_error("Provide column in order to fetch a range.");
+        }
+
+        const bool isCustom = std::stoi(req->get_query_parameter("isCustom", "0")) == 1;
+        const auto& name = req->get_query_parameter("name");
+        // Seconds since epoch. The range defaults to the last hour.
+        const auto now = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        const auto to = std::stoll(req->get_query_parameter("to", std::to_string(now)));
+        const auto from = std::stoll(req->get_query_parameter("from", std::to_string(to - 60 * 60)));
+        const auto range = Application::theApp->metricsManager->GetProviderRangeDataJSON(column, isCustom, name, from, to);
+
+        session->close(OK, range, {
+            { "Content-Type", "application/json"},
+            { "Content-Length", std::to_string(range.length()) }
+            });
+    }
+    catch (std::runtime_error e) {
+        session->close(BAD_REQUEST, e.what(), {
+            { "Content-Type", "text/plain"},
+            { "Content-Length", std::to_string(strlen(e.what())) }
+            });
+    }
+}
+
 void Server::getHealthHandler(const std::shared_ptr< Session >& session)
 {
     try {
@@ -260,3 +290,108 @@ void Server::getHealthHandler(const std::shared_ptr< Session >& session)
             });
     }
 }
+
+void Server::getDebugThreadsHandler(const std::shared_ptr< Session >& session)
+{
+    try {
+        const auto info = Application::theApp->threadManager->GetDebugInfoAsJSON();
+
+        session->close(OK, info, {
+            { "Content-Type", "application/json"},
+            { "Content-Length", std::to_string(info.length()) }
+            });
+    }
+    catch (std::runtime_error e) {
+        session->close(BAD_REQUEST, e.what(), {
+            { "Content-Type", "text/plain"},
+            { "Content-Length", std::to_string(strlen(e.what())) }
+            });
+    }
+}
+
+void Server::getBurstHandler(const std::shared_ptr< Session >& session)
+{
+    try {
+        const auto info = Application::theApp->metricsManager->GetBurstBuffer().GetInfoAsJSON();
+
+        session->close(OK, info, {
+            { "Content-Type", "application/json"},
+            { "Content-Length", std::to_string(info.length()) }
+            });
+    }
+    catch (std::runtime_error e) {
+        session->close(BAD_REQUEST, e.what(), {
+            { "Content-Type", "text/plain"},
+            { "Content-Length", std::to_string(strlen(e.what())) }
+            });
+    }
+}
+
+void Server::getBurstDataHandler(const std::shared_ptr< Session >& session)
+{
+    try {
+        const auto& req = session->get_request();
+        const auto& name = req->get_query_parameter("name");
+        const auto& column = req->get_query_parameter("column");
+        if (name.empty() || column.empty()) {
+            throw std::runtime_error("Provide name and column in order to fetch burst samples.");
+        }
+
+        // Get the specified limit or return the whole buffer
+        const auto fetchLimit = std::stoul(req->get_query_parameter("limit", "0"));
+        const auto data = Application::theApp->metricsManager->GetBurstBuffer().GetDataJSON(name, column, fetchLimit > 0 ? fetchLimit : SIZE_MAX);
+
+        session->close(OK, data, {
+            { "Content-Type", "application/json"},
+            { "Content-Length", std::to_string(data.length()) }
+            });
+    }
+    catch (std::runtime_error e) {
+        session->close(BAD_REQUEST, e.what(), {
+            { "Content-Type", "text/plain"},
+            { "Content-Length", std::to_string(strlen(e.what())) }
+            });
+    }
+}
+
+void Server::postBurstStartHandler(const std::shared_ptr< Session >& session)
+{
+    try {
+        const auto& req = session->get_request();
+        // Duration in milliseconds. Use the configured duration if not specified.
+        const auto duration = std::stoi(req->get_query_parameter("duration", "-1"));
+
+        Application::theApp->metricsManager->StartBurst(duration);
+
+        const std::string responseData = "{\"success\": true}";
+        session->close(OK, responseData, {
+            { "Content-Type", "application/json"},
+            { "Content-Length", std::to_string(responseData.length()) }
+            });
+    }
+    catch (std::runtime_error e) {
+        session->close(BAD_REQUEST, e.what(), {
+            { "Content-Type", "text/plain"},
+            { "Content-Length", std::to_string(strlen(e.what())) }
+            });
+    }
+}
+
+void Server::postBurstStopHandler(const std::shared_ptr< Session >& session)
+{
+    try {
+        Application::theApp->metricsManager->StopBurst();
+
+        const std::string responseData = "{\"success\": true}";
+        session->close(OK, responseData, {
+            { "Content-Type", "application/json"},
+            { "Content-Length", std::to_string(responseData.length()) }
+            });
+    }
+    catch (std::runtime_error e) {
+        session->close(BAD_REQUEST, e.what(), {
+            { "Content-Type", "text/plain"},
+            { "Content-Length", std::to_string(strlen(e.what())) }
+            });
+    }
+}
@@ -15,6 +15,7 @@
 
 #include "ConfigManager.h"
 #include "LogManager.h"
+#include "Utils.h"
 
 using namespace rapidjson;
 using namespace restbed;
@@ -35,8 +36,15 @@ private:
 
     void GetProvidersData(const std::shared_ptr< Session >& session);
     void GetProviderAggregateData(const std::shared_ptr< Session >& session);
+    void GetProviderRangeData(const std::shared_ptr< Session >& session);
 
     void getHealthHandler(const std::shared_ptr< Session >& session);
+    void getDebugThreadsHandler(const std::shared_ptr< Session >& session);
+
+    void getBurstHandler(const std::shared_ptr< Session >& session);
+    void getBurstDataHandler(const std::shared_ptr< Session >& session);
+    void postBurstStartHandler(const std::shared_ptr< Session >& session);
+    void postBurstStopHandler(const std::shared_ptr< Session >& session);
 
 public:
     Server(USHORT _port) {
@@ -78,8 +86,15 @@ public:
 
         service->publish(createRouteResource("/api/providers/{limit: \\d*}", "GET", [&](const std::shared_ptr< Session >& session) { GetProvidersData(session); }));
         service->publish(createRouteResource("/api/provider/aggregate", "GET", [&](const std::shared_ptr< Session >& session) { GetProviderAggregateData(session); }));
+        service->publish(createRouteResource("/api/provider/range", "GET", [&](const std::shared_ptr< Session >& session) { GetProviderRangeData(session); }));
 
         service->publish(createRouteResource("/api/health", "GET", [&](const std::shared_ptr< Session >& session) { getHealthHandler(session); }));
+        service->publish(createRouteResource("/api/debug/threads", "GET", [&](const std::shared_ptr< Session >& session) { getDebugThreadsHandler(session); }));
+
+        service->publish(createRouteResource("/api/burst", "GET", [&](const std::shared_ptr< Session >& session) { getBurstHandler(session); }));
+        service->publish(createRouteResource("/api/burst/data", "GET", [&](const std::shared_ptr< Session >& session) { getBurstDataHandler(session); }));
+        service->publish(createRouteResource("/api/burst/start", "POST", [&](const std::shared_ptr< Session >& session) { postBurstStartHandler(session); }));
+        service->publish(createRouteResource("/api/burst/stop", "POST", [&](const std::shared_ptr< Session >& session) { postBurstStopHandler(session); }));
 
         // Web routes
         service->publish(webAppResource);
@@ -0,0 +1 @@
+#include "SqliteSampleStore.h"
@@ -0,0 +1,89 @@
+#pragma once
+#include "DataManager.h"
+#include "SampleStore.h"
+#include "StorageWriter.h"
+
+// Raw samples in the SQLite provider tables, one row per sample. This is the default
+// engine. Rows are written by the providers and scripts themselves.
+class SqliteSampleStore : public SampleStore {
+public:
+    virtual std::string GetName() const override { return "sqlite"; }
+
+    virtual bool StoresSamples() const override { return false; }
+
+    virtual void Append(const SeriesKey& key, int64_t timestamp, int64_t counter, const double* values, size_t count) override {}
+
+    virtual void Scan(const SeriesKey& key, int64_t from, int64_t to, const SampleVisitor& visitor) override {
+        auto statement = DataManager::GetInstance().PrepareRead("SELECT * FROM " + key.table + " WHERE " + key.seriesColumn + " = ? AND timestamp >= ? AND timestamp < ? ORDER BY id");
+        statement
+            .BindText(key.name)
+            .BindInt64(from)
+            .BindInt64(to);
+        Visit(key, statement, visitor);
+    }
+
+    virtual void ScanLatest(const SeriesKey& key, size_t count, const SampleVisitor& visitor) override {
+        auto statement = DataManager::GetInstance().PrepareRead("SELECT * FROM " + key.table + " WHERE " + key.seriesColumn + " = ? ORDER BY id DESC LIMIT ?");
+        statement
+            .BindText(key.name)
+            .BindInt64(count);
+        Visit(key, statement, visitor);
+    }
+
+    virtual int64_t GetFirstTimestamp(const SeriesKey& key, int64_t from) override {
+        const auto rows = DataManager::GetInstance().PrepareRead("SELECT MIN(timestamp) AS first FROM " + key.table + " WHERE " + key.seriesColumn + " = ? AND timestamp >= ?")
+            .BindText(key.name)
+            .BindInt64(from)
+            .Query();
+        return rows.empty() ? 0 : rows.front().GetInt64("first");
+    }
+
+    virtual AggregateValue Aggregate(const SeriesKey& key, const std::string& column, int64_t from) override {
+        const auto rows = DataManager::GetInstance().PrepareRead("\
+            SELECT \
+            MAX(CAST(" + column + " AS REAL)) AS max, \
+            MIN(CAST(" + column + " AS REAL)) AS min, \
+            TOTAL(CAST(" + column + " AS REAL)) AS total, \
+            COUNT(" + column + ") AS count FROM " + key.table + " WHERE " + key.seriesColumn + " = ? AND timestamp >= ?")
+            .BindText(key.name)
+            .BindInt64(from)
+            .Query();
+
+        AggregateValue result;
+        if (!rows.empty()) {
+            result.max = rows.front().GetDouble("max");
+            result.min = rows.front().GetDouble("min");
+            result.sum = rows.front().GetDouble("total");
+            result.count = rows.front().GetInt64("count");
+        }
+        return result;
+    }
+
+    virtual void Expire(const SeriesKey& key, int64_t before, int batchSize) override {
+        StorageWriter::GetInstance().Write("DELETE FROM " + key.table + " WHERE id IN (SELECT id FROM " + key.table + " WHERE " + key.seriesColumn + " = ? AND timestamp < ? LIMIT ?)", "retention." + key.table + "." + key.name)
+            .BindText(key.name)
+            .BindInt64(before)
+            .BindInt64(batchSize)
+            .Submit();
+    }
+
+private:
+    // Runs `statement` and visits its rows as samples of `key`.
+    static void Visit(const SeriesKey& key, PreparedStatement& statement, const SampleVisitor& visitor) {
+        const int timestampColumn = statement.GetColumnIndex("timestamp");
+        const int counterColumn = statement.GetColumnIndex("counter");
+        std::vector<int> columns;
+        for (const auto& column : key.columns) {
+            columns.push_back(statement.GetColumnIndex(column));
+        }
+
+        std::vector<double> values(key.columns.size());
+        statement.ExecuteSelect([&](const Cursor& row) {
+            for (size_t i = 0; i < columns.size(); i++) {
+                values[i] = row.GetDouble(columns[i]);
+            }
+
+            visitor(row.GetInt64(timestampColumn), row.GetInt64(counterColumn), values.data());
+            });
+    }
+};
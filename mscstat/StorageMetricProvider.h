@@ -6,6 +6,7 @@ class StorageMetricProvider : public MetricProviderBase {
     struct Metric {
         std::string name;
         UINT16 counter;
+        std::chrono::system_clock::time_point timestamp;
         double read = 0;
         double write = 0;
         double transferRate = 0;
@@ -13,26 +14,6 @@ class StorageMetricProvider : public MetricProviderBase {
 
 public:
     StorageMetricProvider() {
-        // Create a table for this metric provider if it does not exist
-        DataManager::GetInstance().CreateTable("StorageMetricProvider", " \
-            id INTEGER PRIMARY KEY, \
-            name TEXT DEFAULT \"Storage\", \
-            counter INTEGER NOT NULL, \
-            read REAL DEFAULT 0, \
-            write REAL DEFAULT 0, \
-            transferRate REAL DEFAULT 0, \
-            timestamp INTEGER NOT NULL");
-
-        PDH_STATUS status = PdhOpenQuery(nullptr, 0, &queryHandle);
-        if (status != ERROR_SUCCESS) {
-            throw std::runtime_error("Failed to open PDH query.");
-        }
-
-        PdhAddEnglishCounter(queryHandle, L"\\PhysicalDisk(_Total)\\Disk Read Bytes/sec", 0, &diskReadRateCounter);
-        PdhAddEnglishCounter(queryHandle, L"\\PhysicalDisk(_Total)\\Disk Write Bytes/sec", 0, &diskWriteRateCounter);
-        PdhAddEnglishCounter(queryHandle, L"\\PhysicalDisk(_Total)\\Disk Bytes/sec", 0, &totalTransferRateCounter);
-
-        PdhCollectQueryData(queryHandle);
     }
 
 
@@ -40,17 +21,24 @@ public:
         // Fetch the most recent data, up to `count`
         rapidjson::Value response(rapidjson::kArrayType);
 
-        const auto rows = DataManager::GetInstance().Select("StorageMetricProvider", "1=1 ORDER BY id DESC LIMIT " + std::to_string(count));
-        for (auto& row : rows) {
+        auto statement = DataManager::GetInstance().PrepareRead("SELECT * FROM StorageMetricProvider ORDER BY id DESC LIMIT ?");
+        const int idColumn = statement.GetColumnIndex("id");
+        const int counterColumn = statement.GetColumnIndex("counter");
+        const int timestampColumn = statement.GetColumnIndex("timestamp");
+        const int readColumn = statement.GetColumnIndex("read");
+        const int writeColumn = statement.GetColumnIndex("write");
+        const int transferRateColumn = statement.GetColumnIndex("transferRate");
+
+        statement.BindInt64(count).ExecuteSelect([&](const Cursor& row) {
             rapidjson::Value obj(rapidjson::kObjectType);
 
-            auto id = row.GetInt("id");
-            auto counter = row.GetInt("counter");
-            auto timestamp = row.GetInt("timestamp");
+            auto id = row.GetInt(idColumn);
+            auto counter = row.GetInt(counterColumn);
+            auto timestamp = row.GetInt(timestampColumn);
 
-            auto read = row.GetDouble("read");
-            auto write = row.GetDouble("write");
-            auto transferRate = row.GetDouble("transferRate");
+            auto read = row.GetDouble(readColumn);
+            auto write = row.GetDouble(writeColumn);
+            auto transferRate = row.GetDouble(transferRateColumn);
 
             obj.AddMember("id", Utils::ConvertIntToJSONValue(id, doc.GetAllocator()), doc.GetAllocator());
             obj.AddMember("counter", Utils::ConvertIntToJSONValue(counter, doc.GetAllocator()), doc.GetAllocator());
@@ -60,83 +48,82 @@ public:
             obj.AddMember("transferRate", Utils::ConvertDoubleToJSONValue(transferRate, doc.GetAllocator()), doc.GetAllocator());
 
             response.PushBack(obj, doc.GetAllocator());
-        }
+            });
 
         return response;
     };
 
     virtual rapidjson::Value GetAggregateDataJSON(rapidjson::Document& doc, const std::string column) const {
-        const auto& rows = DataManager::GetInstance().SelectAggregate("StorageMetricProvider", column);
         rapidjson::Value obj(rapidjson::kObjectType);
-
-        const auto& row = rows[0];
-        auto max = row.GetDouble("max");
-        auto min = row.GetDouble("min");
-        auto avg = row.GetDouble("avg");
-        auto total = row.GetDouble("total");
-        auto count = row.GetInt("count");
-
-        obj.AddMember("max", Utils::ConvertDoubleToJSONValue(max, doc.GetAllocator()), doc.GetAllocator());
-        obj.AddMember("min", Utils::ConvertDoubleToJSONValue(min, doc.GetAllocator()), doc.GetAllocator());
-        obj.AddMember("avg", Utils::ConvertDoubleToJSONValue(avg, doc.GetAllocator()), doc.GetAllocator());
-        obj.AddMember("total", Utils::ConvertDoubleToJSONValue(total, doc.GetAllocator()), doc.GetAllocator());
-        obj.AddMember("count", Utils::ConvertDoubleToJSONValue(count, doc.GetAllocator()), doc.GetAllocator());
+        RollupManager::GetInstance().SelectAggregate("StorageMetricProvider", "Storage", column).AddMembers(obj, doc);
 
         return obj;
     };
 
     virtual std::string GetName() { return  "Storage"; }
 
-    virtual void RetrieveMetricValue(UINT16 counter) override {
+    virtual std::string GetTableName() const override { return "StorageMetricProvider"; }
+
+    virtual const std::vector<std::string>& GetColumns() const override {
+        static const std::vector<std::string> columns = { "read", "write", "transferRate" };
+        return columns;
+    }
+
+    virtual void RegisterCounters(CounterRegistry& registry) override {
+        diskReadRateCounter = registry.AddCounter("\\PhysicalDisk(_Total)\\Disk Read Bytes/sec");
+        diskWriteRateCounter = registry.AddCounter("\\PhysicalDisk(_Total)\\Disk Write Bytes/sec");
+        totalTransferRateCounter = registry.AddCounter("\\PhysicalDisk(_Total)\\Disk Bytes/sec");
+    }
+
+    virtual void RetrieveMetricValue(const CounterSample& sample) override {
         // Save the data to the database
         latestValue = std::make_shared<Metric>();
         latestValue->name = "Storage";
-        latestValue->counter = counter;
+        latestValue->counter = sample.counter;
+        latestValue->timestamp = sample.timestamp;
 
-        if (CollectData()) {
-            latestValue->read = GetDiskReadRate();
-            latestValue->write = GetDiskWriteRate();
-            latestValue->transferRate = GetTotalTransferRate();
+        if (sample.isValid) {
+            latestValue->read = GetDiskReadRate(sample);
+            latestValue->write = GetDiskWriteRate(sample);
+            latestValue->transferRate = GetTotalTransferRate(sample);
         }
 
-        Persist();
+        if (Publish(sample, { latestValue->read, latestValue->write, latestValue->transferRate })) {
+            Persist();
+        }
     }
 
 protected:
     virtual void Persist() override {
-        const auto p1 = std::chrono::system_clock::now();
-
-        // Create a stringstream object
-        std::ostringstream stream{};
-        stream << "NULL, "
-            << "\"" << latestValue->name << "\", "
-            << latestValue->counter << ", "
-            << latestValue->read << ", "
-            << latestValue->write << ", "
-            << latestValue->transferRate << ", "
-            << std::chrono::duration_cast<std::chrono::seconds>(p1.time_since_epoch()).count();
-        std::string sqlString = stream.str();
-
-        DataManager::GetInstance().Insert("StorageMetricProvider", sqlString);
+        const auto p1 = latestValue->timestamp;
+
+        StorageWriter::GetInstance().WriteSample("INSERT INTO StorageMetricProvider VALUES (NULL, ?, ?, ?, ?, ?, ?)", latestValue->name)
+            .BindText(latestValue->name)
+            .BindInt64(latestValue->counter)
+            .BindDouble(latestValue->read)
+            .BindDouble(latestValue->write)
+            .BindDouble(latestValue->transferRate)
+            .BindInt64(std::chrono::duration_cast<std::chrono::seconds>(p1.time_since_epoch()).count())
+            .Submit();
     };
 
 private:
-    double GetDiskReadRate() {
-        return GetCounterValue(diskReadRateCounter);
+    double GetDiskReadRate(const CounterSample& sample) {
+        return sample.GetValue(diskReadRateCounter);
     }
 
-    double GetDiskWriteRate() {
-        return GetCounterValue(diskWriteRateCounter);
+    double GetDiskWriteRate(const CounterSample& sample) {
+        return sample.GetValue(diskWriteRateCounter);
     }
 
-    double GetTotalTransferRate() {
-        return GetCounterValue(totalTransferRateCounter);
+    double GetTotalTransferRate(const CounterSample& sample) {
+        return sample.GetValue(totalTransferRateCounter);
     }
 
 private:
-    PDH_HCOUNTER diskReadRateCounter;
-    PDH_HCOUNTER diskWriteRateCounter;
-    PDH_HCOUNTER totalTransferRateCounter;
+    CounterHandle diskReadRateCounter;
+    CounterHandle diskWriteRateCounter;
+    CounterHandle totalTransferRateCounter;
 
     std::shared_ptr<Metric> latestValue = NULL;
 };
@@ -0,0 +1,243 @@
+#include "StorageWriter.h"
+#include "Application.h"
+
+bool StorageWriter::Push(WriteRequest&& request) {
+    if (!queue || isStopped.load()) {
+        return request.Execute();
+    }
+
+    // Only raw samples may be dropped or coalesced. Losing any other write could leave a
+    // hole for good, e.g. a rollup bucket whose watermark was committed.
+    auto& target = request.IsSample() ? *queue : *durableQueue;
+    const auto overflowPolicy = request.IsSample() ? policy : OverflowPolicy::Block;
+
+    bool isAccepted = true;
+    if (!target.TryPush(std::move(request))) {
+        switch (overflowPolicy) {
+        case OverflowPolicy::DropOldest: {
+            WriteRequest oldest;
+            while (!target.TryPush(std::move(request))) {
+                if (target.TryPop(oldest)) {
+                    droppedWrites++;
+                    isAccepted = false;
+                }
+            }
+            break;
+        }
+        case OverflowPolicy::Coalesce: {
+            std::unique_lock<std::mutex> lock(coalesceMutex);
+            auto it = coalesced.find(request.GetKey());
+            if (it != coalesced.end()) {
+                it->second = std::move(request);
+                coalescedWrites++;
+                isAccepted = false;
+            }
+            else if (coalesced.size() < queue->Capacity()) {
+                coalesced.emplace(request.GetKey(), std::move(request));
+            }
+            else {
+                // New series wait for room once as many samples are held as the queue holds.
+                lock.unlock();
+                isAccepted = WaitToPush(target, request);
+            }
+            break;
+        }
+        default:
+            isAccepted = WaitToPush(target, request);
+            break;
+        }
+    }
+
+    const auto depth = GetQueueDepth();
+    if (depth > maxQueueDepth.load()) {
+        maxQueueDepth = depth;
+    }
+    wake.notify_one();
+
+    // The writer may have made its final drain between the check above and the push,
+    // e.g. for a maintenance task that finished during shutdown. Nothing would commit
+    // the write then, so it is drained here.
+    if (isStopped.load()) {
+        std::vector<WriteRequest> batch;
+        Commit(batch);
+    }
+
+    return isAccepted;
+}
+
+bool StorageWriter::WaitToPush(BoundedQueue<WriteRequest>& target, WriteRequest& request) {
+    while (!target.TryPush(std::move(request))) {
+        if (isStopped.load()) {
+            return request.Execute();
+        }
+        wake.notify_one();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    return true;
+}
+
+void StorageWriter::Run() {
+    if (!queue) {
+        LogManager::GetInstance().LogWarning("Storage writer is not configured. Writes will run synchronously.");
+        return;
+    }
+
+    isRunning = !isStopped.load();
+    LogManager::GetInstance().LogInfo("Storage writer started. Queue capacity: {0}", queue->Capacity());
+
+    std::vector<WriteRequest> batch;
+    batch.reserve(queue->Capacity());
+
+    while (isRunning.load() || HasPendingWrites()) {
+        {
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            wake.wait_for(lock, std::chrono::milliseconds(100), [this] {
+                return !isRunning.load() || GetQueueDepth() > 0;
+                });
+        }
+
+        ScheduleMaintenance();
+
+        if (!HasPendingWrites()) {
+            continue;
+        }
+
+        // Providers of the same tick submit their rows within a few milliseconds of
+        // each other. Waiting a little lets them all land in the same transaction.
+        if (isRunning.load() && commitDelay.count() > 0) {
+            std::this_thread::sleep_for(commitDelay);
+        }
+
+        Commit(batch);
+    }
+
+    LogManager::GetInstance().LogInfo("Storage writer stopped. Committed {0} writes.", committedWrites.load());
+}
+
+void StorageWriter::Commit(std::vector<WriteRequest>& batch) {
+    // Only take what is queued now, so a steady stream of writes cannot keep
+    // the transaction open forever. Each queue keeps the order of its writes.
+    std::lock_guard<std::mutex> drainLock(drainMutex);
+    WriteRequest request;
+    for (auto size = durableQueue->Size(); size > 0 && durableQueue->TryPop(request); size--) {
+        batch.emplace_back(std::move(request));
+    }
+    for (auto size = queue->Size(); size > 0 && queue->TryPop(request); size--) {
+        batch.emplace_back(std::move(request));
+    }
+    {
+        std::lock_guard<std::mutex> lock(coalesceMutex);
+        for (auto& [key, coalescedRequest] : coalesced) {
+            batch.emplace_back(std::move(coalescedRequest));
+        }
+        coalesced.clear();
+    }
+
+    if (batch.empty()) {
+        return;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    auto& dataManager = DataManager::GetInstance();
+
+    bool isCommitted = false;
+    {
+        // The writer connection is held for the whole batch, so writes from other threads
+        // wait for the commit rather than land in its transaction.
+        auto writerLock = dataManager.LockWriter();
+        for (int attempt = 1; attempt <= MAX_COMMIT_ATTEMPTS && !isCommitted; attempt++) {
+            isCommitted = CommitBatch(batch, writerLock);
+            if (!isCommitted) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10 * attempt));
+            }
+        }
+    }
+    dataManager.RecordWrittenBytes();
+
+    if (isCommitted) {
+        committedWrites += batch.size();
+    }
+    else {
+        failedWrites += batch.size();
+        LogManager::GetInstance().LogError("Failed to commit {0} writes after {1} attempts. They are discarded.", batch.size(), MAX_COMMIT_ATTEMPTS);
+    }
+    batches++;
+    lastBatchSize = batch.size();
+    lastCommitUS = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+    batch.clear();
+}
+
+bool StorageWriter::CommitBatch(std::vector<WriteRequest>& batch, const std::unique_lock<std::mutex>& writerLock) {
+    auto& dataManager = DataManager::GetInstance();
+
+    for (;;) {
+        if (!dataManager.BeginTransaction(writerLock)) {
+            dataManager.RollbackTransaction(writerLock);
+            return false;
+        }
+
+        const auto failed = std::find_if(batch.begin(), batch.end(), [&writerLock](const WriteRequest& write) {
+            return !write.Execute(writerLock);
+            });
+        if (failed == batch.end()) {
+            break;
+        }
+
+        // A single bad write does not cost the rest of the batch.
+        dataManager.RollbackTransaction(writerLock);
+        LogManager::GetInstance().LogError("Discarded a write of {0}, as it failed.", failed->GetKey());
+        failedWrites++;
+        batch.erase(failed);
+    }
+
+    if (!dataManager.CommitTransaction(writerLock)) {
+        dataManager.RollbackTransaction(writerLock);
+        return false;
+    }
+
+    return true;
+}
+
+void StorageWriter::ScheduleMaintenance() {
+    const auto now = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(maintenanceMutex);
+    for (const auto& maintenanceTask : maintenanceTasks) {
+        if (now - maintenanceTask->lastRun < maintenanceTask->interval || maintenanceTask->isRunning.load()) {
+            continue;
+        }
+
+        maintenanceTask->lastRun = now;
+        maintenanceTask->isRunning = true;
+        TaskOptions options;
+        options.taskClass = TaskClass::MAINTENANCE_TASK;
+        Application::theApp->threadManager->AddTask([maintenanceTask]() {
+            maintenanceTask->task();
+            maintenanceTask->isRunning = false;
+            }, options);
+    }
+}
+
+rapidjson::Value StorageWriter::GetInfoJSON(rapidjson::Document& doc) const {
+    rapidjson::Value obj(rapidjson::kObjectType);
+
+    const char* policyName = policy == OverflowPolicy::DropOldest ? "drop-oldest"
+        : policy == OverflowPolicy::Coalesce ? "coalesce"
+        : "block";
+
+    obj.AddMember("overflowPolicy", rapidjson::StringRef(policyName), doc.GetAllocator());
+    obj.AddMember("queueDepth", static_cast<uint64_t>(queue ? GetQueueDepth() : 0), doc.GetAllocator());
+    obj.AddMember("queueCapacity", static_cast<uint64_t>(queue ? queue->Capacity() : 0), doc.GetAllocator());
+    obj.AddMember("maxQueueDepth", static_cast<uint64_t>(maxQueueDepth.load()), doc.GetAllocator());
+    obj.AddMember("droppedWrites", droppedWrites.load(), doc.GetAllocator());
+    obj.AddMember("coalescedWrites", coalescedWrites.load(), doc.GetAllocator());
+    obj.AddMember("failedWrites", failedWrites.load(), doc.GetAllocator());
+    obj.AddMember("committedWrites", committedWrites.load(), doc.GetAllocator());
+    obj.AddMember("batches", batches.load(), doc.GetAllocator());
+    obj.AddMember("lastBatchSize", static_cast<uint64_t>(lastBatchSize.load()), doc.GetAllocator());
+    obj.AddMember("lastCommitMS", lastCommitUS.load() / 1000.0, doc.GetAllocator());
+
+    return obj;
+}
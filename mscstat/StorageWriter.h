@@ -0,0 +1,285 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <variant>
+#include <vector>
+#include <rapidjson/document.h>
+
+#include "BoundedQueue.h"
+#include "DataManager.h"
+#include "LogManager.h"
+
+// Value bound to a statement parameter by the storage writer.
+typedef std::variant<std::nullptr_t, int64_t, double, std::string, std::vector<uint8_t>> SqlValue;
+
+// What to do when a raw sample is submitted while the storage queue is full. Other
+// writes always wait for room.
+enum class OverflowPolicy {
+    // Wait until the writer has made room.
+    Block,
+    // Discard the oldest queued write.
+    DropOldest,
+    // Keep only the most recent write for each key until the writer catches up.
+    Coalesce,
+};
+
+// A write queued for the storage writer. Parameters are bound in order, as with
+// PreparedStatement, and the write is queued by `Submit`.
+class WriteRequest {
+public:
+    WriteRequest() {}
+
+    WriteRequest(const std::string& sql, const std::string& key, bool isSample = false) : sql(sql), key(key), isSample(isSample) {}
+
+    WriteRequest& BindNull() {
+        values.emplace_back(nullptr);
+        return *this;
+    }
+
+    WriteRequest& BindInt64(int64_t value) {
+        values.emplace_back(value);
+        return *this;
+    }
+
+    WriteRequest& BindDouble(double value) {
+        values.emplace_back(value);
+        return *this;
+    }
+
+    WriteRequest& BindText(const std::string& value) {
+        values.emplace_back(value);
+        return *this;
+    }
+
+    WriteRequest& BindBlob(const std::vector<uint8_t>& value) {
+        values.emplace_back(value);
+        return *this;
+    }
+
+    // Queues this write for the storage writer. Returns `false` if the write failed
+    // or another write was dropped to make room for it.
+    bool Submit();
+
+    // Runs the statement on the calling thread.
+    bool Execute() const {
+        auto statement = DataManager::GetInstance().Prepare(sql);
+        return Bind(statement).Execute();
+    }
+
+    // Same as `Execute`, while the caller holds `writerLock` from `DataManager::LockWriter`.
+    bool Execute(const std::unique_lock<std::mutex>& writerLock) const {
+        auto statement = DataManager::GetInstance().Prepare(sql, writerLock);
+        return Bind(statement).Execute();
+    }
+
+    const std::string& GetKey() const {
+        return key;
+    }
+
+    // `true` for raw samples, which the overflow policy may drop or coalesce.
+    bool IsSample() const {
+        return isSample;
+    }
+
+private:
+    PreparedStatement& Bind(PreparedStatement& statement) const {
+        for (const auto& value : values) {
+            switch (value.index()) {
+            case 1:
+                statement.BindInt64(std::get<int64_t>(value));
+                break;
+            case 2:
+                statement.BindDouble(std::get<double>(value));
+                break;
+            case 3:
+                statement.BindText(std::get<std::string>(value));
+                break;
+            case 4:
+                statement.BindBlob(std::get<std::vector<uint8_t>>(value));
+                break;
+            default:
+                statement.BindNull();
+                break;
+            }
+        }
+
+        return statement;
+    }
+
+    std::string sql;
+    std::vector<SqlValue> values;
+    // Identifies the series this write belongs to, e.g. the provider name.
+    std::string key;
+    bool isSample = false;
+};
+
+// Single writer for samples. Providers and scripts submit their rows to a bounded
+// lock-free queue, and the writer thread commits everything queued within a tick
+// in one transaction instead of one implicit transaction per row.
+class StorageWriter {
+public:
+    static StorageWriter& GetInstance() {
+        static StorageWriter instance;
+        return instance;
+    }
+
+    StorageWriter(const StorageWriter&) = delete;
+    StorageWriter& operator=(const StorageWriter&) = delete;
+
+    // Creates the queues. This must be called before any write is submitted; until
+    // then, writes run synchronously on the submitting thread. A WAL checkpoint is
+    // started every `checkpointIntervalMS` milliseconds, or never if it is 0.
+    void Configure(size_t capacity, OverflowPolicy overflowPolicy, int commitDelayMS, int checkpointIntervalMS) {
+        queue = std::make_unique<BoundedQueue<WriteRequest>>(capacity > 0 ? capacity : 1);
+        durableQueue = std::make_unique<BoundedQueue<WriteRequest>>(capacity > 0 ? capacity : 1);
+        policy = overflowPolicy;
+        commitDelay = std::chrono::milliseconds(commitDelayMS > 0 ? commitDelayMS : 0);
+
+        AddMaintenanceTask(checkpointIntervalMS, []() {
+            DataManager::GetInstance().Checkpoint();
+            });
+    }
+
+    // Runs `task` on the thread pool every `intervalMS` milliseconds while the writer
+    // is running, so database upkeep never holds up commits. A run is skipped if the
+    // previous one has not finished. Tasks with an interval of 0 are ignored.
+    void AddMaintenanceTask(int intervalMS, std::function<void()> task) {
+        if (intervalMS <= 0) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(maintenanceMutex);
+        maintenanceTasks.emplace_back(std::make_shared<MaintenanceTask>(std::chrono::milliseconds(intervalMS), std::move(task)));
+    }
+
+    // Returns a write for `sql` that is queued once its parameters are bound. It is never
+    // dropped: if the queue is full, it waits for room whatever the overflow policy.
+    WriteRequest Write(const std::string& sql, const std::string& key) {
+        return WriteRequest(sql, key);
+    }
+
+    // Same as `Write`, for a raw sample, which the overflow policy may drop or coalesce.
+    // `key` identifies the series the sample belongs to for the coalesce policy.
+    WriteRequest WriteSample(const std::string& sql, const std::string& key) {
+        return WriteRequest(sql, key, true);
+    }
+
+    // Commits queued writes until `Stop` is called.
+    // This is a blocking call and should be done in a different thread.
+    void Run();
+
+    // Stops the writer once everything queued has been committed. Writes submitted
+    // from then on, or racing with the final drain, are committed synchronously.
+    void Stop() {
+        isStopped = true;
+        isRunning = false;
+        wake.notify_all();
+    }
+
+    bool Push(WriteRequest&& request);
+
+    rapidjson::Value GetInfoJSON(rapidjson::Document& doc) const;
+
+    // Parses `block`, `drop-oldest` or `coalesce`. Anything else is treated as `block`.
+    static OverflowPolicy ParseOverflowPolicy(const std::string& name) {
+        if (name == "drop-oldest") {
+            return OverflowPolicy::DropOldest;
+        }
+        if (name == "coalesce") {
+            return OverflowPolicy::Coalesce;
+        }
+        return OverflowPolicy::Block;
+    }
+
+private:
+    StorageWriter() {}
+
+    // Commits every queued write in a single transaction.
+    void Commit(std::vector<WriteRequest>& batch);
+
+    // Runs `batch` in a transaction, while `writerLock` is held. A write that fails rolls
+    // the transaction back, and is removed from the batch before the rest is run again.
+    // Returns `false` if the transaction could not be started or committed.
+    bool CommitBatch(std::vector<WriteRequest>& batch, const std::unique_lock<std::mutex>& writerLock);
+
+    // Waits for the writer to make room in `target`. If the writer stops first, the write
+    // runs synchronously. Returns `false` if it failed.
+    bool WaitToPush(BoundedQueue<WriteRequest>& target, WriteRequest& request);
+
+    struct MaintenanceTask {
+        MaintenanceTask(std::chrono::milliseconds interval, std::function<void()> task)
+            : interval(interval), task(std::move(task)), lastRun(std::chrono::steady_clock::now()) {}
+
+        std::chrono::milliseconds interval;
+        std::function<void()> task;
+        std::chrono::steady_clock::time_point lastRun;
+        std::atomic<bool> isRunning = false;
+    };
+
+    // Hands every maintenance task that is due to the thread pool.
+    void ScheduleMaintenance();
+
+    size_t GetQueueDepth() const {
+        return queue->Size() + durableQueue->Size();
+    }
+
+    bool HasPendingWrites() {
+        if (GetQueueDepth() > 0) {
+            return true;
+        }
+
+        std::lock_guard<std::mutex> lock(coalesceMutex);
+        return !coalesced.empty();
+    }
+
+private:
+    // Commits are tried this many times before their writes are discarded.
+    static constexpr int MAX_COMMIT_ATTEMPTS = 3;
+
+    // Raw samples, subject to the overflow policy.
+    std::unique_ptr<BoundedQueue<WriteRequest>> queue;
+    // Every other write, such as rollups and retention. Kept apart so dropping the oldest
+    // sample never drops one of them.
+    std::unique_ptr<BoundedQueue<WriteRequest>> durableQueue;
+    OverflowPolicy policy = OverflowPolicy::Block;
+    std::chrono::milliseconds commitDelay = std::chrono::milliseconds(0);
+
+    std::atomic<bool> isRunning = false;
+    std::atomic<bool> isStopped = false;
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+
+    // Samples that did not fit in the queue with the coalesce policy, by key. There are
+    // at most as many as the queue holds.
+    std::mutex coalesceMutex;
+    std::map<std::string, WriteRequest> coalesced;
+    // Held by a commit from taking its batch until it is done, so writes drained by
+    // `Push` after the writer stopped keep their order.
+    std::mutex drainMutex;
+
+    std::mutex maintenanceMutex;
+    std::vector<std::shared_ptr<MaintenanceTask>> maintenanceTasks;
+
+    std::atomic<size_t> maxQueueDepth = 0;
+    std::atomic<uint64_t> droppedWrites = 0;
+    std::atomic<uint64_t> coalescedWrites = 0;
+    // Writes discarded because they failed, or their transaction could not be committed.
+    std::atomic<uint64_t> failedWrites = 0;
+    std::atomic<uint64_t> committedWrites = 0;
+    std::atomic<uint64_t> batches = 0;
+    std::atomic<size_t> lastBatchSize = 0;
+    std::atomic<int64_t> lastCommitUS = 0;
+};
+
+inline bool WriteRequest::Submit() {
+    return StorageWriter::GetInstance().Push(std::move(*this));
+}
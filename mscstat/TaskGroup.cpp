@@ -0,0 +1,31 @@
+#include "TaskGroup.h"
+
+size_t TaskGroup::GetPendingCount() const {
+    size_t pending = 0;
+    for (const auto& handle : handles) {
+        if (!handle.IsDone()) {
+            pending++;
+        }
+    }
+
+    return pending;
+}
+
+TaskGroup::Clock::time_point TaskGroup::GetFinishTime() const {
+    Clock::time_point finished;
+    for (const auto& handle : handles) {
+        finished = (std::max)(finished, handle.GetFinishTime());
+    }
+
+    return finished;
+}
+
+bool TaskGroup::WaitUntil(Clock::time_point deadline) const {
+    for (const auto& handle : handles) {
+        if (!handle.WaitUntil(deadline)) {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,147 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// How a task added to the pool ended.
+enum TaskStatus {
+    TASK_PENDING = 0,
+    // The task ran.
+    TASK_DONE = 1,
+    // The task had not started by its deadline.
+    TASK_DROPPED = 2,
+    // A later task with the same coalesce key was added before it started.
+    TASK_COALESCED = 3,
+    // The pool stopped before the task started, or the task was never queued.
+    TASK_CANCELLED = 4,
+};
+
+// Completion state shared by a task and its handles. The pool finishes it exactly once.
+class TaskState {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    // Only the first call has an effect.
+    void Finish(TaskStatus result) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (status != TaskStatus::TASK_PENDING) {
+                return;
+            }
+            status = result;
+            finished = Clock::now();
+        }
+        condition.notify_all();
+    }
+
+    TaskStatus GetStatus() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return status;
+    }
+
+    // When the task finished, or the epoch of the clock while it is pending.
+    Clock::time_point GetFinishTime() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return finished;
+    }
+
+    // Returns `false` if the task is still pending at `deadline`.
+    bool WaitUntil(Clock::time_point deadline) const {
+        std::unique_lock<std::mutex> lock(mutex);
+        return condition.wait_until(lock, deadline, [this] { return status != TaskStatus::TASK_PENDING; });
+    }
+
+    void Wait() const {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [this] { return status != TaskStatus::TASK_PENDING; });
+    }
+
+private:
+    mutable std::mutex mutex;
+    mutable std::condition_variable condition;
+    TaskStatus status = TaskStatus::TASK_PENDING;
+    Clock::time_point finished;
+};
+
+// Handle of a task added to the pool, used to wait for it. An empty handle refers to no
+// task and is always finished.
+class TaskHandle {
+public:
+    typedef TaskState::Clock Clock;
+
+    TaskHandle() {}
+    explicit TaskHandle(std::shared_ptr<TaskState> state) : state(std::move(state)) {}
+
+    bool IsEmpty() const {
+        return !state;
+    }
+
+    TaskStatus GetStatus() const {
+        return state ? state->GetStatus() : TaskStatus::TASK_CANCELLED;
+    }
+
+    // `true` once the task ran, or will never run.
+    bool IsDone() const {
+        return GetStatus() != TaskStatus::TASK_PENDING;
+    }
+
+    Clock::time_point GetFinishTime() const {
+        return state ? state->GetFinishTime() : Clock::time_point();
+    }
+
+    // Returns `false` if the task is still pending at `deadline`.
+    bool WaitUntil(Clock::time_point deadline) const {
+        return !state || state->WaitUntil(deadline);
+    }
+
+    bool WaitFor(Clock::duration timeout) const {
+        return WaitUntil(Clock::now() + timeout);
+    }
+
+    void Wait() const {
+        if (state) {
+            state->Wait();
+        }
+    }
+
+private:
+    std::shared_ptr<TaskState> state;
+};
+
+// Tasks waited for together, such as every task of one scheduler tick.
+class TaskGroup {
+public:
+    typedef TaskState::Clock Clock;
+
+    void Add(TaskHandle handle) {
+        handles.push_back(std::move(handle));
+    }
+
+    size_t size() const {
+        return handles.size();
+    }
+
+    bool empty() const {
+        return handles.empty();
+    }
+
+    // Number of tasks that have not finished yet.
+    size_t GetPendingCount() const;
+
+    // When the last task to finish did.
+    Clock::time_point GetFinishTime() const;
+
+    // Waits for every task of the group. Returns `false` if some are still pending
+    // at `deadline`.
+    bool WaitUntil(Clock::time_point deadline) const;
+
+    bool WaitFor(Clock::duration timeout) const {
+        return WaitUntil(Clock::now() + timeout);
+    }
+
+private:
+    std::vector<TaskHandle> handles;
+};
@@ -0,0 +1,52 @@
+#include "TaskTelemetry.h"
+
+uint64_t LatencyHistogram::GetPercentileUS(double percentile) const {
+    const auto total = GetCount();
+    if (total == 0) {
+        return 0;
+    }
+
+    // Rank of the value, counting from 1.
+    const auto rank = static_cast<uint64_t>(percentile * total + 0.5);
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < BUCKET_COUNT; bucket++) {
+        seen += buckets[bucket].load(std::memory_order_relaxed);
+        if (seen >= rank && seen > 0) {
+            return bucket < BUCKET_COUNT - 1 ? uint64_t(1) << bucket : GetMaxUS();
+        }
+    }
+
+    return GetMaxUS();
+}
+
+rapidjson::Value LatencyHistogram::GetJSON(rapidjson::Document& doc) const {
+    rapidjson::Value obj(rapidjson::kObjectType);
+    obj.AddMember("count", GetCount(), doc.GetAllocator());
+    obj.AddMember("avgMS", GetAverageUS() / 1000.0, doc.GetAllocator());
+    obj.AddMember("maxMS", GetMaxUS() / 1000.0, doc.GetAllocator());
+    obj.AddMember("p50MS", GetPercentileUS(0.5) / 1000.0, doc.GetAllocator());
+    obj.AddMember("p90MS", GetPercentileUS(0.9) / 1000.0, doc.GetAllocator());
+    obj.AddMember("p99MS", GetPercentileUS(0.99) / 1000.0, doc.GetAllocator());
+
+    rapidjson::Value histogram(rapidjson::kArrayType);
+    for (int bucket = 0; bucket < BUCKET_COUNT; bucket++) {
+        const auto bucketCount = buckets[bucket].load(std::memory_order_relaxed);
+        if (bucketCount == 0) {
+            continue;
+        }
+
+        // The last bucket has no upper bound.
+        rapidjson::Value entry(rapidjson::kObjectType);
+        if (bucket < BUCKET_COUNT - 1) {
+            entry.AddMember("belowMS", (uint64_t(1) << bucket) / 1000.0, doc.GetAllocator());
+        }
+        else {
+            entry.AddMember("belowMS", rapidjson::Value(rapidjson::kNullType), doc.GetAllocator());
+        }
+        entry.AddMember("count", bucketCount, doc.GetAllocator());
+        histogram.PushBack(entry, doc.GetAllocator());
+    }
+    obj.AddMember("buckets", histogram, doc.GetAllocator());
+
+    return obj;
+}
@@ -0,0 +1,143 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <rapidjson/document.h>
+
+// Histogram of durations in microseconds. Bucket `i` counts durations below 2^i
+// microseconds, so percentiles are known to within a factor of 2. Recording takes
+// no lock.
+class LatencyHistogram {
+public:
+    // The last bucket counts everything from about 33 seconds up.
+    static constexpr int BUCKET_COUNT = 26;
+
+    LatencyHistogram() {
+        for (auto& bucket : buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    void Record(uint64_t durationUS) {
+        int bucket = 0;
+        while (bucket < BUCKET_COUNT - 1 && durationUS >= (uint64_t(1) << bucket)) {
+            bucket++;
+        }
+
+        buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        totalUS.fetch_add(durationUS, std::memory_order_relaxed);
+        if (durationUS > maxUS.load(std::memory_order_relaxed)) {
+            maxUS.store(durationUS, std::memory_order_relaxed);
+        }
+    }
+
+    uint64_t GetCount() const {
+        return count.load(std::memory_order_relaxed);
+    }
+
+    double GetAverageUS() const {
+        const auto total = GetCount();
+        return total > 0 ? static_cast<double>(totalUS.load(std::memory_order_relaxed)) / total : 0.0;
+    }
+
+    uint64_t GetMaxUS() const {
+        return maxUS.load(std::memory_order_relaxed);
+    }
+
+    // Returns the upper bound of the bucket holding the `percentile` value, between 0 and 1.
+    uint64_t GetPercentileUS(double percentile) const;
+
+    // Count, average, maximum and percentiles in milliseconds, and the count of every
+    // bucket that is not empty, keyed by its upper bound.
+    rapidjson::Value GetJSON(rapidjson::Document& doc) const;
+
+private:
+    std::atomic<uint64_t> buckets[BUCKET_COUNT];
+    std::atomic<uint64_t> count = 0;
+    std::atomic<uint64_t> totalUS = 0;
+    std::atomic<uint64_t> maxUS = 0;
+};
+
+// Events per second, averaged over the last `WINDOW_SECONDS` full seconds. Counts are
+// kept per second in a ring, so recording takes no lock. A slot reused by two threads
+// in the same instant may lose a few events, which is fine for telemetry.
+class RateMeter {
+public:
+    static constexpr int WINDOW_SECONDS = 10;
+
+    RateMeter() {
+        for (int i = 0; i <= WINDOW_SECONDS; i++) {
+            seconds[i].store(-1, std::memory_order_relaxed);
+            counts[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    RateMeter(const RateMeter&) = delete;
+    RateMeter& operator=(const RateMeter&) = delete;
+
+    void Record() {
+        const auto second = GetSecond();
+        const auto slot = static_cast<size_t>(second % (WINDOW_SECONDS + 1));
+
+        auto previous = seconds[slot].load(std::memory_order_relaxed);
+        if (previous != second && seconds[slot].compare_exchange_strong(previous, second, std::memory_order_relaxed)) {
+            counts[slot].store(0, std::memory_order_relaxed);
+        }
+        counts[slot].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    double GetRate() const {
+        const auto current = GetSecond();
+
+        uint64_t total = 0;
+        for (int i = 0; i <= WINDOW_SECONDS; i++) {
+            const auto second = seconds[i].load(std::memory_order_relaxed);
+            // The current second is not over yet.
+            if (second >= current - WINDOW_SECONDS && second < current) {
+                total += counts[i].load(std::memory_order_relaxed);
+            }
+        }
+
+        return static_cast<double>(total) / WINDOW_SECONDS;
+    }
+
+private:
+    static int64_t GetSecond() {
+        return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // One more slot than the window, for the second in progress.
+    std::atomic<int64_t> seconds[WINDOW_SECONDS + 1];
+    std::atomic<uint64_t> counts[WINDOW_SECONDS + 1];
+};
+
+// Counters of the tasks of one task class, or of one thread.
+struct TaskStats {
+    std::atomic<uint64_t> dropped = 0;
+    std::atomic<uint64_t> coalesced = 0;
+    // Time tasks that ran spent waiting in a queue, and running.
+    LatencyHistogram wait;
+    LatencyHistogram execution;
+    RateMeter rate;
+
+    void RecordRun(uint64_t waitUS, uint64_t executionUS) {
+        wait.Record(waitUS);
+        execution.Record(executionUS);
+        rate.Record();
+    }
+
+    rapidjson::Value GetJSON(rapidjson::Document& doc) const {
+        rapidjson::Value obj(rapidjson::kObjectType);
+        obj.AddMember("run", execution.GetCount(), doc.GetAllocator());
+        obj.AddMember("dropped", dropped.load(), doc.GetAllocator());
+        obj.AddMember("coalesced", coalesced.load(), doc.GetAllocator());
+        obj.AddMember("tasksPerSecond", rate.GetRate(), doc.GetAllocator());
+        obj.AddMember("wait", wait.GetJSON(doc), doc.GetAllocator());
+        obj.AddMember("execution", execution.GetJSON(doc), doc.GetAllocator());
+        return obj;
+    }
+};
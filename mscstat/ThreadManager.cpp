@@ -1 +1,743 @@
 #include "ThreadManager.h"
+#include "LogManager.h"
+
+thread_local int ThreadManager::currentWorker = -1;
+
+namespace {
+    uint64_t GetMicroseconds(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) {
+        return to > from ? static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(to - from).count()) : 0;
+    }
+}
+
+ThreadManager::ThreadManager(int poolSize) {
+    should_stop.store(false);
+
+    const int size = (std::min)((std::max)(poolSize, ThreadType::RESERVED_THREAD_COUNT + 1), MAX_POOL_SIZE);
+    minimumSize.store(size);
+    maximumSize.store(size);
+
+    // Every worker exists before any thread starts, as threads steal from each other.
+    for (int i = 0; i < MAX_POOL_SIZE; ++i) {
+        workers.push_back(std::make_unique<Worker>());
+        workers.back()->random.seed(i + 1);
+    }
+
+    // Initialize the thread pool
+    {
+        std::lock_guard<std::mutex> lock(resizeMutex);
+        for (int i = 0; i < size; ++i) {
+            StartWorker(i);
+        }
+    }
+
+    timerThread = std::thread(&ThreadManager::TimerFunction, this);
+}
+
+ThreadManager::~ThreadManager() {
+    Stop();
+
+    // No thread is started once the pool is stopped.
+    {
+        std::lock_guard<std::mutex> lock(resizeMutex);
+    }
+
+    // Wait for all threads to finish
+    if (timerThread.joinable()) {
+        timerThread.join();
+    }
+    for (auto& worker : workers) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+}
+
+TaskHandle ThreadManager::AddTaskToThread(Task task, int threadIndex) {
+    if (threadIndex == ThreadType::RANDOM_THREAD) {
+        return AddTask(std::move(task), TaskOptions());
+    }
+
+    if (threadIndex >= 0 && threadIndex < MAX_POOL_SIZE) {
+        auto& worker = *workers[threadIndex];
+        std::unique_lock<std::mutex> lock(worker.mutex);
+        if (worker.isActive.load()) {
+            ScheduledTask pinned;
+            pinned.run = std::move(task);
+            pinned.state = std::make_shared<TaskState>();
+            pinned.added = Clock::now();
+            TaskHandle handle(pinned.state);
+            worker.pinned.push_back(std::move(pinned));
+
+            lock.unlock();
+            worker.condition.notify_one();
+            return handle;
+        }
+    }
+
+    LogManager::GetInstance().LogError("Invalid thread index: {0}", threadIndex);
+    return TaskHandle();
+}
+
+TaskHandle ThreadManager::AddTask(Task task, const TaskOptions& options) {
+    auto scheduled = std::make_unique<ScheduledTask>();
+    scheduled->run = std::move(task);
+    scheduled->state = std::make_shared<TaskState>();
+    scheduled->taskClass = options.taskClass >= 0 && options.taskClass < TaskClass::TASK_CLASS_COUNT ? options.taskClass : TaskClass::DEFAULT_TASK;
+    scheduled->added = Clock::now();
+    scheduled->deadline = options.deadline;
+
+    if (!options.coalesceKey.empty()) {
+        std::lock_guard<std::mutex> lock(coalesceMutex);
+        auto& latest = coalesceKeys[options.coalesceKey];
+        if (!latest) {
+            latest = std::make_shared<std::atomic<uint64_t>>(0);
+        }
+
+        scheduled->latest = latest;
+        scheduled->sequence = ++(*latest);
+    }
+
+    // We do not want to use the storage writer's reserved thread for random
+    // tasks. Threads that are exiting leave their tasks to the others.
+    const auto taskClass = scheduled->taskClass;
+    TaskHandle handle(scheduled->state);
+    if (currentWorker >= ThreadType::RESERVED_THREAD_COUNT && workers[currentWorker]->isActive.load()) {
+        workers[currentWorker]->local[taskClass].Push(scheduled.release());
+    }
+    else {
+        std::lock_guard<std::mutex> lock(sharedMutex);
+        shared[taskClass].push_back(std::move(scheduled));
+    }
+
+    if (!WakeIdleWorker()) {
+        Grow();
+    }
+
+    return handle;
+}
+
+ThreadManager::TimerId ThreadManager::AddTimer(Task task, Clock::time_point due, const TaskOptions& options) {
+    std::lock_guard<std::mutex> lock(timerMutex);
+    const auto id = nextTimerId++;
+
+    auto& timer = timers[id];
+    timer.run = std::move(task);
+    timer.options = options;
+    ScheduleTimer(id, due);
+
+    return id;
+}
+
+ThreadManager::TimerId ThreadManager::AddPeriodicTimer(Task task, Clock::duration interval, Clock::time_point first, const TaskOptions& options) {
+    std::lock_guard<std::mutex> lock(timerMutex);
+    const auto id = nextTimerId++;
+
+    auto& timer = timers[id];
+    timer.run = std::move(task);
+    timer.options = options;
+    timer.interval = (std::max)(interval, Clock::duration(std::chrono::milliseconds(1)));
+    ScheduleTimer(id, first);
+
+    return id;
+}
+
+void ThreadManager::SetTimerInterval(TimerId id, Clock::duration interval) {
+    std::lock_guard<std::mutex> lock(timerMutex);
+    const auto it = timers.find(id);
+    if (it == timers.end() || it->second.interval == Clock::duration::zero()) {
+        return;
+    }
+
+    auto& timer = it->second;
+    const auto previous = timer.due - timer.interval;
+    timer.interval = (std::max)(interval, Clock::duration(std::chrono::milliseconds(1)));
+    ScheduleTimer(id, (std::max)(previous + timer.interval, Clock::now()));
+}
+
+void ThreadManager::CancelTimer(TimerId id) {
+    // Its heap entry is skipped once it reaches the top.
+    std::lock_guard<std::mutex> lock(timerMutex);
+    timers.erase(id);
+}
+
+void ThreadManager::ScheduleTimer(TimerId id, Clock::time_point due) {
+    timers[id].due = due;
+    timerHeap.push_back({ due, id });
+    std::push_heap(timerHeap.begin(), timerHeap.end(), std::greater<TimerEntry>());
+
+    // The timer thread may be waiting for a later timer.
+    timerCondition.notify_one();
+}
+
+void ThreadManager::TimerFunction() {
+    std::unique_lock<std::mutex> lock(timerMutex);
+
+    while (!should_stop.load()) {
+        if (timerHeap.empty()) {
+            timerCondition.wait(lock, [this] { return should_stop.load() || !timerHeap.empty(); });
+            continue;
+        }
+
+        const auto next = timerHeap.front();
+        const auto now = Clock::now();
+        if (next.due > now) {
+            timerCondition.wait_until(lock, next.due);
+            continue;
+        }
+
+        std::pop_heap(timerHeap.begin(), timerHeap.end(), std::greater<TimerEntry>());
+        timerHeap.pop_back();
+
+        const auto it = timers.find(next.id);
+        if (it == timers.end() || it->second.due != next.due) {
+            continue;
+        }
+        auto& timer = it->second;
+
+        if (timer.interval == Clock::duration::zero()) {
+            auto run = std::move(timer.run);
+            const auto options = timer.options;
+            timers.erase(it);
+
+            lock.unlock();
+            AddTask(std::move(run), options);
+            lock.lock();
+            continue;
+        }
+
+        // The next run is due an interval after this one. Runs missed while the process
+        // was suspended are skipped rather than run in a burst.
+        auto due = timer.due + timer.interval;
+        if (due <= now) {
+            due = now + timer.interval;
+        }
+        ScheduleTimer(next.id, due);
+
+        if (!timer.inFlight.IsDone()) {
+            skippedTimerRuns++;
+            continue;
+        }
+
+        auto run = timer.run;
+        auto options = timer.options;
+        options.deadline = due;
+
+        // Tasks are added without `timerMutex`, as they may add timers themselves.
+        lock.unlock();
+        auto handle = AddTask(std::move(run), options);
+        lock.lock();
+
+        const auto added = timers.find(next.id);
+        if (added != timers.end()) {
+            added->second.inFlight = std::move(handle);
+        }
+    }
+}
+
+void ThreadManager::Resize(int minimum, int maximum) {
+    std::lock_guard<std::mutex> lock(resizeMutex);
+    if (should_stop.load()) {
+        return;
+    }
+
+    minimum = (std::min)((std::max)(minimum, ThreadType::RESERVED_THREAD_COUNT + 1), MAX_POOL_SIZE);
+    maximum = (std::min)((std::max)(maximum, minimum), MAX_POOL_SIZE);
+    minimumSize.store(minimum);
+    maximumSize.store(maximum);
+
+    for (int id = ThreadType::RESERVED_THREAD_COUNT; id < MAX_POOL_SIZE && poolSize.load() < minimum; id++) {
+        if (!workers[id]->isRunning.load()) {
+            StartWorker(id);
+        }
+    }
+
+    // The threads of the highest slots exit first, so the pool stays compact.
+    for (int id = MAX_POOL_SIZE - 1; id >= ThreadType::RESERVED_THREAD_COUNT && poolSize.load() > maximum; id--) {
+        auto& worker = *workers[id];
+        if (!worker.isActive.load() || worker.shouldRetire.load()) {
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> workerLock(worker.mutex);
+            worker.shouldRetire.store(true);
+        }
+        worker.condition.notify_one();
+        poolSize--;
+    }
+}
+
+void ThreadManager::Stop() {
+    should_stop.store(true);
+
+    {
+        std::lock_guard<std::mutex> lock(timerMutex);
+        timers.clear();
+        timerHeap.clear();
+    }
+    timerCondition.notify_all();
+
+    for (auto& worker : workers) {
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+        }
+        worker->condition.notify_all();
+    }
+
+    // Cancel the random tasks not started yet, so nothing waits for them. Any thread
+    // may steal from the deques.
+    std::deque<std::unique_ptr<ScheduledTask>> cancelled;
+    {
+        std::lock_guard<std::mutex> lock(sharedMutex);
+        for (auto& queue : shared) {
+            std::move(queue.begin(), queue.end(), std::back_inserter(cancelled));
+            queue.clear();
+        }
+    }
+
+    const int slots = slotCount.load();
+    for (int id = ThreadType::RESERVED_THREAD_COUNT; id < slots; id++) {
+        for (auto& local : workers[id]->local) {
+            while (ScheduledTask* task = local.Steal()) {
+                cancelled.emplace_back(task);
+            }
+        }
+    }
+}
+
+void ThreadManager::Grow() {
+    std::unique_lock<std::mutex> lock(resizeMutex, std::try_to_lock);
+    if (!lock.owns_lock() || should_stop.load() || poolSize.load() >= maximumSize.load()) {
+        return;
+    }
+
+    const auto now = Clock::now();
+    if (now - lastGrowth < GROW_INTERVAL) {
+        return;
+    }
+
+    for (int id = ThreadType::RESERVED_THREAD_COUNT; id < MAX_POOL_SIZE; id++) {
+        if (!workers[id]->isRunning.load()) {
+            lastGrowth = now;
+            StartWorker(id);
+            return;
+        }
+    }
+}
+
+void ThreadManager::SetClassPolicy(TaskClass taskClass, const ThreadPolicy& policy) {
+    std::lock_guard<std::mutex> lock(policyMutex);
+    policies[taskClass] = policy;
+    policyVersion++;
+}
+
+void ThreadManager::SetReservedPolicy(int threadIndex, const ThreadPolicy& policy) {
+    if (threadIndex < 0 || threadIndex >= ThreadType::RESERVED_THREAD_COUNT) {
+        LogManager::GetInstance().LogError("Invalid reserved thread index: {0}", threadIndex);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(policyMutex);
+    policies[TaskClass::TASK_CLASS_COUNT + threadIndex] = policy;
+    policyVersion++;
+}
+
+void ThreadManager::ApplyPolicy(int id, int index) {
+    auto& worker = *workers[id];
+
+    const auto version = policyVersion.load();
+    if (worker.policyIndex == index && worker.policyVersion == version) {
+        return;
+    }
+
+    ThreadPolicy policy;
+    {
+        std::lock_guard<std::mutex> lock(policyMutex);
+        policy = policies[index];
+    }
+
+    if (policy != worker.policy && !ThreadPolicy::Apply(worker.policy, policy)) {
+        policyFailures++;
+    }
+    worker.policy = policy;
+    worker.policyIndex = index;
+    worker.policyVersion = version;
+}
+
+void ThreadManager::StartWorker(int id) {
+    auto& worker = *workers[id];
+
+    // The previous thread of this slot has returned.
+    if (worker.thread.joinable()) {
+        worker.thread.join();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.isWakeRequested = false;
+    }
+    // New threads start with the default policy.
+    worker.policy = ThreadPolicy();
+    worker.policyIndex = -1;
+    worker.shouldRetire.store(false);
+    worker.isRunning.store(true);
+    worker.isActive.store(true);
+    poolSize++;
+    if (slotCount.load() <= id) {
+        slotCount.store(id + 1);
+    }
+
+    worker.thread = std::thread(&ThreadManager::ThreadFunction, this, id);
+}
+
+void ThreadManager::ThreadFunction(int id) {
+    currentWorker = id;
+    auto& worker = *workers[id];
+
+    while (!should_stop.load() && !worker.shouldRetire.load()) {
+        ScheduledTask pinned;
+        {
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            if (!worker.pinned.empty()) {
+                pinned = std::move(worker.pinned.front());
+                worker.pinned.pop_front();
+            }
+        }
+
+        // Execute the task
+        if (pinned.run) {
+            RunPinnedTask(id, pinned);
+            continue;
+        }
+
+        auto scheduled = id >= ThreadType::RESERVED_THREAD_COUNT ? FindTask(id) : nullptr;
+        if (scheduled) {
+            RunTask(id, *scheduled);
+        }
+        else if (!Sleep(id)) {
+            break;
+        }
+    }
+
+    if (!should_stop.load()) {
+        RetireWorker(id);
+    }
+    worker.isActive.store(false);
+    worker.isRunning.store(false);
+}
+
+void ThreadManager::RetireWorker(int id) {
+    auto& worker = *workers[id];
+
+    std::deque<ScheduledTask> pinned;
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.isActive.store(false);
+        pinned.swap(worker.pinned);
+    }
+
+    for (auto& task : pinned) {
+        RunPinnedTask(id, task);
+    }
+
+    // Tasks added by the tasks above went to the shared queue, but earlier ones may
+    // still be in the deques of this thread.
+    int moved = 0;
+    for (int taskClass = 0; taskClass < TaskClass::TASK_CLASS_COUNT; taskClass++) {
+        while (ScheduledTask* task = worker.local[taskClass].Pop()) {
+            std::lock_guard<std::mutex> lock(sharedMutex);
+            shared[taskClass].emplace_back(task);
+            moved++;
+        }
+    }
+
+    for (int i = 0; i < moved && WakeIdleWorker(); i++) {}
+}
+
+std::unique_ptr<ThreadManager::ScheduledTask> ThreadManager::FindTask(int id) {
+    auto& worker = *workers[id];
+
+    for (int taskClass = 0; taskClass < TaskClass::TASK_CLASS_COUNT; taskClass++) {
+        // The most recent task of this thread is the most likely to still be in cache.
+        std::unique_ptr<ScheduledTask> task(worker.local[taskClass].Pop());
+        if (task) {
+            return task;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(sharedMutex);
+            if (!shared[taskClass].empty()) {
+                task = std::move(shared[taskClass].front());
+                shared[taskClass].pop_front();
+                return task;
+            }
+        }
+
+        task = StealTask(id, taskClass);
+        if (task) {
+            return task;
+        }
+    }
+
+    return nullptr;
+}
+
+std::unique_ptr<ThreadManager::ScheduledTask> ThreadManager::StealTask(int id, int taskClass) {
+    // Slots without a thread are visited too, as a thread may exit before its last
+    // tasks are moved to the shared queue.
+    const int count = slotCount.load() - ThreadType::RESERVED_THREAD_COUNT;
+    if (count <= 0) {
+        return nullptr;
+    }
+
+    const int start = static_cast<int>(workers[id]->random() % count);
+    for (int i = 0; i < count; i++) {
+        const int victim = ThreadType::RESERVED_THREAD_COUNT + (start + i) % count;
+        if (victim == id) {
+            continue;
+        }
+
+        std::unique_ptr<ScheduledTask> task(workers[victim]->local[taskClass].Steal());
+        if (task) {
+            return task;
+        }
+    }
+
+    return nullptr;
+}
+
+void ThreadManager::RunTask(int id, ScheduledTask& task) {
+    auto& classStats = stats[task.taskClass];
+    auto& workerStats = workers[id]->stats;
+
+    if (task.latest && task.latest->load() != task.sequence) {
+        classStats.coalesced++;
+        workerStats.coalesced++;
+        task.state->Finish(TaskStatus::TASK_COALESCED);
+        return;
+    }
+
+    const auto started = Clock::now();
+    if (started > task.deadline) {
+        classStats.dropped++;
+        workerStats.dropped++;
+        task.state->Finish(TaskStatus::TASK_DROPPED);
+        return;
+    }
+
+    ApplyPolicy(id, task.taskClass);
+    task.run();
+    task.state->Finish(TaskStatus::TASK_DONE);
+
+    const auto waitUS = GetMicroseconds(task.added, started);
+    const auto executionUS = GetMicroseconds(started, Clock::now());
+    classStats.RecordRun(waitUS, executionUS);
+    workerStats.RecordRun(waitUS, executionUS);
+}
+
+void ThreadManager::RunPinnedTask(int id, ScheduledTask& task) {
+    // Other threads keep the policy of their last random task.
+    if (id < ThreadType::RESERVED_THREAD_COUNT) {
+        ApplyPolicy(id, TaskClass::TASK_CLASS_COUNT + id);
+    }
+
+    const auto started = Clock::now();
+    task.run();
+    task.state->Finish(TaskStatus::TASK_DONE);
+
+    workers[id]->stats.RecordRun(GetMicroseconds(task.added, started), GetMicroseconds(started, Clock::now()));
+}
+
+bool ThreadManager::HasRandomTask() {
+    {
+        std::lock_guard<std::mutex> lock(sharedMutex);
+        for (const auto& queue : shared) {
+            if (!queue.empty()) {
+                return true;
+            }
+        }
+    }
+
+    const int count = slotCount.load();
+    for (int i = ThreadType::RESERVED_THREAD_COUNT; i < count; i++) {
+        for (const auto& local : workers[i]->local) {
+            if (!local.IsEmpty()) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+bool ThreadManager::WakeIdleWorker() {
+    int id;
+    {
+        std::lock_guard<std::mutex> lock(idleMutex);
+        if (idle.empty()) {
+            return false;
+        }
+
+        id = idle.back();
+        idle.pop_back();
+    }
+
+    auto& worker = *workers[id];
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.isWakeRequested = true;
+    }
+    worker.condition.notify_one();
+    return true;
+}
+
+bool ThreadManager::Sleep(int id) {
+    auto& worker = *workers[id];
+    const bool takesRandomTasks = id >= ThreadType::RESERVED_THREAD_COUNT;
+
+    if (takesRandomTasks) {
+        // Tasks are added before `WakeIdleWorker` takes `idleMutex`, so any task added
+        // after this check finds this thread in the idle list.
+        std::lock_guard<std::mutex> lock(idleMutex);
+        if (HasRandomTask()) {
+            return true;
+        }
+        idle.push_back(id);
+    }
+
+    bool isTimedOut;
+    {
+        std::unique_lock<std::mutex> lock(worker.mutex);
+        isTimedOut = !worker.condition.wait_for(lock, IDLE_TIMEOUT, [this, &worker] {
+            return should_stop.load() || worker.shouldRetire.load() || worker.isWakeRequested || !worker.pinned.empty();
+            });
+        worker.isWakeRequested = false;
+    }
+
+    if (!takesRandomTasks) {
+        return true;
+    }
+
+    // Woken for a pinned task or to stop, or timed out, this thread is still in the idle list.
+    bool isIdle;
+    {
+        std::lock_guard<std::mutex> lock(idleMutex);
+        const auto it = std::find(idle.begin(), idle.end(), id);
+        isIdle = it != idle.end() && !HasRandomTask();
+        if (it != idle.end()) {
+            idle.erase(it);
+        }
+    }
+
+    if (isTimedOut && isIdle) {
+        std::lock_guard<std::mutex> lock(resizeMutex);
+        if (!worker.shouldRetire.load() && poolSize.load() > minimumSize.load()) {
+            worker.shouldRetire.store(true);
+            poolSize--;
+        }
+    }
+
+    return !worker.shouldRetire.load();
+}
+
+size_t ThreadManager::GetQueuedCount(int taskClass) const {
+    size_t count;
+    {
+        std::lock_guard<std::mutex> lock(sharedMutex);
+        count = shared[taskClass].size();
+    }
+
+    const int slots = slotCount.load();
+    for (int i = ThreadType::RESERVED_THREAD_COUNT; i < slots; i++) {
+        count += workers[i]->local[taskClass].Size();
+    }
+
+    return count;
+}
+
+rapidjson::Value ThreadManager::GetInfoJSON(rapidjson::Document& doc) const {
+    rapidjson::Value obj(rapidjson::kObjectType);
+    obj.AddMember("poolSize", poolSize.load(), doc.GetAllocator());
+    obj.AddMember("minPoolSize", minimumSize.load(), doc.GetAllocator());
+    obj.AddMember("maxPoolSize", maximumSize.load(), doc.GetAllocator());
+    obj.AddMember("skippedTimerRuns", skippedTimerRuns.load(), doc.GetAllocator());
+    obj.AddMember("policyFailures", policyFailures.load(), doc.GetAllocator());
+
+    rapidjson::Value classes(rapidjson::kObjectType);
+    for (int taskClass = 0; taskClass < TaskClass::TASK_CLASS_COUNT; taskClass++) {
+        const auto& classStats = stats[taskClass];
+
+        rapidjson::Value classObj(rapidjson::kObjectType);
+        classObj.AddMember("run", classStats.execution.GetCount(), doc.GetAllocator());
+        classObj.AddMember("dropped", classStats.dropped.load(), doc.GetAllocator());
+        classObj.AddMember("coalesced", classStats.coalesced.load(), doc.GetAllocator());
+        classObj.AddMember("avgWaitMS", classStats.wait.GetAverageUS() / 1000.0, doc.GetAllocator());
+        classObj.AddMember("maxWaitMS", classStats.wait.GetMaxUS() / 1000.0, doc.GetAllocator());
+        classes.AddMember(rapidjson::StringRef(GetTaskClassName(taskClass)), classObj, doc.GetAllocator());
+    }
+    obj.AddMember("classes", classes, doc.GetAllocator());
+
+    return obj;
+}
+
+std::string ThreadManager::GetDebugInfoAsJSON() const {
+    rapidjson::Document doc;
+    doc.SetObject();
+
+    doc.AddMember("poolSize", poolSize.load(), doc.GetAllocator());
+    doc.AddMember("minPoolSize", minimumSize.load(), doc.GetAllocator());
+    doc.AddMember("maxPoolSize", maximumSize.load(), doc.GetAllocator());
+    {
+        std::lock_guard<std::mutex> lock(idleMutex);
+        doc.AddMember("idle", static_cast<uint64_t>(idle.size()), doc.GetAllocator());
+    }
+    doc.AddMember("skippedTimerRuns", skippedTimerRuns.load(), doc.GetAllocator());
+    doc.AddMember("policyFailures", policyFailures.load(), doc.GetAllocator());
+
+    rapidjson::Value classes(rapidjson::kObjectType);
+    for (int taskClass = 0; taskClass < TaskClass::TASK_CLASS_COUNT; taskClass++) {
+        auto classObj = stats[taskClass].GetJSON(doc);
+        classObj.AddMember("queued", static_cast<uint64_t>(GetQueuedCount(taskClass)), doc.GetAllocator());
+        classes.AddMember(rapidjson::StringRef(GetTaskClassName(taskClass)), classObj, doc.GetAllocator());
+    }
+    doc.AddMember("classes", classes, doc.GetAllocator());
+
+    rapidjson::Value threads(rapidjson::kArrayType);
+    const int slots = slotCount.load();
+    for (int id = 0; id < slots; id++) {
+        const auto& worker = *workers[id];
+
+        size_t queued = 0;
+        for (const auto& local : worker.local) {
+            queued += local.Size();
+        }
+
+        auto threadObj = worker.stats.GetJSON(doc);
+        threadObj.AddMember("id", id, doc.GetAllocator());
+        threadObj.AddMember("reserved", id < ThreadType::RESERVED_THREAD_COUNT, doc.GetAllocator());
+        threadObj.AddMember("active", worker.isActive.load(), doc.GetAllocator());
+        threadObj.AddMember("queued", static_cast<uint64_t>(queued), doc.GetAllocator());
+        threads.PushBack(threadObj, doc.GetAllocator());
+    }
+    doc.AddMember("threads", threads, doc.GetAllocator());
+
+    // Serialize the Document to a JSON string
+    rapidjson::StringBuffer buffer;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+    doc.Accept(writer);
+
+    return buffer.GetString();
+}
+
+const char* ThreadManager::GetTaskClassName(int taskClass) {
+    switch (taskClass) {
+    case TaskClass::SAMPLING_TASK:
+        return "sampling";
+    case TaskClass::SCRIPT_TASK:
+        return "script";
+    case TaskClass::MAINTENANCE_TASK:
+        return "maintenance";
+    default:
+        return "default";
+    }
+}
@@ -1,115 +1,326 @@
 #pragma once
-#include <iostream>
-#include <vector>
-#include <thread>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <functional>
+#include <iostream>
+#include <iterator>
+#include <memory>
 #include <mutex>
-#include <condition_variable>
-#include <map>
 #include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <rapidjson/document.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+#include "TaskGroup.h"
+#include "TaskTelemetry.h"
+#include "ThreadPolicy.h"
+#include "WorkStealingDeque.h"
 
 enum ThreadType {
     RANDOM_THREAD = -1,
-    METRICS_MANAGER_THREAD = 0,
-    INTELLIGENCE_MANAGER_THREAD = 1,
+    STORAGE_WRITER_THREAD = 0,
+    // Number of threads reserved for the long-running tasks above. They are never
+    // picked for random tasks.
+    RESERVED_THREAD_COUNT = 1,
 };
 
+// Classes of random tasks, highest priority first. Threads always start the waiting task
+// of the highest class, so a slow script cannot hold back the next sample.
+enum TaskClass {
+    SAMPLING_TASK = 0,
+    SCRIPT_TASK = 1,
+    DEFAULT_TASK = 2,
+    MAINTENANCE_TASK = 3,
+    TASK_CLASS_COUNT = 4,
+};
+
+// How a random task is scheduled.
+struct TaskOptions {
+    TaskClass taskClass = TaskClass::DEFAULT_TASK;
+    // The task is dropped if it has not started by then.
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    // A task is dropped if another task with the same key is added before it starts,
+    // so only the latest of them runs.
+    std::string coalesceKey;
+};
+
+// Thread pool of the application. Each thread has a queue of tasks added for it alone,
+// which is all the reserved threads ever run. The other threads share random tasks by
+// work stealing: tasks added from one of them go to its own deque, tasks added from any
+// other thread go to a shared queue, and threads that run out of tasks steal from the
+// deques of the others. Idle threads sleep until a task is added for them, and each
+// task wakes at most one of them.
+//
+// Random tasks have a class, and each class has its own queues. The time tasks of each
+// class wait before they start and the time they run are recorded, per class and per
+// thread, as are tasks dropped past their deadline or coalesced with a later one.
+//
+// The number of threads changes at runtime, between a minimum and a maximum set with
+// `Resize`. A thread is added when a random task finds no idle thread, at most once
+// every `GROW_INTERVAL`, and a thread that took no random task for `IDLE_TIMEOUT` exits
+// while there are more than the minimum.
+//
+// Each task class, and each reserved thread, may have a thread policy. A thread applies
+// the policy of a task before running it, unless it already runs with that policy.
+//
+// Delayed and periodic tasks are kept by a timer thread in a min-heap of due times. It
+// adds each of them as a random task when it is due, so no pool thread sleeps between
+// the runs of a periodic task.
 class ThreadManager {
 public:
+    typedef std::function<void()> Task;
+    typedef std::chrono::steady_clock Clock;
+    typedef uint64_t TimerId;
+
+    // Upper bound of `Resize`, reserved threads included.
+    static constexpr int MAX_POOL_SIZE = 64;
+
     static ThreadManager& GetInstance(int poolSize) {
         static ThreadManager instance(poolSize);
         return instance;
     }
 
-    ~ThreadManager() {
-        // Wait for all threads to finish
-        for (std::thread& thread : threads) {
-            thread.join();
-        }
-    }
+    ~ThreadManager();
 
     // Add a task to a specific thread in the thread pool
     // Use threadIndex = -1 to indicate that the task can run on any available thread
-    void AddTaskToThread(std::function<void()> task, int threadIndex = ThreadType::RANDOM_THREAD) {
-        if (threadIndex == ThreadType::RANDOM_THREAD) {
-            // If threadIndex is -1, randomly select an available thread.
-            // We however do not want to use the thread reserved for Metrics
-            // manager for other tasks.
-            std::uniform_int_distribution<int> distribution(ThreadType::METRICS_MANAGER_THREAD + 1, poolSize - 1);
-            threadIndex = distribution(generator);
-        }
+    // The returned handle finishes once the task ran, or was dropped.
+    TaskHandle AddTaskToThread(Task task, int threadIndex = ThreadType::RANDOM_THREAD);
 
-        if (threadIndex >= 0 && threadIndex < poolSize) {
-            std::lock_guard<std::mutex> lock(tasksMutex);
-            tasks[threadIndex].emplace_back(task);
-            condition.notify_all();
-        }
-        else {
-            std::cout << "Invalid thread index." << std::endl;
-        }
-    }
+    // Adds a random task, scheduled according to `options`.
+    TaskHandle AddTask(Task task, const TaskOptions& options);
 
-    void Stop() {
-        should_stop.store(true);
-    }
+    // Adds `task` as a random task at `due`.
+    TimerId AddTimer(Task task, Clock::time_point due, const TaskOptions& options = TaskOptions());
+
+    // Adds `task` as a random task every `interval`, starting at `first`. A run is
+    // skipped if the previous one is not done yet. The deadline of `options` is ignored,
+    // as each run is dropped if it has not started by the next one.
+    TimerId AddPeriodicTimer(Task task, Clock::duration interval, Clock::time_point first, const TaskOptions& options = TaskOptions());
+
+    // Changes the interval of a periodic timer. Its next run is `interval` after its
+    // previous one, or now if that is already past.
+    void SetTimerInterval(TimerId id, Clock::duration interval);
+
+    // Runs already added to the pool are not cancelled.
+    void CancelTimer(TimerId id);
+
+    // Sets the bounds of the number of threads, reserved threads included. Threads are
+    // started right away up to `minimum`, and threads above `maximum` exit once their
+    // current task is done.
+    void Resize(int minimum, int maximum);
+
+    // Sets the policy of the threads running random tasks of `taskClass`. Each thread
+    // applies it before its next task of that class.
+    void SetClassPolicy(TaskClass taskClass, const ThreadPolicy& policy);
+
+    // Sets the policy of reserved thread `threadIndex`, applied before its next task.
+    // Tasks already running on it keep the policy they started with.
+    void SetReservedPolicy(int threadIndex, const ThreadPolicy& policy);
+
+    // Size of the pool, and scheduling statistics of each task class.
+    rapidjson::Value GetInfoJSON(rapidjson::Document& doc) const;
+
+    // Size of the pool, and the queues, rates and histograms of wait and execution times
+    // of each task class and thread. Served by `/api/debug/threads`.
+    std::string GetDebugInfoAsJSON() const;
+
+    // Wakes every thread so it exits once its current task is done. Random tasks not
+    // started yet, and timers, are cancelled.
+    void Stop();
 
 private:
-    int poolSize;
-    std::atomic<bool> should_stop;
-    std::vector<std::thread> threads;
-    std::map<int, std::vector<std::function<void()>>> tasks;
-    std::mutex tasksMutex;
-    std::condition_variable condition;
-    std::default_random_engine generator; // Random number generator
-
-    ThreadManager(int poolSize) : poolSize(poolSize) {
-        should_stop.store(false);
-        // Initialize the thread pool
-        for (int i = 0; i < poolSize; ++i) {
-            threads.emplace_back(std::bind(&ThreadManager::ThreadFunction, this, i));
+
+    struct ScheduledTask {
+        ScheduledTask() {}
+        ScheduledTask(ScheduledTask&&) = default;
+        ScheduledTask& operator=(ScheduledTask&&) = default;
+
+        // A task destroyed before it ran, such as when the pool stops, is cancelled.
+        ~ScheduledTask() {
+            if (state) {
+                state->Finish(TaskStatus::TASK_CANCELLED);
+            }
         }
-    }
+
+        Task run;
+        std::shared_ptr<TaskState> state;
+        TaskClass taskClass = TaskClass::DEFAULT_TASK;
+        Clock::time_point added;
+        Clock::time_point deadline;
+        // Sequence of the last task added with the coalesce key of this task, if it has one.
+        std::shared_ptr<std::atomic<uint64_t>> latest;
+        uint64_t sequence = 0;
+    };
+
+    // Slot of the pool, which runs a thread while it is active. Slots are reused by the
+    // threads started after others exited.
+    struct Worker {
+        std::thread thread;
+        // Set while the thread takes tasks.
+        std::atomic<bool> isActive = false;
+        // Set from the start of the thread until it has returned, so it can be joined.
+        std::atomic<bool> isRunning = false;
+        // Set when the thread should exit once its current task is done.
+        std::atomic<bool> shouldRetire = false;
+
+        std::mutex mutex;
+        std::condition_variable condition;
+        // Tasks added for this thread alone, run in order.
+        std::deque<ScheduledTask> pinned;
+        // Set when this thread is taken from the idle list for a random task.
+        bool isWakeRequested = false;
+        // Random tasks added from this thread, by class. Only used by threads that are
+        // not reserved.
+        WorkStealingDeque<ScheduledTask> local[TaskClass::TASK_CLASS_COUNT];
+        // Picks the first thread to steal from.
+        std::minstd_rand random;
+        // Every task run by the threads of this slot, pinned tasks included.
+        TaskStats stats;
+        // Policy the thread runs with, and the entry of `policies` and `policyVersion`
+        // it was taken from. Reset when a thread starts in this slot.
+        ThreadPolicy policy;
+        int policyIndex = -1;
+        uint64_t policyVersion = 0;
+    };
+
+    struct Timer {
+        Task run;
+        TaskOptions options;
+        // Zero for timers that run once.
+        Clock::duration interval = Clock::duration::zero();
+        Clock::time_point due;
+        // Latest run added to the pool.
+        TaskHandle inFlight;
+    };
+
+    // Entry of the timer heap. Entries whose timer was cancelled or rescheduled are
+    // skipped when they reach the top.
+    struct TimerEntry {
+        Clock::time_point due;
+        TimerId id;
+
+        bool operator>(const TimerEntry& other) const {
+            return due > other.due;
+        }
+    };
+
+    // Time a thread may wait for a random task before it exits.
+    static constexpr std::chrono::seconds IDLE_TIMEOUT{ 30 };
+    // Minimum time between two threads added under load.
+    static constexpr std::chrono::milliseconds GROW_INTERVAL{ 250 };
+
+    // Starts the reserved threads, and at least one thread for random tasks.
+    ThreadManager(int poolSize);
     ThreadManager() = delete;
     ThreadManager(const ThreadManager&) = delete;
     ThreadManager& operator=(const ThreadManager&) = delete;
 
     // Function executed by each thread in the pool
-    void ThreadFunction(int id) {
-        std::mutex mutex;
+    void ThreadFunction(int id);
 
-        while (!should_stop.load()) {
-            std::function<void()> task;
-            {
-                std::unique_lock<std::mutex> lock(mutex);
-
-                // Wait for a task if the task queue is empty
-                condition.wait(lock, [this, id] {
-                    // If we have a signal to exit, we should stop waiting
-                    if (should_stop.load()) {
-                        return true;
-                    }
-
-                    return !tasks[id].empty();
-                });
-
-                // Get the next task from this thread's task queue
-                if (!should_stop.load() && !tasks[id].empty()) {
-                    std::lock_guard<std::mutex> lockTasks(tasksMutex);
-                    task = tasks[id].front();
-                    tasks[id].erase(tasks[id].begin());
-                }
-
-                lock.unlock();
-            }
+    // Function of the timer thread. Adds the timers that are due to the pool.
+    void TimerFunction();
 
-            // Execute the task
-            if (task) {
-                task();
-            }
-        }
+    // Pushes the next run of `id` onto the heap. Called with `timerMutex` held.
+    void ScheduleTimer(TimerId id, Clock::time_point due);
 
-        // This will trigger all pending threads waiting when the loop
-        // has been triggered to stop.
-        condition.notify_all();
-    }
+    // Returns the next random task for thread `id`, from the highest class with one:
+    // from its own deque, then the shared queue, then stolen from another thread.
+    // Returns `nullptr` if there is none.
+    std::unique_ptr<ScheduledTask> FindTask(int id);
+
+    std::unique_ptr<ScheduledTask> StealTask(int id, int taskClass);
+
+    // Runs `task` on thread `id` unless it is past its deadline or was coalesced.
+    void RunTask(int id, ScheduledTask& task);
+
+    void RunPinnedTask(int id, ScheduledTask& task);
+
+    // Makes thread `id` run with `policies[index]`. Nothing is done if it already does.
+    void ApplyPolicy(int id, int index);
+
+    // Number of random tasks of `taskClass` waiting in any queue.
+    size_t GetQueuedCount(int taskClass) const;
+
+    static const char* GetTaskClassName(int taskClass);
+
+    // `true` if a random task is waiting anywhere. This is checked with `idleMutex` held.
+    bool HasRandomTask();
+
+    // Wakes one idle thread for a random task that was just added. Returns `false` if
+    // no thread is idle.
+    bool WakeIdleWorker();
+
+    // Waits until thread `id` is woken for a task, or the pool is stopped. Returns `false`
+    // if the thread should exit, as it has been idle for `IDLE_TIMEOUT` while the pool is
+    // above its minimum size.
+    bool Sleep(int id);
+
+    // Starts a thread for random tasks when all of them are busy, unless the pool is at
+    // its maximum size or grew less than `GROW_INTERVAL` ago.
+    void Grow();
+
+    // Starts the thread of slot `id`. Called with `resizeMutex` held.
+    void StartWorker(int id);
+
+    // Called by thread `id` as it exits while the pool keeps running. Its random tasks
+    // go to the shared queue, and its pinned tasks are run.
+    void RetireWorker(int id);
+
+    // Number of active threads.
+    std::atomic<int> poolSize = 0;
+    std::atomic<int> minimumSize;
+    std::atomic<int> maximumSize;
+    // One more than the highest slot that ever ran a thread.
+    std::atomic<int> slotCount = 0;
+    std::atomic<bool> should_stop;
+    // Every slot, created before any thread starts, as threads steal from each other.
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    // Held while threads are started, or chosen to exit.
+    std::mutex resizeMutex;
+    Clock::time_point lastGrowth;
+
+    // Random tasks added from threads outside the pool, or from reserved threads, by class.
+    mutable std::mutex sharedMutex;
+    std::deque<std::unique_ptr<ScheduledTask>> shared[TaskClass::TASK_CLASS_COUNT];
+
+    std::mutex coalesceMutex;
+    std::unordered_map<std::string, std::shared_ptr<std::atomic<uint64_t>>> coalesceKeys;
+
+    TaskStats stats[TaskClass::TASK_CLASS_COUNT];
+
+    // Threads that are not reserved and are waiting for a random task, most recent last.
+    mutable std::mutex idleMutex;
+    std::vector<int> idle;
+
+    std::thread timerThread;
+    std::mutex timerMutex;
+    std::condition_variable timerCondition;
+    std::unordered_map<TimerId, Timer> timers;
+    // Min-heap of due times.
+    std::vector<TimerEntry> timerHeap;
+    // Ids start at 1, so 0 can stand for no timer.
+    TimerId nextTimerId = 1;
+    // Runs of periodic timers skipped as the previous run was not done.
+    std::atomic<uint64_t> skippedTimerRuns = 0;
+
+    // Policies of each task class, then of each reserved thread.
+    std::mutex policyMutex;
+    ThreadPolicy policies[TaskClass::TASK_CLASS_COUNT + ThreadType::RESERVED_THREAD_COUNT];
+    // Incremented whenever a policy is set, so threads only take `policyMutex` then.
+    std::atomic<uint64_t> policyVersion = 0;
+    // Policies that could not be fully applied, such as for lack of privileges.
+    std::atomic<uint64_t> policyFailures = 0;
+
+    // Index of the pool thread running on this thread, or -1 outside the pool.
+    static thread_local int currentWorker;
 };
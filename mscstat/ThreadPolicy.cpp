@@ -0,0 +1,86 @@
+#include "ThreadPolicy.h"
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+bool ThreadPolicy::Apply(const ThreadPolicy& from, const ThreadPolicy& to) {
+    bool isApplied = true;
+
+    if (from.cores != to.cores) {
+        DWORD_PTR processMask = 0;
+        DWORD_PTR systemMask = 0;
+        if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask)) {
+            return false;
+        }
+
+        DWORD_PTR mask = 0;
+        for (const auto core : to.cores) {
+            if (core >= 0 && core < static_cast<int>(sizeof(DWORD_PTR) * 8)) {
+                mask |= static_cast<DWORD_PTR>(1) << core;
+            }
+        }
+        mask &= processMask;
+
+        // No cores, or none the process may use, lets the thread run anywhere again.
+        isApplied = SetThreadAffinityMask(GetCurrentThread(), mask != 0 ? mask : processMask) != 0;
+    }
+
+    // Background mode lowers the I/O and memory priority along with the CPU priority.
+    if (from.isBackground != to.isBackground) {
+        isApplied = SetThreadPriority(GetCurrentThread(), to.isBackground ? THREAD_MODE_BACKGROUND_BEGIN : THREAD_MODE_BACKGROUND_END) && isApplied;
+    }
+
+    return isApplied;
+}
+#else
+namespace {
+    // From linux/ioprio.h, which is not always installed.
+    constexpr int IOPRIO_WHO_PROCESS = 1;
+    constexpr int IOPRIO_CLASS_SHIFT = 13;
+    constexpr int IOPRIO_CLASS_BE = 2;
+    constexpr int IOPRIO_CLASS_IDLE = 3;
+}
+
+bool ThreadPolicy::Apply(const ThreadPolicy& from, const ThreadPolicy& to) {
+    bool isApplied = true;
+
+    if (from.cores != to.cores) {
+        // The main thread keeps the affinity of the process.
+        cpu_set_t processSet;
+        CPU_ZERO(&processSet);
+        if (sched_getaffinity(getpid(), sizeof(processSet), &processSet) != 0) {
+            return false;
+        }
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (const auto core : to.cores) {
+            if (core >= 0 && core < CPU_SETSIZE && CPU_ISSET(core, &processSet)) {
+                CPU_SET(core, &set);
+            }
+        }
+
+        // No cores, or none the process may use, lets the thread run anywhere again.
+        isApplied = sched_setaffinity(0, sizeof(set), CPU_COUNT(&set) > 0 ? &set : &processSet) == 0;
+    }
+
+    // Background mode uses the batch CPU policy and the idle I/O class. A higher nice
+    // value or SCHED_IDLE could not be undone without CAP_SYS_NICE, while any thread
+    // may leave these, so shared workers can switch back and forth.
+    if (from.isBackground != to.isBackground) {
+        const auto thread = static_cast<pid_t>(syscall(SYS_gettid));
+        const int ioPriority = to.isBackground ? IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT : (IOPRIO_CLASS_BE << IOPRIO_CLASS_SHIFT) | 4;
+        const sched_param param = {};
+
+        isApplied = sched_setscheduler(thread, to.isBackground ? SCHED_BATCH : SCHED_OTHER, &param) == 0 && isApplied;
+        isApplied = syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, thread, ioPriority) == 0 && isApplied;
+    }
+
+    return isApplied;
+}
+#endif
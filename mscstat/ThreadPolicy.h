@@ -0,0 +1,24 @@
+#pragma once
+#include <vector>
+
+// Cores and priority a thread runs with. The observer mode of the configuration sets one
+// per class of work, so the agent competes as little as possible with what it measures.
+struct ThreadPolicy {
+    // Cores the thread may run on. Empty lets it run on any core of the process.
+    std::vector<int> cores;
+    // Lowers the CPU and I/O priority of the thread.
+    bool isBackground = false;
+
+    bool operator==(const ThreadPolicy& other) const {
+        return cores == other.cores && isBackground == other.isBackground;
+    }
+
+    bool operator!=(const ThreadPolicy& other) const {
+        return !(*this == other);
+    }
+
+    // Moves the calling thread from `from`, the policy it runs with, to `to`. Cores the
+    // process may not run on are ignored. Returns `false` if any part of `to` could not
+    // be applied. On Linux, a thread only leaves background priority with `CAP_SYS_NICE`.
+    static bool Apply(const ThreadPolicy& from, const ThreadPolicy& to);
+};
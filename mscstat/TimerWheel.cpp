@@ -0,0 +1 @@
+#include "TimerWheel.h"
@@ -0,0 +1,153 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Hierarchical timer wheel keyed on a monotonic clock.
+//
+// Time is divided into ticks of `resolution`. The wheel has `LEVELS` levels of
+// `SLOTS` slots each: level 0 holds timers due within the next `SLOTS` ticks,
+// level 1 within the next `SLOTS^2` ticks and so on. Timers on higher levels are
+// cascaded down as the wheel turns, so scheduling and expiring a timer is O(1).
+//
+// Timers are identified by an id chosen by the caller. The wheel is not thread
+// safe and is expected to be driven by a single thread.
+class TimerWheel {
+public:
+    typedef std::chrono::steady_clock Clock;
+    typedef uint64_t TimerId;
+
+    static constexpr int SLOT_BITS = 6;
+    static constexpr uint64_t SLOTS = 1 << SLOT_BITS;
+    static constexpr int LEVELS = 4;
+
+    TimerWheel(Clock::duration resolution, Clock::time_point start) : resolution(resolution), start(start) {}
+
+    // Schedules the timer `id` to expire at `due`. A timer is never expired
+    // before `due`, but may be expired up to one tick after it. Scheduling an
+    // id that is already scheduled replaces its due time.
+    void Schedule(TimerId id, Clock::time_point due) {
+        const auto dueTick = ToTick(due);
+        timers[id] = dueTick;
+        Insert(id, dueTick);
+    }
+
+    void Cancel(TimerId id) {
+        // Slots are cleaned up lazily when they are reached.
+        timers.erase(id);
+    }
+
+    bool IsEmpty() const {
+        return timers.empty();
+    }
+
+    // Turns the wheel up to `now` and appends the id of every expired timer
+    // to `expired`.
+    void Advance(Clock::time_point now, std::vector<TimerId>& expired) {
+        const auto targetTick = now <= start ? 0 : static_cast<uint64_t>((now - start) / resolution);
+
+        Collect(ready, expired);
+
+        while (currentTick < targetTick) {
+            currentTick++;
+
+            // Move timers from the higher levels down whenever a lower level wraps.
+            for (int level = 1; level < LEVELS; level++) {
+                if ((currentTick & ((uint64_t(1) << (SLOT_BITS * level)) - 1)) != 0) {
+                    break;
+                }
+                Cascade(level);
+            }
+
+            Collect(wheel[0][currentTick & (SLOTS - 1)], expired);
+        }
+    }
+
+    // Returns the earliest time at which `Advance` could expire a timer. This is
+    // either the next occupied slot of level 0 or the next time it wraps around,
+    // whichever comes first.
+    Clock::time_point NextExpiry() const {
+        if (!ready.empty()) {
+            return start + resolution * currentTick;
+        }
+
+        uint64_t tick = currentTick + 1;
+        for (; tick <= currentTick + SLOTS; tick++) {
+            if (!wheel[0][tick & (SLOTS - 1)].empty() || (tick & (SLOTS - 1)) == 0) {
+                break;
+            }
+        }
+
+        return start + resolution * tick;
+    }
+
+private:
+    uint64_t ToTick(Clock::time_point time) const {
+        if (time <= start) {
+            return 0;
+        }
+
+        // Round up so a timer never fires early.
+        const auto elapsed = time - start;
+        return static_cast<uint64_t>((elapsed + resolution - Clock::duration(1)) / resolution);
+    }
+
+    void Insert(TimerId id, uint64_t dueTick) {
+        if (dueTick <= currentTick) {
+            ready.push_back(id);
+            return;
+        }
+
+        const auto delta = dueTick - currentTick;
+        int level = 0;
+        while (level < LEVELS - 1 && delta >= (uint64_t(1) << (SLOT_BITS * (level + 1)))) {
+            level++;
+        }
+
+        // Timers further away than the wheel can hold are parked in the last
+        // slot of the highest level and re-inserted when it cascades.
+        if (level == LEVELS - 1 && delta >= (uint64_t(1) << (SLOT_BITS * LEVELS))) {
+            dueTick = currentTick + (uint64_t(1) << (SLOT_BITS * LEVELS)) - 1;
+        }
+
+        wheel[level][(dueTick >> (SLOT_BITS * level)) & (SLOTS - 1)].push_back(id);
+    }
+
+    void Cascade(int level) {
+        auto& slot = wheel[level][(currentTick >> (SLOT_BITS * level)) & (SLOTS - 1)];
+        std::vector<TimerId> ids;
+        ids.swap(slot);
+
+        for (const auto id : ids) {
+            const auto it = timers.find(id);
+            if (it != timers.end()) {
+                Insert(id, it->second);
+            }
+        }
+    }
+
+    void Collect(std::vector<TimerId>& slot, std::vector<TimerId>& expired) {
+        for (const auto id : slot) {
+            const auto it = timers.find(id);
+            // Skip timers that were cancelled or rescheduled to a later tick.
+            if (it != timers.end() && it->second <= currentTick) {
+                timers.erase(it);
+                expired.push_back(id);
+            }
+        }
+        slot.clear();
+    }
+
+private:
+    Clock::duration resolution;
+    Clock::time_point start;
+    uint64_t currentTick = 0;
+
+    std::array<std::array<std::vector<TimerId>, SLOTS>, LEVELS> wheel;
+    // Timers that were scheduled at or before the current tick.
+    std::vector<TimerId> ready;
+    // Due tick of every scheduled timer.
+    std::unordered_map<TimerId, uint64_t> timers;
+};
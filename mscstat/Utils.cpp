@@ -1,7 +1,11 @@
 #include "Utils.h"
 #include "Application.h"
+#if defined(_WIN32) || defined(MSCSTAT_HAS_LIBZIP)
+#include <zip.h>
+#endif
 
 bool Utils::ExtractZip(std::string source, std::string destination) {
+#if defined(_WIN32) || defined(MSCSTAT_HAS_LIBZIP)
        zip_t* archive = zip_open(source.c_str(), ZIP_RDONLY, nullptr);
        if (!archive) {
             std::cerr << "Failed to open the zip file." << std::endl;
@@ -58,11 +62,16 @@ bool Utils::ExtractZip(std::string source, std::string destination) {
 
         LogManager::GetInstance().LogInfo("Zip file successfully extracted to: {0}", destination);
         return true;
+#else
+        LogManager::GetInstance().LogError("Cannot extract {0}, as this build has no zip support.", source);
+        return false;
+#endif
 }
 
 std::string Utils::GetAppDataPath() {
     const auto& appName = Application::theApp->name;
 
+#ifdef _WIN32
     std::wstring wideSubfolder(appName.begin(), appName.end());
 
     wchar_t* appDataPath = nullptr;
@@ -77,4 +86,15 @@ std::string Utils::GetAppDataPath() {
     }
 
     return appName;
+#else
+    // Follows the XDG base directory specification.
+    if (const char* dataHome = std::getenv("XDG_DATA_HOME"); dataHome != nullptr && *dataHome != '\0') {
+        return std::string(dataHome) + "/" + appName;
+    }
+    if (const char* home = std::getenv("HOME"); home != nullptr && *home != '\0') {
+        return std::string(home) + "/.local/share/" + appName;
+    }
+
+    return appName;
+#endif
 }
\ No newline at end of file
@@ -1,13 +1,8 @@
 #pragma once
 #include <algorithm>
-#include <zip.h>
 #include <iostream>
 #include <string>
-#include <Windows.h>
-#include <Knownfolders.h>
-#include <ShlObj.h>
 #include <vector>
-#include <iphlpapi.h>
 #include <functional>
 #include <codecvt>
 #include <rapidjson/document.h>
@@ -15,6 +10,27 @@
 #include <set>
 #include <fstream>
 #include <sstream>
+#ifdef _WIN32
+#include <Windows.h>
+#include <Knownfolders.h>
+#include <ShlObj.h>
+#include <iphlpapi.h>
+#else
+#include <cstdint>
+#include <cstdio>
+
+// Windows integer types, which are used throughout the code base.
+typedef uint8_t UINT8;
+typedef uint16_t UINT16;
+typedef unsigned short USHORT;
+typedef unsigned int UINT;
+typedef uint64_t UINT64;
+typedef int64_t INT64;
+typedef unsigned long DWORD;
+
+#define _popen popen
+#define _pclose pclose
+#endif
 
 
 #include "LogManager.h"
@@ -106,11 +122,17 @@ public:
     }
 
     static std::string GetExecutableDir() {
+#ifdef _WIN32
         char buffer[MAX_PATH];
         GetModuleFileNameA(nullptr, buffer, MAX_PATH);
         return std::filesystem::path(buffer).parent_path().string();
+#else
+        std::error_code error;
+        return std::filesystem::read_symlink("/proc/self/exe", error).parent_path().string();
+#endif
     }
 
+#ifdef _WIN32
     static void NotifyUser(const std::string title, const std::string& message, const UINT type = MB_ICONINFORMATION) {
         UINT mask;
 
@@ -130,6 +152,12 @@ public:
         MessageBeep(mask);
         MessageBoxA(NULL, message.c_str(), title.c_str(), type | MB_OK | MB_TASKMODAL | MB_SERVICE_NOTIFICATION);
     }
+#else
+    // There is no desktop to notify, so the message is logged.
+    static void NotifyUser(const std::string title, const std::string& message) {
+        LogManager::GetInstance().LogWarning("{0}: {1}", title, message);
+    }
+#endif
 
     static rapidjson::Value ConvertDoubleToJSONValue(const double& value, rapidjson::Document::AllocatorType& allocator) {
         rapidjson::Value rapidValue;
@@ -150,7 +178,11 @@ public:
 
         // Open a pipe to the shell process
         //FILE* pipe = _popen(command.c_str(), "r");
+#ifdef _WIN32
         FILE* pipe = _popen(("powershell.exe " + command).c_str(), "r");
+#else
+        FILE* pipe = _popen(command.c_str(), "r");
+#endif
 
         if (!pipe) {
             throw std::runtime_error("Failed to open shell pipe.");
@@ -219,6 +251,7 @@ public:
         return output;
     }
 
+#ifdef _WIN32
     static std::string GetActiveProcessTitle() {
         HWND hwnd = GetForegroundWindow(); // Get the handle of the focused window
 
@@ -280,6 +313,18 @@ public:
         return WideStringToString(buffer, length);
     }
 
+#else
+    // Only Windows has a foreground window.
+    static std::string GetActiveProcessTitle() {
+        return "";
+    }
+
+    static std::string GetActiveWindowTitle() {
+        return "";
+    }
+#endif
+
+#ifdef _WIN32
     static void EnumNetworkInterfaces(std::function<void(std::string)> callback) {
         // Define variables for storing network interface information
         ULONG ulOutBufLen = 0;
@@ -315,6 +360,21 @@ public:
         }
     }
 
+#else
+    // Interfaces are named as in /proc/net/dev. The loopback interface is skipped, as
+    // Windows does not list it either.
+    static void EnumNetworkInterfaces(std::function<void(std::string)> callback) {
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator("/sys/class/net", error)) {
+            const auto name = entry.path().filename().string();
+            if (name != "lo") {
+                callback(name);
+            }
+        }
+    }
+#endif
+
+#ifdef _WIN32
     static std::string WideStringToString(const wchar_t* wideStr) {
         int len = WideCharToMultiByte(CP_UTF8, 0, wideStr, -1, nullptr, 0, nullptr, nullptr);
 
@@ -337,6 +397,7 @@ public:
         MultiByteToWideChar(CP_ACP, 0, str.c_str(), -1, &wstr[0], wstrLen);
         return wstr;
     }
+#endif
 
     static int* ReadIntegersFromFile(const std::string& filename) {
         int integers[] = {0,0,0,0,0};
@@ -0,0 +1 @@
+#include "WorkStealingDeque.h"
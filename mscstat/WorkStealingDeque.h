@@ -0,0 +1,141 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Chase-Lev deque of owned pointers. The owning thread pushes and pops at the bottom,
+// while any other thread may steal from the top. None of these take a lock. The array
+// grows when full, and arrays that are replaced are kept until the deque is destroyed,
+// as thieves may still be reading from them.
+//
+// Based on "Correct and Efficient Work-Stealing for Weak Memory Models" (Lê et al., 2013).
+template <typename T>
+class WorkStealingDeque {
+public:
+    explicit WorkStealingDeque(size_t capacity = 64) {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+
+        arrays.push_back(std::make_unique<Array>(size));
+        array.store(arrays.back().get(), std::memory_order_relaxed);
+    }
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    ~WorkStealingDeque() {
+        while (T* item = Pop()) {
+            delete item;
+        }
+    }
+
+    // Only called by the owning thread. The deque takes ownership of `item`.
+    void Push(T* item) {
+        const auto b = bottom.load(std::memory_order_relaxed);
+        const auto t = top.load(std::memory_order_acquire);
+        Array* a = array.load(std::memory_order_relaxed);
+
+        if (b - t > static_cast<int64_t>(a->size) - 1) {
+            a = Grow(a, b, t);
+        }
+
+        a->Put(b, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    // Only called by the owning thread. Returns the most recently pushed item, or
+    // `nullptr` if the deque is empty.
+    T* Pop() {
+        const auto b = bottom.load(std::memory_order_relaxed) - 1;
+        Array* a = array.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto t = top.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        T* item = a->Get(b);
+        if (t == b) {
+            // Last item. A thief may be taking it at the same time.
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                item = nullptr;
+            }
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+
+        return item;
+    }
+
+    // Called by any thread. Returns the oldest item, or `nullptr` if the deque is empty
+    // or another thread took the item first.
+    T* Steal() {
+        auto t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const auto b = bottom.load(std::memory_order_acquire);
+
+        if (t >= b) {
+            return nullptr;
+        }
+
+        Array* a = array.load(std::memory_order_acquire);
+        T* item = a->Get(t);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return nullptr;
+        }
+
+        return item;
+    }
+
+    // Approximate, as other threads may be pushing or stealing.
+    bool IsEmpty() const {
+        return top.load(std::memory_order_acquire) >= bottom.load(std::memory_order_acquire);
+    }
+
+    // Approximate, as other threads may be pushing or stealing.
+    size_t Size() const {
+        const auto t = top.load(std::memory_order_acquire);
+        const auto b = bottom.load(std::memory_order_acquire);
+        return b > t ? static_cast<size_t>(b - t) : 0;
+    }
+
+private:
+    struct Array {
+        explicit Array(size_t size) : size(size), items(new std::atomic<T*>[size]) {}
+
+        T* Get(int64_t index) const {
+            return items[static_cast<size_t>(index) & (size - 1)].load(std::memory_order_relaxed);
+        }
+
+        void Put(int64_t index, T* item) {
+            items[static_cast<size_t>(index) & (size - 1)].store(item, std::memory_order_relaxed);
+        }
+
+        const size_t size;
+        std::unique_ptr<std::atomic<T*>[]> items;
+    };
+
+    Array* Grow(Array* a, int64_t b, int64_t t) {
+        arrays.push_back(std::make_unique<Array>(a->size * 2));
+        Array* grown = arrays.back().get();
+        for (auto i = t; i < b; i++) {
+            grown->Put(i, a->Get(i));
+        }
+
+        array.store(grown, std::memory_order_release);
+        return grown;
+    }
+
+    std::atomic<int64_t> top = 0;
+    std::atomic<int64_t> bottom = 0;
+    std::atomic<Array*> array;
+    // Every array used so far. Only the owning thread adds to this.
+    std::vector<std::unique_ptr<Array>> arrays;
+};
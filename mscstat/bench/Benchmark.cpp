@@ -0,0 +1,579 @@
+// Benchmarks of the storage, query, thread pool and script paths of the agent, and of
+// both storage engines. They run
+// against a database of their own, in the `Metrics Fetcher Bench` data folder (in
+// LocalAppData on Windows), which is recreated on every run.
+//
+// Usage: mscstat-bench [rows] [ticks] [indexRows]
+#define _HAS_STD_BYTE 0
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Application.h"
+#include "ColumnarStore.h"
+#include "LegacyThreadManager.h"
+#include "SqliteSampleStore.h"
+
+namespace {
+    typedef std::chrono::steady_clock Clock;
+
+    constexpr int SCRIPT_COUNT = 50;
+    // Most rows returned by a provider query, as asked for by the dashboard history.
+    constexpr int QUERY_LIMIT = 1000;
+    constexpr int QUERY_RUNS = 200;
+    constexpr int TASK_COUNT = 100000;
+    // Tasks added one at a time, each once the previous one has started.
+    constexpr int IDLE_TASK_COUNT = 10000;
+    // Series sharing the tables of the index benchmark, one of which stopped reporting
+    // after its first `QUERY_LIMIT` rows.
+    constexpr int INTERFACE_COUNT = 4;
+    constexpr int INDEX_QUERY_RUNS = 20;
+    constexpr int INDEX_BATCH_ROWS = 100000;
+    // About 11 days of CPU samples at one per second, so most are in sealed segments.
+    constexpr int ENGINE_SAMPLE_COUNT = 1000000;
+    constexpr int ENGINE_SCAN_RUNS = 20;
+
+    const std::string INSERT_SQL = "INSERT INTO CPUMetricProvider VALUES (NULL, ?, ?, ?, ?, ?, ?, ?, ?)";
+    const std::string SELECT_SQL = "SELECT * FROM CPUMetricProvider ORDER BY id DESC LIMIT ?";
+
+    double GetElapsedMS(Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    void Report(const std::string& name, double value, const std::string& unit) {
+        std::cout << std::left << std::setw(52) << name
+            << std::right << std::setw(14) << std::fixed << std::setprecision(2) << value
+            << " " << unit << std::endl;
+    }
+
+    // Returns the value at `fraction` of `values`, which are sorted.
+    double GetPercentile(std::vector<double>& values, double fraction) {
+        std::sort(values.begin(), values.end());
+        return values.empty() ? 0 : values[static_cast<size_t>(fraction * (values.size() - 1))];
+    }
+
+    void Wait(const TaskGroup& group) {
+        if (!group.WaitFor(std::chrono::minutes(5))) {
+            throw std::runtime_error("Tasks of the benchmark did not finish.");
+        }
+    }
+
+    int64_t GetTimestamp() {
+        return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    // Same sample as CPUMetricProvider persists, as JSON.
+    void AddSample(rapidjson::Document& doc, rapidjson::Value& response, int id, int counter, const double* values, int timestamp) {
+        auto& allocator = doc.GetAllocator();
+        rapidjson::Value obj(rapidjson::kObjectType);
+        obj.AddMember("id", Utils::ConvertIntToJSONValue(id, allocator), allocator);
+        obj.AddMember("counter", Utils::ConvertIntToJSONValue(counter, allocator), allocator);
+        obj.AddMember("usage", Utils::ConvertDoubleToJSONValue(values[0], allocator), allocator);
+        obj.AddMember("instructionsRetired", Utils::ConvertDoubleToJSONValue(values[1], allocator), allocator);
+        obj.AddMember("cycles", Utils::ConvertDoubleToJSONValue(values[2], allocator), allocator);
+        obj.AddMember("floatingPointOperations", Utils::ConvertDoubleToJSONValue(values[3], allocator), allocator);
+        obj.AddMember("temperature", Utils::ConvertDoubleToJSONValue(values[4], allocator), allocator);
+        obj.AddMember("timestamp", Utils::ConvertIntToJSONValue(timestamp, allocator), allocator);
+        response.PushBack(obj, allocator);
+    }
+
+    // Inserts `rowCount` CPU samples, one implicit transaction per row: first with the
+    // values formatted into the SQL text, as before the statement cache, then through the
+    // cached statement with bound values.
+    void BenchmarkInserts(int rowCount) {
+        auto& dataManager = DataManager::GetInstance();
+        const auto timestamp = GetTimestamp();
+
+        auto start = Clock::now();
+        for (int i = 0; i < rowCount; i++) {
+            std::ostringstream stream{};
+            stream << "NULL, \"CPU\", " << i << ", " << i * 0.5 << ", " << i * 2.0 << ", " << i * 3.0 << ", " << i * 0.25 << ", 40.0, " << timestamp;
+            auto values = stream.str();
+            dataManager.Insert("CPUMetricProvider", values);
+        }
+        Report("Insert, formatted SQL", rowCount / (GetElapsedMS(start) / 1000), "rows/s");
+
+        start = Clock::now();
+        for (int i = 0; i < rowCount; i++) {
+            dataManager.Prepare(INSERT_SQL)
+                .BindText("CPU")
+                .BindInt64(i)
+                .BindDouble(i * 0.5)
+                .BindDouble(i * 2.0)
+                .BindDouble(i * 3.0)
+                .BindDouble(i * 0.25)
+                .BindDouble(40.0)
+                .BindInt64(timestamp)
+                .Execute();
+        }
+        Report("Insert, cached statement", rowCount / (GetElapsedMS(start) / 1000), "rows/s");
+    }
+
+    // Submits `rowCount` CPU samples to the storage writer, which commits them in batches,
+    // and stops it once they are queued. Returns once everything is committed.
+    void BenchmarkStorageWriter(int rowCount, const TaskHandle& writer) {
+        auto& storageWriter = StorageWriter::GetInstance();
+        const auto timestamp = GetTimestamp();
+
+        const auto start = Clock::now();
+        for (int i = 0; i < rowCount; i++) {
+            storageWriter.WriteSample(INSERT_SQL, "CPU")
+                .BindText("CPU")
+                .BindInt64(i)
+                .BindDouble(i * 0.5)
+                .BindDouble(i * 2.0)
+                .BindDouble(i * 3.0)
+                .BindDouble(i * 0.25)
+                .BindDouble(40.0)
+                .BindInt64(timestamp)
+                .Submit();
+        }
+        storageWriter.Stop();
+        writer.Wait();
+        Report("Insert, storage writer batches", rowCount / (GetElapsedMS(start) / 1000), "rows/s");
+    }
+
+    // Reads the latest `QUERY_LIMIT` CPU samples as JSON: through a materialized result
+    // set with columns looked up by name, and streamed with column indices as
+    // CPUMetricProvider::GetDataJSON does. The API caps its count at 255, so the query
+    // is run here directly.
+    void BenchmarkQueries() {
+        auto& dataManager = DataManager::GetInstance();
+        std::vector<double> durations;
+
+        for (int run = 0; run < QUERY_RUNS; run++) {
+            const auto start = Clock::now();
+            rapidjson::Document doc;
+            rapidjson::Value response(rapidjson::kArrayType);
+
+            const auto rows = dataManager.PrepareRead(SELECT_SQL).BindInt64(QUERY_LIMIT).Query();
+            for (const auto& row : rows) {
+                const double values[] = { row.GetDouble("usage"), row.GetDouble("instructionsRetired"), row.GetDouble("cycles"), row.GetDouble("floatingPointOperations"), row.GetDouble("temperature") };
+                AddSample(doc, response, row.GetInt("id"), row.GetInt("counter"), values, row.GetInt("timestamp"));
+            }
+            durations.push_back(GetElapsedMS(start));
+        }
+        Report("GetDataJSON limit=1000, result set, p50", GetPercentile(durations, 0.5), "ms");
+
+        durations.clear();
+        for (int run = 0; run < QUERY_RUNS; run++) {
+            const auto start = Clock::now();
+            rapidjson::Document doc;
+            rapidjson::Value response(rapidjson::kArrayType);
+
+            auto statement = dataManager.PrepareRead(SELECT_SQL);
+            const int idColumn = statement.GetColumnIndex("id");
+            const int counterColumn = statement.GetColumnIndex("counter");
+            const int usageColumn = statement.GetColumnIndex("usage");
+            const int timestampColumn = statement.GetColumnIndex("timestamp");
+            statement.BindInt64(QUERY_LIMIT).ExecuteSelect([&](const Cursor& row) {
+                // The value columns follow `usage`.
+                double values[5];
+                for (int i = 0; i < 5; i++) {
+                    values[i] = row.GetDouble(usageColumn + i);
+                }
+                AddSample(doc, response, row.GetInt(idColumn), row.GetInt(counterColumn), values, row.GetInt(timestampColumn));
+                });
+            durations.push_back(GetElapsedMS(start));
+        }
+        Report("GetDataJSON limit=1000, streamed, p50", GetPercentile(durations, 0.5), "ms");
+    }
+
+    // Fills `table` with `rowCount` rows of `seriesCount` interleaved series, named
+    // `<prefix><n>`, in transactions of `INDEX_BATCH_ROWS` rows. The first `QUERY_LIMIT`
+    // rows are of the series `<prefix>stopped`, which has none after them.
+    void FillSeries(const std::string& table, const std::string& insertSql, const std::string& prefix, int seriesCount, int rowCount) {
+        auto& dataManager = DataManager::GetInstance();
+        const auto timestamp = GetTimestamp();
+        std::vector<std::string> names;
+        for (int i = 0; i < seriesCount; i++) {
+            names.push_back(prefix + std::to_string(i));
+        }
+        const auto stopped = prefix + "stopped";
+
+        const auto start = Clock::now();
+        for (int batchStart = 0; batchStart < rowCount; batchStart += INDEX_BATCH_ROWS) {
+            auto writerLock = dataManager.LockWriter();
+            dataManager.BeginTransaction(writerLock);
+            for (int i = batchStart; i < (std::min)(batchStart + INDEX_BATCH_ROWS, rowCount); i++) {
+                dataManager.Prepare(insertSql, writerLock)
+                    .BindInt64(i)
+                    .BindText(i < QUERY_LIMIT ? stopped : names[i % seriesCount])
+                    .BindDouble(i * 0.5)
+                    .BindInt64(timestamp)
+                    .Execute();
+            }
+            if (!dataManager.CommitTransaction(writerLock)) {
+                throw std::runtime_error("Failed to fill " + table + ".");
+            }
+        }
+        Report("Indexes, fill " + table, rowCount / (GetElapsedMS(start) / 1000), "rows/s");
+    }
+
+    // Returns the median time to read the latest `QUERY_LIMIT` rows of `series` with `sql`.
+    double TimeSeriesQuery(const std::string& sql, const std::string& series) {
+        auto& dataManager = DataManager::GetInstance();
+        std::vector<double> durations;
+
+        for (int run = 0; run < INDEX_QUERY_RUNS; run++) {
+            const auto start = Clock::now();
+            size_t rows = 0;
+            dataManager.PrepareRead(sql).BindText(series).BindInt64(QUERY_LIMIT).ExecuteSelect([&rows](const Cursor&) {
+                rows++;
+                });
+            if (rows != QUERY_LIMIT) {
+                throw std::runtime_error("Query of " + series + " returned " + std::to_string(rows) + " rows.");
+            }
+            durations.push_back(GetElapsedMS(start));
+        }
+
+        return GetPercentile(durations, 0.5);
+    }
+
+    // Reads the latest rows of a series from `table` as the API does, with the series
+    // index of schema version 2 and without it (`NOT INDEXED`, which still allows the
+    // backwards rowid scan used before it). Without the index, the query scans rows
+    // from the newest until it has found enough of the series, so series that are
+    // active cost little either way, and a series that stopped reporting costs a scan
+    // of the whole table.
+    void BenchmarkSeriesIndex(const std::string& table, const std::string& column, const std::string& prefix) {
+        const auto indexed = "SELECT * FROM " + table + " WHERE " + column + " = ? ORDER BY id DESC LIMIT ?";
+        const auto notIndexed = "SELECT * FROM " + table + " NOT INDEXED WHERE " + column + " = ? ORDER BY id DESC LIMIT ?";
+
+        for (const auto& series : { prefix + "0", prefix + "stopped" }) {
+            const auto name = table + " " + column + "=" + series;
+            Report(name + ", index, p50", TimeSeriesQuery(indexed, series), "ms");
+            Report(name + ", no index, p50", TimeSeriesQuery(notIndexed, series), "ms");
+        }
+    }
+
+    // Latest-rows queries of network interfaces and script series over `rowCount` rows
+    // in each table.
+    void BenchmarkIndexes(int rowCount) {
+        FillSeries("NetworkMetricProvider", "INSERT INTO NetworkMetricProvider (counter, name, bytesTotalPerSecond, timestamp) VALUES (?, ?, ?, ?)", "eth", INTERFACE_COUNT, rowCount);
+        FillSeries("ScriptData", "INSERT INTO ScriptData (counter, key, value, timestamp) VALUES (?, ?, ?, ?)", "bench.", SCRIPT_COUNT, rowCount);
+
+        BenchmarkSeriesIndex("NetworkMetricProvider", "name", "eth");
+        BenchmarkSeriesIndex("ScriptData", "key", "bench.");
+    }
+
+    // Returns the value of `pragma`, such as `page_count`, for the database.
+    int64_t GetPragma(const std::string& pragma) {
+        const auto rows = DataManager::GetInstance().PrepareRead("PRAGMA " + pragma).Query();
+        return rows.empty() ? 0 : rows.front().GetInt64(pragma);
+    }
+
+    // Returns the bytes used by the pages of the database, free pages excluded.
+    int64_t GetDatabaseSize() {
+        return (GetPragma("page_count") - GetPragma("freelist_count")) * GetPragma("page_size");
+    }
+
+    int64_t GetDirectorySize(const std::filesystem::path& directory) {
+        int64_t size = 0;
+        for (const auto& entry : std::filesystem::recursive_directory_iterator(directory)) {
+            if (entry.is_regular_file()) {
+                size += entry.file_size();
+            }
+        }
+        return size;
+    }
+
+    // Values of the `index`th CPU sample of the engine benchmark. They vary like real
+    // counters do, so that neither engine compresses them better than it would in use.
+    void GetEngineSample(int index, double* values) {
+        values[0] = (index * 7919LL % 10000) / 100.0;
+        values[1] = 1e9 + index * 104729LL % 1000000;
+        values[2] = 2e9 + index * 15485863LL % 1000000;
+        values[3] = static_cast<double>(index * 31LL % 1000);
+        values[4] = 40.0 + (index % 20) * 0.5;
+    }
+
+    // Returns the median time to scan `from <= timestamp < to` of `key` from `store`.
+    double TimeEngineScan(SampleStore& store, const SeriesKey& key, int64_t from, int64_t to) {
+        std::vector<double> durations;
+
+        for (int run = 0; run < ENGINE_SCAN_RUNS; run++) {
+            const auto start = Clock::now();
+            int64_t samples = 0;
+            store.Scan(key, from, to, [&samples](int64_t, int64_t, const double*) {
+                samples++;
+                });
+            durations.push_back(GetElapsedMS(start));
+            if (samples != to - from) {
+                throw std::runtime_error(store.GetName() + " scanned " + std::to_string(samples) + " samples instead of " + std::to_string(to - from) + ".");
+            }
+        }
+
+        return GetPercentile(durations, 0.5);
+    }
+
+    // Stores the same `ENGINE_SAMPLE_COUNT` CPU samples, one per second until an hour
+    // ago, in both storage engines, and reads back an hour and a day of them with
+    // `SampleStore::Scan`. The SQLite engine leaves storing samples to the providers, so
+    // they are inserted as the storage writer does, in transactions of many rows.
+    void BenchmarkStorageEngines(const std::filesystem::path& dataPath) {
+        const SeriesKey key = { "CPUMetricProvider", "name", "engine-bench", { "usage", "instructionsRetired", "cycles", "floatingPointOperations", "temperature" } };
+        const auto first = GetTimestamp() - 60 * 60 - ENGINE_SAMPLE_COUNT;
+        // Windows in the middle of the samples, within sealed segments of the columnar store.
+        const auto scanFrom = first + 3 * 24 * 60 * 60 + 12 * 60 * 60;
+        double values[5];
+
+        SqliteSampleStore sqliteStore;
+        auto& dataManager = DataManager::GetInstance();
+        const auto sqliteSize = GetDatabaseSize();
+        auto start = Clock::now();
+        for (int batchStart = 0; batchStart < ENGINE_SAMPLE_COUNT; batchStart += INDEX_BATCH_ROWS) {
+            auto writerLock = dataManager.LockWriter();
+            dataManager.BeginTransaction(writerLock);
+            for (int i = batchStart; i < (std::min)(batchStart + INDEX_BATCH_ROWS, ENGINE_SAMPLE_COUNT); i++) {
+                GetEngineSample(i, values);
+                dataManager.Prepare(INSERT_SQL, writerLock)
+                    .BindText(key.name)
+                    .BindInt64(i)
+                    .BindDouble(values[0])
+                    .BindDouble(values[1])
+                    .BindDouble(values[2])
+                    .BindDouble(values[3])
+                    .BindDouble(values[4])
+                    .BindInt64(first + i)
+                    .Execute();
+            }
+            if (!dataManager.CommitTransaction(writerLock)) {
+                throw std::runtime_error("Failed to store the samples of the engine benchmark.");
+            }
+        }
+        Report("Engine sqlite, ingest", ENGINE_SAMPLE_COUNT / (GetElapsedMS(start) / 1000), "samples/s");
+        Report("Engine sqlite, size", static_cast<double>(GetDatabaseSize() - sqliteSize) / ENGINE_SAMPLE_COUNT, "bytes/sample");
+
+        const auto columnarPath = dataPath / "columnar-bench";
+        {
+            ColumnarStore columnarStore(columnarPath.string());
+            start = Clock::now();
+            for (int i = 0; i < ENGINE_SAMPLE_COUNT; i++) {
+                GetEngineSample(i, values);
+                columnarStore.Append(key, first + i, i, values, 5);
+            }
+            columnarStore.Flush();
+            Report("Engine columnar, ingest", ENGINE_SAMPLE_COUNT / (GetElapsedMS(start) / 1000), "samples/s");
+            Report("Engine columnar, size", static_cast<double>(GetDirectorySize(columnarPath)) / ENGINE_SAMPLE_COUNT, "bytes/sample");
+        }
+
+        // Scanned by a store opened on the files, as after a restart.
+        ColumnarStore columnarStore(columnarPath.string());
+        for (const auto& [window, seconds] : { std::make_pair(std::string("hour"), 60 * 60), std::make_pair(std::string("day"), 24 * 60 * 60) }) {
+            for (SampleStore* store : { static_cast<SampleStore*>(&sqliteStore), static_cast<SampleStore*>(&columnarStore) }) {
+                const auto duration = TimeEngineScan(*store, key, scanFrom, scanFrom + seconds);
+                const auto name = "Engine " + store->GetName() + ", scan of 1 " + window;
+                Report(name + ", p50", duration, "ms");
+                Report(name + ", p50 rate", seconds / (duration / 1000), "samples/s");
+            }
+        }
+    }
+
+    // Measures the time from `AddTask` until the task starts, for tasks added from outside
+    // the pool to idle threads and all at once, and the rate of tasks added by a worker,
+    // which idle workers steal.
+    void BenchmarkThreadPool(ThreadManager& threadManager) {
+        std::vector<double> idleLatencies(IDLE_TASK_COUNT);
+        for (int i = 0; i < IDLE_TASK_COUNT; i++) {
+            const auto submitted = Clock::now();
+            threadManager.AddTask([&idleLatencies, i, submitted] {
+                idleLatencies[i] = std::chrono::duration<double, std::micro>(Clock::now() - submitted).count();
+                }, TaskOptions()).Wait();
+        }
+        Report("Pool, dispatch latency to idle threads p50", GetPercentile(idleLatencies, 0.5), "us");
+        Report("Pool, dispatch latency to idle threads p99", GetPercentile(idleLatencies, 0.99), "us");
+
+        std::vector<double> latencies(TASK_COUNT);
+        TaskGroup group;
+
+        auto start = Clock::now();
+        for (int i = 0; i < TASK_COUNT; i++) {
+            const auto submitted = Clock::now();
+            group.Add(threadManager.AddTask([&latencies, i, submitted] {
+                latencies[i] = std::chrono::duration<double, std::micro>(Clock::now() - submitted).count();
+                }, TaskOptions()));
+        }
+        Wait(group);
+        Report("Pool, tasks added from outside", TASK_COUNT / (GetElapsedMS(start) / 1000), "tasks/s");
+        Report("Pool, dispatch latency all at once p50", GetPercentile(latencies, 0.5), "us");
+        Report("Pool, dispatch latency all at once p99", GetPercentile(latencies, 0.99), "us");
+
+        TaskGroup spawned;
+        start = Clock::now();
+        threadManager.AddTask([&threadManager, &spawned] {
+            for (int i = 0; i < TASK_COUNT; i++) {
+                spawned.Add(threadManager.AddTask([] {}, TaskOptions()));
+            }
+            }, TaskOptions()).Wait();
+        Wait(spawned);
+        Report("Pool, tasks added by a worker and stolen", TASK_COUNT / (GetElapsedMS(start) / 1000), "tasks/s");
+    }
+
+    // Same cases as BenchmarkThreadPool, on the pool ThreadManager replaced. It has no
+    // task handles, so the last task to finish tells the benchmark, and it does not steal,
+    // so tasks added by a worker run on random threads.
+    void BenchmarkLegacyThreadPool(int poolSize) {
+        LegacyThreadManager threadManager(poolSize);
+        std::vector<double> idleLatencies(IDLE_TASK_COUNT);
+        for (int i = 0; i < IDLE_TASK_COUNT; i++) {
+            const auto submitted = Clock::now();
+            std::promise<void> started;
+            threadManager.AddTaskToThread([&idleLatencies, &started, i, submitted] {
+                idleLatencies[i] = std::chrono::duration<double, std::micro>(Clock::now() - submitted).count();
+                started.set_value();
+                });
+            started.get_future().wait();
+        }
+        Report("Legacy pool, dispatch latency to idle threads p50", GetPercentile(idleLatencies, 0.5), "us");
+        Report("Legacy pool, dispatch latency to idle threads p99", GetPercentile(idleLatencies, 0.99), "us");
+
+        std::vector<double> latencies(TASK_COUNT);
+        std::atomic<int> remaining = TASK_COUNT;
+        std::promise<void> done;
+
+        auto start = Clock::now();
+        for (int i = 0; i < TASK_COUNT; i++) {
+            const auto submitted = Clock::now();
+            threadManager.AddTaskToThread([&latencies, &remaining, &done, i, submitted] {
+                latencies[i] = std::chrono::duration<double, std::micro>(Clock::now() - submitted).count();
+                if (--remaining == 0) {
+                    done.set_value();
+                }
+                });
+        }
+        if (done.get_future().wait_for(std::chrono::minutes(5)) != std::future_status::ready) {
+            throw std::runtime_error("Tasks of the benchmark did not finish.");
+        }
+        Report("Legacy pool, tasks added from outside", TASK_COUNT / (GetElapsedMS(start) / 1000), "tasks/s");
+        Report("Legacy pool, dispatch latency all at once p50", GetPercentile(latencies, 0.5), "us");
+        Report("Legacy pool, dispatch latency all at once p99", GetPercentile(latencies, 0.99), "us");
+
+        std::atomic<int> spawnedRemaining = TASK_COUNT;
+        std::promise<void> spawnedDone;
+        start = Clock::now();
+        threadManager.AddTaskToThread([&threadManager, &spawnedRemaining, &spawnedDone] {
+            for (int i = 0; i < TASK_COUNT; i++) {
+                threadManager.AddTaskToThread([&spawnedRemaining, &spawnedDone] {
+                    if (--spawnedRemaining == 0) {
+                        spawnedDone.set_value();
+                    }
+                    });
+            }
+            });
+        if (spawnedDone.get_future().wait_for(std::chrono::minutes(5)) != std::future_status::ready) {
+            throw std::runtime_error("Tasks of the benchmark did not finish.");
+        }
+        Report("Legacy pool, tasks added by a worker", TASK_COUNT / (GetElapsedMS(start) / 1000), "tasks/s");
+    }
+
+    // Runs `SCRIPT_COUNT` scripts that each persist a value, as the scheduler does on every
+    // tick, and measures how long each tick takes until the last script is done.
+    void BenchmarkScripts(ScriptManager& scriptManager, int tickCount) {
+        std::vector<std::string> names;
+        for (int i = 0; i < SCRIPT_COUNT; i++) {
+            names.push_back("bench" + std::to_string(i));
+            scriptManager.SaveScript("{\"name\": \"" + names.back() + "\", \"scriptText\": \"function execute() { persist(Math.random()); }\", \"metricName\": \"bench\"}");
+        }
+
+        auto sample = std::make_shared<CounterSample>();
+        sample->timestamp = std::chrono::system_clock::now();
+        sample->isValid = true;
+
+        std::vector<double> durations;
+        // The first tick creates the heaps, which later ticks keep.
+        for (int tick = 0; tick <= tickCount; tick++) {
+            const auto start = Clock::now();
+            for (const auto& [name, handle] : scriptManager.Process(names, tick, sample)) {
+                handle.Wait();
+            }
+            if (tick == 0) {
+                Report("Scripts, first tick of 50", GetElapsedMS(start), "ms");
+            }
+            else {
+                durations.push_back(GetElapsedMS(start));
+            }
+        }
+        Report("Scripts, tick of 50, p50", GetPercentile(durations, 0.5), "ms");
+        Report("Scripts, tick of 50, p99", GetPercentile(durations, 0.99), "ms");
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const int rowCount = argc > 1 ? (std::max)(std::atoi(argv[1]), QUERY_LIMIT) : 20000;
+    const int tickCount = argc > 2 ? (std::max)(std::atoi(argv[2]), 1) : 200;
+    const int indexRows = argc > 3 ? (std::max)(std::atoi(argv[3]), 0) : 10000000;
+
+    try {
+        auto& app = Application::CreateInstance();
+        // The data path is named after the application, so the agent's data is never touched.
+        app.name = "Metrics Fetcher Bench";
+        const std::filesystem::path dataPath = Utils::GetAppDataPath();
+        std::filesystem::remove_all(dataPath);
+        std::filesystem::create_directories(dataPath);
+
+        // Same startup as Application::Initialize, without the server and predictions.
+        app.configManager = &ConfigManager::GetInstance();
+        app.logManager = &LogManager::GetInstance();
+        app.dataManager = &DataManager::GetInstance();
+        if (!app.dataManager->IsOpen() || !app.dataManager->Migrate()) {
+            throw std::runtime_error("Failed to create the benchmark database.");
+        }
+
+        const auto& config = app.configManager->GetConfig();
+        DatabaseOptions databaseOptions;
+        databaseOptions.readers = config.databaseReaders;
+        databaseOptions.synchronous = config.databaseSynchronous;
+        databaseOptions.cacheSize = config.databaseCacheSize;
+        databaseOptions.mmapSize = config.databaseMmapSize;
+        databaseOptions.walAutoCheckpoint = config.walAutoCheckpoint;
+        databaseOptions.storageEngine = config.storageEngine;
+        app.dataManager->Configure(databaseOptions);
+
+        app.storageWriter = &StorageWriter::GetInstance();
+        app.storageWriter->Configure(config.storageQueueSize, StorageWriter::ParseOverflowPolicy(config.storageOverflowPolicy), config.storageCommitDelay, 0);
+
+        app.metricsManager = &MetricsManager::GetInstance(config.metricFetchInterval);
+        app.threadManager = &ThreadManager::GetInstance(config.poolSize);
+        app.threadManager->Resize(config.poolSize, config.maxPoolSize);
+        app.scriptManager = &ScriptManager::GetInstance(config.metricFetchInterval);
+        app.scriptManager->SetBudgets(config);
+        app.scriptManager->Initialize(app.metricsManager->GetCounterRegistry(), app.metricsManager->GetAggregateStore(), (std::max)(config.hotTierSize, 0));
+
+        const auto writer = app.threadManager->AddTaskToThread([&app] {
+            app.storageWriter->Run();
+            },
+            ThreadType::STORAGE_WRITER_THREAD
+        );
+
+        std::cout << "Rows: " << rowCount << ", ticks: " << tickCount << ", index rows: " << indexRows << ", pool size: " << config.poolSize << std::endl;
+        BenchmarkInserts(rowCount);
+        BenchmarkQueries();
+        if (indexRows > QUERY_LIMIT) {
+            BenchmarkIndexes(indexRows);
+        }
+        BenchmarkStorageEngines(dataPath);
+        BenchmarkThreadPool(*app.threadManager);
+        BenchmarkLegacyThreadPool(config.poolSize);
+        BenchmarkScripts(*app.scriptManager, tickCount);
+        // Last, as it stops the storage writer to know when everything is committed.
+        BenchmarkStorageWriter(rowCount, writer);
+
+        app.scriptManager->Stop();
+        app.threadManager->Stop();
+    }
+    catch (const std::exception& ex) {
+        std::cout << ex.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
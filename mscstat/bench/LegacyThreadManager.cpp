@@ -0,0 +1 @@
+#include "LegacyThreadManager.h"
@@ -0,0 +1,116 @@
+#pragma once
+#include <atomic>
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <map>
+#include <random>
+
+#include "ThreadManager.h"
+
+// The thread pool ThreadManager replaced, kept to compare both in the benchmark. Every
+// queue is a vector in one map, popped with `erase(begin())`, and every task wakes every
+// thread of the pool. Random tasks go to a random thread, which is the only one to run them.
+//
+// Three changes keep it from hanging the benchmark, without changing its costs:
+// - Threads wait on `tasksMutex` rather than a mutex of their own, so no wakeup is lost
+//   between checking their queue and waiting.
+// - Queues are created up front, so threads never insert into the map concurrently.
+// - `Stop` wakes the threads, so they can be joined.
+// It also reserves as many threads as ThreadManager, so both run random tasks on as many.
+class LegacyThreadManager {
+public:
+    // At least one thread is always available for random tasks.
+    explicit LegacyThreadManager(int poolSize) : poolSize(poolSize > ThreadType::RESERVED_THREAD_COUNT ? poolSize : ThreadType::RESERVED_THREAD_COUNT + 1) {
+        should_stop.store(false);
+        for (int i = 0; i < this->poolSize; ++i) {
+            tasks[i];
+        }
+        // Initialize the thread pool
+        for (int i = 0; i < this->poolSize; ++i) {
+            threads.emplace_back(std::bind(&LegacyThreadManager::ThreadFunction, this, i));
+        }
+    }
+
+    LegacyThreadManager(const LegacyThreadManager&) = delete;
+    LegacyThreadManager& operator=(const LegacyThreadManager&) = delete;
+
+    ~LegacyThreadManager() {
+        Stop();
+        // Wait for all threads to finish
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+
+    // Add a task to a specific thread in the thread pool
+    // Use threadIndex = -1 to indicate that the task can run on any available thread
+    void AddTaskToThread(std::function<void()> task, int threadIndex = ThreadType::RANDOM_THREAD) {
+        std::lock_guard<std::mutex> lock(tasksMutex);
+        if (threadIndex == ThreadType::RANDOM_THREAD) {
+            // If threadIndex is -1, randomly select an available thread, other than
+            // the reserved ones.
+            std::uniform_int_distribution<int> distribution(ThreadType::RESERVED_THREAD_COUNT, poolSize - 1);
+            threadIndex = distribution(generator);
+        }
+
+        if (threadIndex >= 0 && threadIndex < poolSize) {
+            tasks[threadIndex].emplace_back(task);
+            condition.notify_all();
+        }
+        else {
+            std::cout << "Invalid thread index." << std::endl;
+        }
+    }
+
+    void Stop() {
+        {
+            std::lock_guard<std::mutex> lock(tasksMutex);
+            should_stop.store(true);
+        }
+        condition.notify_all();
+    }
+
+private:
+    int poolSize;
+    std::atomic<bool> should_stop;
+    std::vector<std::thread> threads;
+    std::map<int, std::vector<std::function<void()>>> tasks;
+    std::mutex tasksMutex;
+    std::condition_variable condition;
+    std::default_random_engine generator; // Random number generator
+
+    // Function executed by each thread in the pool
+    void ThreadFunction(int id) {
+        while (!should_stop.load()) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(tasksMutex);
+
+                // Wait for a task if the task queue is empty
+                condition.wait(lock, [this, id] {
+                    // If we have a signal to exit, we should stop waiting
+                    if (should_stop.load()) {
+                        return true;
+                    }
+
+                    return !tasks[id].empty();
+                });
+
+                // Get the next task from this thread's task queue
+                if (!should_stop.load() && !tasks[id].empty()) {
+                    task = tasks[id].front();
+                    tasks[id].erase(tasks[id].begin());
+                }
+            }
+
+            // Execute the task
+            if (task) {
+                task();
+            }
+        }
+    }
+};
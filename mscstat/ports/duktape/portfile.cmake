@@ -0,0 +1,41 @@
+# Duktape calls ScriptExecTimeoutCheck, which is defined by mscstat, so it is linked
+# into the executable rather than built as a DLL.
+vcpkg_check_linkage(ONLY_STATIC_LIBRARY)
+
+vcpkg_download_distfile(ARCHIVE
+    URLS "https://github.com/svaarala/duktape/releases/download/v${VERSION}/duktape-${VERSION}.tar.xz"
+    FILENAME "duktape-${VERSION}.tar.xz"
+    SHA512 8ff5465c9c335ea08ebb0d4a06569c991b9dc4661b63e10da6b123b882e7375e82291d6b883c2644902d68071a29ccc880dae8229447cebe710c910b54496c1d
+)
+
+vcpkg_extract_source_archive(SOURCE_PATH ARCHIVE "${ARCHIVE}")
+
+# Scripts are interrupted while they run, so a run over its CPU time budget is aborted
+# even if it never allocates.
+set(DUK_CONFIG_H_PATH "${SOURCE_PATH}/src/duk_config.h")
+file(READ "${DUK_CONFIG_H_PATH}" DUK_CONFIG_H)
+string(REPLACE
+    "#undef DUK_USE_INTERRUPT_COUNTER"
+    "#define DUK_USE_INTERRUPT_COUNTER"
+    DUK_CONFIG_H "${DUK_CONFIG_H}")
+string(REPLACE
+    "#undef DUK_USE_EXEC_TIMEOUT_CHECK"
+    "#if defined(__cplusplus)\nextern \"C\"\n#endif\nduk_bool_t ScriptExecTimeoutCheck(void *udata);\n#define DUK_USE_EXEC_TIMEOUT_CHECK(udata) ScriptExecTimeoutCheck((udata))"
+    DUK_CONFIG_H "${DUK_CONFIG_H}")
+if(NOT DUK_CONFIG_H MATCHES "define DUK_USE_EXEC_TIMEOUT_CHECK")
+    message(FATAL_ERROR "Failed to enable DUK_USE_EXEC_TIMEOUT_CHECK in duk_config.h.")
+endif()
+file(WRITE "${DUK_CONFIG_H_PATH}" "${DUK_CONFIG_H}")
+
+file(COPY
+    "${CMAKE_CURRENT_LIST_DIR}/CMakeLists.txt"
+    "${CMAKE_CURRENT_LIST_DIR}/duktapeConfig.cmake.in"
+    DESTINATION "${SOURCE_PATH}")
+
+vcpkg_cmake_configure(SOURCE_PATH "${SOURCE_PATH}")
+vcpkg_cmake_install()
+vcpkg_cmake_config_fixup()
+
+file(REMOVE_RECURSE "${CURRENT_PACKAGES_DIR}/debug/include")
+file(INSTALL "${CMAKE_CURRENT_LIST_DIR}/usage" DESTINATION "${CURRENT_PACKAGES_DIR}/share/${PORT}")
+vcpkg_install_copyright(FILE_LIST "${SOURCE_PATH}/LICENSE.txt")
@@ -0,0 +1,108 @@
+// Checks the /proc parsers of LinuxCounterSource against two snapshots in `fixtures`,
+// which are copied in turn to a folder that stands in for /proc.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <thread>
+
+#include "LinuxCounterSource.h"
+
+namespace {
+    int failures = 0;
+
+    void Check(bool condition, const char* what) {
+        if (!condition) {
+            std::printf("FAILED: %s\n", what);
+            failures++;
+        }
+    }
+
+    bool IsNear(double value, double expected) {
+        return std::abs(value - expected) <= 1e-9 * (std::max)(std::abs(expected), 1.0);
+    }
+
+    void CopySnapshot(const std::filesystem::path& snapshot, const std::filesystem::path& procRoot) {
+        std::filesystem::copy(snapshot, procRoot,
+            std::filesystem::copy_options::recursive | std::filesystem::copy_options::overwrite_existing);
+    }
+}
+
+int main() {
+    const std::filesystem::path fixtures = MSCSTAT_FIXTURES_DIR;
+    const auto procRoot = std::filesystem::temp_directory_path() / "mscstat-linux-counter-source-test";
+    std::filesystem::remove_all(procRoot);
+    std::filesystem::create_directories(procRoot);
+    CopySnapshot(fixtures / "proc-1", procRoot);
+
+    LinuxCounterSource source(procRoot.string());
+    const auto cpu = source.AddCounter("\\Processor(_Total)\\% Processor Time");
+    const auto processes = source.AddCounter("\\System\\Processes");
+    const auto available = source.AddCounter("\\Memory\\Available Bytes");
+    const auto committed = source.AddCounter("\\Memory\\Committed Bytes");
+    const auto pageFaults = source.AddCounter("\\Memory\\Page Faults/sec");
+    const auto diskRead = source.AddCounter("\\PhysicalDisk(_Total)\\Disk Read Bytes/sec");
+    const auto diskWrite = source.AddCounter("\\PhysicalDisk(_Total)\\Disk Write Bytes/sec");
+    const auto diskTotal = source.AddCounter("\\PhysicalDisk(_Total)\\Disk Bytes/sec");
+    const auto bytesSent = source.AddCounter("\\Network Interface(eth0)\\Bytes Sent/sec");
+    const auto bytesReceived = source.AddCounter("\\Network Interface(eth0)\\Bytes Received/sec");
+    const auto bytesTotal = source.AddCounter("\\Network Interface(eth0)\\Bytes Total/sec");
+    const auto packetsSent = source.AddCounter("\\Network Interface(eth0)\\Packets Sent/sec");
+    const auto packetsReceived = source.AddCounter("\\Network Interface(eth0)\\Packets Received/sec");
+    const auto errors = source.AddCounter("\\Network Interface(eth0)\\Network Error/sec");
+
+    // The first collection only primes the rates and the processor time.
+    Check(source.Collect(), "first collection succeeds");
+    Check(source.GetValue(cpu) == 0, "processor time reads 0 until primed");
+    Check(source.GetValue(processes) == 456, "processes are read from loadavg");
+    Check(source.GetValue(available) == 4000000.0 * 1024, "available bytes are read from meminfo");
+    Check(source.GetValue(committed) == 2000000.0 * 1024, "committed bytes are read from meminfo");
+    Check(source.GetValue(pageFaults) == 0, "page faults read 0 until primed");
+    Check(source.GetValue(diskTotal) == 0, "disk bytes read 0 until primed");
+    Check(source.GetValue(bytesTotal) == 0, "network bytes read 0 until primed");
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    CopySnapshot(fixtures / "proc-2", procRoot);
+    Check(source.Collect(), "second collection succeeds");
+
+    // 150 of the 900 jiffies in between were not idle or waiting for I/O.
+    Check(IsNear(source.GetValue(cpu), 100.0 * 150 / 900), "processor time is the busy share of the jiffies");
+    Check(source.GetValue(processes) == 470, "processes are updated");
+    Check(source.GetValue(available) == 3500000.0 * 1024, "available bytes are updated");
+    Check(source.GetValue(committed) == 2500000.0 * 1024, "committed bytes are updated");
+
+    // Rates depend on the time between collections, so only their ratios are exact.
+    // Disks read 100 sectors and wrote 300, without partitions, loop or device mapper
+    // devices. There were 4000 page faults.
+    const auto readRate = source.GetValue(diskRead);
+    Check(readRate > 0, "disk read bytes are a rate");
+    Check(IsNear(source.GetValue(diskWrite), readRate * 3), "disk write bytes skip partitions and virtual devices");
+    Check(IsNear(source.GetValue(diskTotal), readRate + source.GetValue(diskWrite)), "disk bytes are read and write bytes");
+    Check(IsNear(source.GetValue(pageFaults), readRate * 4000 / (100 * 512)), "page faults are a rate");
+
+    // eth0 received 600000 bytes in 600 packets, sent 200000 bytes in 200 packets,
+    // and had 3 errors. The loopback interface is not counted.
+    const auto sentRate = source.GetValue(bytesSent);
+    Check(sentRate > 0, "bytes sent are a rate");
+    Check(IsNear(source.GetValue(bytesReceived), sentRate * 3), "bytes received are read for the interface");
+    Check(IsNear(source.GetValue(bytesTotal), sentRate + source.GetValue(bytesReceived)), "bytes total are sent and received bytes");
+    Check(IsNear(source.GetValue(packetsSent), sentRate / 1000), "packets sent are read for the interface");
+    Check(IsNear(source.GetValue(packetsReceived), sentRate * 3 / 1000), "packets received are read for the interface");
+    Check(IsNear(source.GetValue(errors), sentRate * 3 / 200000), "errors are receive and transmit errors");
+
+    // Missing files fail the collection.
+    std::filesystem::remove(procRoot / "vmstat");
+    Check(!source.Collect(), "collection fails without vmstat");
+
+    std::filesystem::remove_all(procRoot);
+
+    if (failures > 0) {
+        std::printf("%d checks failed.\n", failures);
+        return 1;
+    }
+
+    std::printf("All checks passed.\n");
+    return 0;
+}